@@ -32,133 +32,137 @@
 
 #include <stdlib.h>
 #include <inttypes.h>
+#include <math.h>
 
 #include <rte_cycles.h>
 
 #include "prox_malloc.h"
 #include "cdf.h"
 
-static uint32_t round_pow2(uint32_t val)
-{
-	uint32_t ret;
-	uint32_t s = 1 << 31;
-
-	while ((s & val) == 0)
-		s = s >> 1;
-	if (s == 1U << 31 && s != val)
-		return 0;
-
-	ret = val;
-	if (s != ret)
-		ret = (s << 1);
-
-	return ret;
-}
-
-static uint32_t get_r_max(struct cdf *cdf, uint32_t cur)
-{
-	uint32_t right_child = cur;
-
-	do {
-		cur = right_child;
-		right_child = cur * 2 + 1;
-	} while (right_child < cdf->elems[0]);
-
-	return cdf->elems[cur];
-}
-
 struct cdf *cdf_create(uint32_t n_vals, int socket_id)
 {
 	struct cdf *ret;
 	size_t mem_size = 0;
-	uint32_t n_vals_round = round_pow2(n_vals);
 
-	if (0 == n_vals_round)
+	if (0 == n_vals)
 		return NULL;
 
 	mem_size += sizeof(struct cdf);
-	mem_size += sizeof(((struct cdf *)(0))->elems[0]) * n_vals_round * 2;
+	mem_size += sizeof(((struct cdf *)(0))->elems[0]) * n_vals;
 	ret = prox_zmalloc(mem_size, socket_id);
-	ret->elems[0] = n_vals;
+	if (NULL == ret)
+		return NULL;
 
-	/* leafs are [n_vals, 2 * n_vals[. During cdf_add() and
-	   cdf_setup(), rand_max refers to the index of the next leaf
-	   to be added.  */
-	ret->rand_max = n_vals_round;
-	ret->first_child = n_vals_round;
-	ret->seed = rte_rdtsc();
+	ret->n_vals = n_vals;
+	ret->n_added = 0;
+	random_init_seed(&ret->rand);
 
 	return ret;
 }
 
 void cdf_add(struct cdf *cdf, uint32_t len)
 {
-	cdf->elems[cdf->rand_max++] = len;
+	if (cdf->n_added < cdf->n_vals)
+		cdf->elems[cdf->n_added].prob = len;
+	cdf->n_added++;
 }
 
 int cdf_setup(struct cdf *cdf)
 {
-	uint32_t last_leaf, first_leaf;
-	uint32_t first_parent, last_parent;
-	uint32_t total, multiplier, cur, end;
-
-	if (cdf->elems[0] == 1) {
-		cdf->rand_max = RAND_MAX;
-		cdf->elems[1] = RAND_MAX;
-		cdf->elems[0] = 2;
-		return 0;
-	}
+	const uint32_t n = cdf->n_vals;
+	uint64_t total = 0;
+	uint64_t *scaled;
+	uint32_t *work;
+	uint32_t n_small = 0, n_large = 0;
 
-	last_leaf  = cdf->rand_max;
-	first_leaf = round_pow2(cdf->elems[0]);
 	/* Failed to add all elements through cdf_add() */
-	if (last_leaf - first_leaf != cdf->elems[0])
+	if (cdf->n_added != n)
 		return -1;
 
-	total = 0;
-	for (uint32_t i = first_leaf; i < last_leaf; ++i) {
-		total += cdf->elems[i];
-	}
+	for (uint32_t i = 0; i < n; ++i)
+		total += cdf->elems[i].prob;
+	if (total == 0)
+		return -1;
 
-	multiplier = RAND_MAX / total;
-	if (multiplier * total == RAND_MAX)
-		multiplier--;
-	cdf->rand_max = multiplier * total;
-	total = 0;
-	for (uint32_t i = first_leaf; i < last_leaf; ++i) {
-		uint32_t cur = cdf->elems[i];
-
-		/* Each element represents the range between previous
-		   total (non-inclusive) and new total (inclusive). */
-		total += cur * multiplier - 1;
-		cdf->elems[i] = total;
-		total += 1;
+	scaled = malloc(n * sizeof(scaled[0]));
+	work = malloc(n * sizeof(work[0]));
+	if (scaled == NULL || work == NULL) {
+		free(scaled);
+		free(work);
+		return -1;
 	}
-	end = round_pow2(first_leaf) << 1;
-	for (uint32_t i = last_leaf; i < end; ++i) {
-		cdf->elems[i] = RAND_MAX;
+
+	/* Weights are scaled by n so that the average slot holds
+	   exactly total. Slots below total (small) are filled up
+	   by a slot above total (large). Small slots are pushed from
+	   the start of work[], large slots from the end. All
+	   arithmetic is done on integers so that the resulting
+	   table is exact up to the 2^-32 resolution of prob. Since
+	   total can exceed 2^32, prob is computed on 128 bits. */
+	for (uint32_t i = 0; i < n; ++i) {
+		scaled[i] = (uint64_t)cdf->elems[i].prob * n;
+		if (scaled[i] < total)
+			work[n_small++] = i;
+		else
+			work[n - 1 - n_large++] = i;
 	}
-	cdf->first_child = first_leaf;
-	cdf->elems[0] = end;
-
-	/* Build the binary tree used at run-time. */
-	last_leaf = end - 1;
-	do {
-		first_parent = first_leaf/2;
-		last_parent  = last_leaf/2;
-
-		for (uint32_t i = first_parent; i <= last_parent; ++i) {
-			/* The current nodes value should be the
-			   biggest value accessible through its left
-			   child. This value is stored in the right
-			   most child of the left child. The left most
-			   child of the right child is the first value
-			   that can not be accessed through the left
-			   child.  */
-			cdf->elems[i] = get_r_max(cdf, i * 2);
+
+	while (n_small && n_large) {
+		uint32_t s = work[--n_small];
+		uint32_t l = work[n - n_large];
+
+		cdf->elems[s].prob = ((unsigned __int128)scaled[s] << 32) / total;
+		cdf->elems[s].alias = l;
+
+		scaled[l] -= total - scaled[s];
+		if (scaled[l] < total) {
+			/* The large slot became small: move it
+			   from the large stack to the small one. */
+			n_large--;
+			work[n_small++] = l;
 		}
-		first_leaf = first_parent;
-		last_leaf = last_parent;
-	} while (first_parent != last_parent);
+	}
+
+	/* Remaining slots are full (up to rounding). Pointing the
+	   alias to the slot itself makes the value of prob
+	   irrelevant. */
+	while (n_large) {
+		uint32_t l = work[n - n_large--];
+
+		cdf->elems[l].prob = UINT32_MAX;
+		cdf->elems[l].alias = l;
+	}
+	while (n_small) {
+		uint32_t s = work[--n_small];
+
+		cdf->elems[s].prob = UINT32_MAX;
+		cdf->elems[s].alias = s;
+	}
+
+	free(scaled);
+	free(work);
 	return 0;
 }
+
+struct cdf *cdf_create_zipf(uint32_t n_vals, double s, int socket_id)
+{
+	struct cdf *cdf = cdf_create(n_vals, socket_id);
+
+	if (cdf == NULL)
+		return NULL;
+
+	/* The largest weight uses the full 32 bits to keep the
+	   rounding error of small weights low. The sum of the weights
+	   is above 2^32, which cdf_setup() supports. */
+	for (uint32_t i = 0; i < n_vals; ++i) {
+		uint32_t w = UINT32_MAX / pow(i + 1, s);
+
+		/* Keep every value reachable */
+		cdf_add(cdf, w? w : 1);
+	}
+	if (cdf_setup(cdf)) {
+		prox_free(cdf);
+		return NULL;
+	}
+	return cdf;
+}
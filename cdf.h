@@ -30,36 +30,70 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifndef _CDF_H_
+#define _CDF_H_
+
+#include <inttypes.h>
+
+#include "random.h"
+
+/* Discrete distribution sampled in O(1) through Walker's alias
+   method (Vose's construction). Each slot holds the probability
+   (scaled to 2^32) of returning its own index; otherwise, the
+   index stored in alias is returned. One random number selects
+   both the slot and the outcome of the biased coin, which means
+   that each sample costs one multiplication and one memory
+   access regardless of the number of values. */
+struct cdf_alias {
+	uint32_t prob;
+	uint32_t alias;
+};
+
 struct cdf {
-	uint32_t rand_max;
-	uint32_t seed;
-	uint32_t first_child;
-	uint32_t elems[0];
+	struct random rand;
+	uint32_t n_vals;
+	/* During cdf_add(), n_added is the index of the next value
+	   to be added. The weights are kept in elems[].prob until
+	   cdf_setup() builds the alias table. */
+	uint32_t n_added;
+	struct cdf_alias elems[0];
 };
 
 struct cdf *cdf_create(uint32_t n_vals, int socket_id);
 void cdf_add(struct cdf *cdf, uint32_t len);
 int cdf_setup(struct cdf *cdf);
+/* Zipf distribution with exponent s over n_vals values: value i has
+   a probability proportional to 1/(i + 1)^s. */
+struct cdf *cdf_create_zipf(uint32_t n_vals, double s, int socket_id);
 
-static uint32_t cdf_sample(struct cdf *cdf)
+static uint32_t cdf_sample_one(const struct cdf *cdf, uint64_t rand)
 {
-	uint32_t left_child, right_child;
-	uint32_t rand;
+	/* Upper 32 bits select the slot, lower 32 bits flip the
+	   biased coin. */
+	uint32_t idx = ((rand >> 32) * cdf->n_vals) >> 32;
+	const struct cdf_alias *e = &cdf->elems[idx];
+	/* The outcome of the coin is unpredictable: select without
+	   a branch. */
+	const uint32_t keep = -(uint32_t)((uint32_t)rand < e->prob);
 
-	do {
-		rand = rand_r(&cdf->seed);
-	} while (rand > cdf->rand_max);
+	return (idx & keep) | (e->alias & ~keep);
+}
 
-	uint32_t cur = 1;
+static uint32_t cdf_sample(struct cdf *cdf)
+{
+	return cdf_sample_one(cdf, random_next(&cdf->rand));
+}
 
-	while (1) {
-		left_child = cur * 2;
-		right_child = cur * 2 + 1;
-		if (right_child < cdf->elems[0])
-			cur = rand > cdf->elems[cur]? right_child : left_child;
-		else if (left_child < cdf->elems[0])
-			cur = left_child;
-		else
-			return cur - cdf->first_child;
-	}
+static void cdf_sample_n(struct cdf *cdf, uint32_t *out, uint32_t n)
+{
+	/* Work on a local copy of the generator state: out[] could
+	   alias the cdf and would force the state through memory on
+	   every sample. */
+	struct random rand = cdf->rand;
+
+	for (uint32_t i = 0; i < n; ++i)
+		out[i] = cdf_sample_one(cdf, random_next(&rand));
+	cdf->rand = rand;
 }
+
+#endif /* _CDF_H_ */
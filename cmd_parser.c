@@ -48,6 +48,7 @@
 #include "lconf.h"
 #include "main.h"
 #include "parse_utils.h"
+#include "stats.h"
 #include "stats_parser.h"
 #include "stats_port.h"
 #include "stats_latency.h"
@@ -55,12 +56,17 @@
 #include "stats_prio_task.h"
 
 #include "handle_routing.h"
+#include "handle_nat.h"
+#include "prox_lua_types.h"
 #include "handle_qinq_decap4.h"
 #include "handle_lat.h"
 #include "handle_arp.h"
 #include "handle_gen.h"
 #include "handle_acl.h"
 #include "handle_irq.h"
+#include "handle_cpe_learn.h"
+#include "handle_ipv6_tunnel.h"
+#include "ipv6_tun_table.h"
 #include "defines.h"
 #include "prox_cfg.h"
 #include "version.h"
@@ -215,7 +221,7 @@ static int parse_cmd_reset_lat_stats(const char *str, struct input *input)
 		return -1;
 	}
 
-	stats_latency_reset();
+	stats_reset_latency();
 	return 0;
 }
 
@@ -506,6 +512,21 @@ static int parse_cmd_reconnect(const char *str, struct input *input)
 	return 0;
 }
 
+static int parse_cmd_task_migrate(const char *str, struct input *input)
+{
+	unsigned lcore_id, task_id, dest_id;
+
+	if (sscanf(str, "%u %u %u", &lcore_id, &task_id, &dest_id) != 3)
+		return -1;
+
+	if (core_task_is_valid(lcore_id, task_id) && core_task_is_valid(dest_id, 0)) {
+		if (migrate_task(lcore_id, task_id, dest_id) != 0)
+			return -1;
+		req_refresh();
+	}
+	return 0;
+}
+
 static int parse_cmd_pkt_size(const char *str, struct input *input)
 {
 	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, pkt_size, nb_cores;
@@ -555,8 +576,9 @@ static int parse_cmd_speed(const char *str, struct input *input)
 		if ((!task_is_mode(lcore_id, task_id, "gen", "")) && (!task_is_mode(lcore_id, task_id, "gen", "l3"))) {
 			plog_err("Core %u task %u is not generating packets\n", lcore_id, task_id);
 		}
-		else if (speed > 400.0f || speed < 0.0f) {
-			plog_err("Speed out of range (must be betweeen 0%% and 100%%)\n");
+		else if (speed < 0.0f || speed * 12500000 > 4 * task_gen_get_max_rate(lcore_cfg[lcore_id].tasks_all[task_id])) {
+			plog_err("Speed out of range (must be betweeen 0%% and %"PRIu64"%%)\n",
+				 4 * task_gen_get_max_rate(lcore_cfg[lcore_id].tasks_all[task_id]) / 12500000);
 		}
 		else {
 			struct task_base *tbase = lcore_cfg[lcore_id].tasks_all[task_id];
@@ -589,8 +611,9 @@ static int parse_cmd_speed_byte(const char *str, struct input *input)
 			if ((!task_is_mode(lcore_id, task_id, "gen", "")) && (!task_is_mode(lcore_id, task_id, "gen", "l3"))) {
 				plog_err("Core %u task %u is not generating packets\n", lcore_id, task_id);
 			}
-			else if (bps > 1250000000) {
-				plog_err("Speed out of range (must be <= 1250000000)\n");
+			else if (bps > task_gen_get_max_rate(lcore_cfg[lcore_id].tasks_all[task_id])) {
+				plog_err("Speed out of range (must be <= %"PRIu64")\n",
+					 task_gen_get_max_rate(lcore_cfg[lcore_id].tasks_all[task_id]));
 			}
 			else {
 				struct task_base *tbase = lcore_cfg[lcore_id].tasks_all[task_id];
@@ -746,6 +769,65 @@ static int parse_cmd_set_random(const char *str, struct input *input)
 	return 0;
 }
 
+static int parse_cmd_flow_counts(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, nb_cores;
+	char file_name[256];
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+	if (!(str = strchr_skip_twice(str, ' ')))
+		return -1;
+	if (sscanf(str, "%255s", file_name) != 1)
+		return -1;
+	if (nb_cores != 1) {
+		plog_err("Flow counts can only be written for one core at a time\n");
+		return -1;
+	}
+
+	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
+		lcore_id = lcores[0];
+		if ((!task_is_mode(lcore_id, task_id, "gen", "")) && (!task_is_mode(lcore_id, task_id, "gen", "l3"))) {
+			plog_err("Core %u task %u is not generating packets\n", lcore_id, task_id);
+		} else {
+			struct task_base *tbase = lcore_cfg[lcore_id].tasks_all[task_id];
+
+			if (task_gen_dump_flow_counts(tbase, file_name) == 0)
+				plog_info("Flow counts written to %s\n", file_name);
+		}
+	}
+	return 0;
+}
+
+static int parse_cmd_tun_bindings_load(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, nb_cores;
+	char file_name[256];
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+	if (!(str = strchr_skip_twice(str, ' ')))
+		return -1;
+	if (sscanf(str, "%255s", file_name) != 1)
+		return -1;
+	if (nb_cores != 1) {
+		plog_err("Bindings can only be loaded for one core at a time\n");
+		return -1;
+	}
+
+	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
+		lcore_id = lcores[0];
+		if ((!task_is_mode(lcore_id, task_id, "ipv6_encap", "")) && (!task_is_mode(lcore_id, task_id, "ipv6_decap", ""))) {
+			plog_err("Core %u task %u is not an IPv6 tunnel task\n", lcore_id, task_id);
+		} else {
+			struct task_base *tbase = lcore_cfg[lcore_id].tasks_all[task_id];
+
+			ipv6_tun_table_load_delta(task_ipv6_tun_get_table(tbase), file_name);
+		}
+	}
+	return 0;
+}
+
 static int parse_cmd_thread_info(const char *str, struct input *input)
 {
 	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, nb_cores;
@@ -914,45 +996,113 @@ static int parse_cmd_local_ip(const char *str, struct input *input)
 	return 0;
 }
 
-static int parse_cmd_route_add(const char *str, struct input *input)
+static int parse_cmd_route_update(const char *str, int del)
 {
-	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, prefix, next_hop_idx, ip[4], nb_cores;
+	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, prefix, next_hop_idx = 0, ip[4], nb_cores;
+	struct lpm4 *updated[RTE_MAX_LCORE], *lpm;
+	unsigned n_updated = 0, j;
+	struct lpm4_update update;
 
 	if (parse_core_task(str, lcores, &task_id, &nb_cores))
 		return -1;
 	if (!(str = strchr_skip_twice(str, ' ')))
 		return -1;
-	if (strcmp(str, ""))
-		return -1;
 	if (sscanf(str, "%u.%u.%u.%u/%u %u", ip, ip + 1, ip + 2, ip + 3,
-		   &prefix, &next_hop_idx) != 8) {
+		   &prefix, &next_hop_idx) != (del? 5 : 6)) {
 		return -1;
 	}
-	struct rte_ring *ring;
+	if (ip[0] > 255 || ip[1] > 255 || ip[2] > 255 || ip[3] > 255 || prefix > 32)
+		return -1;
+	if (next_hop_idx >= MAX_HOP_INDEX) {
+		plog_err("Next hop %u too high (only supporting %d next hops)\n", next_hop_idx, MAX_HOP_INDEX);
+		return 0;
+	}
+
+	update.ip = ip[0] << 24 | ip[1] << 16 | ip[2] << 8 | ip[3];
+	update.prefix = prefix;
+	update.del = del;
+	update.next_hop_index = next_hop_idx;
 
 	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
 		for (unsigned int i = 0; i < nb_cores; i++) {
 			lcore_id = lcores[i];
-			ring = ctrl_rings[lcore_id*MAX_TASKS_PER_CORE + task_id];
-			if (!ring) {
-				plog_err("No ring for control messages to core %u task %u\n", lcore_id, task_id);
+			if (!task_is_mode(lcore_id, task_id, "routing", "")) {
+				plog_err("Core %u task %u is not routing\n", lcore_id, task_id);
+				continue;
 			}
-			else {
-				struct route_msg rmsg;
-				struct route_msg *pmsg = &rmsg;
-
-				rmsg.ip_bytes[0] = ip[0];
-				rmsg.ip_bytes[1] = ip[1];
-				rmsg.ip_bytes[2] = ip[2];
-				rmsg.ip_bytes[3] = ip[3];
-				rmsg.prefix = prefix;
-				rmsg.nh = next_hop_idx;
-#if RTE_VERSION < RTE_VERSION_NUM(17,5,0,1)
-				while (rte_ring_sp_enqueue_bulk(ring, (void *const *)&pmsg, 1));
-#else
-				while (rte_ring_sp_enqueue_bulk(ring, (void *const *)&pmsg, 1, NULL) == 0);
-#endif
-				while (!rte_ring_empty(ring));
+			/* Tasks can share their route table, update it once */
+			lpm = task_routing_get_lpm(lcore_cfg[lcore_id].tasks_all[task_id]);
+			for (j = 0; j < n_updated && updated[j] != lpm; ++j)
+				;
+			if (j < n_updated)
+				continue;
+			updated[n_updated++] = lpm;
+
+			if (task_routing_update(lcore_cfg[lcore_id].tasks_all[task_id], &update, 1)) {
+				plog_err("Failed %s route %u.%u.%u.%u/%u on core %u task %u\n", del? "deleting" : "adding",
+					 ip[0], ip[1], ip[2], ip[3], prefix, lcore_id, task_id);
+			}
+		}
+	}
+	return 0;
+}
+
+static int parse_cmd_route_add(const char *str, struct input *input)
+{
+	return parse_cmd_route_update(str, 0);
+}
+
+static int parse_cmd_route_del(const char *str, struct input *input)
+{
+	return parse_cmd_route_update(str, 1);
+}
+
+static int parse_cmd_route_load(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, nb_cores;
+	char file_name[256];
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+	if (!(str = strchr_skip_twice(str, ' ')))
+		return -1;
+	if (sscanf(str, "%255s", file_name) != 1)
+		return -1;
+	if (nb_cores != 1) {
+		plog_err("Routes can only be loaded for one core at a time\n");
+		return -1;
+	}
+
+	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
+		lcore_id = lcores[0];
+		if (!task_is_mode(lcore_id, task_id, "routing", "")) {
+			plog_err("Core %u task %u is not routing\n", lcore_id, task_id);
+		} else {
+			task_routing_load(lcore_cfg[lcore_id].tasks_all[task_id], file_name);
+		}
+	}
+	return 0;
+}
+
+static int parse_cmd_nat_load(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, nb_cores;
+	char file_name[256];
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+	if (!(str = strchr_skip_twice(str, ' ')))
+		return -1;
+	if (sscanf(str, "%255s", file_name) != 1)
+		return -1;
+
+	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
+		for (unsigned int i = 0; i < nb_cores; i++) {
+			lcore_id = lcores[i];
+			if (!task_is_mode(lcore_id, task_id, "nat", "")) {
+				plog_err("Core %u task %u is not nat\n", lcore_id, task_id);
+			} else {
+				task_nat_load(lcore_cfg[lcore_id].tasks_all[task_id], file_name);
 			}
 		}
 	}
@@ -1159,10 +1309,17 @@ static int parse_cmd_tot_stats(const char *str, struct input *input)
 		return -1;
 	}
 
-	struct global_stats_sample *gsl = stats_get_global_stats(1);
-	uint64_t tot_rx = gsl->host_rx_packets;
-	uint64_t tot_tx = gsl->host_tx_packets;
-	uint64_t last_tsc = gsl->tsc;
+	struct global_stats_sample *gsl;
+	uint64_t tot_rx, tot_tx, last_tsc;
+	int retries = 0;
+
+	do {
+		stats_acquire();
+		gsl = stats_get_global_stats(1);
+		tot_rx = gsl->host_rx_packets;
+		tot_tx = gsl->host_tx_packets;
+		last_tsc = gsl->tsc;
+	} while (stats_release() && ++retries < STATS_READ_RETRIES);
 
 	if (input->reply) {
 		char buf[128];
@@ -1211,9 +1368,16 @@ static int parse_cmd_tot_ierrors_tot(const char *str, struct input *input)
 		return -1;
 	}
 
-	struct global_stats_sample *gsl = stats_get_global_stats(1);
-	uint64_t tot = gsl->nics_ierrors;
-	uint64_t last_tsc = gsl->tsc;
+	struct global_stats_sample *gsl;
+	uint64_t tot, last_tsc;
+	int retries = 0;
+
+	do {
+		stats_acquire();
+		gsl = stats_get_global_stats(1);
+		tot = gsl->nics_ierrors;
+		last_tsc = gsl->tsc;
+	} while (stats_release() && ++retries < STATS_READ_RETRIES);
 
 	if (input->reply) {
 		char buf[128];
@@ -1234,9 +1398,16 @@ static int parse_cmd_tot_imissed_tot(const char *str, struct input *input)
 		return -1;
 	}
 
-	struct global_stats_sample *gsl = stats_get_global_stats(1);
-	uint64_t tot = gsl->nics_imissed;
-	uint64_t last_tsc = gsl->tsc;
+	struct global_stats_sample *gsl;
+	uint64_t tot, last_tsc;
+	int retries = 0;
+
+	do {
+		stats_acquire();
+		gsl = stats_get_global_stats(1);
+		tot = gsl->nics_imissed;
+		last_tsc = gsl->tsc;
+	} while (stats_release() && ++retries < STATS_READ_RETRIES);
 
 	if (input->reply) {
 		char buf[128];
@@ -1486,24 +1657,33 @@ static int parse_cmd_stats(const char *str, struct input *input)
 
 	char buf[32768];
 	char ret2[32768];
-	char *ret = ret2;
-	int list = 0;
+	char *ret;
+	int list;
+	int retries = 0;
 
-	strncpy(buf, str, sizeof(buf) - 1);
-	char *tok;
+	buf[sizeof(buf) - 1] = 0;
+	char *tok, *cur;
 	uint64_t stat_val;
 
-	while ((tok = strchr(str, ','))) {
-		*tok = 0;
-		stat_val = stats_parser_get(str);
+	do {
+		stats_acquire();
+		strncpy(buf, str, sizeof(buf) - 1);
+		cur = buf;
+		ret = ret2;
+		list = 0;
 
-		ret += sprintf(ret, "%s%"PRIu64"", list? "," :"", stat_val);
-		list = 1;
-		str = tok + 1;
-	}
+		while ((tok = strchr(cur, ','))) {
+			*tok = 0;
+			stat_val = stats_parser_get(cur);
 
-	stat_val = stats_parser_get(str);
-	ret += sprintf(ret, "%s%"PRIu64"", list? "," :"", stat_val);
+			ret += sprintf(ret, "%s%"PRIu64"", list? "," :"", stat_val);
+			list = 1;
+			cur = tok + 1;
+		}
+
+		stat_val = stats_parser_get(cur);
+		ret += sprintf(ret, "%s%"PRIu64"", list? "," :"", stat_val);
+	} while (stats_release() && ++retries < STATS_READ_RETRIES);
 
 	sprintf(ret, "\n");
 
@@ -1571,7 +1751,13 @@ static int parse_cmd_port_stats(const char *str, struct input *input)
 	}
 
 	struct get_port_stats s;
-	if (stats_port(val, &s)) {
+	int ret, retries = 0;
+
+	do {
+		stats_acquire();
+		ret = stats_port(val, &s);
+	} while (stats_release() && ++retries < STATS_READ_RETRIES);
+	if (ret) {
 		plog_err("Invalid port %u\n", val);
 		return 0;
 	}
@@ -1602,10 +1788,16 @@ static int parse_cmd_core_stats(const char *str, struct input *input)
 	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
 		for (unsigned int i = 0; i < nb_cores; i++) {
 			lcore_id = lcores[i];
-			uint64_t tot_rx = stats_core_task_tot_rx(lcore_id, task_id);
-			uint64_t tot_tx = stats_core_task_tot_tx(lcore_id, task_id);
-			uint64_t tot_drop = stats_core_task_tot_drop(lcore_id, task_id);
-			uint64_t last_tsc = stats_core_task_last_tsc(lcore_id, task_id);
+			uint64_t tot_rx, tot_tx, tot_drop, last_tsc;
+			int retries = 0;
+
+			do {
+				stats_acquire();
+				tot_rx = stats_core_task_tot_rx(lcore_id, task_id);
+				tot_tx = stats_core_task_tot_tx(lcore_id, task_id);
+				tot_drop = stats_core_task_tot_drop(lcore_id, task_id);
+				last_tsc = stats_core_task_last_tsc(lcore_id, task_id);
+			} while (stats_release() && ++retries < STATS_READ_RETRIES);
 
 			if (input->reply) {
 				char buf[128];
@@ -1637,15 +1829,22 @@ static int parse_cmd_lat_stats(const char *str, struct input *input)
 				plog_err("Core %u task %u is not measuring latency\n", lcore_id, task_id);
 			}
 			else {
-				struct stats_latency *stats = stats_latency_find(lcore_id, task_id);
-				struct stats_latency *tot = stats_latency_tot_find(lcore_id, task_id);
-
-				uint64_t last_tsc = stats_core_task_last_tsc(lcore_id, task_id);
-				uint64_t lat_min_usec = time_unit_to_usec(&stats->min.time);
-				uint64_t lat_max_usec = time_unit_to_usec(&stats->max.time);
-				uint64_t tot_lat_min_usec = time_unit_to_usec(&tot->min.time);
-				uint64_t tot_lat_max_usec = time_unit_to_usec(&tot->max.time);
-				uint64_t lat_avg_usec = time_unit_to_usec(&stats->avg.time);
+				struct stats_latency stats, tot;
+				uint64_t last_tsc;
+				int retries = 0;
+
+				do {
+					stats_acquire();
+					stats = *stats_latency_find(lcore_id, task_id);
+					tot = *stats_latency_tot_find(lcore_id, task_id);
+					last_tsc = stats_core_task_last_tsc(lcore_id, task_id);
+				} while (stats_release() && ++retries < STATS_READ_RETRIES);
+
+				uint64_t lat_min_usec = time_unit_to_usec(&stats.min.time);
+				uint64_t lat_max_usec = time_unit_to_usec(&stats.max.time);
+				uint64_t tot_lat_min_usec = time_unit_to_usec(&tot.min.time);
+				uint64_t tot_lat_max_usec = time_unit_to_usec(&tot.max.time);
+				uint64_t lat_avg_usec = time_unit_to_usec(&stats.avg.time);
 
 				if (input->reply) {
 					char buf[128];
@@ -1674,6 +1873,27 @@ static int parse_cmd_lat_stats(const char *str, struct input *input)
 	return 0;
 }
 
+static int parse_cmd_cpe_learn_stats(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, nb_cores;
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+
+	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
+		for (unsigned int i = 0; i < nb_cores; i++) {
+			lcore_id = lcores[i];
+			if (!task_is_mode(lcore_id, task_id, "cpelearn", "")) {
+				plog_err("Core %u task %u is not in cpelearn mode\n", lcore_id, task_id);
+			}
+			else {
+				task_cpe_learn_print_stats(lcore_cfg[lcore_id].tasks_all[task_id]);
+			}
+		}
+	}
+	return 0;
+}
+
 static int parse_cmd_irq(const char *str, struct input *input)
 {
 	unsigned int i, c;
@@ -1685,7 +1905,11 @@ static int parse_cmd_irq(const char *str, struct input *input)
 	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
 		for (c = 0; c < nb_cores; c++) {
 			lcore_id = lcores[c];
-			if (!task_is_mode(lcore_id, task_id, "irq", "")) {
+			if (task_is_mode(lcore_id, task_id, "irq", "hist")) {
+				struct task_irq_hist *task_irq_hist = (struct task_irq_hist *)(lcore_cfg[lcore_id].tasks_all[task_id]);
+
+				task_irq_hist_show_stats(task_irq_hist, input);
+			} else if (!task_is_mode(lcore_id, task_id, "irq", "")) {
 				plog_err("Core %u task %u is not in irq mode\n", lcore_id, task_id);
 			} else {
 				struct task_irq *task_irq = (struct task_irq *)(lcore_cfg[lcore_id].tasks_all[task_id]);
@@ -1700,11 +1924,18 @@ static int parse_cmd_irq(const char *str, struct input *input)
 static void task_lat_show_latency_histogram(uint8_t lcore_id, uint8_t task_id, struct input *input)
 {
 #ifdef LATENCY_HISTOGRAM
-	uint64_t *buckets;
-
-	stats_core_lat_histogram(lcore_id, task_id, &buckets);
-
-	if (buckets == NULL)
+	uint64_t *sample_buckets;
+	uint64_t buckets[128];
+	int retries = 0;
+
+	do {
+		stats_acquire();
+		stats_core_lat_histogram(lcore_id, task_id, &sample_buckets);
+		if (sample_buckets)
+			memcpy(buckets, sample_buckets, sizeof(buckets));
+	} while (stats_release() && ++retries < STATS_READ_RETRIES);
+
+	if (sample_buckets == NULL)
 		return;
 
 	if (input->reply) {
@@ -1893,11 +2124,13 @@ static struct cmd_str cmd_strings[] = {
 	{"count","<core id> <task id> <count>", "Generate <count> packets", parse_cmd_count},
 	{"bypass", "<core_id> <task_id>", "Bypass task", parse_cmd_bypass},
 	{"reconnect", "<core_id> <task_id>", "Reconnect task", parse_cmd_reconnect},
+	{"task migrate", "<core_id> <task_id> <new core_id>", "Move task <task_id> of core <core_id> to core <new core_id> without stopping it. The task keeps being addressed as <core_id> <task_id>.", parse_cmd_task_migrate},
 	{"pkt_size", "<core_id> <task_id> <pkt_size>", "Set the packet size to <pkt_size>", parse_cmd_pkt_size},
 	{"speed", "<core_id> <task_id> <speed percentage>", "Change the speed to <speed percentage> at which packets are being generated on core <core_id> in task <task_id>.", parse_cmd_speed},
 	{"speed_byte", "<core_id> <task_id> <speed>", "Change speed to <speed>. The speed is specified in units of bytes per second.", parse_cmd_speed_byte},
 	{"set value", "<core_id> <task_id> <offset> <value> <value_len>", "Set <value_len> bytes to <value> at offset <offset> in packets generated on <core_id> <task_id>", parse_cmd_set_value},
 	{"set random", "<core_id> <task_id> <offset> <random_str> <value_len>", "Set <value_len> bytes to <rand_str> at offset <offset> in packets generated on <core_id> <task_id>", parse_cmd_set_random},
+	{"flow counts", "<core_id> <task_id> <file>", "Write the number of packets sent per flow by <core_id> <task_id> to <file>", parse_cmd_flow_counts},
 	{"reset values all", "", "Undo all \"set value\" commands on all cores/tasks", parse_cmd_reset_values_all},
 	{"reset randoms all", "", "Undo all \"set random\" commands on all cores/tasks", parse_cmd_reset_randoms_all},
 	{"reset values", "<core id> <task id>", "Undo all \"set value\" commands on specified core/task", parse_cmd_reset_values},
@@ -1905,8 +2138,12 @@ static struct cmd_str cmd_strings[] = {
 	{"arp add", "<core id> <task id> <port id> <gre id> <svlan> <cvlan> <ip addr> <mac addr> <user>", "Add a single ARP entry into a CPE table on <core id>/<task id>.", parse_cmd_arp_add},
 	{"rule add", "<core id> <task id> svlan_id&mask cvlan_id&mask ip_proto&mask source_ip/prefix destination_ip/prefix range dport_range action", "Add a rule to the ACL table on <core id>/<task id>", parse_cmd_rule_add},
 	{"route add", "<core id> <task id> <ip/prefix> <next hop id>", "Add a route to the routing table on core <core id> <task id>. Example: route add 10.0.16.0/24 9", parse_cmd_route_add},
+	{"route del", "<core id> <task id> <ip/prefix>", "Delete a route from the routing table on core <core id> <task id>. Example: route del 10.0.16.0/24", parse_cmd_route_del},
+	{"route load", "<core id> <task id> <file>", "Apply the route changes in <file> to the routing table used by <core id> <task id>. Each line is either \"add <ip/prefix> <next hop id>\" or \"del <ip/prefix>\". Forwarding continues during the update.", parse_cmd_route_load},
+	{"nat load", "<core id> <task id> <file>", "Apply the changes in <file> to the NAT table of <core id> <task id>. Each line is either \"add <from ip> <to ip>\" or \"del <from ip>\". Forwarding continues during the update.", parse_cmd_nat_load},
 	{"gateway ip", "<core id> <task id> <ip>", "Define/Change IP address of destination gateway on core <core id> <task id>.", parse_cmd_gateway_ip},
 	{"local ip", "<core id> <task id> <ip>", "Define/Change IP address of destination gateway on core <core id> <task id>.", parse_cmd_local_ip},
+	{"tun bindings load", "<core id> <task id> <file>", "Apply the binding changes in <file> to the IPv6 tunnel binding table used by <core id> <task id> and by all tunnel tasks on the same socket. Each line is either \"add <ipv4> <port> <ipv6> <mac>\" or \"del <ipv4> <port>\". Forwarding continues during the update.", parse_cmd_tun_bindings_load},
 
 	{"pps unit", "", "Change core stats pps unit", parse_cmd_pps_unit},
 	{"reset stats", "", "Reset all statistics", parse_cmd_reset_stats},
@@ -1916,6 +2153,7 @@ static struct cmd_str cmd_strings[] = {
 	{"tot imissed tot", "", "Print total number of imissed since reset", parse_cmd_tot_imissed_tot},
 	{"lat stats", "<core id> <task id>", "Print min,max,avg latency as measured during last sampling interval", parse_cmd_lat_stats},
 	{"irq stats", "<core id> <task id>", "Print irq related infos", parse_cmd_irq},
+	{"cpe learn stats", "<core id> <task id>", "Print learn events, latency and backlog per core handled by cpelearn task <task id> on <core id>", parse_cmd_cpe_learn_stats},
 	{"lat packets", "<core id> <task id>", "Print the latency for each of the last set of packets", parse_cmd_lat_packets},
 	{"accuracy limit", "<core id> <task id> <nsec>", "Only consider latency of packets that were measured with an error no more than <nsec>", parse_cmd_accuracy},
 	{"core stats", "<core id> <task id>", "Print rx/tx/drop for task <task id> running on core <core id>", parse_cmd_core_stats},
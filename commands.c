@@ -52,6 +52,7 @@
 #include "rw_reg.h"
 #include "cqm.h"
 #include "stats_core.h"
+#include "thread_generic.h"
 
 void start_core_all(int task_id)
 {
@@ -139,7 +140,10 @@ void start_cores(uint32_t *cores, int count, int task_id)
 	for (int i = 0; i < count; ++i) {
 		struct lcore_cfg *lconf = &lcore_cfg[cores[i]];
 
-		if (lconf->n_tasks_run != lconf->n_tasks_all) {
+		if (task_id != -1 && lconf->task_is_away[task_id]) {
+			plog_warn("Core %u task %u has been migrated to another core\n", cores[i], task_id);
+		}
+		else if (lconf->n_tasks_run != lconf->n_tasks_all - lconf->n_tasks_away) {
 			if (task_id == -1) {
 				for (uint8_t tid = 0; tid < lconf->n_tasks_all; ++tid) {
 					targ = &lconf->targs[tid];
@@ -185,6 +189,10 @@ void stop_cores(uint32_t *cores, int count, int task_id)
 
 	for (int i = 0; i < count; ++i) {
 		struct lcore_cfg *lconf = &lcore_cfg[cores[i]];
+		if (task_id != -1 && lconf->task_is_away[task_id]) {
+			plog_warn("Core %u task %u has been migrated to another core\n", cores[i], task_id);
+			continue;
+		}
 		if (lconf->n_tasks_run) {
 			if (wait_command_handled(lconf) == -1) return;
 
@@ -212,6 +220,28 @@ void stop_cores(uint32_t *cores, int count, int task_id)
 	}
 }
 
+/* Returns the core on which a configured task currently runs */
+static struct lcore_cfg *task_host(struct lcore_cfg *lconf, uint8_t task_id, uint8_t *host_task_id)
+{
+	uint32_t lcore_id = -1;
+
+	*host_task_id = task_id;
+	if (!lconf->task_is_away[task_id])
+		return lconf;
+
+	while (prox_core_next(&lcore_id, 0) == 0) {
+		struct lcore_cfg *host = &lcore_cfg[lcore_id];
+
+		for (uint8_t i = 0; i < host->n_tasks_all; ++i) {
+			if (lconf_task_is_guest(host, i) && host->tasks_all[i] == lconf->tasks_all[task_id]) {
+				*host_task_id = i;
+				return host;
+			}
+		}
+	}
+	return NULL;
+}
+
 struct size_unit {
 	uint64_t val;
 	uint64_t frac;
@@ -310,8 +340,9 @@ void cmd_dump(uint8_t lcore_id, uint8_t task_id, uint32_t nb_packets, struct inp
 		plog_warn("task_id too high, should be in [0, %u]\n", lcore_cfg[lcore_id].n_tasks_all - 1);
 	}
 	else {
-		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
+		struct lcore_cfg *lconf = task_host(&lcore_cfg[lcore_id], task_id, &task_id);
 
+		if (lconf == NULL) return;
 		lconf->tasks_all[task_id]->aux->task_rt_dump.input = input;
 
 		if (wait_command_handled(lconf) == -1) return;
@@ -344,8 +375,9 @@ void cmd_trace(uint8_t lcore_id, uint8_t task_id, uint32_t nb_packets)
 		plog_warn("task_id too high, should be in [0, %u]\n", lcore_cfg[lcore_id].n_tasks_all - 1);
 	}
 	else {
-		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
+		struct lcore_cfg *lconf = task_host(&lcore_cfg[lcore_id], task_id, &task_id);
 
+		if (lconf == NULL) return;
 		if (wait_command_handled(lconf) == -1) return;
 
 		lconf->msg.type = LCONF_MSG_TRACE;
@@ -1050,3 +1082,135 @@ int reconnect_task(uint32_t lcore_id, uint32_t task_id)
 
 	return 0;
 }
+
+static int send_migrate_msg(struct lcore_cfg *lconf, enum lconf_msg_type type, uint8_t task_id, int val)
+{
+	if (wait_command_handled(lconf) == -1)
+		return -1;
+	lconf->msg.type = type;
+	lconf->msg.task_id = task_id;
+	lconf->msg.val = val;
+	lconf_set_req(lconf);
+	return wait_command_handled(lconf);
+}
+
+int migrate_task(uint32_t lcore_id, uint32_t task_id, uint32_t dest_id)
+{
+	struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
+	struct lcore_cfg *dest = &lcore_cfg[dest_id];
+	struct lcore_cfg *host;
+	struct task_args *targ;
+	uint8_t host_task_id, dest_task_id;
+	uint64_t tsc_beg, tsc_out, tsc_in;
+	uint32_t host_id;
+	int run;
+
+	if (task_id >= lconf->n_tasks_all)
+		return -1;
+	if (lconf_task_is_guest(lconf, task_id)) {
+		plog_err("Core %u task %u has been migrated from core %u task %u, use the latter\n",
+			 lcore_id, task_id, lconf->targs[task_id].lconf->id, lconf->targs[task_id].task);
+		return -1;
+	}
+
+	targ = &lconf->targs[task_id];
+	host = task_host(lconf, task_id, &host_task_id);
+	if (host == NULL) {
+		plog_err("Core %u task %u is not running on any core\n", lcore_id, task_id);
+		return -1;
+	}
+	host_id = host->id;
+	if (host == dest) {
+		plog_info("Core %u task %u is already on core %u\n", lcore_id, task_id, dest_id);
+		return 0;
+	}
+
+	if (task_is_master(targ)) {
+		plog_err("The master task can't be migrated\n");
+		return -1;
+	}
+	/* Tasks connected through an optimized ring call each other and
+	   must share the core. */
+	if (targ->tx_opt_ring || targ->tx_opt_ring_task) {
+		plog_err("Core %u task %u uses an optimized ring and can't be migrated\n", lcore_id, task_id);
+		return -1;
+	}
+	if (targ->task_init->start_first || targ->task_init->stop_last || lconf->period_func) {
+		plog_err("Core %u task %u keeps state per core and can't be migrated\n", lcore_id, task_id);
+		return -1;
+	}
+	if (lconf->thread_x != thread_generic || dest->thread_x != thread_generic) {
+		plog_err("Tasks can only be migrated between cores running the generic thread\n");
+		return -1;
+	}
+	if (dest != lconf && dest->n_tasks_all == MAX_TASKS_PER_CORE) {
+		plog_err("Core %u already has %u tasks\n", dest_id, MAX_TASKS_PER_CORE);
+		return -1;
+	}
+	if (rte_lcore_to_socket_id(dest_id) != rte_lcore_to_socket_id(lcore_id))
+		plog_warn("Core %u task %u memory stays on socket %u\n", lcore_id, task_id, rte_lcore_to_socket_id(lcore_id));
+
+	/* The new slot is filled in before the task leaves its current
+	   core. It only becomes visible to the destination core when
+	   n_tasks_all is incremented as the task is attached. */
+	if (dest == lconf) {
+		dest_task_id = task_id;
+	}
+	else {
+		dest_task_id = dest->n_tasks_all;
+		dest->tasks_all[dest_task_id] = lconf->tasks_all[task_id];
+		dest->targs[dest_task_id] = *targ;
+		dest->flush_queues[dest_task_id] = host->flush_queues[host_task_id];
+		dest->ctrl_func_m[dest_task_id] = host->ctrl_func_m[host_task_id];
+		dest->ctrl_rings_m[dest_task_id] = host->ctrl_rings_m[host_task_id];
+		dest->ctrl_func_p[dest_task_id] = host->ctrl_func_p[host_task_id];
+		dest->ctrl_rings_p[dest_task_id] = host->ctrl_rings_p[host_task_id];
+	}
+
+	tsc_beg = rte_rdtsc();
+	run = host->task_is_running[host_task_id];
+	if (host->flags & LCONF_FLAG_RUNNING) {
+		if (send_migrate_msg(host, LCONF_MSG_MIGRATE_OUT, host_task_id, 0) == -1)
+			return -1;
+		tsc_out = host->migrate_tsc;
+		if (host->n_tasks_run == 0) {
+			rte_eal_wait_lcore(host_id);
+			host->flags &= ~LCONF_FLAG_RUNNING;
+		}
+	}
+	else {
+		lconf_task_detach(host, host_task_id);
+		tsc_out = rte_rdtsc();
+	}
+
+	/* Input rings and RX queues have been left untouched, packets
+	   received in the mean time are handled by the destination core. */
+	if (dest->flags & LCONF_FLAG_RUNNING) {
+		if (send_migrate_msg(dest, LCONF_MSG_MIGRATE_IN, dest_task_id, run) == -1) {
+			plog_err("Core %u task %u is not running on any core\n", lcore_id, task_id);
+			return -1;
+		}
+		tsc_in = dest->migrate_tsc;
+	}
+	else if (run) {
+		dest->msg.type = LCONF_MSG_MIGRATE_IN;
+		dest->msg.task_id = dest_task_id;
+		dest->msg.val = run;
+		lconf_set_req(dest);
+		dest->flags |= LCONF_FLAG_RUNNING;
+		rte_eal_remote_launch(lconf_run, NULL, dest_id);
+		if (wait_command_handled(dest) == -1)
+			return -1;
+		tsc_in = dest->migrate_tsc;
+	}
+	else {
+		lconf_task_attach(dest, dest_task_id, 0);
+		tsc_in = rte_rdtsc();
+	}
+
+	const uint64_t hz = rte_get_tsc_hz();
+
+	plog_info("Migrated core %u task %u from core %u to core %u in %"PRIu64" us, not serviced for %"PRIu64" us\n",
+		  lcore_id, task_id, host_id, dest_id, (tsc_in - tsc_beg) * 1000000 / hz, (tsc_in - tsc_out) * 1000000 / hz);
+	return 0;
+}
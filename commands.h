@@ -82,5 +82,8 @@ void cmd_cache_reset(void);
 void cmd_reset_port(uint8_t port_id);
 int reconnect_task(uint32_t lcore_id, uint32_t task_id);
 int bypass_task(uint32_t lcore_id, uint32_t task_id);
+/* Move core lcore_id task task_id to dest_id while it is running. The
+   task keeps its core and task id in commands and statistics. */
+int migrate_task(uint32_t lcore_id, uint32_t task_id, uint32_t dest_id);
 
 #endif /* _COMMANDS_H_ */
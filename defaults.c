@@ -179,6 +179,7 @@ void set_task_defaults(struct prox_cfg* prox_cfg, struct lcore_cfg* lcore_cfg_in
 
 			targ->tunnel_hop_limit = 3;
 			targ->ctrl_freq = 1000;
+			targ->learn_rate = 65536;
 			targ->lb_friend_core = 0xFF;
 			targ->mbuf_size = MBUF_SIZE;
 			targ->n_pkts = 1024*64;
@@ -42,6 +42,8 @@ static struct display_column *occup_col;
 static struct display_column *used_col;
 static struct display_column *free_col;
 static struct display_column *total_col;
+static struct display_column *max_used_col;
+static struct display_column *plan_col;
 static struct display_column *mem_used_col;
 static struct display_column *mem_free_col;
 static struct display_column *mem_tot_col;
@@ -71,6 +73,10 @@ static void display_mempools_draw_frame(struct screen_state *screen_state)
 	display_column_init(free_col, "Free (#)", 12);
 	total_col = display_table_add_col(stats);
 	display_column_init(total_col, "Total (#)", 13);
+	max_used_col = display_table_add_col(stats);
+	display_column_init(max_used_col, "Max Used (#)", 12);
+	plan_col = display_table_add_col(stats);
+	display_column_init(plan_col, "Plan (#)", 12);
 
 	mem_used_col = display_table_add_col(stats);
 	display_column_init(mem_used_col, "Mem Used (KB)", 13);
@@ -87,6 +93,7 @@ static void display_mempools_draw_frame(struct screen_state *screen_state)
 		display_column_print(nb_col, i, "%4u", ms->port);
 		display_column_print(queue_col, i, "%5u", ms->queue);
 		display_column_print(total_col, i, "%13zu", ms->size);
+		display_column_print(plan_col, i, "%12zu", ms->plan);
 		display_column_print(mem_tot_col, i, "%12zu", ms->size * MBUF_SIZE/1024);
 	}
 }
@@ -97,15 +104,17 @@ static void display_mempools_draw_stats(struct screen_state *state)
 
 	for (uint16_t i = 0; i < n_mempools; ++i) {
 		struct mempool_stats *ms = stats_get_mempool_stats(i);
-		const size_t used = ms->size - ms->free;
+		struct mempool_stats_sample *last = stats_get_mempool_stats_sample(i, 1);
+		const size_t used = ms->size - last->free;
 		const uint32_t used_frac = used*10000/ms->size;
 
 		display_column_print(occup_col, i, "%6u.%02u", used_frac/100, used_frac % 100);
 		display_column_print(used_col, i, "%12zu", used);
-		display_column_print(free_col, i, "%12zu", ms->free);
+		display_column_print(free_col, i, "%12zu", last->free);
+		display_column_print(max_used_col, i, "%12zu", last->max_used);
 
 		display_column_print(mem_free_col, i, "%13zu", used * MBUF_SIZE/1024);
-		display_column_print(mem_used_col, i, "%13zu", ms->free * MBUF_SIZE/1024);
+		display_column_print(mem_used_col, i, "%13zu", last->free * MBUF_SIZE/1024);
 	}
 }
 
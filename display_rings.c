@@ -30,6 +30,7 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <inttypes.h>
 #include <rte_ring.h>
 
 #include "display.h"
@@ -44,10 +45,12 @@ static struct display_column *free_col;
 static struct display_column *size_col;
 static struct display_column *sc_col;
 static struct display_column *sp_col;
+static struct display_column *xsocket_col;
 
 static void display_rings_draw_frame(struct screen_state *state)
 {
 	const uint32_t n_rings = stats_get_n_rings();
+	const uint32_t n_ports = stats_get_n_xsocket_ports();
 	char sc_val, sp_val;
 
 	display_page_init(&display_page_rings);
@@ -71,8 +74,10 @@ static void display_rings_draw_frame(struct screen_state *state)
 	display_column_init(sc_col, "SC", 2);
 	sp_col = display_table_add_col(stats_table);
 	display_column_init(sp_col, "SP", 2);
+	xsocket_col = display_table_add_col(stats_table);
+	display_column_init(xsocket_col, "X-socket mbufs", 14);
 
-	display_page_draw_frame(&display_page_rings, n_rings);
+	display_page_draw_frame(&display_page_rings, n_rings + n_ports);
 
 	for (uint16_t i = 0; i < n_rings; ++i) {
 		struct ring_stats *rs = stats_get_ring_stats(i);
@@ -85,6 +90,7 @@ static void display_rings_draw_frame(struct screen_state *state)
 
 			for (uint32_t j = 0; j < rs->nb_ports; j++)
 				offset += sprintf(name + offset, "%s", rs->port[j]->name);
+			display_column_print(ring_col, i, "%s", name);
 		}
 
 		sc_val = (rs->ring->flags & RING_F_SC_DEQ) ? 'y' : 'n';
@@ -92,6 +98,14 @@ static void display_rings_draw_frame(struct screen_state *state)
 
 		display_column_print(sc_col, i, " %c", sc_val);
 		display_column_print(sp_col, i, " %c", sp_val);
+		if (!rs->xsocket_counter)
+			display_column_print(xsocket_col, i, "%14s", "-");
+	}
+
+	for (uint32_t i = 0; i < n_ports; ++i) {
+		struct port_xsocket_stats *ps = stats_get_xsocket_port_stats(i);
+
+		display_column_print(ring_col, n_rings + i, "port %u q %u", ps->port, ps->queue);
 	}
 }
 
@@ -106,12 +120,20 @@ static void display_rings_draw_stats(struct screen_state *state)
 		display_column_print(occup_col, i, "%8u.%02u", used/100, used%100);
 		display_column_print(free_col, i, "%11u", rs->free);
 		display_column_print(size_col, i, "%11u", rs->size);
+		if (rs->xsocket_counter)
+			display_column_print(xsocket_col, i, "%14"PRIu64"", rs->xsocket_mbufs);
+	}
+
+	for (uint32_t i = 0; i < n_ports; ++i) {
+		struct port_xsocket_stats *ps = stats_get_xsocket_port_stats(i);
+
+		display_column_print(xsocket_col, n_rings + i, "%14"PRIu64"", ps->xsocket_mbufs);
 	}
 }
 
 static int display_rings_get_height(void)
 {
-	return stats_get_n_rings();
+	return stats_get_n_rings() + stats_get_n_xsocket_ports();
 }
 
 static struct display_screen display_screen_rings = {
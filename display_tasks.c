@@ -294,7 +294,7 @@ static void display_core_task_stats_per_sec(const struct task_stats_disp *t, str
 
 static void display_core_task_stats_tot(const struct task_stats_disp *t, struct screen_state *state, int row)
 {
-	struct task_stats *ts = stats_get_task_stats(t->lcore_id, t->task_id);
+	struct task_stats_sample *ts = stats_get_task_stats_sample(t->lcore_id, t->task_id, 1);
 
 	display_column_print(rx_col, row, "%lu", ts->tot_rx_pkt_count);
 	display_column_print(tx_col, row, "%lu", ts->tot_tx_pkt_count);
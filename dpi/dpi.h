@@ -86,7 +86,37 @@ struct dpi_engine {
 	int (*dpi_print)(const char *fmt, ...);
 };
 
+/* Payload passed to dpi_process_burst(). Instead of a struct
+   timeval, the time is given in TSC cycles. The frequency of the TSC
+   is passed to dpi_burst_init(). */
+struct dpi_burst_pkt {
+	struct flow_info *fi;
+	void             *flow_data;
+	uint8_t          *payload;
+	uint16_t         len;
+	uint16_t         client_to_server;
+	uint64_t         tsc;
+	uint32_t         results[2];
+	size_t           result_len;
+};
+
+struct dpi_engine_burst {
+	/* Called after dpi_init() from the master thread during
+	   initialization, once for each task that will use the
+	   engine, before any dpi_thread_start(). The DPI threads call
+	   dpi_process_burst() later. If a value different from 0 is
+	   returned, dpi_process() is used instead for that task. */
+	int (*dpi_burst_init)(uint64_t tsc_hz);
+	/* Same as dpi_process() for n_pkts payloads. The function
+	   returns 0 on success. */
+	int (*dpi_process_burst)(void *opaque, struct dpi_burst_pkt *pkts, uint32_t n_pkts);
+};
+
 /* Returns the implementation of a dpi_engine. */
 struct dpi_engine *get_dpi_engine(void);
 
+/* Optional, returns the burst entry points of the dpi_engine. Engines
+   that don't provide this function are called through dpi_process(). */
+struct dpi_engine_burst *get_dpi_engine_burst(void);
+
 #endif /* _DPI_H_ */
@@ -31,28 +31,96 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "dpi.h"
 
 /* The following functions are not a real implementation of a
    DPI. They serve only to create dpi_stub.so which can be loaded into
-   prox. */
+   prox. Each payload is read once and counted, so that the cost of
+   passing payloads to the engine can be measured. The burst entry
+   point is used unless "no-burst" is passed as engine argument. */
+
+struct dpi_stub_flow {
+	uint64_t n_bytes;
+	uint32_t n_pkts;
+};
+
+struct dpi_stub_thread {
+	uint64_t n_pkts;
+	uint64_t n_bytes;
+	uint64_t n_calls;
+	uint64_t sum;
+};
+
+static int use_burst = 1;
+
+static struct dpi_engine dpi_engine;
 
 static int dpi_init(uint32_t thread_count, int argc, const char *argv[])
 {
+	for (int i = 0; i < argc; ++i) {
+		if (!strcmp(argv[i], "no-burst"))
+			use_burst = 0;
+	}
 	return 0;
 }
 
-size_t dpi_get_flow_entry_size(void) {return 0;}
+size_t dpi_get_flow_entry_size(void) {return sizeof(struct dpi_stub_flow);}
 void flow_data_dpi_flow_expire(void *flow_data) {}
-void *dpi_thread_start() {return NULL;}
-void dpi_thread_stop(void *opaque) {}
+void *dpi_thread_start() {return calloc(1, sizeof(struct dpi_stub_thread));}
 void dpi_finish(void) {}
 
+void dpi_thread_stop(void *opaque)
+{
+	struct dpi_stub_thread *t = opaque;
+
+	dpi_engine.dpi_print("dpi stub: %"PRIu64" packets, %"PRIu64" bytes in %"PRIu64" calls\n", t->n_pkts, t->n_bytes, t->n_calls);
+	free(t);
+}
+
+static void dpi_stub_payload(struct dpi_stub_thread *t, void *flow_data, const uint8_t *payload, uint16_t len)
+{
+	struct dpi_stub_flow *flow = flow_data;
+	uint64_t sum = 0;
+
+	for (uint16_t i = 0; i < len; ++i)
+		sum += payload[i];
+
+	t->sum += sum;
+	t->n_pkts++;
+	t->n_bytes += len;
+	flow->n_pkts++;
+	flow->n_bytes += len;
+}
+
 int dpi_process(void *opaque, struct flow_info *fi, void *flow_data,
 		struct dpi_payload *payload, uint32_t results[],
 		size_t *result_len)
 {
+	struct dpi_stub_thread *t = opaque;
+
+	t->n_calls++;
+	dpi_stub_payload(t, flow_data, payload->payload, payload->len);
+	*result_len = 0;
+	return 0;
+}
+
+static int dpi_burst_init(uint64_t tsc_hz)
+{
+	return !use_burst;
+}
+
+static int dpi_process_burst(void *opaque, struct dpi_burst_pkt *pkts, uint32_t n_pkts)
+{
+	struct dpi_stub_thread *t = opaque;
+
+	t->n_calls++;
+	for (uint32_t i = 0; i < n_pkts; ++i) {
+		dpi_stub_payload(t, pkts[i].flow_data, pkts[i].payload, pkts[i].len);
+		pkts[i].result_len = 0;
+	}
 	return 0;
 }
 
@@ -67,7 +135,17 @@ static struct dpi_engine dpi_engine = {
 	.dpi_print = printf,
 };
 
+static struct dpi_engine_burst dpi_engine_burst = {
+	.dpi_burst_init = dpi_burst_init,
+	.dpi_process_burst = dpi_process_burst,
+};
+
 struct dpi_engine *get_dpi_engine(void)
 {
 	return &dpi_engine;
 }
+
+struct dpi_engine_burst *get_dpi_engine_burst(void)
+{
+	return &dpi_engine_burst;
+}
@@ -0,0 +1,76 @@
+--
+-- Copyright(c) 2010-2015 Intel Corporation.
+-- Copyright(c) 2016-2018 Viosoft Corporation.
+-- All rights reserved.
+--
+-- Redistribution and use in source and binary forms, with or without
+-- modification, are permitted provided that the following conditions
+-- are met:
+--
+--   * Redistributions of source code must retain the above copyright
+--     notice, this list of conditions and the following disclaimer.
+--   * Redistributions in binary form must reproduce the above copyright
+--     notice, this list of conditions and the following disclaimer in
+--     the documentation and/or other materials provided with the
+--     distribution.
+--   * Neither the name of Intel Corporation nor the names of its
+--     contributors may be used to endorse or promote products derived
+--     from this software without specific prior written permission.
+--
+-- THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+-- "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+-- LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+-- A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+-- OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+-- SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+-- LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+-- DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+-- THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+-- (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+-- OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--
+
+dofile("bundle_maker.lua")
+
+if (test_system_id == nil) then
+   error("test_system_id not set")
+end
+
+if (max_setup_rate == nil) then
+   error("max_setup_rate not set")
+end
+
+if (connections == nil) then
+   error("connections not set")
+end
+
+if (n_cores == nil) then
+   n_cores = 1
+end
+
+-- All clients (and all servers) share the same profile. Replies are
+-- returned to the client core that created the connection through
+-- RSS steering, so there is no need to split the IP ranges by core.
+c, s = setup_bundles(128 + 8 * test_system_id, ss)
+
+clients = ""
+servers = ""
+for i = 0, n_cores - 1 do
+   if (i ~= 0) then
+      clients = clients .. ","
+      servers = servers .. ","
+   end
+   clients = clients .. (2 + i) .. "s0"
+   servers = servers .. (10 + i) .. "s0"
+end
+
+bps = 1250000000/n_cores
+msr = max_setup_rate/n_cores
+conn = connections/n_cores
+
+mempool_size = conn
+if (mempool_size > 100000) then
+   mempool_size = 100000
+elseif (mempool_size < 2048) then
+   mempool_size = 2048
+end
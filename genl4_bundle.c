@@ -45,6 +45,9 @@
 #include "log.h"
 #include "pkt_parser.h"
 #include "prox_lua_types.h"
+#include "handle_lb_net.h"
+
+#define BUNDLE_STEER_MAX_TRIES 1024
 
 #if RTE_VERSION < RTE_VERSION_NUM(1,8,0,0)
 #define RTE_CACHE_LINE_SIZE CACHE_LINE_SIZE
@@ -229,7 +232,7 @@ static int bundle_iterate_streams(struct bundle_ctx *bundle, struct bundle_ctx_p
 			   connection. */
 			int retries = 0;
 			do {
-				bundle_create_tuple(&bundle->tuple, &bundle->cfg->clients, bundle->ctx.stream_cfg, 0, seed);
+				bundle_create_tuple(&bundle->tuple, bundle->cfg, bundle->ctx.stream_cfg, 0, seed);
 
 				ret = rte_hash_lookup(pool->hash, (const void *)&bundle->tuple);
 				if (++retries == 1000) {
@@ -262,17 +265,26 @@ static int bundle_iterate_streams(struct bundle_ctx *bundle, struct bundle_ctx_p
 	return ret;
 }
 
-void bundle_create_tuple(struct pkt_tuple *tp, const struct host_set *clients, const struct stream_cfg *stream_cfg, int rnd_ip, unsigned  *seed)
+static int bundle_steer_queue(const struct bundle_steer *steer, const struct pkt_tuple *tp)
 {
-	tp->dst_port = clients->port;
-	tp->dst_port &= ~clients->port_mask;
-	tp->dst_port |= rand_r(seed) & clients->port_mask;
-
-	if (rnd_ip) {
-		tp->dst_addr = clients->ip;
-		tp->dst_addr &= ~clients->ip_mask;
-		tp->dst_addr |= rand_r(seed) & clients->ip_mask;
-	}
+	uint8_t buf[TOEPLITZ_TBL_LEN];
+
+	/* Input as hashed by the NIC on packets from server to client */
+	memcpy(buf, &tp->src_addr, 4);
+	memcpy(buf + 4, &tp->dst_addr, 4);
+	memcpy(buf + 8, &tp->src_port, 2);
+	memcpy(buf + 10, &tp->dst_port, 2);
+
+	/* Only the addresses are hashed for other protocols */
+	int len = (tp->proto_id == IPPROTO_TCP || tp->proto_id == IPPROTO_UDP)? 12 : 8;
+
+	return rss_to_queue(toeplitz_tbl_hash(&steer->tbl, buf, len), steer->n_queues);
+}
+
+void bundle_create_tuple(struct pkt_tuple *tp, const struct bundle_cfg *cfg, const struct stream_cfg *stream_cfg, int rnd_ip, unsigned  *seed)
+{
+	const struct host_set *clients = &cfg->clients;
+	uint32_t tries = 0;
 
 	tp->src_addr = stream_cfg->servers.ip;
 	tp->src_port = stream_cfg->servers.port;
@@ -280,6 +292,24 @@ void bundle_create_tuple(struct pkt_tuple *tp, const struct host_set *clients, c
 	tp->proto_id = stream_cfg->proto;
 
 	tp->l2_types[0] = 0x0008;
+
+	/* With steering, roughly n_queues tries are needed. Only the
+	   client port can be redrawn when moving to the next stream of
+	   a bundle. If no tuple is found, the replies are handled by
+	   another core and will not match any bundle there. */
+	const int steer = cfg->steer && (rnd_ip || clients->port_mask);
+
+	do {
+		tp->dst_port = clients->port;
+		tp->dst_port &= ~clients->port_mask;
+		tp->dst_port |= rand_r(seed) & clients->port_mask;
+
+		if (rnd_ip) {
+			tp->dst_addr = clients->ip;
+			tp->dst_addr &= ~clients->ip_mask;
+			tp->dst_addr |= rand_r(seed) & clients->ip_mask;
+		}
+	} while (steer && bundle_steer_queue(cfg->steer, tp) != cfg->steer->queue && ++tries < BUNDLE_STEER_MAX_TRIES);
 }
 
 void bundle_init_w_cfg(struct bundle_ctx *bundle, const struct bundle_cfg *cfg, struct heap *heap, enum l4gen_peer peer, unsigned *seed)
@@ -297,7 +327,7 @@ void bundle_init(struct bundle_ctx *bundle, struct heap *heap, enum l4gen_peer p
 	bundle->stream_idx = 0;
 
 	stream_ctx_init(&bundle->ctx, peer, bundle->cfg->stream_cfgs[bundle->stream_idx], &bundle->tuple);
-	bundle_create_tuple(&bundle->tuple, &bundle->cfg->clients, bundle->ctx.stream_cfg, peer == PEER_CLIENT, seed);
+	bundle_create_tuple(&bundle->tuple, bundle->cfg, bundle->ctx.stream_cfg, peer == PEER_CLIENT, seed);
 }
 
 void bundle_expire(struct bundle_ctx *bundle, struct bundle_ctx_pool *pool, struct l4_stats *l4_stats)
@@ -36,15 +36,26 @@
 #include "heap.h"
 #include "genl4_stream.h"
 #include "lconf.h"
+#include "toeplitz.h"
 
 /* Configured once and used during packet generation. The structure
    describes a single set of consecutive streams. When used at the
    server side, it only contains a simple stream to represent a
    service. */
+/* Client side tuples are chosen so that replies, hashed by RSS on
+   the IPv4 4-tuple (or by lbpos in rss mode), come back to the core
+   that created them. */
+struct bundle_steer {
+	uint16_t            n_queues;
+	uint16_t            queue;
+	struct toeplitz_tbl tbl;
+};
+
 struct bundle_cfg {
 	struct host_set   clients;
 	uint32_t          n_stream_cfgs;
 	struct stream_cfg **stream_cfgs;
+	const struct bundle_steer *steer; /* NULL if replies are not steered */
 };
 
 /* A bundle_ctx represents a an active stream between a client and a
@@ -94,7 +105,7 @@ struct bundle_ctx *bundle_ctx_pool_get(struct bundle_ctx_pool *p);
 struct bundle_ctx *bundle_ctx_pool_get_w_cfg(struct bundle_ctx_pool *p);
 void bundle_ctx_pool_put(struct bundle_ctx_pool *p, struct bundle_ctx *bundle);
 
-void bundle_create_tuple(struct pkt_tuple *tp, const struct host_set *clients, const struct stream_cfg *stream_cfg, int rnd_ip, unsigned *seed);
+void bundle_create_tuple(struct pkt_tuple *tp, const struct bundle_cfg *cfg, const struct stream_cfg *stream_cfg, int rnd_ip, unsigned *seed);
 void bundle_init(struct bundle_ctx *bundle, struct heap *heap, enum l4gen_peer peer, unsigned *seed);
 void bundle_init_w_cfg(struct bundle_ctx *bundle, const struct bundle_cfg *cfg, struct heap *heap, enum l4gen_peer peer, unsigned *seed);
 void bundle_expire(struct bundle_ctx *bundle, struct bundle_ctx_pool *pool, struct l4_stats *l4_stats);
@@ -33,6 +33,9 @@
 #ifndef _GENL4_STREAM_H_
 #define _GENL4_STREAM_H_
 
+#include <rte_mbuf.h>
+#include <rte_version.h>
+
 #include "prox_lua_types.h"
 #include "pkt_parser.h"
 #include "token_time.h"
@@ -81,8 +84,9 @@ static const char *tcp_state_to_str(const enum tcp_state s)
 #define STREAM_CTX_F_TCP_ENDED     0x04
 #define STREAM_CTX_F_TCP_GOT_SYN   0x08 /* Set only once when syn has been received */
 #define STREAM_CTX_F_TCP_GOT_FIN   0x10 /* Set only once when fin has been received */
-#define STREAM_CTX_F_MORE_DATA     0x20
 #define STREAM_CTX_F_LAST_RX_PKT_MADE_PROGRESS  0x40
+#define STREAM_CTX_F_FAST_RETX     0x80 /* Set on third duplicate ACK */
+#define STREAM_CTX_F_GOT_PKT       0x100 /* Set while processing a received packet */
 
 /* Run-time structure to management state information associated with current stream_cfg. */
 struct stream_ctx {
@@ -103,10 +107,27 @@ struct stream_ctx {
 	uint32_t                other_mss;
 	uint64_t                sched_tsc;
 	uint32_t                retransmits;
+	/* Send window. The receiving side only accepts in-order
+	   data, so lost segments are recovered by going back to
+	   ackd_seq (go-back-N). */
+	uint32_t                snd_max;              /* highest seq sent so far */
+	uint32_t                cwnd;                 /* congestion window in bytes */
+	uint32_t                ssthresh;
+	uint32_t                recover;              /* no fast retransmit before this seq is ACK'ed */
+	uint16_t                dup_acks;
+	uint8_t                 rto_backoff;
+	uint32_t                rtt_seq;              /* RTT measured on ACK of this seq, 0 if none */
+	uint64_t                rtt_tsc;
+	uint64_t                srtt;                 /* smoothed RTT in tsc, 0 until first sample */
+	uint64_t                rttvar;
 	const struct stream_cfg *stream_cfg;          /* Current active steam_cfg */
 	struct pkt_tuple        *tuple;
 };
 
+/* Maximum number of MSS sized segments in a single super-frame. This
+   keeps the IP length and the wire size of a super-frame below 64KB. */
+#define GENL4_MAX_TSO_SEGS 32
+
 struct host_set {
 	uint32_t ip;
 	uint32_t ip_mask;
@@ -119,8 +140,14 @@ struct stream_cfg {
 	struct host_set    servers; // Current implementation only allows mask == 0. (i.e. single server)
 	struct token_time_cfg tt_cfg[2]; // bytes per period rate
 	uint16_t           proto;
-	uint64_t           tsc_timeout;
+	uint64_t           tsc_timeout;            /* initial and maximum retransmit timeout */
 	uint64_t           tsc_timeout_time_wait;
+	uint64_t           tsc_rto_min;
+	uint32_t           init_window;            /* initial send window in segments */
+	uint32_t           window;                 /* maximum send window in bytes */
+	uint8_t            window_scale;
+	uint8_t            large_segments;         /* send data as TSO super-frames */
+	struct rte_mempool *ext_pool;              /* zero copy: mbufs to attach content to */
 	uint32_t           n_actions;
 	uint32_t           n_pkts;
 	uint32_t           n_bytes;
@@ -129,6 +156,44 @@ struct stream_cfg {
 	struct peer_action actions[0];
 };
 
+/* Shorter payloads are copied, as attaching costs about as much. */
+#define GENL4_ZERO_COPY_MIN_LEN 256
+
+/* In zero copy mode, len bytes of content starting at beg are attached
+   to mbuf as a second segment instead of being copied after the
+   headers. Returns 0 if the content has been attached. */
+static int stream_attach_content(const struct stream_cfg *cfg, enum l4gen_peer peer, struct rte_mbuf *mbuf, uint32_t beg, uint32_t len)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(18,5,0,0)
+	const struct peer_data *data = &cfg->data[peer];
+	struct rte_mbuf *seg;
+
+	if (cfg->ext_pool == NULL || len < GENL4_ZERO_COPY_MIN_LEN)
+		return -1;
+	seg = rte_pktmbuf_alloc(cfg->ext_pool);
+	if (seg == NULL)
+		return -1;
+
+	rte_mbuf_ext_refcnt_update(data->content_shinfo, 1);
+	rte_pktmbuf_attach_extbuf(seg, data->content + beg, data->content_iova + beg, len, data->content_shinfo);
+	seg->data_len = len;
+	mbuf->next = seg;
+	mbuf->nb_segs = 2;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static int stream_content_attached(const struct rte_mbuf *mbuf)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(18,5,0,0)
+	return mbuf->next && RTE_MBUF_HAS_EXTBUF(mbuf->next);
+#else
+	return 0;
+#endif
+}
+
 static void scale_for_jitter(uint64_t *to_scale)
 {
 	(*to_scale) *= 2;
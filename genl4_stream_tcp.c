@@ -33,19 +33,55 @@
 #include <rte_cycles.h>
 #include <rte_ether.h>
 #include <rte_eth_ctrl.h>
+#include <rte_version.h>
 
 #include "log.h"
 #include "genl4_stream_tcp.h"
 #include "prox_assert.h"
 #include "mbuf_utils.h"
 
+/* Retransmit timeout as per RFC 6298. The configured timeout is used
+   until the first RTT sample and as upper bound. */
+static uint64_t tcp_rto(const struct stream_ctx *ctx)
+{
+	const struct stream_cfg *cfg = ctx->stream_cfg;
+	uint64_t rto;
+
+	if (ctx->srtt == 0)
+		return cfg->tsc_timeout;
+
+	rto = ctx->srtt + 4 * ctx->rttvar;
+	if (rto < cfg->tsc_rto_min)
+		rto = cfg->tsc_rto_min;
+	rto <<= ctx->rto_backoff;
+
+	return rto > cfg->tsc_timeout? cfg->tsc_timeout : rto;
+}
+
+static void tcp_rtt_sample(struct stream_ctx *ctx, uint64_t rtt)
+{
+	if (ctx->srtt == 0) {
+		ctx->srtt = rtt;
+		ctx->rttvar = rtt / 2;
+	}
+	else {
+		uint64_t delta = ctx->srtt > rtt? ctx->srtt - rtt : rtt - ctx->srtt;
+
+		ctx->rttvar = (3 * ctx->rttvar + delta) / 4;
+		ctx->srtt = (7 * ctx->srtt + rtt) / 8;
+	}
+}
+
 static uint64_t tcp_retx_timeout(const struct stream_ctx *ctx)
 {
 	uint64_t delay = token_time_tsc_until_full(&ctx->token_time_other);
 
-	return delay + ctx->stream_cfg->tsc_timeout;
+	return delay + tcp_rto(ctx);
 }
 
+/* Data is sent when the token bucket is full. With large segments,
+   the bucket holds multiple packets and all of them go out in a
+   single super-frame. */
 static uint64_t tcp_resched_timeout(const struct stream_ctx *ctx)
 {
 	uint64_t delay = token_time_tsc_until_full(&ctx->token_time);
@@ -53,6 +89,16 @@ static uint64_t tcp_resched_timeout(const struct stream_ctx *ctx)
 	return delay;
 }
 
+/* Other packets only need room for one full sized packet. */
+static uint64_t tcp_tsc_until_ready(const struct stream_ctx *ctx)
+{
+	uint64_t bytes = ctx->token_time.cfg.bytes_max;
+
+	if (bytes > ETHER_MAX_LEN + 20)
+		bytes = ETHER_MAX_LEN + 20;
+	return token_time_tsc_until(&ctx->token_time, bytes);
+}
+
 static void tcp_retx_timeout_start(struct stream_ctx *ctx, uint64_t *next_tsc)
 {
 	uint64_t now = rte_rdtsc();
@@ -68,12 +114,71 @@ static int tcp_retx_timeout_occured(const struct stream_ctx *ctx, uint64_t now)
 
 static void tcp_retx_timeout_resume(const struct stream_ctx *ctx, uint64_t now, uint64_t *next_tsc)
 {
-	*next_tsc = ctx->sched_tsc - now;
+	*next_tsc = ctx->sched_tsc > now? ctx->sched_tsc - now : 0;
 }
 
 static void tcp_set_retransmit(struct stream_ctx *ctx)
 {
 	ctx->retransmits++;
+	/* Karn's algorithm: no RTT samples from retransmitted data */
+	ctx->rtt_seq = 0;
+}
+
+static void tcp_window_init(struct stream_ctx *ctx)
+{
+	const struct stream_cfg *cfg = ctx->stream_cfg;
+
+	ctx->cwnd = cfg->init_window * ctx->other_mss;
+	if (ctx->cwnd > cfg->window)
+		ctx->cwnd = cfg->window;
+	ctx->ssthresh = cfg->window;
+}
+
+static int tcp_window_allows(const struct stream_ctx *ctx, uint32_t outstanding_bytes, uint32_t remaining_len)
+{
+	uint32_t seg_len = remaining_len > ctx->other_mss? ctx->other_mss : remaining_len;
+
+	return outstanding_bytes == 0 || outstanding_bytes + seg_len <= ctx->cwnd;
+}
+
+static void tcp_window_grow(struct stream_ctx *ctx, uint32_t acked)
+{
+	const uint32_t mss = ctx->other_mss;
+
+	if (ctx->cwnd < ctx->ssthresh) {
+		/* Slow start */
+		ctx->cwnd += acked < mss? acked : mss;
+	}
+	else {
+		/* Congestion avoidance */
+		uint32_t inc = mss * mss / ctx->cwnd;
+
+		ctx->cwnd += inc? inc : 1;
+	}
+	if (ctx->cwnd > ctx->stream_cfg->window)
+		ctx->cwnd = ctx->stream_cfg->window;
+}
+
+static void tcp_window_loss(struct stream_ctx *ctx, int timeout)
+{
+	uint32_t flight = ctx->snd_max - ctx->ackd_seq;
+
+	ctx->ssthresh = flight / 2 > 2 * ctx->other_mss? flight / 2 : 2 * ctx->other_mss;
+	ctx->cwnd = timeout? ctx->other_mss : ctx->ssthresh;
+}
+
+/* Resend everything after ackd_seq. Data received out of order is
+   discarded by the other side, so there is no point in only
+   retransmitting the first missing segment. */
+static void tcp_go_back(struct stream_ctx *ctx, uint64_t now)
+{
+	ctx->same_state++;
+	tcp_set_retransmit(ctx);
+	plogx_dbg("Assuming %d->%d lost\n", ctx->ackd_seq, ctx->next_seq);
+	ctx->recover = ctx->snd_max;
+	ctx->dup_acks = 0;
+	ctx->next_seq = ctx->ackd_seq;
+	ctx->sched_tsc = now + tcp_retx_timeout(ctx);
 }
 
 struct tcp_option {
@@ -81,6 +186,62 @@ struct tcp_option {
 	uint8_t len;
 } __attribute__((packed));
 
+/* With large segments, send as much as the token bucket, the send
+   window and the TSO limit allow in one super-frame. The NIC (or the
+   GSO stage in the task) cuts it into MSS sized packets. */
+static uint32_t tcp_max_seg_len(const struct stream_ctx *ctx)
+{
+	const struct stream_cfg *cfg = ctx->stream_cfg;
+	const uint32_t mss = ctx->other_mss;
+
+	if (!cfg->large_segments)
+		return mss;
+
+	uint32_t seg_wire = pkt_len_to_wire_size(cfg->data[ctx->peer].hdr_len + sizeof(struct tcp_hdr) + mss);
+	uint32_t outstanding_bytes = ctx->next_seq - ctx->ackd_seq;
+	uint32_t room = ctx->cwnd > outstanding_bytes? ctx->cwnd - outstanding_bytes : 0;
+	uint32_t n_segs = ctx->token_time.bytes_now / seg_wire;
+
+	if (n_segs > room / mss)
+		n_segs = room / mss;
+	if (n_segs > GENL4_MAX_TSO_SEGS)
+		n_segs = GENL4_MAX_TSO_SEGS;
+
+	return n_segs > 1? n_segs * mss : mss;
+}
+
+/* Chain segments to mbuf so that data_len bytes of payload fit after
+   offset. The payload is copied in by create_tcp_pkt(). */
+static int tcp_chain_segments(struct rte_mbuf *mbuf, uint32_t offset, uint32_t data_len)
+{
+	uint32_t first_room = mbuf->buf_len - mbuf->data_off - offset;
+	struct rte_mbuf *last = mbuf;
+
+	if (data_len <= first_room)
+		return 0;
+
+	data_len -= first_room;
+	while (data_len) {
+		struct rte_mbuf *seg = rte_pktmbuf_alloc(mbuf->pool);
+
+		if (seg == NULL) {
+			if (mbuf->next)
+				rte_pktmbuf_free(mbuf->next);
+			mbuf->next = NULL;
+			mbuf->nb_segs = 1;
+			return -1;
+		}
+		uint32_t room = rte_pktmbuf_tailroom(seg);
+
+		seg->data_len = data_len < room? data_len : room;
+		data_len -= seg->data_len;
+		last->next = seg;
+		last = seg;
+		mbuf->nb_segs++;
+	}
+	return 0;
+}
+
 void stream_tcp_create_rst(struct rte_mbuf *mbuf, struct l4_meta *l4_meta, struct pkt_tuple *tuple)
 {
 	struct tcp_hdr *tcp = (struct tcp_hdr *)l4_meta->l4_hdr;
@@ -130,7 +291,6 @@ static void create_tcp_pkt(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint8_
 	}
 	else if (tcp_flags & TCP_SYN_FLAG) {
 		tcp_flags |= TCP_SYN_FLAG;
-		/* Window scaling */
 
 		/* TODO: make options come from the stream. */
 		tcp_op = (struct tcp_option *)(l4_hdr + 1);
@@ -139,7 +299,15 @@ static void create_tcp_pkt(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint8_
 		tcp_op->len = 4;
 		*(uint16_t *)(tcp_op + 1) = rte_bswap16(1460); /* TODO: Save this in this_mss */
 
-		tcp_len += 4;
+		/* Window scaling, preceded by NOP for alignment */
+		uint8_t *ws = (uint8_t *)tcp_op + 4;
+
+		ws[0] = 1;
+		ws[1] = 3;
+		ws[2] = 3;
+		ws[3] = stream_cfg->window_scale;
+
+		tcp_len += 8;
 		seq_len = 1;
 
 		ctx->seq_first_byte = ctx->ackd_seq + 1;
@@ -158,27 +326,67 @@ static void create_tcp_pkt(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint8_
 
 	uint16_t l4_payload_offset = stream_cfg->data[act->peer].hdr_len + tcp_len;
 
-	if (data_len) {
+	uint32_t first_len = data_len;
+
+	if (stream_content_attached(mbuf)) {
+		seq_len = data_len;
+		first_len = 0;
+	}
+	else if (data_len) {
+		const uint8_t *content = stream_cfg->data[act->peer].content + data_beg;
+		uint32_t first_room = mbuf->buf_len - mbuf->data_off - l4_payload_offset;
+
 		seq_len = data_len;
 		plogx_dbg("l4 payload offset = %d\n", l4_payload_offset);
-		rte_memcpy(pkt + l4_payload_offset, stream_cfg->data[act->peer].content + data_beg, data_len);
+		/* Super-frames continue in the segments chained by
+		   tcp_chain_segments() */
+		if (data_len > first_room) {
+			uint32_t copied = first_len = first_room;
+
+			for (struct rte_mbuf *seg = mbuf->next; seg; seg = seg->next) {
+				rte_memcpy(rte_pktmbuf_mtod(seg, uint8_t *), content + copied, seg->data_len);
+				copied += seg->data_len;
+			}
+		}
+		rte_memcpy(pkt + l4_payload_offset, content, first_len);
 	}
 
 	l4_hdr->sent_seq = rte_bswap32(ctx->next_seq);
 	l4_hdr->tcp_flags = tcp_flags; /* SYN */
-	l4_hdr->rx_win = rte_bswap16(0x3890); // TODO: make this come from stream (config)
+	/* The window in SYN packets is never scaled. */
+	if (tcp_flags & TCP_SYN_FLAG)
+		l4_hdr->rx_win = rte_bswap16(stream_cfg->window > 0xffff? 0xffff : stream_cfg->window);
+	else
+		l4_hdr->rx_win = rte_bswap16(stream_cfg->window >> stream_cfg->window_scale);
 	//l4_hdr->cksum = ...;
 	l4_hdr->tcp_urp = 0;
 	l4_hdr->data_off = ((tcp_len / 4) << 4); /* Highest 4 bits are TCP header len in units of 32 bit words */
 
 	/* ctx->next_seq = ctx->ackd_seq + seq_len; */
 	ctx->next_seq += seq_len;
+	if (ctx->next_seq > ctx->snd_max)
+		ctx->snd_max = ctx->next_seq;
 
 	/* No payload after TCP header. */
 	rte_pktmbuf_pkt_len(mbuf)  = l4_payload_offset + data_len;
-	rte_pktmbuf_data_len(mbuf) = l4_payload_offset + data_len;
+	rte_pktmbuf_data_len(mbuf) = l4_payload_offset + first_len;
 
 	l3_hdr->total_length = rte_bswap16(sizeof(struct ipv4_hdr) + tcp_len + data_len);
+#if RTE_VERSION >= RTE_VERSION_NUM(17,11,0,0)
+	if (stream_cfg->large_segments) {
+		/* mbufs are not reset when taken from the mempool */
+		mbuf->ol_flags = 0;
+		if (data_len > ctx->other_mss) {
+			mbuf->ol_flags = PKT_TX_TCP_SEG | PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+			mbuf->l2_len = stream_cfg->data[act->peer].hdr_len - sizeof(struct ipv4_hdr);
+			mbuf->l3_len = sizeof(struct ipv4_hdr);
+			mbuf->l4_len = tcp_len;
+			mbuf->tso_segsz = ctx->other_mss;
+			l3_hdr->hdr_checksum = 0;
+			l4_hdr->cksum = rte_ipv4_phdr_cksum(l3_hdr, mbuf->ol_flags);
+		}
+	}
+#endif
 	plogdx_dbg(mbuf, NULL);
 
 	plogx_dbg("put tcp packet with flags: %s%s%s, (len = %d, seq = %d, ack =%d)\n",
@@ -200,9 +408,10 @@ uint16_t stream_tcp_reply_len(struct stream_ctx *ctx)
 		if (ctx->tcp_state == SYN_SENT || ctx->tcp_state == LISTEN) {
 			/* First packet received is a SYN packet. In
 			   the current implementation this packet
-			   contains the TCP option field to set the
-			   MSS. For this, add 4 bytes. */
-			return ctx->stream_cfg->data[!ctx->peer].hdr_len + sizeof(struct tcp_hdr) + 4;
+			   contains the TCP option fields to set the
+			   MSS and the window scale. For this, add 8
+			   bytes. */
+			return ctx->stream_cfg->data[!ctx->peer].hdr_len + sizeof(struct tcp_hdr) + 8;
 		}
 		return ctx->stream_cfg->data[!ctx->peer].hdr_len + sizeof(struct tcp_hdr);
 	}
@@ -347,7 +556,25 @@ static int stream_tcp_proc_in(struct stream_ctx *ctx, struct l4_meta *l4_meta)
 
 		if (ackd_seq > ctx->ackd_seq) {
 			plogx_dbg("Got ACK for outstanding data, from %d to %d\n", ctx->ackd_seq, ackd_seq);
+			uint32_t acked = ackd_seq - ctx->ackd_seq;
+			uint64_t now = rte_rdtsc();
+
 			ctx->ackd_seq = ackd_seq;
+			/* Cumulative ACK past data that is being
+			   retransmitted. */
+			if (ctx->next_seq < ctx->ackd_seq)
+				ctx->next_seq = ctx->ackd_seq;
+			if (ctx->rtt_seq && ctx->ackd_seq >= ctx->rtt_seq) {
+				tcp_rtt_sample(ctx, now - ctx->rtt_tsc);
+				ctx->rtt_seq = 0;
+			}
+			ctx->dup_acks = 0;
+			ctx->rto_backoff = 0;
+			if (ctx->cwnd)
+				tcp_window_grow(ctx, acked);
+			/* Restart the retransmit timer while data is outstanding */
+			if (ctx->tcp_state == ESTABLISHED && ctx->snd_max != ctx->ackd_seq)
+				ctx->sched_tsc = now + tcp_retx_timeout(ctx);
 			plogx_dbg("ackable data = %d\n", ctx->ackable_data_seq);
 			/* Ackable_data_seq set to byte after
 			   current action. */
@@ -374,6 +601,13 @@ static int stream_tcp_proc_in(struct stream_ctx *ctx, struct l4_meta *l4_meta)
 			}
 			progress_ack = 1;
 		}
+		else if (ackd_seq == ctx->ackd_seq && l4_meta->len == 0 && !got_syn && !got_fin &&
+			 ctx->tcp_state == ESTABLISHED && ctx->snd_max != ctx->ackd_seq && ctx->ackd_seq >= ctx->recover) {
+			if (++ctx->dup_acks == 3) {
+				plogx_dbg("Third duplicate ACK for %d\n", ackd_seq);
+				ctx->flags |= STREAM_CTX_F_FAST_RETX;
+			}
+		}
 		else {
 			plogx_dbg("Old data acked: acked = %d, ackable =%d\n", ackd_seq, ctx->ackd_seq);
 		}
@@ -420,10 +654,18 @@ static int stream_tcp_proc_in(struct stream_ctx *ctx, struct l4_meta *l4_meta)
 		uint8_t *payload = (uint8_t *)tcp + ((tcp->data_off >> 4)*4);
 
 		do {
+			if (tcp_op->kind == 0)
+				break;
+			if (tcp_op->kind == 1) {
+				tcp_op = (struct tcp_option *)(((uint8_t*)tcp_op) + 1);
+				continue;
+			}
 			if (tcp_op->kind == 2 && tcp_op->len == 4) {
 				uint16_t mss = rte_bswap16(*(uint16_t *)(tcp_op + 1));
 				ctx->other_mss = mss;
 			}
+			if (tcp_op->len < 2)
+				break;
 
 			tcp_op = (struct tcp_option *)(((uint8_t*)tcp_op) + tcp_op->len);
 		} while (((uint8_t*)tcp_op) < payload);
@@ -441,7 +683,7 @@ static int stream_tcp_proc_in(struct stream_ctx *ctx, struct l4_meta *l4_meta)
 
 static int stream_tcp_proc_out_closed(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint64_t *next_tsc)
 {
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -456,6 +698,10 @@ static int stream_tcp_proc_out_closed(struct stream_ctx *ctx, struct rte_mbuf *m
 	ctx->ackd_seq = 99;
 
 	create_tcp_pkt(ctx, mbuf, TCP_SYN_FLAG, 0, 0);
+	if (ctx->retransmits == 0) {
+		ctx->rtt_seq = ctx->next_seq;
+		ctx->rtt_tsc = rte_rdtsc();
+	}
 	token_time_take(&ctx->token_time, mbuf_wire_size(mbuf));
 	*next_tsc = tcp_retx_timeout(ctx);
 	return 0;
@@ -463,7 +709,7 @@ static int stream_tcp_proc_out_closed(struct stream_ctx *ctx, struct rte_mbuf *m
 
 static int stream_tcp_proc_out_listen(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint64_t *next_tsc)
 {
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -491,6 +737,8 @@ static int stream_tcp_proc_out_listen(struct stream_ctx *ctx, struct rte_mbuf *m
 	ctx->tcp_state = SYN_RECEIVED;
 
 	create_tcp_pkt(ctx, mbuf, TCP_SYN_FLAG | TCP_ACK_FLAG, 0, 0);
+	ctx->rtt_seq = ctx->next_seq;
+	ctx->rtt_tsc = rte_rdtsc();
 	token_time_take(&ctx->token_time, mbuf_wire_size(mbuf));
 	*next_tsc = tcp_retx_timeout(ctx);
 	return 0;
@@ -498,7 +746,7 @@ static int stream_tcp_proc_out_listen(struct stream_ctx *ctx, struct rte_mbuf *m
 
 static int stream_tcp_proc_out_syn_sent(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint64_t *next_tsc)
 {
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -541,7 +789,7 @@ static int stream_tcp_proc_out_syn_sent(struct stream_ctx *ctx, struct rte_mbuf
 
 static int stream_tcp_proc_out_syn_recv(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint64_t *next_tsc)
 {
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -628,14 +876,32 @@ static int stream_tcp_proc_out_estab_tx(struct stream_ctx *ctx, struct rte_mbuf
 	   immediately. */
 
 	plogx_dbg("This peer to send!\n");
+	if (ctx->cwnd == 0)
+		tcp_window_init(ctx);
+
+	uint64_t now = rte_rdtsc();
 	uint32_t outstanding_bytes = ctx->next_seq - ctx->ackd_seq;
 
 	uint32_t data_beg2 = ctx->next_seq - ctx->seq_first_byte;
 	uint32_t remaining_len2 = act->len - (data_beg2 - act->beg);
 
-	const uint32_t rx_win = 300000;
-	/* If still data to be sent and allowed by outstanding amount */
-	if (outstanding_bytes <= rx_win && remaining_len2) {
+	if (ctx->flags & STREAM_CTX_F_FAST_RETX) {
+		ctx->flags &= ~STREAM_CTX_F_FAST_RETX;
+		plogx_dbg("Fast retransmit: outstanding = %d\n", outstanding_bytes);
+		tcp_window_loss(ctx, 0);
+		tcp_go_back(ctx, now);
+	}
+	else if (outstanding_bytes && tcp_retx_timeout_occured(ctx, now)) {
+		/* This possibly means that now retransmit is resumed half-way in the action. */
+		plogx_dbg("Retransmit: outstanding = %d\n", outstanding_bytes);
+		tcp_window_loss(ctx, 1);
+		if (ctx->rto_backoff < 6)
+			ctx->rto_backoff++;
+		tcp_go_back(ctx, now);
+		plogx_dbg("highest seq from other side = %d\n", ctx->recv_seq);
+	}
+	/* If still data to be sent and allowed by the send window */
+	else if (remaining_len2 && tcp_window_allows(ctx, outstanding_bytes, remaining_len2)) {
 		plogx_dbg("Outstanding bytes = %d, and remaining_len = %d, next_seq = %d\n", outstanding_bytes, remaining_len2, ctx->next_seq);
 
 		if (ctx->ackable_data_seq == 0) {
@@ -645,71 +911,55 @@ static int stream_tcp_proc_out_estab_tx(struct stream_ctx *ctx, struct rte_mbuf
 		}
 		else
 			plogx_dbg("This will not be the first part of the data within an action\n");
+		if (outstanding_bytes == 0)
+			ctx->sched_tsc = now + tcp_retx_timeout(ctx);
 	}
-	/* still data yet to be acked || still data to be sent but blocked by RX win. */
+	/* still data yet to be acked || still data to be sent but blocked by the window. */
 	else {
-		if (ctx->flags & STREAM_CTX_F_MORE_DATA) {
-			/* Don't send any packet. */
-			ctx->flags &= ~STREAM_CTX_F_MORE_DATA;
-			*next_tsc = tcp_retx_timeout(ctx);
-			ctx->sched_tsc = rte_rdtsc() + *next_tsc;
-			return -1;
-		}
-		else {
-			uint64_t now = rte_rdtsc();
-
-			if ((ctx->flags & STREAM_CTX_F_LAST_RX_PKT_MADE_PROGRESS) && token_time_tsc_until_full(&ctx->token_time_other) != 0) {
-				tcp_retx_timeout_start(ctx, next_tsc);
-				ctx->flags &= ~STREAM_CTX_F_LAST_RX_PKT_MADE_PROGRESS;
-				return -1;
-			}
-			/* This function might be called due to packet
-			   reception. In that case, cancel here and
-			   wait until the timeout really occurs before
-			   reTX. */
-			if (!tcp_retx_timeout_occured(ctx, now)) {
-				tcp_retx_timeout_resume(ctx, now, next_tsc);
-				return -1;
-			}
-
-			ctx->same_state++;
-			tcp_set_retransmit(ctx);
-			/* This possibly means that now retransmit is resumed half-way in the action. */
-			plogx_dbg("Retransmit: outstanding = %d\n", outstanding_bytes);
-			plogx_dbg("Assuming %d->%d lost\n", ctx->ackd_seq, ctx->next_seq);
-			ctx->next_seq = ctx->ackd_seq;
-			plogx_dbg("highest seq from other side = %d\n", ctx->recv_seq);
-		}
-		/* When STREAM_CTX_F_MORE_DATA is set, real timeouts
-		   can't occur. If this is needed, timeouts
-		   need to carry additional information. */
+		/* This function might be called due to packet
+		   reception. In that case, wait for more ACKs or
+		   until the timeout really occurs before reTX. */
+		tcp_retx_timeout_resume(ctx, now, next_tsc);
+		return -1;
 	}
 
 	/* The following code will retransmit the same data if next_seq is not moved forward. */
 	uint32_t data_beg = ctx->next_seq - ctx->seq_first_byte;
 	uint32_t remaining_len = act->len - (data_beg - act->beg);
-	uint32_t data_len = remaining_len > ctx->other_mss? ctx->other_mss: remaining_len;
+	uint32_t max_len = tcp_max_seg_len(ctx);
+	uint32_t data_len = remaining_len > max_len? max_len: remaining_len;
+	int new_data = ctx->next_seq == ctx->snd_max;
 	if (data_len == 0)
 		plogx_warn("data_len == 0\n");
 
-	if (remaining_len > ctx->other_mss)
-		ctx->flags |= STREAM_CTX_F_MORE_DATA;
-	else
-		ctx->flags &= ~STREAM_CTX_F_MORE_DATA;
+	/* In zero copy mode, the payload is attached. Otherwise,
+	   super-frames need a chain of segments to copy it into. */
+	if (stream_attach_content(ctx->stream_cfg, act->peer, mbuf, data_beg, data_len) &&
+	    data_len > ctx->other_mss &&
+	    tcp_chain_segments(mbuf, ctx->stream_cfg->data[act->peer].hdr_len + sizeof(struct tcp_hdr), data_len))
+		data_len = ctx->other_mss;
 
 	create_tcp_pkt(ctx, mbuf, TCP_ACK_FLAG, data_beg, data_len);
 	token_time_take(&ctx->token_time, mbuf_wire_size(mbuf));
-	if (ctx->flags & STREAM_CTX_F_MORE_DATA)
+	if (new_data && ctx->rtt_seq == 0) {
+		ctx->rtt_seq = ctx->next_seq;
+		ctx->rtt_tsc = now;
+	}
+
+	/* Keep sending as long as the window is open, paced by
+	   the token bucket. Otherwise, wait for ACKs. */
+	remaining_len -= data_len;
+	if (remaining_len && tcp_window_allows(ctx, ctx->next_seq - ctx->ackd_seq, remaining_len))
 		*next_tsc = tcp_resched_timeout(ctx);
 	else
-		tcp_retx_timeout_start(ctx, next_tsc);
+		tcp_retx_timeout_resume(ctx, now, next_tsc);
 
 	return 0;
 }
 
 static int stream_tcp_proc_out_estab_rx(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint64_t *next_tsc)
 {
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -736,6 +986,11 @@ static int stream_tcp_proc_out_estab_rx(struct stream_ctx *ctx, struct rte_mbuf
 
 	if (ctx->flags & STREAM_CTX_F_NEW_DATA)
 		ctx->flags &= ~STREAM_CTX_F_NEW_DATA;
+	else if (ctx->flags & STREAM_CTX_F_GOT_PKT) {
+		/* Out of order or old data: send a duplicate ACK,
+		   the other side will go back to recv_seq. */
+		plogx_dbg("dup ack (ack = %d)\n", ctx->recv_seq);
+	}
 	else {
 		ctx->same_state++;
 		tcp_set_retransmit(ctx);
@@ -760,7 +1015,7 @@ static int stream_tcp_proc_out_estab(struct stream_ctx *ctx, struct rte_mbuf *mb
 
 static int stream_tcp_proc_out_close_wait(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint64_t *next_tsc)
 {
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -785,7 +1040,7 @@ static int stream_tcp_proc_out_last_ack(struct stream_ctx *ctx, struct rte_mbuf
 		return -1;
 	}
 	else {
-		uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+		uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 		if (wait_tsc != 0) {
 			*next_tsc = wait_tsc;
@@ -810,7 +1065,7 @@ static int stream_tcp_proc_out_last_ack(struct stream_ctx *ctx, struct rte_mbuf
 
 static int stream_tcp_proc_out_fin_wait(struct stream_ctx *ctx, struct rte_mbuf *mbuf, uint64_t *next_tsc)
 {
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -859,7 +1114,7 @@ static int stream_tcp_proc_out_time_wait(struct stream_ctx *ctx, struct rte_mbuf
 		ctx->flags |= STREAM_CTX_F_TCP_ENDED;
 		return -1;
 	}
-	uint64_t wait_tsc = token_time_tsc_until_full(&ctx->token_time);
+	uint64_t wait_tsc = tcp_tsc_until_ready(ctx);
 
 	if (wait_tsc != 0) {
 		*next_tsc = wait_tsc;
@@ -920,9 +1175,13 @@ int stream_tcp_proc(struct stream_ctx *ctx, struct rte_mbuf *mbuf, struct l4_met
 		ret = stream_tcp_proc_in(ctx, l4_meta);
 		if (ret)
 			return ret;
+		ctx->flags |= STREAM_CTX_F_GOT_PKT;
 	}
 
-	return stream_tcp_proc_out(ctx, mbuf, next_tsc);
+	int ret = stream_tcp_proc_out(ctx, mbuf, next_tsc);
+
+	ctx->flags &= ~STREAM_CTX_F_GOT_PKT;
+	return ret;
 }
 
 int stream_tcp_is_ended(struct stream_ctx *ctx)
@@ -947,8 +1206,8 @@ void stream_tcp_calc_len(struct stream_cfg *cfg, uint32_t *n_pkts, uint32_t *n_b
 	*n_bytes = 0;
 
 	/* Connection setup */
-	add_pkt_bytes(n_pkts, n_bytes, client_hdr_len + sizeof(struct tcp_hdr) + 4); /* SYN */
-	add_pkt_bytes(n_pkts, n_bytes, server_hdr_len + sizeof(struct tcp_hdr) + 4); /* SYN/ACK */
+	add_pkt_bytes(n_pkts, n_bytes, client_hdr_len + sizeof(struct tcp_hdr) + 8); /* SYN */
+	add_pkt_bytes(n_pkts, n_bytes, server_hdr_len + sizeof(struct tcp_hdr) + 8); /* SYN/ACK */
 	add_pkt_bytes(n_pkts, n_bytes, client_hdr_len + sizeof(struct tcp_hdr)); /* ACK */
 
 	for (uint32_t i = 0; i < cfg->n_actions; ++i) {
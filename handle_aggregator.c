@@ -60,6 +60,13 @@
                 (stats)->rx_prio[prio] += ntx;           \
         } while(0)                                      \
 
+#define TASK_STATS_ADD_ENQ_PRIO(stats, nenq, prio) do {    \
+	(stats)->enq_prio[prio] += nenq;           \
+	} while(0)
+
+/* A DRR weight of 1 allows sending one maximum sized frame per round */
+#define DRR_QUANTUM_UNIT	(ETHER_MAX_LEN + 20)
+
 static inline uint8_t detect_l4_priority(uint8_t l3_priority, const struct ipv4_hdr *ipv4_hdr)
 {
 	if (ipv4_hdr->next_proto_id == IPPROTO_UDP) {
@@ -108,12 +115,13 @@ static inline void buffer_packet(struct task_aggregator *task, struct rte_mbuf *
 	struct task_base *tbase = (struct task_base *)task;
 
 	struct task_buffer *prio = &task->priority[priority];
-	if (prio->pkt_nb < BUFFER_LENGTH) {
+	if (prio->pkt_nb < prio->limit) {
 		prio->buffer[prio->pkt_pos] = mbuf;
 		prio->pkt_pos++;
 		if (prio->pkt_pos == BUFFER_LENGTH)
 			prio->pkt_pos = 0;
 		prio->pkt_nb++;
+		TASK_STATS_ADD_ENQ_PRIO(&task->stats, 1, priority);
 	} else {
 		task->drop.buffer[task->drop.pkt_nb] = mbuf;
 		task->drop.pkt_nb++;
@@ -167,6 +175,70 @@ static inline void handle_aggregator(struct task_aggregator *task, struct rte_mb
 	buffer_packet(task, mbuf, priority);
 }
 
+/* Deficit round robin over the priority buffers. Packets from all
+   priorities are gathered in out so that they can be sent with a
+   single tx_pkt_try() call. If out is full before the current
+   priority has used its deficit, the next call resumes with the same
+   priority without adding a new quantum. */
+static uint16_t drr_dequeue(struct task_aggregator *task, struct rte_mbuf **out)
+{
+	uint16_t n_out = 0;
+	uint32_t n_buffered = 0;
+
+	for (int i = 0; i < MAX_PRIORITIES; i++)
+		n_buffered += task->priority[i].pkt_nb;
+
+	while (n_buffered && n_out < MAX_PKT_BURST) {
+		struct task_buffer *prio = &task->priority[task->drr_cur];
+
+		if (!task->drr_visited) {
+			if (prio->pkt_nb)
+				prio->deficit += prio->quantum;
+			task->drr_visited = 1;
+		}
+
+		while (prio->pkt_nb && n_out < MAX_PKT_BURST) {
+			uint16_t head = (prio->pkt_pos - prio->pkt_nb) & (BUFFER_LENGTH - 1);
+			struct rte_mbuf *mbuf = prio->buffer[head];
+			uint32_t size = mbuf_wire_size(mbuf);
+
+			if (size > prio->deficit)
+				break;
+			prio->deficit -= size;
+			prio->pkt_nb--;
+			n_buffered--;
+			out[n_out++] = mbuf;
+			TASK_STATS_ADD_TX_PRIO(&task->stats, 1, task->drr_cur);
+		}
+
+		if (n_out == MAX_PKT_BURST && prio->pkt_nb)
+			break;
+
+		if (prio->pkt_nb == 0)
+			prio->deficit = 0;
+		task->drr_cur = (task->drr_cur + 1) & (MAX_PRIORITIES - 1);
+		task->drr_visited = 0;
+	}
+	return n_out;
+}
+
+static void drr_tx(struct task_aggregator *task)
+{
+	struct task_base *tbase = (struct task_base *)task;
+	uint16_t n;
+
+	if (task->n_pending == 0) {
+		task->pending_pos = 0;
+		task->n_pending = drr_dequeue(task, task->pending);
+		if (task->n_pending == 0)
+			return;
+	}
+
+	n = tbase->aux->tx_pkt_try(tbase, task->pending + task->pending_pos, task->n_pending);
+	task->pending_pos += n;
+	task->n_pending -= n;
+}
+
 static int handle_aggregator_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_aggregator *task = (struct task_aggregator *)tbase;
@@ -203,6 +275,11 @@ static int handle_aggregator_bulk(struct task_base *tbase, struct rte_mbuf **mbu
 	TASK_STATS_ADD_DROP_BYTES(&tbase->aux->stats, drop_bytes);
 	task->drop.pkt_nb = 0;
 
+	if (task->drr) {
+		drr_tx(task);
+		return 0;
+	}
+
 	for (int priority = 0; priority < MAX_PRIORITIES; priority++) {
 		struct task_buffer *prio = &task->priority[priority];
 		if (prio->pkt_nb) {
@@ -229,6 +306,30 @@ static void init_task_aggregator(struct task_base *tbase, struct task_args *targ
 {
 	struct task_aggregator *task = (struct task_aggregator *)tbase;
 	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
+
+	PROX_PANIC(targ->n_prio_weights && targ->n_prio_weights != MAX_PRIORITIES,
+		   "prio weights requires %d values, got %u\n", MAX_PRIORITIES, targ->n_prio_weights);
+	PROX_PANIC(targ->n_prio_queue_limits && targ->n_prio_queue_limits != MAX_PRIORITIES,
+		   "prio queue limits requires %d values, got %u\n", MAX_PRIORITIES, targ->n_prio_queue_limits);
+
+	task->drr = targ->n_prio_weights != 0;
+	for (int i = 0; i < MAX_PRIORITIES; i++) {
+		struct task_buffer *prio = &task->priority[i];
+
+		prio->limit = BUFFER_LENGTH;
+		if (targ->n_prio_queue_limits) {
+			PROX_PANIC(targ->prio_queue_limit[i] == 0 || targ->prio_queue_limit[i] > BUFFER_LENGTH,
+				   "prio queue limit %u for priority %d must be in [1, %d]\n",
+				   targ->prio_queue_limit[i], i, BUFFER_LENGTH);
+			prio->limit = targ->prio_queue_limit[i];
+		}
+		if (task->drr) {
+			PROX_PANIC(targ->prio_weight[i] == 0, "prio weight for priority %d must be > 0\n", i);
+			prio->quantum = targ->prio_weight[i] * DRR_QUANTUM_UNIT;
+		}
+	}
+	if (task->drr)
+		plog_info("\tUsing deficit round robin between priorities\n");
 }
 
 static struct task_init task_init_aggregator = {
@@ -36,6 +36,7 @@
 #include "task_base.h"
 #include "task_init.h"
 #include "stats_prio_task.h"
+#include "defaults.h"
 
 #define MAX_PRIORITIES  8
 #define LOW_PRIORITY  (MAX_PRIORITIES - 1)
@@ -46,6 +47,9 @@ struct task_buffer {
 	struct rte_mbuf *buffer[BUFFER_LENGTH];
 	uint16_t pkt_pos;
 	uint16_t pkt_nb;
+	uint16_t limit;    /* Max number of packets buffered */
+	uint32_t quantum;  /* DRR: bytes added to deficit each round */
+	uint32_t deficit;  /* DRR: bytes that can still be sent this round */
 };
 
 struct task_aggregator {
@@ -53,6 +57,15 @@ struct task_aggregator {
 	struct prio_task_rt_stats stats;
 	struct task_buffer  priority[MAX_PRIORITIES];
 	struct task_buffer  drop;
+	/* When drr is set, priorities are served through deficit round
+	   robin instead of strict priority. Packets dequeued by DRR
+	   but not yet accepted by tx_pkt_try are kept in pending. */
+	uint8_t             drr;
+	uint8_t             drr_cur;
+	uint8_t             drr_visited;
+	uint16_t            n_pending;
+	uint16_t            pending_pos;
+	struct rte_mbuf     *pending[MAX_PKT_BURST];
 };
 
 #endif /* _HANDLE_AGGREGATOR_H_ */
@@ -54,6 +54,7 @@
 #include "prox_port_cfg.h"
 #include "hash_entry_types.h"
 #include "prox_shared.h"
+#include "qsbr.h"
 #include "handle_cgnat.h"
 
 #define ALL_32_BITS 0xffffffff
@@ -111,7 +112,7 @@ struct task_nat {
 	struct public_entry *public_entries;
 	struct next_hop *next_hops;
 	struct lcore_cfg *lconf;
-	struct rte_lpm *ipv4_lpm;
+	struct lpm4 *lpm;
 	uint32_t total_free_port_count;
 	uint32_t number_free_rules;
 	int    private;
@@ -151,6 +152,16 @@ static void set_l2(struct task_nat *task, struct rte_mbuf *mbuf, uint8_t nh_idx)
 	*((uint64_t *)(&peth->s_addr)) = task->src_mac[task->next_hops[nh_idx].mac_port.out_idx];
 }
 
+/* Address and port have been translated from old_ip/old_port to
+   new_ip/new_port, update the checksums accordingly */
+static inline void nat_cksum(struct task_nat *task, struct rte_mbuf *mbuf, struct pkt_eth_ipv4 *pkt, uint32_t old_ip, uint32_t new_ip, uint16_t old_port, uint16_t new_port)
+{
+	if (prox_cksum_in_sw(task->offload_crc))
+		prox_ip_udp_cksum_update(&pkt->ipv4_hdr, old_ip, new_ip, old_port, new_port);
+	else
+		prox_ip_udp_cksum(mbuf, &pkt->ipv4_hdr, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
+}
+
 static uint8_t route_ipv4(struct task_nat *task, struct rte_mbuf *mbuf)
 {
 	struct pkt_eth_ipv4 *pkt = rte_pktmbuf_mtod(mbuf, struct pkt_eth_ipv4 *);
@@ -175,7 +186,7 @@ static uint8_t route_ipv4(struct task_nat *task, struct rte_mbuf *mbuf)
 #else
 	uint8_t next_hop_index;
 #endif
-	if (unlikely(rte_lpm_lookup(task->ipv4_lpm, rte_bswap32(dst_ip), &next_hop_index) != 0)) {
+	if (unlikely(rte_lpm_lookup(qsbr_deref(task->lpm->rte_lpm), rte_bswap32(dst_ip), &next_hop_index) != 0)) {
 		uint8_t* dst_ipp = (uint8_t*)&dst_ip;
 		plog_warn("lpm_lookup failed for ip %d.%d.%d.%d: rc = %d\n",
 			dst_ipp[0], dst_ipp[1], dst_ipp[2], dst_ipp[3], -ENOENT);
@@ -403,6 +414,8 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 				ip_addr = &(pkt[j]->ipv4_hdr.src_addr);
 				udp_src_port = &(pkt[j]->udp_hdr.src_port);
 				plogx_dbg("ip/port %d.%d.%d.%d / %x found in private ip/port hash\n", IP4(pkt[j]->ipv4_hdr.src_addr), pkt[j]->udp_hdr.src_port);
+				private_ip = *ip_addr;
+				private_port = *udp_src_port;
        				*ip_addr = task->private_flow_entries[port_idx].ip_addr;
        				*udp_src_port = task->private_flow_entries[port_idx].l4_port;
 				uint64_t flow_time = task->private_flow_entries[port_idx].flow_time;
@@ -412,7 +425,7 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 				private_ip_idx = task->private_flow_entries[port_idx].private_ip_idx;
 				if (task->private_ip_info[private_ip_idx].mac_aging_time + tsc_hz < tsc)
 					task->private_ip_info[private_ip_idx].mac_aging_time = tsc;
-				prox_ip_udp_cksum(mbufs[j], &pkt[j]->ipv4_hdr, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
+				nat_cksum(task, mbufs[j], pkt[j], private_ip, *ip_addr, private_port, *udp_src_port);
 				out[j] =  route_ipv4(task, mbufs[j]);
 			}
 		}
@@ -504,7 +517,7 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 				}
 				if (task->private_ip_info[private_ip_idx].mac_aging_time + tsc_hz < tsc)
 					task->private_ip_info[private_ip_idx].mac_aging_time = tsc;
-				prox_ip_udp_cksum(mbufs[j], &pkt[j]->ipv4_hdr, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
+				nat_cksum(task, mbufs[j], pkt[j], private_ip, *ip_addr, private_port, *udp_src_port);
 				// TODO: if route fails while just added new key in table, should we delete the key from the table?
 				out[j] =  route_ipv4(task, mbufs[j]);
 				if (out[j] && new_entry) {
@@ -542,6 +555,8 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 				out[j] = OUT_DISCARD;
 			} else {
 				plogx_dbg("Found ip/port %d.%d.%d.%d/%x in public_ip_port_hash\n", IP4(*ip_addr), *udp_src_port);
+				public_ip = *ip_addr;
+				public_port = *udp_src_port;
         			*ip_addr = task->public_entries[port_idx].ip_addr;
 				*udp_src_port = task->public_entries[port_idx].l4_port;
 				private_ip_idx = task->public_entries[port_idx].private_ip_idx;
@@ -549,8 +564,8 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 				rte_memcpy(((uint8_t *)(pkt[j])) + 0, &task->private_ip_info[private_ip_idx].private_mac, 6);
 				rte_memcpy(((uint8_t *)(pkt[j])) + 6, &task->src_mac_from_dpdk_port[task->public_entries[port_idx].dpdk_port], 6);
 				out[j] = task->public_entries[port_idx].dpdk_port;
+				nat_cksum(task, mbufs[j], pkt[j], public_ip, *ip_addr, public_port, *udp_src_port);
 			}
-			prox_ip_udp_cksum(mbufs[j], &pkt[j]->ipv4_hdr, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
 		}
         	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 	}
@@ -945,7 +960,7 @@ static void init_task_nat(struct task_base *tbase, struct task_args *targ)
 			prox_sh_add_socket(socket_id, targ->route_table, lpm);
 		}
 	}
-	task->ipv4_lpm = lpm->rte_lpm;
+	task->lpm = lpm;
 	task->next_hops = lpm->next_hops;
 	task->number_free_rules = lpm->n_free_rules;
 
@@ -0,0 +1,444 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rte_cycles.h>
+#include <rte_hash_crc.h>
+#include <rte_table_hash.h>
+#include <rte_version.h>
+
+#include "handle_cpe_learn.h"
+#include "kv_store_expire.h"
+#include "task_base.h"
+#include "task_init.h"
+#include "lconf.h"
+#include "stats.h"
+#include "prox_shared.h"
+#include "prox_malloc.h"
+#include "quit.h"
+#include "clock.h"
+#include "log.h"
+
+/* Number of entries checked for aging each time the scan runs. The
+   whole store is walked every CPE_LEARN_SCAN_MS. */
+#define CPE_LEARN_SCAN_BURST 64
+#define CPE_LEARN_SCAN_MS    500
+
+struct cpe_learn_entry {
+	struct cpe_learn_chan *chan;
+	struct cpe_key        key;
+	struct cpe_data       data;
+	uint64_t              timeout;
+};
+
+struct task_cpe_learn {
+	struct task_base        base;
+	struct kv_store_expire  *kv_store;
+	struct cpe_learn_chan   *chans[MAX_WT_PER_LB];
+	uint32_t                n_chans;
+	uint32_t                scan_idx;
+	uint64_t                scan_tsc;
+	uint64_t                scan_period;
+	uint64_t                cpe_timeout;
+};
+
+static struct cpe_learn_chan *cpe_learn_chan_get(struct task_args *learner, uint32_t lcore_id)
+{
+	const int socket_id = rte_lcore_to_socket_id(lcore_id);
+	struct cpe_learn_chan *chan;
+	char sh_name[64];
+	char name[64];
+
+	snprintf(sh_name, sizeof(sh_name), "cpe_learn_chan_%u", lcore_id);
+	chan = prox_sh_find_system(sh_name);
+	if (chan)
+		return chan;
+
+	chan = prox_zmalloc(sizeof(*chan), socket_id);
+	PROX_PANIC(chan == NULL, "Failed to allocate CPE learn channel for core %u\n", lcore_id);
+	chan->lcore_id = lcore_id;
+
+	snprintf(name, sizeof(name), "cpe_learn_%u", lcore_id);
+	chan->learn_ring = rte_ring_create(name, learner->ring_size, socket_id, RING_F_SP_ENQ | RING_F_SC_DEQ);
+	PROX_PANIC(chan->learn_ring == NULL, "Failed to create learn ring for core %u\n", lcore_id);
+
+	snprintf(name, sizeof(name), "cpe_publish_%u", lcore_id);
+	chan->publish_ring = rte_ring_create(name, learner->ring_size, socket_id, RING_F_SP_ENQ | RING_F_SC_DEQ);
+	PROX_PANIC(chan->publish_ring == NULL, "Failed to create publish ring for core %u\n", lcore_id);
+
+	/* Records are either queued in one of the two rings or being
+	   handled by one of both sides. Running out of records is
+	   accounted as lost events. */
+	snprintf(name, sizeof(name), "cpe_learn_pool_%u", lcore_id);
+	chan->pool = rte_mempool_create(name, 2 * learner->ring_size - 1, sizeof(struct cpe_learn_rec),
+					0, 0, NULL, NULL, NULL, NULL, socket_id, 0);
+	PROX_PANIC(chan->pool == NULL, "Failed to create learn record pool on socket %u with %u elements\n",
+		   socket_id, 2 * learner->ring_size - 1);
+
+	struct token_time_cfg tt_cfg = token_time_cfg_create(learner->learn_rate, rte_get_tsc_hz(), MAX_RING_BURST);
+	token_time_init(&chan->worker.token_time, &tt_cfg);
+	token_time_reset_full(&chan->worker.token_time, rte_rdtsc());
+
+	/* Known entries are posted again before the learner would
+	   age them out. */
+	chan->worker.refresh = learner->cpe_table_timeout_ms?
+		msec_to_tsc(learner->cpe_table_timeout_ms) / 4 : UINT64_MAX;
+
+	prox_sh_add_system(sh_name, chan);
+	return chan;
+}
+
+struct cpe_learn_chan *cpe_learn_chan_find(struct task_args *targ)
+{
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *ltarg;
+
+	while (core_targ_next(&lconf, &ltarg, 0) == 0) {
+		if (strcmp(ltarg->task_init->mode_str, "cpelearn"))
+			continue;
+		for (uint32_t i = 0; i < ltarg->learn_core_task_set.n_elems; ++i) {
+			if (ltarg->learn_core_task_set.core_task[i].core == targ->lconf->id)
+				return cpe_learn_chan_get(ltarg, targ->lconf->id);
+		}
+	}
+	return NULL;
+}
+
+void cpe_learn_post(struct cpe_learn_chan *chan, const struct cpe_key *key, const struct cpe_data *data)
+{
+	struct cpe_learn_rec *rec;
+	uint64_t now = rte_rdtsc();
+	uint32_t key_hash = rte_hash_crc(key, sizeof(*key), 0);
+	uint64_t sig = (uint64_t)key_hash << 32 | rte_hash_crc(data, offsetof(struct cpe_data, tsc), key_hash);
+	struct cpe_learn_recent *recent = &chan->worker.recent[key_hash & (CPE_LEARN_RECENT - 1)];
+
+	/* When learning on every packet, most events are for entries
+	   which have been posted recently. */
+	if (recent->sig == sig && now - recent->tsc < chan->worker.refresh) {
+		chan->worker.n_filtered++;
+		return;
+	}
+
+	token_time_update(&chan->worker.token_time, now);
+	if (token_time_take(&chan->worker.token_time, 1)) {
+		chan->worker.n_limited++;
+		return;
+	}
+
+	if (unlikely(rte_mempool_get(chan->pool, (void **)&rec))) {
+		chan->worker.n_lost++;
+		return;
+	}
+
+	rec->key = *key;
+	rec->data = *data;
+	rec->tsc = now;
+	rec->op = CPE_LEARN_ADD;
+	if (unlikely(rte_ring_sp_enqueue(chan->learn_ring, rec) == -ENOBUFS)) {
+		rte_mempool_put(chan->pool, rec);
+		chan->worker.n_lost++;
+		return;
+	}
+	recent->sig = sig;
+	recent->tsc = now;
+	chan->worker.n_posted++;
+}
+
+void cpe_learn_apply(void *data)
+{
+	struct cpe_learn_chan *chan = (struct cpe_learn_chan *)data;
+	struct cpe_learn_rec *recs[MAX_RING_BURST];
+	uint64_t now = rte_rdtsc();
+	void *entry_in_hash;
+	int ret, key_found;
+	uint16_t n_recs;
+
+#if RTE_VERSION < RTE_VERSION_NUM(17,5,0,1)
+	n_recs = rte_ring_sc_dequeue_burst(chan->publish_ring, (void **)recs, MAX_RING_BURST);
+#else
+	n_recs = rte_ring_sc_dequeue_burst(chan->publish_ring, (void **)recs, MAX_RING_BURST, NULL);
+#endif
+	if (n_recs == 0)
+		return;
+
+	for (uint16_t i = 0; i < n_recs; ++i) {
+		key_found = 0;
+		if (recs[i]->op == CPE_LEARN_ADD) {
+			ret = rte_table_hash_key8_ext_dosig_ops.
+				f_add(chan->cpe_table, &recs[i]->key, &recs[i]->data, &key_found, &entry_in_hash);
+		}
+		else {
+			ret = rte_table_hash_key8_ext_dosig_ops.
+				f_delete(chan->cpe_table, &recs[i]->key, &key_found, NULL);
+		}
+		if (unlikely(ret)) {
+			chan->worker.n_failed++;
+			continue;
+		}
+
+		uint64_t latency = now - recs[i]->tsc;
+
+		chan->worker.latency_sum += latency;
+		if (latency > chan->worker.latency_max)
+			chan->worker.latency_max = latency;
+		chan->worker.n_applied++;
+	}
+	rte_mempool_put_bulk(chan->pool, (void **)recs, n_recs);
+}
+
+static void cpe_learn_flush(struct cpe_learn_chan *chan)
+{
+	uint16_t n_pub = chan->learner.n_pub;
+	uint16_t sent;
+
+	if (n_pub == 0)
+		return;
+
+#if RTE_VERSION < RTE_VERSION_NUM(17,5,0,1)
+	sent = rte_ring_sp_enqueue_burst(chan->publish_ring, (void *const *)chan->learner.pub, n_pub);
+#else
+	sent = rte_ring_sp_enqueue_burst(chan->publish_ring, (void *const *)chan->learner.pub, n_pub, NULL);
+#endif
+	if (unlikely(sent < n_pub)) {
+		rte_mempool_put_bulk(chan->pool, (void **)&chan->learner.pub[sent], n_pub - sent);
+		chan->learner.n_lost += n_pub - sent;
+	}
+	chan->learner.n_pub = 0;
+}
+
+static void cpe_learn_publish(struct cpe_learn_chan *chan, struct cpe_learn_rec *rec)
+{
+	chan->learner.pub[chan->learner.n_pub++] = rec;
+	if (chan->learner.n_pub == MAX_RING_BURST)
+		cpe_learn_flush(chan);
+}
+
+/* Room in the publish ring for at least one more burst of learn
+   events, taking into account what is still buffered. */
+static int cpe_learn_can_publish(struct cpe_learn_chan *chan)
+{
+	return rte_ring_free_count(chan->publish_ring) >= (unsigned)chan->learner.n_pub + MAX_RING_BURST;
+}
+
+static void cpe_learn_publish_del(struct cpe_learn_chan *chan, const struct cpe_key *key)
+{
+	struct cpe_learn_rec *rec;
+
+	if (unlikely(rte_mempool_get(chan->pool, (void **)&rec))) {
+		chan->learner.n_lost++;
+		return;
+	}
+	rec->key = *key;
+	rec->tsc = rte_rdtsc();
+	rec->op = CPE_LEARN_DEL;
+	cpe_learn_publish(chan, rec);
+}
+
+/* Called when an entry is aged out by the scan */
+static void cpe_learn_expire(void *entry_value)
+{
+	struct cpe_learn_entry *v = (struct cpe_learn_entry *)entry_value;
+
+	if (v->chan) {
+		cpe_learn_publish_del(v->chan, &v->key);
+		v->chan->learner.n_aged++;
+		v->chan = NULL;
+	}
+}
+
+static void cpe_learn_handle_rec(struct task_cpe_learn *task, struct cpe_learn_chan *chan, struct cpe_learn_rec *rec, uint64_t now)
+{
+	struct kv_store_expire_entry *e = kv_store_expire_get_or_put(task->kv_store, &rec->key, now);
+	struct cpe_learn_entry *v;
+
+	if (unlikely(e == NULL)) {
+		chan->learner.n_full++;
+		TASK_STATS_ADD_DROP_DISCARD(&task->base.aux->stats, 1);
+		rte_mempool_put(chan->pool, rec);
+		return;
+	}
+
+	v = (struct cpe_learn_entry *)entry_value(task->kv_store, e);
+	v->timeout = now + task->cpe_timeout;
+
+	if (v->chan == chan && !memcmp(&v->data, &rec->data, offsetof(struct cpe_data, tsc))) {
+		chan->learner.n_dup++;
+		TASK_STATS_ADD_DROP_HANDLED(&task->base.aux->stats, 1);
+		rte_mempool_put(chan->pool, rec);
+		return;
+	}
+
+	if (v->chan == NULL) {
+		chan->learner.n_new++;
+	}
+	else {
+		chan->learner.n_changed++;
+		/* The CPE moved, remove it from the core it was on */
+		if (v->chan != chan)
+			cpe_learn_publish_del(v->chan, &rec->key);
+	}
+	v->chan = chan;
+	v->key = rec->key;
+	v->data = rec->data;
+	TASK_STATS_ADD_TX(&task->base.aux->stats, 1);
+	cpe_learn_publish(chan, rec);
+}
+
+static void cpe_learn_scan(struct task_cpe_learn *task, uint64_t now)
+{
+	size_t size = kv_store_expire_size(task->kv_store);
+
+	for (uint32_t i = 0; i < CPE_LEARN_SCAN_BURST; ++i) {
+		struct kv_store_expire_entry *e = kv_store_expire_get_entry(task->kv_store, task->scan_idx);
+		struct cpe_learn_entry *v = (struct cpe_learn_entry *)entry_value(task->kv_store, e);
+
+		/* If the removal can't be published now, it is
+		   retried during the next sweep rather than lost. */
+		if (e->timeout && v->timeout < now &&
+		    (!v->chan || cpe_learn_can_publish(v->chan))) {
+			task->kv_store->expire(v);
+			e->timeout = 0;
+		}
+		if (++task->scan_idx == size)
+			task->scan_idx = 0;
+	}
+}
+
+static int handle_cpe_learn_bulk(struct task_base *tbase, __attribute__((unused)) struct rte_mbuf **mbufs, __attribute__((unused)) uint16_t n_pkts)
+{
+	struct task_cpe_learn *task = (struct task_cpe_learn *)tbase;
+	struct cpe_learn_rec *recs[MAX_RING_BURST];
+	uint64_t now = rte_rdtsc();
+	uint32_t n_total = 0;
+	uint16_t n_recs;
+
+	for (uint32_t i = 0; i < task->n_chans; ++i) {
+		struct cpe_learn_chan *chan = task->chans[i];
+
+		/* Leave events in the learn ring while the worker
+		   is not keeping up, the worker will drop new ones. */
+		if (!cpe_learn_can_publish(chan))
+			continue;
+#if RTE_VERSION < RTE_VERSION_NUM(17,5,0,1)
+		n_recs = rte_ring_sc_dequeue_burst(chan->learn_ring, (void **)recs, MAX_RING_BURST);
+#else
+		n_recs = rte_ring_sc_dequeue_burst(chan->learn_ring, (void **)recs, MAX_RING_BURST, NULL);
+#endif
+		for (uint16_t j = 0; j < n_recs; ++j)
+			cpe_learn_handle_rec(task, chan, recs[j], now);
+		n_total += n_recs;
+	}
+
+	if (task->scan_period && now > task->scan_tsc) {
+		cpe_learn_scan(task, now);
+		task->scan_tsc = now + task->scan_period;
+	}
+
+	for (uint32_t i = 0; i < task->n_chans; ++i)
+		cpe_learn_flush(task->chans[i]);
+
+	TASK_STATS_ADD_RX(&task->base.aux->stats, n_total);
+	return 0;
+}
+
+static void init_task_cpe_learn(struct task_base *tbase, struct task_args *targ)
+{
+	struct task_cpe_learn *task = (struct task_cpe_learn *)tbase;
+	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
+	struct core_task_set *cts = &targ->learn_core_task_set;
+
+	PROX_PANIC(cts->n_elems == 0, "No learn cores specified for core %u task %u\n", targ->lconf->id, targ->task);
+
+	for (uint32_t i = 0; i < cts->n_elems; ++i) {
+		struct core_task ct = cts->core_task[i];
+		struct task_args *dtarg = core_targ_get(ct.core, ct.task);
+		struct cpe_learn_chan *chan;
+
+		PROX_PANIC(dtarg->mode != QINQ_DECAP4, "Core %u task %u is not in mode qinqdecapv4, can't learn CPEs for it\n", ct.core, ct.task);
+		chan = cpe_learn_chan_get(targ, ct.core);
+
+		uint32_t j;
+		for (j = 0; j < task->n_chans && task->chans[j] != chan; ++j);
+		if (j == task->n_chans)
+			task->chans[task->n_chans++] = chan;
+	}
+
+	/* Aging is done by the learner based on the timeout in the
+	   entries, entries never expire by themselves in the store. */
+	task->kv_store = kv_store_expire_create(MAX_GRE, sizeof(struct cpe_key), sizeof(struct cpe_learn_entry),
+						socket_id, cpe_learn_expire, UINT64_MAX >> 1);
+	PROX_PANIC(task->kv_store == NULL, "Failed to allocate CPE learn store\n");
+
+	if (targ->cpe_table_timeout_ms) {
+		task->cpe_timeout = msec_to_tsc(targ->cpe_table_timeout_ms);
+		task->scan_period = msec_to_tsc(CPE_LEARN_SCAN_MS) * CPE_LEARN_SCAN_BURST / kv_store_expire_size(task->kv_store);
+		task->scan_tsc = rte_rdtsc() + task->scan_period;
+	}
+	else {
+		task->cpe_timeout = UINT64_MAX >> 1;
+	}
+}
+
+void task_cpe_learn_print_stats(struct task_base *tbase)
+{
+	struct task_cpe_learn *task = (struct task_cpe_learn *)tbase;
+	const uint64_t hz = rte_get_tsc_hz();
+
+	for (uint32_t i = 0; i < task->n_chans; ++i) {
+		struct cpe_learn_chan *chan = task->chans[i];
+		uint64_t avg = chan->worker.n_applied? chan->worker.latency_sum / chan->worker.n_applied : 0;
+
+		plog_info("Core %u: posted %"PRIu64", filtered %"PRIu64", rate limited %"PRIu64", lost %"PRIu64"\n",
+			  chan->lcore_id, chan->worker.n_posted, chan->worker.n_filtered,
+			  chan->worker.n_limited, chan->worker.n_lost);
+		plog_info("\tnew %"PRIu64", changed %"PRIu64", duplicate %"PRIu64", aged %"PRIu64", store full %"PRIu64", publish lost %"PRIu64"\n",
+			  chan->learner.n_new, chan->learner.n_changed, chan->learner.n_dup,
+			  chan->learner.n_aged, chan->learner.n_full, chan->learner.n_lost);
+		plog_info("\tapplied %"PRIu64", failed %"PRIu64", latency avg %"PRIu64" us, max %"PRIu64" us\n",
+			  chan->worker.n_applied, chan->worker.n_failed,
+			  avg * 1000000 / hz, chan->worker.latency_max * 1000000 / hz);
+		plog_info("\tbacklog learn %u, publish %u\n",
+			  rte_ring_count(chan->learn_ring), rte_ring_count(chan->publish_ring));
+	}
+}
+
+static struct task_init task_init_cpe_learn = {
+	.mode_str = "cpelearn",
+	.init = init_task_cpe_learn,
+	.handle = handle_cpe_learn_bulk,
+	.flag_features = TASK_FEATURE_NO_RX,
+	.size = sizeof(struct task_cpe_learn)
+};
+
+__attribute__((constructor)) static void reg_task_cpe_learn(void)
+{
+	reg_task(&task_init_cpe_learn);
+}
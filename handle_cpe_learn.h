@@ -0,0 +1,125 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _HANDLE_CPE_LEARN_H_
+#define _HANDLE_CPE_LEARN_H_
+
+#include <rte_ring.h>
+#include <rte_mempool.h>
+
+#include "defaults.h"
+#include "hash_entry_types.h"
+#include "token_time.h"
+
+struct task_args;
+struct task_base;
+struct rte_table_hash;
+
+/* A task in mode cpelearn takes CPE learning (adding entries to the
+   CPE table) off the forwarding path of the qinqdecapv4 tasks running
+   on its "learn cores". Instead of updating their table inline, these
+   tasks post learn events which the learner de-duplicates and ages
+   out. Only new or changed entries are published back. The CPE table
+   is per core, so there is one channel per core. Each worker core
+   applies the published entries to its own table from its period
+   function, so that readers on that core never see partially written
+   entries. */
+
+#define CPE_LEARN_ADD    0
+#define CPE_LEARN_DEL    1
+
+/* Size of the per channel filter suppressing repeated posts */
+#define CPE_LEARN_RECENT 1024
+
+struct cpe_learn_rec {
+	struct cpe_key  key;
+	struct cpe_data data;
+	/* Time at which the event was posted */
+	uint64_t        tsc;
+	uint8_t         op;
+};
+
+struct cpe_learn_recent {
+	uint64_t sig;
+	uint64_t tsc;
+};
+
+/* Connects the qinqdecapv4 tasks of one core with the learner */
+struct cpe_learn_chan {
+	struct rte_ring       *learn_ring;
+	struct rte_ring       *publish_ring;
+	struct rte_mempool    *pool;
+	struct rte_table_hash *cpe_table;
+	uint32_t              lcore_id;
+
+	/* Only accessed by the worker */
+	struct {
+		struct token_time token_time;
+		uint64_t refresh;
+		uint64_t n_posted;
+		uint64_t n_filtered;
+		uint64_t n_limited;
+		uint64_t n_lost;
+		uint64_t n_applied;
+		uint64_t n_failed;
+		uint64_t latency_sum;
+		uint64_t latency_max;
+		struct cpe_learn_recent recent[CPE_LEARN_RECENT];
+	} worker __rte_cache_aligned;
+
+	/* Only accessed by the learner */
+	struct {
+		uint64_t n_new;
+		uint64_t n_changed;
+		uint64_t n_dup;
+		uint64_t n_aged;
+		uint64_t n_full;
+		uint64_t n_lost;
+		uint16_t n_pub;
+		struct cpe_learn_rec *pub[MAX_RING_BURST];
+	} learner __rte_cache_aligned;
+};
+
+/* Returns the channel to the learner for a qinqdecapv4 task or NULL
+   if no learner has been configured for its core. */
+struct cpe_learn_chan *cpe_learn_chan_find(struct task_args *targ);
+
+/* Called for each learn event on the forwarding path. Events above
+   the learn rate, or that can't be queued, are dropped and counted. */
+void cpe_learn_post(struct cpe_learn_chan *chan, const struct cpe_key *key, const struct cpe_data *data);
+
+/* Period function of the worker cores, data points to the channel */
+void cpe_learn_apply(void *data);
+
+void task_cpe_learn_print_stats(struct task_base *tbase);
+
+#endif /* _HANDLE_CPE_LEARN_H_ */
@@ -49,6 +49,7 @@
 #include "prox_shared.h"
 #include "etypes.h"
 #include "prox_cfg.h"
+#include "prefetch.h"
 #include "dpi/dpi.h"
 
 struct task_dpi_per_core {
@@ -62,7 +63,21 @@ struct task_fm {
 	void                     *dpi_opaque;
 
 	struct dpi_engine        dpi_engine;
+	struct dpi_engine_burst  dpi_engine_burst;
+	int                      use_burst;
 	struct task_dpi_per_core *dpi_shared; /* Used only during init */
+	/* Time of day at tsc_base, used to convert TSC to struct timeval */
+	struct timeval           tv_base;
+	uint64_t                 tsc_base;
+};
+
+/* Flow info of a packet, extracted before the lookups of the burst */
+struct fm_pkt {
+	struct flow_info             fi;
+	struct flow_info             fi_flipped;
+	struct kv_store_expire_entry *bucket;
+	uint8_t                      *payload;
+	uint32_t                     len;
 };
 
 struct eth_ip4_udp {
@@ -150,85 +165,156 @@ static int is_flow_beg(const struct flow_info *fi, const struct eth_ip4_udp *p)
 		(fi->ip_proto == IPPROTO_TCP && p->l4.tcp.tcp_flags & TCP_SYN_FLAG);
 }
 
-static void *lookup_flow(struct task_fm *task, struct flow_info *fi, uint64_t now_tsc)
+/* Both directions of a flow are stored in the same bucket so that
+   the lookup of either direction only needs one hash and one bucket. */
+static uint32_t flow_hash(const struct flow_info *fi, const struct flow_info *fi_flipped)
+{
+	const struct flow_info *key = memcmp(fi, fi_flipped, sizeof(*fi)) < 0? fi : fi_flipped;
+
+	return rte_hash_crc(key, sizeof(*key), 0);
+}
+
+static void *lookup_flow(struct task_fm *task, struct kv_store_expire_entry *bucket, struct flow_info *fi, uint64_t now_tsc)
 {
 	struct kv_store_expire_entry *entry;
 
-	entry = kv_store_expire_get(task->kv_store_expire, fi, now_tsc);
+	entry = kv_store_expire_get_in_bucket(task->kv_store_expire, bucket, fi, now_tsc);
 
 	return entry ? entry_value(task->kv_store_expire, entry) : NULL;
 }
 
-static void *lookup_or_insert_flow(struct task_fm *task, struct flow_info *fi, uint64_t now_tsc)
+static void *lookup_or_insert_flow(struct task_fm *task, struct kv_store_expire_entry *bucket, struct flow_info *fi, uint64_t now_tsc)
 {
 	struct kv_store_expire_entry *entry;
 
-	entry = kv_store_expire_get_or_put(task->kv_store_expire, fi, now_tsc);
+	entry = kv_store_expire_get_or_put_in_bucket(task->kv_store_expire, bucket, fi, now_tsc);
 
 	return entry ? entry_value(task->kv_store_expire, entry) : NULL;
 }
 
-static int handle_fm(struct task_fm *task, struct rte_mbuf *mbuf, uint64_t now_tsc)
+static int fm_extract(struct task_fm *task, struct rte_mbuf *mbuf, struct fm_pkt *pkt)
 {
-	struct eth_ip4_udp *p;
-	struct flow_info fi, fi_flipped;
-	void *flow_data;
-	uint32_t len;
-	uint8_t *payload;
-	uint32_t res[2];
-	size_t res_len = 2;
-	int flow_beg;
-	struct dpi_payload dpi_payload;
-	int is_upstream = 0;
+	struct eth_ip4_udp *p = rte_pktmbuf_mtod(mbuf, struct eth_ip4_udp *);
 
-	p = rte_pktmbuf_mtod(mbuf, struct eth_ip4_udp *);
-
-	if (0 != extract_flow_info(p, &fi, &fi_flipped, &len, &payload)) {
+	if (0 != extract_flow_info(p, &pkt->fi, &pkt->fi_flipped, &pkt->len, &pkt->payload)) {
 		plogx_err("Unknown packet type\n");
 		return OUT_DISCARD;
 	}
 
+	pkt->bucket = kv_store_expire_bucket(task->kv_store_expire, flow_hash(&pkt->fi, &pkt->fi_flipped));
+	kv_store_expire_prefetch_bucket(task->kv_store_expire, pkt->bucket);
+	return 0;
+}
+
+static int handle_fm(struct task_fm *task, struct rte_mbuf *mbuf, struct fm_pkt *pkt, uint64_t now_tsc, struct dpi_burst_pkt *dpi_pkt)
+{
+	struct eth_ip4_udp *p = rte_pktmbuf_mtod(mbuf, struct eth_ip4_udp *);
+	void *flow_data;
+	int is_upstream = 0;
+
 	/* First, try to see if the flow already exists where the
 	   current packet is sent by the server. */
-	if (!(flow_data = lookup_flow(task, &fi_flipped, now_tsc))) {
+	if (!(flow_data = lookup_flow(task, pkt->bucket, &pkt->fi_flipped, now_tsc))) {
 		/* Insert a new flow, only if this is the first packet
 		   in the flow. */
 		is_upstream = 1;
-		if (is_flow_beg(&fi, p))
-			flow_data = lookup_or_insert_flow(task, &fi, now_tsc);
+		if (is_flow_beg(&pkt->fi, p))
+			flow_data = lookup_or_insert_flow(task, pkt->bucket, &pkt->fi, now_tsc);
 		else
-			flow_data = lookup_flow(task, &fi, now_tsc);
+			flow_data = lookup_flow(task, pkt->bucket, &pkt->fi, now_tsc);
 	}
 
 	if (!flow_data)
 		return OUT_DISCARD;
-	else if (!len)
+	else if (!pkt->len)
 		return 0;
 
-	dpi_payload.payload = payload;
-	dpi_payload.len = len;
-	dpi_payload.client_to_server = is_upstream;
-	gettimeofday(&dpi_payload.tv, NULL);
-	task->dpi_engine.dpi_process(task->dpi_opaque, is_upstream? &fi : &fi_flipped, flow_data, &dpi_payload, res, &res_len);
+	dpi_pkt->fi = is_upstream? &pkt->fi : &pkt->fi_flipped;
+	dpi_pkt->flow_data = flow_data;
+	dpi_pkt->payload = pkt->payload;
+	dpi_pkt->len = pkt->len;
+	dpi_pkt->client_to_server = is_upstream;
+	dpi_pkt->tsc = now_tsc;
+	dpi_pkt->result_len = sizeof(dpi_pkt->results)/sizeof(dpi_pkt->results[0]);
 	return OUT_HANDLED;
 }
 
+static void tsc_to_timeval(const struct task_fm *task, uint64_t tsc, struct timeval *tv)
+{
+	const uint64_t hz = rte_get_tsc_hz();
+	const uint64_t delta = tsc - task->tsc_base;
+	uint64_t usec = task->tv_base.tv_usec + (delta % hz) * 1000000 / hz;
+
+	tv->tv_sec = task->tv_base.tv_sec + delta / hz + usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+static void process_dpi(struct task_fm *task, struct dpi_burst_pkt *pkts, uint16_t n_pkts)
+{
+	struct dpi_payload dpi_payload;
+
+	if (n_pkts == 0)
+		return;
+
+	if (task->use_burst) {
+		task->dpi_engine_burst.dpi_process_burst(task->dpi_opaque, pkts, n_pkts);
+		return;
+	}
+
+	/* All packets in the burst share the same timestamp */
+	tsc_to_timeval(task, pkts[0].tsc, &dpi_payload.tv);
+	for (uint16_t i = 0; i < n_pkts; ++i) {
+		dpi_payload.payload = pkts[i].payload;
+		dpi_payload.len = pkts[i].len;
+		dpi_payload.client_to_server = pkts[i].client_to_server;
+		task->dpi_engine.dpi_process(task->dpi_opaque, pkts[i].fi, pkts[i].flow_data, &dpi_payload, pkts[i].results, &pkts[i].result_len);
+	}
+}
+
 static int handle_fm_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_fm *task = (struct task_fm *)tbase;
 	uint64_t now_tsc = rte_rdtsc();
+	struct fm_pkt pkts[MAX_PKT_BURST];
+	struct dpi_burst_pkt dpi_pkts[MAX_PKT_BURST];
+	uint8_t out[MAX_PKT_BURST];
 	uint16_t handled = 0;
 	uint16_t discard = 0;
+	uint16_t j;
 	int ret;
 
-	for (uint16_t i = 0; i < n_pkts; ++i) {
-		ret = handle_fm(task, mbufs[i], now_tsc);
+	/* Extract the flow info and prefetch the flow table buckets
+	   of the whole burst before any lookup is done. */
+	prefetch_first(mbufs, n_pkts);
+
+	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
+#ifdef PROX_PREFETCH_OFFSET
+		PREFETCH0(mbufs[j + PREFETCH_OFFSET]);
+		PREFETCH0(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
+#endif
+		out[j] = fm_extract(task, mbufs[j], &pkts[j]);
+	}
+#ifdef PROX_PREFETCH_OFFSET
+	PREFETCH0(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
+	for (; j < n_pkts; ++j) {
+		out[j] = fm_extract(task, mbufs[j], &pkts[j]);
+	}
+#endif
+
+	for (j = 0; j < n_pkts; ++j) {
+		if (out[j] == OUT_DISCARD) {
+			discard++;
+			continue;
+		}
+		ret = handle_fm(task, mbufs[j], &pkts[j], now_tsc, &dpi_pkts[handled]);
 		if (ret == OUT_DISCARD)
 			discard++;
 		else if (ret == OUT_HANDLED)
 			handled++;
 	}
 
+	process_dpi(task, dpi_pkts, handled);
+
 	for (uint16_t i = 0; i < n_pkts; ++i)
 		rte_pktmbuf_free(mbufs[i]);
 
@@ -258,6 +344,18 @@ static void load_dpi_engine(const char *dpi_engine_path, struct dpi_engine *dst)
 	rte_memcpy(dst, dpi_engine, sizeof(*dst));
 }
 
+static int load_dpi_engine_burst(const char *dpi_engine_path, struct dpi_engine_burst *dst)
+{
+	void *handle = prox_sh_find_system(dpi_engine_path);
+	struct dpi_engine_burst *(*get_dpi_engine_burst)(void) = dlsym(handle, "get_dpi_engine_burst");
+
+	if (get_dpi_engine_burst == NULL)
+		return -1;
+
+	rte_memcpy(dst, get_dpi_engine_burst(), sizeof(*dst));
+	return 0;
+}
+
 static uint32_t count_fm_cores(void)
 {
 	uint32_t n_cores = 0;
@@ -335,6 +433,10 @@ static void init_task_fm(struct task_base *tbase, struct task_args *targ)
 
 		PROX_PANIC(ret, "Failed to initialize DPI engine\n");
 	}
+
+	if (load_dpi_engine_burst(targ->dpi_engine_path, &task->dpi_engine_burst) == 0)
+		task->use_burst = task->dpi_engine_burst.dpi_burst_init(rte_get_tsc_hz()) == 0;
+	plogx_info("DPI engine is called %s\n", task->use_burst? "per burst" : "per packet");
 }
 
 static void start_first(struct task_base *tbase)
@@ -352,6 +454,9 @@ static void start(struct task_base *tbase)
 
 	task->dpi_opaque = task->dpi_shared->dpi_opaque;
 	PROX_PANIC(task->dpi_opaque == NULL, "dpi_opaque == NULL");
+
+	gettimeofday(&task->tv_base, NULL);
+	task->tsc_base = rte_rdtsc();
 }
 
 static void stop(struct task_base *tbase)
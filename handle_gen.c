@@ -32,6 +32,7 @@
 
 #include <rte_mbuf.h>
 #include <pcap.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <rte_cycles.h>
@@ -42,6 +43,7 @@
 
 #include "prox_shared.h"
 #include "random.h"
+#include "cdf.h"
 #include "prox_malloc.h"
 #include "handle_gen.h"
 #include "handle_lat.h"
@@ -59,6 +61,7 @@
 #include "prox_assert.h"
 #include "prefetch.h"
 #include "token_time.h"
+#include "rate_group.h"
 #include "local_mbuf.h"
 #include "arp.h"
 #include "tx_pkt.h"
@@ -75,6 +78,20 @@ struct pkt_template {
 #define TEMPLATE_INDEX_MASK	(MAX_TEMPLATE_INDEX - 1)
 #define MBUF_ARP		MAX_TEMPLATE_INDEX
 
+/* Flow table entries hold the bytes spanned by all random fields
+   of one flow. Four entries share a cache line. */
+#define GEN_FLOW_ENTRY_SIZE	16
+
+struct gen_flows {
+	uint8_t *entries; /* n_flows * GEN_FLOW_ENTRY_SIZE bytes */
+	uint64_t *pkt_count; /* packets sent per flow, NULL if disabled */
+	struct cdf *cdf; /* flow popularity, NULL for uniform */
+	struct random rand;
+	uint32_t n_flows;
+	uint16_t offset; /* offset in the packet of the first byte of each entry */
+	uint16_t len; /* bytes written from each entry */
+};
+
 #define IP4(x) x & 0xff, (x >> 8) & 0xff, (x >> 16) & 0xff, x >> 24
 
 static void pkt_template_init_mbuf(struct pkt_template *pkt_template, struct rte_mbuf *mbuf, uint8_t *pkt)
@@ -104,6 +121,8 @@ struct task_gen {
 	uint64_t hz;
 	uint64_t link_speed;
 	struct token_time token_time;
+	struct rate_group *rate_group; /* if set, tokens are taken from the group */
+	uint64_t rate_group_batch;
 	struct local_mbuf local_mbuf;
 	struct pkt_template *pkt_template; /* packet templates used at runtime */
 	uint64_t write_duration_estimate; /* how long it took previously to write the time stamps in the packets */
@@ -135,9 +154,21 @@ struct task_gen {
 	uint64_t accur[64];
 	uint64_t pkt_tsc_offset[64];
 	struct pkt_template *pkt_template_orig; /* packet templates (from inline or from pcap) */
+	struct gen_flows *flows; /* if set, randoms are taken from the flow table */
 	struct ether_addr  src_mac;
 	uint8_t flags;
 	uint8_t cksum_offload;
+	uint32_t template_gen; /* changed whenever the templates change */
+	/* If set, the task keeps a reference to each mbuf it sends
+	   on its port. Once the PMD has completed the transmission it
+	   only drops its own reference, and the mbuf is taken back from
+	   here instead of going through the mempool. The packet data is
+	   still the one written from the template. */
+	struct rte_mbuf **recycle;
+	uint32_t recycle_mask;
+	uint32_t recycle_head;
+	uint32_t recycle_tail;
+	struct rte_mbuf *recycled[MAX_PKT_BURST];
 } __rte_cache_aligned;
 
 static inline uint8_t ipv4_get_hdr_len(struct ipv4_hdr *ip)
@@ -212,6 +243,19 @@ static void task_gen_reset_token_time(struct task_gen *task)
 	token_time_reset(&task->token_time, rte_rdtsc(), 0);
 }
 
+static void task_gen_update_tokens(struct task_gen *task)
+{
+	if (task->rate_group == NULL) {
+		token_time_update(&task->token_time, rte_rdtsc());
+		return;
+	}
+
+	/* Only go to the shared budget when the locally cached tokens
+	   run low to limit accesses to the shared cache line. */
+	if (task->token_time.bytes_now < task->rate_group_batch)
+		task->token_time.bytes_now += rate_group_take(task->rate_group, rte_rdtsc(), task->rate_group_batch);
+}
+
 static void task_gen_take_count(struct task_gen *task, uint32_t send_bulk)
 {
 	if (task->pkt_count == (uint32_t)-1)
@@ -369,6 +413,29 @@ static void task_gen_apply_all_random_fields(struct task_gen *task, uint8_t **pk
 		task_gen_apply_random_fields(task, pkt_hdr[i]);
 }
 
+static void task_gen_apply_all_flows(struct task_gen *task, uint8_t **pkt_hdr, uint32_t count)
+{
+	struct gen_flows *flows = task->flows;
+	uint32_t flow_idx[64];
+
+	if (flows->cdf) {
+		cdf_sample_n(flows->cdf, flow_idx, count);
+	} else {
+		for (uint16_t i = 0; i < count; ++i)
+			flow_idx[i] = ((random_next(&flows->rand) >> 32) * flows->n_flows) >> 32;
+	}
+
+	/* With millions of flows, the entries are not in cache. */
+	for (uint16_t i = 0; i < count; ++i)
+		PREFETCH0(flows->entries + (uint64_t)flow_idx[i] * GEN_FLOW_ENTRY_SIZE);
+
+	for (uint16_t i = 0; i < count; ++i) {
+		rte_memcpy(pkt_hdr[i] + flows->offset, flows->entries + (uint64_t)flow_idx[i] * GEN_FLOW_ENTRY_SIZE, flows->len);
+		if (flows->pkt_count)
+			flows->pkt_count[flow_idx[i]]++;
+	}
+}
+
 static void task_gen_apply_accur_pos(struct task_gen *task, uint8_t *pkt_hdr, uint32_t accuracy)
 {
 	*(uint32_t *)(pkt_hdr + task->accur_pos) = accuracy;
@@ -452,6 +519,10 @@ static void task_gen_consume_tokens(struct task_gen *task, uint32_t tokens, uint
 	   that we can (leaving a "gap" in the packet stream on the
 	   wire) */
 	task->token_time.bytes_now -= tokens;
+	/* In a rate group, other members can use the bytes we could
+	   not send. */
+	if (task->rate_group)
+		return;
 	if (send_count == task->max_bulk_size && task->token_time.bytes_now > tokens) {
 		task->token_time.bytes_now = tokens;
 	}
@@ -549,6 +620,60 @@ static void task_gen_load_and_prefetch(struct rte_mbuf **mbufs, uint8_t **pkt_hd
 		rte_prefetch0(pkt_hdr[i]);
 }
 
+/* Returns count mbufs, taking first those for which the PMD has
+   completed the transmission. */
+static struct rte_mbuf **task_gen_take_mbufs(struct task_gen *task, uint32_t count)
+{
+	struct rte_mbuf **new_pkts;
+	uint32_t n = 0;
+
+	if (!task->recycle)
+		return local_mbuf_refill_and_take(&task->local_mbuf, count);
+
+	while (n < count && task->recycle_tail != task->recycle_head) {
+		struct rte_mbuf *mbuf = task->recycle[task->recycle_tail & task->recycle_mask];
+
+		if (rte_mbuf_refcnt_read(mbuf) != 1)
+			break;
+		task->recycled[n++] = mbuf;
+		task->recycle_tail++;
+	}
+	if (n == count)
+		return task->recycled;
+
+	new_pkts = local_mbuf_refill_and_take(&task->local_mbuf, count - n);
+	if (new_pkts == NULL) {
+		/* The entries are still in place, nothing has been
+		   added since they were taken. */
+		task->recycle_tail -= n;
+		return NULL;
+	}
+	rte_memcpy(&task->recycled[n], new_pkts, (count - n) * sizeof(new_pkts[0]));
+	return task->recycled;
+}
+
+/* Keep a reference to the mbufs about to be sent so that they come
+   back to the task after the transmission. When the FIFO is full, the
+   remaining mbufs are freed to the mempool as usual. */
+static void task_gen_hold_mbufs(struct task_gen *task, struct rte_mbuf **mbufs, uint32_t count)
+{
+	if (!task->recycle)
+		return;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		if (task->recycle_head - task->recycle_tail > task->recycle_mask)
+			return;
+		rte_mbuf_refcnt_set(mbufs[i], 2);
+		task->recycle[task->recycle_head++ & task->recycle_mask] = mbufs[i];
+	}
+}
+
+static void task_gen_release_mbufs(struct task_gen *task)
+{
+	while (task->recycle_tail != task->recycle_head)
+		rte_pktmbuf_free(task->recycle[task->recycle_tail++ & task->recycle_mask]);
+}
+
 static void task_gen_build_packets(struct task_gen *task, struct rte_mbuf **mbufs, uint8_t **pkt_hdr, uint32_t count)
 {
 	uint64_t will_send_bytes = 0;
@@ -556,8 +681,23 @@ static void task_gen_build_packets(struct task_gen *task, struct rte_mbuf **mbuf
 	for (uint16_t i = 0; i < count; ++i) {
 		struct pkt_template *pktpl = &task->pkt_template[task->pkt_idx];
 		struct pkt_template *pkt_template = &task->pkt_template[task->pkt_idx];
-		pkt_template_init_mbuf(pkt_template, mbufs[i], pkt_hdr[i]);
-		mbufs[i]->udata64 = task->pkt_idx & TEMPLATE_INDEX_MASK;
+		uint64_t tag = task->pkt_idx & TEMPLATE_INDEX_MASK;
+
+		if (task->recycle) {
+			/* The mempool is owned by the task, an mbuf
+			   carrying the tag still holds the content of
+			   this template. Only the fields that change per
+			   packet will be written. */
+			tag |= (uint64_t)task->template_gen << 32;
+			if (mbufs[i]->udata64 == tag) {
+				rte_pktmbuf_pkt_len(mbufs[i]) = pkt_template->len;
+				rte_pktmbuf_data_len(mbufs[i]) = pkt_template->len;
+				init_mbuf_seg(mbufs[i]);
+			} else
+				pkt_template_init_mbuf(pkt_template, mbufs[i], pkt_hdr[i]);
+		} else
+			pkt_template_init_mbuf(pkt_template, mbufs[i], pkt_hdr[i]);
+		mbufs[i]->udata64 = tag;
 		struct ether_hdr *hdr = (struct ether_hdr *)pkt_hdr[i];
 		if (task->lat_enabled) {
 			task->pkt_tsc_offset[i] = bytes_to_tsc(task, will_send_bytes);
@@ -569,6 +709,8 @@ static void task_gen_build_packets(struct task_gen *task, struct rte_mbuf **mbuf
 
 static void task_gen_update_config(struct task_gen *task)
 {
+	if (task->rate_group)
+		return;
 	if (task->token_time.cfg.bpp != task->new_rate_bps)
 		task_gen_reset_token_time(task);
 }
@@ -662,10 +804,10 @@ static int handle_gen_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 		task_gen_reset_token_time(task);
 		return 0;
 	}
-	if (!task->token_time.cfg.bpp)
+	if (task->rate_group? !task->rate_group->bps : !task->token_time.cfg.bpp)
 		return 0;
 
-	token_time_update(&task->token_time, rte_rdtsc());
+	task_gen_update_tokens(task);
 
 	uint32_t would_send_bytes;
 	uint32_t send_bulk = task_gen_calc_send_bulk(task, &would_send_bytes);
@@ -675,14 +817,17 @@ static int handle_gen_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 	task_gen_take_count(task, send_bulk);
 	task_gen_consume_tokens(task, would_send_bytes, send_bulk);
 
-	struct rte_mbuf **new_pkts = local_mbuf_refill_and_take(&task->local_mbuf, send_bulk);
+	struct rte_mbuf **new_pkts = task_gen_take_mbufs(task, send_bulk);
 	if (new_pkts == NULL)
 		return 0;
 	uint8_t *pkt_hdr[MAX_RING_BURST];
 
 	task_gen_load_and_prefetch(new_pkts, pkt_hdr, send_bulk);
 	task_gen_build_packets(task, new_pkts, pkt_hdr, send_bulk);
-	task_gen_apply_all_random_fields(task, pkt_hdr, send_bulk);
+	if (task->flows)
+		task_gen_apply_all_flows(task, pkt_hdr, send_bulk);
+	else
+		task_gen_apply_all_random_fields(task, pkt_hdr, send_bulk);
 	task_gen_apply_all_accur_pos(task, new_pkts, pkt_hdr, send_bulk);
 	task_gen_apply_all_sig(task, new_pkts, pkt_hdr, send_bulk);
 	task_gen_apply_all_unique_id(task, new_pkts, pkt_hdr, send_bulk);
@@ -691,6 +836,7 @@ static int handle_gen_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 
 	tsc_before_tx = task_gen_write_latency(task, pkt_hdr, send_bulk);
 	task_gen_checksum_packets(task, new_pkts, pkt_hdr, send_bulk);
+	task_gen_hold_mbufs(task, new_pkts, send_bulk);
 	ret = task->base.tx_pkt(&task->base, new_pkts, send_bulk, out);
 	task_gen_store_accuracy(task, send_bulk, tsc_before_tx);
 	return ret;
@@ -1008,6 +1154,7 @@ int task_gen_set_pkt_size(struct task_base *tbase, uint32_t pkt_size)
 	int rc;
 
 	task->pkt_template[0].len = pkt_size;
+	task->template_gen++;
 	if ((rc = check_all_pkt_size(task, 0)) != 0)
 		return rc;
 	check_fields_in_bounds(task);
@@ -1018,7 +1165,19 @@ void task_gen_set_rate(struct task_base *tbase, uint64_t bps)
 {
 	struct task_gen *task = (struct task_gen *)tbase;
 
-	task->new_rate_bps = bps;
+	if (task->rate_group)
+		rate_group_set_rate(task->rate_group, bps);
+	else
+		task->new_rate_bps = bps;
+}
+
+uint64_t task_gen_get_max_rate(struct task_base *tbase)
+{
+	struct task_gen *task = (struct task_gen *)tbase;
+
+	if (task->rate_group)
+		return (uint64_t)task->rate_group->n_members * 1250000000;
+	return 1250000000;
 }
 
 void task_gen_reset_randoms(struct task_base *tbase)
@@ -1031,6 +1190,7 @@ void task_gen_reset_randoms(struct task_base *tbase)
 		task->rand[i].rand_offset = 0;
 	}
 	task->n_rands = 0;
+	task->template_gen++;
 }
 
 int task_gen_set_value(struct task_base *tbase, uint32_t value, uint32_t offset, uint32_t len)
@@ -1045,6 +1205,7 @@ int task_gen_set_value(struct task_base *tbase, uint32_t value, uint32_t offset,
 	}
 
 	task_gen_pkt_template_recalc_all(task);
+	task->template_gen++;
 
 	return 0;
 }
@@ -1054,6 +1215,7 @@ void task_gen_reset_values(struct task_base *tbase)
 	struct task_gen *task = (struct task_gen *)tbase;
 
 	task_gen_reset_pkt_templates_content(task);
+	task->template_gen++;
 }
 
 uint32_t task_gen_get_n_randoms(struct task_base *tbase)
@@ -1119,6 +1281,10 @@ int task_gen_add_rand(struct task_base *tbase, const char *rand_str, uint32_t of
 	struct task_gen *task = (struct task_gen *)tbase;
 	uint32_t existing_rand;
 
+	if (task->flows) {
+		plog_err("Randoms are part of the flow table and can't be changed at runtime\n");
+		return -1;
+	}
 	if (rand_id == UINT32_MAX && task->n_rands == 64) {
 		plog_err("Too many randoms\n");
 		return -1;
@@ -1157,6 +1323,8 @@ static void start(struct task_base *tbase)
 	task->pkt_queue_index = 0;
 
 	task_gen_reset_token_time(task);
+	if (task->rate_group)
+		rate_group_start(task->rate_group);
 	if (tbase->l3.tmaster) {
 		register_all_ip_to_ctrl_plane(task);
 	}
@@ -1170,6 +1338,15 @@ static void start(struct task_base *tbase)
 	*/
 }
 
+static void stop(struct task_base *tbase)
+{
+	struct task_gen *task = (struct task_gen *)tbase;
+
+	if (task->rate_group)
+		rate_group_stop(task->rate_group);
+	task_gen_release_mbufs(task);
+}
+
 static void start_pcap(struct task_base *tbase)
 {
 	struct task_gen_pcap *task = (struct task_gen_pcap *)tbase;
@@ -1190,6 +1367,175 @@ static void init_task_gen_early(struct task_args *targ)
 	(*generator_count)++;
 }
 
+static uint32_t flow_weights_load(const char *file_name, uint32_t **weights)
+{
+	char line[64];
+	uint32_t n = 0, max = 1024;
+	uint32_t *w;
+	FILE *f;
+
+	f = fopen(file_name, "r");
+	PROX_PANIC(f == NULL, "Failed to open flow weights file %s\n", file_name);
+	w = malloc(max * sizeof(*w));
+	PROX_PANIC(w == NULL, "Failed to allocate flow weights\n");
+
+	/* One weight per line, for example the number of packets
+	   seen for each flow in a capture. */
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (n == max) {
+			max *= 2;
+			w = realloc(w, max * sizeof(*w));
+			PROX_PANIC(w == NULL, "Failed to allocate flow weights\n");
+		}
+		w[n++] = strtoul(line, NULL, 0);
+	}
+	fclose(f);
+	*weights = w;
+	return n;
+}
+
+static void init_task_gen_flows(struct task_gen *task, struct task_args *targ)
+{
+	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
+	uint32_t *weights = NULL;
+	uint32_t n_flows = targ->n_gen_flows;
+	uint16_t first = UINT16_MAX, last = 0;
+	uint32_t n_bits = 0;
+
+	PROX_PANIC(task->n_rands == 0, "Flows require at least one random field\n");
+	for (uint32_t i = 0; i < task->n_rands; ++i) {
+		if (task->rand[i].rand_offset < first)
+			first = task->rand[i].rand_offset;
+		if (task->rand[i].rand_offset + task->rand[i].rand_len > last)
+			last = task->rand[i].rand_offset + task->rand[i].rand_len;
+		n_bits += __builtin_popcount(task->rand[i].rand_mask);
+	}
+	PROX_PANIC(last - first > GEN_FLOW_ENTRY_SIZE, "Random fields must fit within %u bytes to be used as flows (now %u)\n", GEN_FLOW_ENTRY_SIZE, last - first);
+	PROX_PANIC(last > task->pkt_template[0].len, "Random fields beyond packet size\n");
+	if (task->n_pkts > 1)
+		plog_warn("\tFlow bytes not covered by randoms are taken from the first packet\n");
+
+	if (!strcmp(targ->flow_distr, "replay")) {
+		uint32_t n_weights = flow_weights_load(targ->flow_weights_file, &weights);
+
+		PROX_PANIC(n_weights == 0, "No weights in %s\n", targ->flow_weights_file);
+		if (n_flows == 0 || n_flows > n_weights)
+			n_flows = n_weights;
+	} else {
+		PROX_PANIC(strcmp(targ->flow_distr, "") && strcmp(targ->flow_distr, "uniform") && strcmp(targ->flow_distr, "zipf"),
+			   "Unknown flow distribution %s, should be uniform, zipf or replay\n", targ->flow_distr);
+	}
+	if (n_bits < 32 && n_flows > (1U << n_bits))
+		plog_warn("\tOnly %u random bits for %u flows, some flows will be identical\n", n_bits, n_flows);
+
+	task->flows = prox_zmalloc(sizeof(*task->flows), socket_id);
+	PROX_PANIC(task->flows == NULL, "Failed to allocate flows\n");
+	struct gen_flows *flows = task->flows;
+
+	flows->n_flows = n_flows;
+	flows->offset = first;
+	flows->len = last - first;
+	random_init_seed(&flows->rand);
+	flows->entries = prox_zmalloc((uint64_t)n_flows * GEN_FLOW_ENTRY_SIZE, socket_id);
+	PROX_PANIC(flows->entries == NULL, "Failed to allocate %u flows\n", n_flows);
+	if (targ->flow_counters) {
+		flows->pkt_count = prox_zmalloc((uint64_t)n_flows * sizeof(uint64_t), socket_id);
+		PROX_PANIC(flows->pkt_count == NULL, "Failed to allocate flow counters\n");
+	}
+
+	/* Randoms are generated once per flow instead of once per
+	   packet. Bytes in between random fields keep the value from
+	   the template. */
+	uint8_t buf[ETHER_MAX_LEN];
+
+	rte_memcpy(buf, task->pkt_template[0].buf, task->pkt_template[0].len);
+	for (uint32_t i = 0; i < n_flows; ++i) {
+		task_gen_apply_random_fields(task, buf);
+		rte_memcpy(flows->entries + (uint64_t)i * GEN_FLOW_ENTRY_SIZE, buf + first, flows->len);
+	}
+
+	if (weights) {
+		flows->cdf = cdf_create(n_flows, socket_id);
+		PROX_PANIC(flows->cdf == NULL, "Failed to allocate flow distribution\n");
+		for (uint32_t i = 0; i < n_flows; ++i) {
+			/* Keep every flow reachable */
+			cdf_add(flows->cdf, weights[i]? weights[i] : 1);
+		}
+		PROX_PANIC(cdf_setup(flows->cdf), "Failed to setup flow distribution\n");
+	} else if (!strcmp(targ->flow_distr, "zipf")) {
+		double s = targ->flow_zipf_s? targ->flow_zipf_s : 1.0;
+
+		flows->cdf = cdf_create_zipf(n_flows, s, socket_id);
+		PROX_PANIC(flows->cdf == NULL, "Failed to setup zipf flow distribution\n");
+	}
+	plog_info("\t%u flows (%s), %u bytes at offset %u\n", n_flows,
+		  weights? "replay" : flows->cdf? "zipf" : "uniform", flows->len, flows->offset);
+	free(weights);
+}
+
+int task_gen_dump_flow_counts(struct task_base *tbase, const char *file_name)
+{
+	struct task_gen *task = (struct task_gen *)tbase;
+	struct gen_flows *flows = task->flows;
+	FILE *f;
+
+	if (flows == NULL || flows->pkt_count == NULL) {
+		plog_err("Flow counters not enabled\n");
+		return -1;
+	}
+	f = fopen(file_name, "w");
+	if (f == NULL) {
+		plog_err("Failed to open %s\n", file_name);
+		return -1;
+	}
+	fprintf(f, "# flow,packets,bytes at offset %u\n", flows->offset);
+	for (uint32_t i = 0; i < flows->n_flows; ++i) {
+		const uint8_t *entry = flows->entries + (uint64_t)i * GEN_FLOW_ENTRY_SIZE;
+
+		fprintf(f, "%u,%"PRIu64",", i, flows->pkt_count[i]);
+		for (uint16_t j = 0; j < flows->len; ++j)
+			fprintf(f, "%02x", entry[j]);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return 0;
+}
+
+static void init_task_gen_recycle(struct task_gen *task, struct task_args *targ)
+{
+	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
+	uint32_t n;
+	uint8_t port_id;
+
+	/* In L3 mode, mbufs can be handed to the master which changes
+	   their content. Through rings, the mbufs would be freed on
+	   other cores. */
+	if (targ->nb_txrings || targ->nb_txports != 1 || (targ->task_init->flag_features & TASK_FEATURE_L3)) {
+		plog_warn("mbuf recycle requires a single tx port and no l3 submode, disabling it on core %u task %u\n",
+			  targ->lconf->id, targ->id);
+		return;
+	}
+	port_id = targ->tx_port_queue[0].port;
+
+	/* Enough room for all mbufs owned by the TX descriptors
+	   plus the bursts waiting for a descriptor. */
+	n = rte_align32pow2(prox_port_cfg[port_id].n_txd + 2 * MAX_PKT_BURST);
+	PROX_PANIC(n + LOCAL_MBUF_COUNT > targ->nb_mbuf - 1,
+		   "mbuf recycle needs a mempool of at least %u mbufs on core %u task %u\n",
+		   n + LOCAL_MBUF_COUNT + 1, targ->lconf->id, targ->id);
+
+	task->recycle = prox_zmalloc(n * sizeof(task->recycle[0]), socket_id);
+	PROX_PANIC(task->recycle == NULL, "Failed to allocate mbuf recycle FIFO\n");
+	task->recycle_mask = n - 1;
+
+	/* The PMD must honor the reference count when freeing
+	   transmitted mbufs. */
+	prox_port_cfg[port_id].tx_conf.txq_flags &= ~ETH_TXQ_FLAGS_NOREFCOUNT;
+	plog_info("\tRecycling up to %u transmitted mbufs on port %u\n", n, port_id);
+}
+
 static void init_task_gen(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_gen *task = (struct task_gen *)tbase;
@@ -1249,11 +1595,26 @@ static void init_task_gen(struct task_base *tbase, struct task_args *targ)
 		PROX_PANIC(task_gen_add_rand(tbase, targ->rand_str[i], targ->rand_offset[i], UINT32_MAX),
 			   "Failed to add random\n");
 	}
+	if (targ->n_gen_flows || !strcmp(targ->flow_distr, "replay"))
+		init_task_gen_flows(task, targ);
 
 	struct prox_port_cfg *port = find_reachable_port(targ);
 	if (port) {
 		task->cksum_offload = port->capabilities.tx_offload_cksum;
 	}
+
+	task->template_gen = 1;
+	if (targ->flags & TASK_ARG_MBUF_RECYCLE)
+		init_task_gen_recycle(task, targ);
+
+	if (strcmp(targ->rate_group, "")) {
+		/* Each member caches at most one bulk of maximum
+		   sized packets taken from the group. */
+		task->rate_group_batch = task->max_bulk_size * (ETHER_MAX_LEN + 20);
+		task->rate_group = rate_group_join(targ->rate_group, targ->rate_bps, task->rate_group_batch,
+						   rte_lcore_to_socket_id(targ->lconf->id));
+		PROX_PANIC(task->rate_group == NULL, "Failed to join rate group %s\n", targ->rate_group);
+	}
 }
 
 static struct task_init task_init_gen = {
@@ -1261,6 +1622,7 @@ static struct task_init task_init_gen = {
 	.init = init_task_gen,
 	.handle = handle_gen_bulk,
 	.start = start,
+	.stop = stop,
 #ifdef SOFT_CRC
 	// For SOFT_CRC, no offload is needed. If both NOOFFLOADS and NOMULTSEGS flags are set the
 	// vector mode is used by DPDK, resulting (theoretically) in higher performance.
@@ -1277,6 +1639,7 @@ static struct task_init task_init_gen_l3 = {
 	.init = init_task_gen,
 	.handle = handle_gen_bulk,
 	.start = start,
+	.stop = stop,
 #ifdef SOFT_CRC
 	// For SOFT_CRC, no offload is needed. If both NOOFFLOADS and NOMULTSEGS flags are set the
 	// vector mode is used by DPDK, resulting (theoretically) in higher performance.
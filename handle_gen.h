@@ -55,10 +55,12 @@ struct task_base;
 void task_gen_set_pkt_count(struct task_base *tbase, uint32_t count);
 int task_gen_set_pkt_size(struct task_base *tbase, uint32_t pkt_size);
 void task_gen_set_rate(struct task_base *tbase, uint64_t bps);
+uint64_t task_gen_get_max_rate(struct task_base *tbase);
 void task_gen_reset_randoms(struct task_base *tbase);
 void task_gen_reset_values(struct task_base *tbase);
 int task_gen_set_value(struct task_base *tbase, uint32_t value, uint32_t offset, uint32_t len);
 int task_gen_add_rand(struct task_base *tbase, const char *rand_str, uint32_t offset, uint32_t rand_id);
+int task_gen_dump_flow_counts(struct task_base *tbase, const char *file_name);
 
 uint32_t task_gen_get_n_randoms(struct task_base *tbase);
 uint32_t task_gen_get_n_values(struct task_base *tbase);
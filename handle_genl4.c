@@ -41,6 +41,10 @@
 #include <rte_tcp.h>
 #include <rte_hash.h>
 #include <rte_hash_crc.h>
+#include <rte_memzone.h>
+#if RTE_VERSION >= RTE_VERSION_NUM(17,11,0,0)
+#include <rte_gso.h>
+#endif
 
 #include "prox_lua.h"
 #include "prox_lua_types.h"
@@ -63,11 +67,11 @@
 #include "genl4_bundle.h"
 #include "genl4_stream_udp.h"
 #include "genl4_stream_tcp.h"
-#include "cdf.h"
 #include "fqueue.h"
 #include "token_time.h"
 #include "commands.h"
 #include "prox_shared.h"
+#include "prox_cksum.h"
 
 #if RTE_VERSION < RTE_VERSION_NUM(1,8,0,0)
 #define RTE_CACHE_LINE_SIZE CACHE_LINE_SIZE
@@ -82,6 +86,17 @@ struct new_tuple {
 
 enum handle_state {HANDLE_QUEUED, HANDLE_SCHEDULED};
 
+/* Super-frames built when "large segments" is set are cut into MSS
+   sized packets by the NIC if it supports TSO. Otherwise, they are
+   segmented in software right before TX. */
+struct genl4_gso {
+#if RTE_VERSION >= RTE_VERSION_NUM(17,11,0,0)
+	struct rte_gso_ctx ctx;
+#endif
+	uint8_t enabled;
+	int cksum_offload;
+};
+
 struct task_gen_server {
 	struct task_base base;
 	struct l4_stats l4_stats;
@@ -107,6 +122,7 @@ struct task_gen_server {
 	/* Handle scheduled events */
 	struct rte_mbuf *new_mbufs[MAX_PKT_BURST];
 	uint32_t n_new_mbufs;
+	struct genl4_gso gso;
 };
 
 struct task_gen_client {
@@ -123,11 +139,66 @@ struct task_gen_client {
 	uint64_t new_conn_last_tsc;
 	uint32_t n_new_mbufs;
 	uint64_t last_tsc;
-	struct cdf *cdf;
 	unsigned seed;
 	struct heap *heap;
+	struct genl4_gso gso;
 };
 
+#if RTE_VERSION >= RTE_VERSION_NUM(17,11,0,0)
+static int genl4_tx_gso(struct task_base *tbase, struct genl4_gso *gso, struct rte_mbuf **mbufs, uint16_t n_pkts, uint8_t *out)
+{
+	struct rte_mbuf *segs[MAX_PKT_BURST];
+	uint8_t segs_out[MAX_PKT_BURST];
+	uint16_t n_segs = 0;
+	int ret = 0;
+
+	for (uint16_t j = 0; j < n_pkts; ++j) {
+		struct rte_mbuf *mbuf = mbufs[j];
+		int n = 1;
+
+		if (n_segs + GENL4_MAX_TSO_SEGS > MAX_PKT_BURST) {
+			ret |= tbase->tx_pkt(tbase, segs, n_segs, segs_out);
+			n_segs = 0;
+		}
+
+		segs[n_segs] = mbuf;
+		segs_out[n_segs] = out[j];
+		if (out[j] == 0 && (mbuf->ol_flags & PKT_TX_TCP_SEG)) {
+			gso->ctx.gso_size = mbuf->l2_len + mbuf->l3_len + mbuf->l4_len + mbuf->tso_segsz;
+			n = rte_gso_segment(mbuf, &gso->ctx, segs + n_segs, MAX_PKT_BURST - n_segs);
+			if (n < 0) {
+				plogx_dbg("Failed to segment super-frame\n");
+				segs_out[n_segs++] = OUT_DISCARD;
+				continue;
+			}
+			/* The generated headers are copies of the
+			   super-frame header, except for the IP length
+			   and id and for the TCP sequence number. */
+			for (int k = 0; k < n; ++k) {
+				struct rte_mbuf *seg = segs[n_segs + k];
+				struct ipv4_hdr *ip = rte_pktmbuf_mtod_offset(seg, struct ipv4_hdr *, seg->l2_len);
+
+				seg->ol_flags = 0;
+				prox_ip_cksum(seg, ip, seg->l2_len, seg->l3_len, gso->cksum_offload & IPV4_CKSUM);
+				segs_out[n_segs + k] = 0;
+			}
+		}
+		n_segs += n;
+	}
+
+	return ret | tbase->tx_pkt(tbase, segs, n_segs, segs_out);
+}
+#endif
+
+static int genl4_tx(struct task_base *tbase, struct genl4_gso *gso, struct rte_mbuf **mbufs, uint16_t n_pkts, uint8_t *out)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(17,11,0,0)
+	if (unlikely(gso->enabled))
+		return genl4_tx_gso(tbase, gso, mbufs, n_pkts, out);
+#endif
+	return tbase->tx_pkt(tbase, mbufs, n_pkts, out);
+}
+
 static int refill_mbufs(uint32_t *n_new_mbufs, struct rte_mempool *mempool, struct rte_mbuf **mbufs)
 {
 	if (*n_new_mbufs == MAX_PKT_BURST)
@@ -202,7 +273,7 @@ static int handle_gen_bulk_client(struct task_base *tbase, struct rte_mbuf **mbu
 			ret = bundle_proc_data(conn, mbufs[i], &l4_meta, &task->bundle_ctx_pool, &task->seed, &task->l4_stats);
 			out[i] = ret == 0? 0: OUT_HANDLED;
 		}
-		task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+		genl4_tx(&task->base, &task->gso, mbufs, n_pkts, out);
 	}
 
 	/* If there is at least one callback to handle, handle at most MAX_PKT_BURST */
@@ -224,7 +295,7 @@ static int handle_gen_bulk_client(struct task_base *tbase, struct rte_mbuf **mbu
 		}
 		plogx_dbg("During callback, will send %d packets\n", n_called_back);
 
-		task->base.tx_pkt(&task->base, task->new_mbufs, n_called_back, out);
+		genl4_tx(&task->base, &task->gso, task->new_mbufs, n_called_back, out);
 		task->n_new_mbufs -= n_called_back;
 	}
 
@@ -292,7 +363,7 @@ static int handle_gen_bulk_client(struct task_base *tbase, struct rte_mbuf **mbu
 		out[i] = ret == 0? 0: OUT_HANDLED;
 	}
 
-	int ret2 = task->base.tx_pkt(&task->base, task->new_mbufs, n_new, out);
+	int ret2 = genl4_tx(&task->base, &task->gso, task->new_mbufs, n_new, out);
 	task->n_new_mbufs -= n_new;
 	return ret2;
 }
@@ -395,7 +466,7 @@ static int handle_gen_queued(struct task_gen_server *task)
 				if (token_time_take(&task->token_time, pkt_len) != 0) {
 					task->out_saved = out[j];
 					task->cancelled = 1;
-					task->base.tx_pkt(&task->base, mbufs, j, out);
+					genl4_tx(&task->base, &task->gso, mbufs, j, out);
 					task->cur_mbufs_beg += j;
 					return -1;
 				}
@@ -408,7 +479,7 @@ static int handle_gen_queued(struct task_gen_server *task)
 		}
 	}
 
-	task->base.tx_pkt(&task->base, mbufs, j, out);
+	genl4_tx(&task->base, &task->gso, mbufs, j, out);
 
 	task->cur_mbufs_beg += j;
 	return 0;
@@ -428,7 +499,7 @@ static int handle_gen_scheduled(struct task_gen_server *task)
 		if (token_time_take(&task->token_time, pkt_len) == 0) {
 			task->cancelled = 0;
 			out[0] = 0;
-			task->base.tx_pkt(&task->base, &mbuf, 1, out);
+			genl4_tx(&task->base, &task->gso, &mbuf, 1, out);
 		}
 		else {
 			return -1;
@@ -462,7 +533,7 @@ static int handle_gen_scheduled(struct task_gen_server *task)
 				task->out_saved = 0;
 				task->cancelled = 1;
 				task->mbuf_saved = mbuf;
-				task->base.tx_pkt(&task->base, task->new_mbufs, n_called_back, out);
+				genl4_tx(&task->base, &task->gso, task->new_mbufs, n_called_back, out);
 				/* The mbuf that is currently been
 				   processed (and which has been
 				   cancelled) is saved in
@@ -475,7 +546,7 @@ static int handle_gen_scheduled(struct task_gen_server *task)
 		}
 	}
 
-	task->base.tx_pkt(&task->base, task->new_mbufs, n_called_back, out);
+	genl4_tx(&task->base, &task->gso, task->new_mbufs, n_called_back, out);
 	task->n_new_mbufs -= n_called_back;
 
 	return 0;
@@ -761,6 +832,23 @@ static int lua_to_stream_cfg(struct lua_State *L, enum lua_place from, const cha
 		}
 
 		ret->tsc_timeout_time_wait = usec_to_tsc(timeout_time_wait_us);
+
+		/* Send window: starts at init_window segments and
+		   grows up to window bytes. */
+		uint32_t rto_min_us;
+
+		if (lua_to_int(L, TABLE, "init_window", &ret->init_window))
+			ret->init_window = 10;
+		if (lua_to_int(L, TABLE, "window", &ret->window))
+			ret->window = 300000;
+		if (lua_to_int(L, TABLE, "rto_min", &rto_min_us))
+			rto_min_us = 1000;
+		PROX_PANIC(ret->init_window == 0, "init_window must be at least 1 segment\n");
+
+		ret->tsc_rto_min = usec_to_tsc(rto_min_us);
+		while ((ret->window >> ret->window_scale) > 0xffff)
+			ret->window_scale++;
+		PROX_PANIC(ret->window_scale > 14, "TCP window of %u bytes is too big\n", ret->window);
 	}
 	else if (!strcmp(proto, "udp")) {
 		plogx_dbg("loading UDP\n");
@@ -853,21 +941,227 @@ static int lua_to_bundle_cfg(struct lua_State *L, enum lua_place from, const cha
 	return 0;
 }
 
+/* With large segments, TCP streams send super-frames of up to
+   GENL4_MAX_TSO_SEGS segments. Each stream's token bucket holds about
+   50us worth of data so that a super-frame is not limited to a single
+   MSS by the size of the bucket. */
+static void bundle_cfgs_set_large_segments(struct bundle_cfg *bundle_cfgs, uint32_t n_bundle_cfgs)
+{
+	const uint64_t max_bytes = GENL4_MAX_TSO_SEGS * (ETHER_MAX_LEN + 20);
+	const uint64_t tsc_burst = usec_to_tsc(50);
+
+	for (uint32_t i = 0; i < n_bundle_cfgs; ++i) {
+		for (uint32_t j = 0; j < bundle_cfgs[i].n_stream_cfgs; ++j) {
+			struct stream_cfg *cfg = bundle_cfgs[i].stream_cfgs[j];
+
+			if (cfg->proto != IPPROTO_TCP)
+				continue;
+			cfg->large_segments = 1;
+			for (int p = 0; p < 2; ++p) {
+				struct token_time_cfg *tt_cfg = &cfg->tt_cfg[p];
+				uint64_t bytes = tt_cfg->bpp * tsc_burst / tt_cfg->period;
+
+				if (bytes < ETHER_MAX_LEN + 20)
+					bytes = ETHER_MAX_LEN + 20;
+				tt_cfg->bytes_max = bytes > max_bytes? max_bytes : bytes;
+			}
+		}
+	}
+}
+
+/* Zero copy payloads and the indirect mbufs built by software GSO
+   can only be freed through the refcount aware path of the PMD. The
+   TX queues are set up after the tasks are initialized, so it is
+   enough to clear ETH_TXQ_FLAGS_NOREFCOUNT here. */
+static void genl4_tx_use_refcount(struct task_args *targ)
+{
+	for (uint8_t i = 0; i < targ->nb_txports; ++i) {
+		uint8_t port_id = targ->tx_port_queue[i].port;
+
+		if (prox_port_cfg[port_id].tx_conf.txq_flags & ETH_TXQ_FLAGS_NOREFCOUNT) {
+			prox_port_cfg[port_id].tx_conf.txq_flags &= ~ETH_TXQ_FLAGS_NOREFCOUNT;
+			plog_info("\tRefcnt used on port %u\n", port_id);
+		}
+	}
+}
+
+/* Use TSO if the TX port supports it. Otherwise, or when
+   transmitting to a ring, super-frames are segmented in software. */
+static void init_large_segments(struct genl4_gso *gso, struct task_args *targ, struct rte_mempool *direct_pool, uint32_t socket)
+{
+	if (targ->nb_txports) {
+		struct prox_port_cfg *port = &prox_port_cfg[targ->tx_port_queue[0].port];
+
+		if (port->capabilities.tx_offload_tso) {
+			plog_info("\tUsing TSO on port %s for large segments\n", port->name);
+			return;
+		}
+		gso->cksum_offload = port->capabilities.tx_offload_cksum;
+		genl4_tx_use_refcount(targ);
+	}
+#if RTE_VERSION >= RTE_VERSION_NUM(17,11,0,0)
+	static char name[] = "gso_pool";
+	name[0]++;
+
+	gso->ctx.direct_pool = direct_pool;
+	gso->ctx.indirect_pool = rte_pktmbuf_pool_create(name, 16*1024 - 1, targ->nb_cache_mbuf, 0, 0, socket);
+	PROX_PANIC(gso->ctx.indirect_pool == NULL, "Failed to create indirect mbuf pool for large segments\n");
+	gso->ctx.gso_types = DEV_TX_OFFLOAD_TCP_TSO;
+	gso->ctx.flag = 0;
+	gso->enabled = 1;
+	plog_info("\tNo TSO support on TX, large segments are segmented in software\n");
+#else
+	PROX_PANIC(1, "Large segments without TSO support on TX require DPDK 17.11 or later\n");
+#endif
+}
+
+#if RTE_VERSION >= RTE_VERSION_NUM(18,5,0,0)
+/* Pinned copy of stream content, shared by all tasks on a socket */
+struct genl4_pinned_content {
+	uint8_t *addr;
+	rte_iova_t iova;
+};
+
+/* Length of the content referenced by the actions of a peer */
+static uint32_t stream_cfg_content_len(const struct stream_cfg *cfg, enum l4gen_peer peer)
+{
+	uint32_t len = 0;
+
+	for (uint32_t i = 0; i < cfg->n_actions; ++i) {
+		const struct peer_action *act = &cfg->actions[i];
+
+		if (act->peer == peer && act->beg + act->len > len)
+			len = act->beg + act->len;
+	}
+	return len;
+}
+
+static void genl4_content_free_cb(void *addr, void *opaque)
+{
+	/* Content is never freed, the stream keeps a reference */
+}
+
+static struct genl4_pinned_content *content_pin(const uint8_t *content, uint32_t len, uint32_t socket)
+{
+	static uint32_t n_pinned;
+	char name[64];
+	struct genl4_pinned_content *pinned;
+
+	snprintf(name, sizeof(name), "genl4_pinned_%p_%u", content, len);
+	pinned = prox_sh_find_socket(socket, name);
+	if (pinned)
+		return pinned;
+
+	char mz_name[RTE_MEMZONE_NAMESIZE];
+	snprintf(mz_name, sizeof(mz_name), "genl4_content_%u", n_pinned++);
+	const struct rte_memzone *mz = rte_memzone_reserve_aligned(mz_name, len, socket, RTE_MEMZONE_IOVA_CONTIG, RTE_CACHE_LINE_SIZE);
+	PROX_PANIC(mz == NULL, "Failed to reserve %u bytes of IOVA contiguous memory for zero copy content\n", len);
+	rte_memcpy(mz->addr, content, len);
+
+	pinned = prox_zmalloc(sizeof(*pinned), socket);
+	PROX_PANIC(pinned == NULL, "Failed to allocate memory for pinned content\n");
+	pinned->addr = mz->addr;
+	pinned->iova = mz->iova;
+	prox_sh_add_socket(socket, name, pinned);
+	return pinned;
+}
+#endif
+
+/* In zero copy mode, payloads are attached to packets from IOVA
+   contiguous copies of the stream content. Each stream cfg has its
+   own reference count on the content (held in the shared info) so
+   that tasks do not share a cache line while transmitting. */
+static void bundle_cfgs_set_zero_copy(struct bundle_cfg *bundle_cfgs, uint32_t n_bundle_cfgs, struct task_args *targ, uint32_t socket)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(18,5,0,0)
+	static char name[] = "ext_pool";
+	struct rte_mempool *ext_pool;
+
+	PROX_PANIC(targ->nb_txports == 0, "Zero copy requires transmitting to a port\n");
+	genl4_tx_use_refcount(targ);
+	name[0]++;
+	/* The size of the pool also keeps the number of references
+	   on a content within the 16 bit reference counter. */
+	ext_pool = rte_pktmbuf_pool_create(name, 16*1024 - 1, targ->nb_cache_mbuf, 0, 0, socket);
+	PROX_PANIC(ext_pool == NULL, "Failed to create mbuf pool for zero copy\n");
+
+	for (uint32_t i = 0; i < n_bundle_cfgs; ++i) {
+		for (uint32_t j = 0; j < bundle_cfgs[i].n_stream_cfgs; ++j) {
+			struct stream_cfg *cfg = bundle_cfgs[i].stream_cfgs[j];
+
+			if (cfg->ext_pool)
+				continue;
+			for (int p = 0; p < 2; ++p) {
+				struct peer_data *data = &cfg->data[p];
+				uint32_t len = stream_cfg_content_len(cfg, p);
+
+				if (data->content == NULL || len == 0)
+					continue;
+
+				struct genl4_pinned_content *pinned = content_pin(data->content, len, socket);
+
+				data->content_shinfo = prox_zmalloc(sizeof(*data->content_shinfo), socket);
+				PROX_PANIC(data->content_shinfo == NULL, "Failed to allocate shared info for zero copy\n");
+				data->content_shinfo->free_cb = genl4_content_free_cb;
+				rte_mbuf_ext_refcnt_set(data->content_shinfo, 1);
+				data->content = pinned->addr;
+				data->content_iova = pinned->iova;
+			}
+			cfg->ext_pool = ext_pool;
+		}
+	}
+#else
+	PROX_PANIC(1, "Zero copy requires DPDK 18.05 or later\n");
+#endif
+}
+
+static void bundle_cfgs_set_steering(struct bundle_cfg *bundle_cfgs, uint32_t n_bundle_cfgs, struct task_args *targ, uint32_t socket)
+{
+	struct bundle_steer *steer = prox_zmalloc(sizeof(*steer), socket);
+
+	PROX_PANIC(steer == NULL, "Failed to allocate steering table\n");
+
+	/* With a load balancer in front, the worker is selected by
+	   lbpos in rss mode. Otherwise, replies are spread over the RX
+	   queues by the NIC. */
+	if (targ->nb_slave_threads) {
+		steer->n_queues = targ->nb_slave_threads;
+		steer->queue = targ->worker_thread_id;
+	} else if (targ->nb_rxports) {
+		steer->n_queues = prox_port_cfg[targ->rx_port_queue[0].port].n_rxq;
+		steer->queue = targ->rx_port_queue[0].queue;
+	}
+	PROX_PANIC(steer->n_queues == 0, "RSS steering needs an RX port or a load balancer\n");
+	if (!rte_is_power_of_2(steer->n_queues))
+		plog_warn("\t\t%u queues is not a power of 2, replies might not match the NIC redirection table\n", steer->n_queues);
+	plog_info("\t\tSteering replies to queue %u out of %u\n", steer->queue, steer->n_queues);
+
+	toeplitz_tbl_init(&steer->tbl);
+	for (uint32_t i = 0; i < n_bundle_cfgs; ++i) {
+		if (bundle_cfgs[i].clients.port_mask == 0 && bundle_cfgs[i].n_stream_cfgs > 1)
+			plog_warn("\t\tClient port is fixed, only the first stream of bundle %u is steered\n", i);
+		bundle_cfgs[i].steer = steer;
+	}
+}
+
 static void init_task_gen(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_gen_server *task = (struct task_gen_server *)tbase;
 	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
 
+	/* Super-frames chain additional mbufs */
+	const uint32_t n_mbufs = targ->large_segments? 16*1024 - 1 : 4*1024 - 1;
+
 	static char name[] = "server_mempool";
 	name[0]++;
 	task->mempool = rte_mempool_create(name,
-					   4*1024 - 1, MBUF_SIZE,
+					   n_mbufs, MBUF_SIZE,
 					   targ->nb_cache_mbuf,
 					   sizeof(struct rte_pktmbuf_pool_private),
 					   rte_pktmbuf_pool_init, NULL,
 					   rte_pktmbuf_init, 0,
 					   socket_id, 0);
-	PROX_PANIC(task->mempool == NULL, "Failed to allocate memory pool with %u elements\n", 4*1024 - 1);
+	PROX_PANIC(task->mempool == NULL, "Failed to allocate memory pool with %u elements\n", n_mbufs);
 	int pop = lua_getfrom(prox_lua(), GLOBAL, targ->streams);
 	PROX_PANIC(pop < 0, "Failed to find '%s' in lua\n", targ->streams);
 
@@ -928,6 +1222,13 @@ static void init_task_gen(struct task_base *tbase, struct task_args *targ)
 		lua_pop(prox_lua(), 1);
 	}
 
+	if (targ->large_segments) {
+		bundle_cfgs_set_large_segments(task->bundle_cfgs, n_listen);
+		init_large_segments(&task->gso, targ, task->mempool, socket_id);
+	}
+	if (targ->zero_copy)
+		bundle_cfgs_set_zero_copy(task->bundle_cfgs, n_listen, targ, socket_id);
+
 	static char name2[] = "task_gen_hash2";
 
 	name2[0]++;
@@ -973,15 +1274,16 @@ static void init_task_gen_client(struct task_base *tbase, struct task_args *targ
 	struct task_gen_client *task = (struct task_gen_client *)tbase;
 	static char name[] = "gen_pool";
 	const uint32_t socket = rte_lcore_to_socket_id(targ->lconf->id);
+	const uint32_t n_mbufs = targ->large_segments? 16*1024 - 1 : 4*1024 - 1;
 	name[0]++;
 	task->mempool = rte_mempool_create(name,
-					   4*1024 - 1, MBUF_SIZE,
+					   n_mbufs, MBUF_SIZE,
 					   targ->nb_cache_mbuf,
 					   sizeof(struct rte_pktmbuf_pool_private),
 					   rte_pktmbuf_pool_init, NULL,
 					   rte_pktmbuf_init, 0,
 					   socket, 0);
-	PROX_PANIC(task->mempool == NULL, "Failed to allocate memory pool with %u elements\n", 4*1024 - 1);
+	PROX_PANIC(task->mempool == NULL, "Failed to allocate memory pool with %u elements\n", n_mbufs);
 
 	/* streams contains a lua table. Go through it and read each
 	   stream with associated imix_fraction. */
@@ -1011,13 +1313,11 @@ static void init_task_gen_client(struct task_base *tbase, struct task_args *targ
 	int total_imix = 0;
 
 	uint32_t *occur = prox_zmalloc(n_bundle_cfgs * sizeof(*occur), socket);
-	struct cdf *cdf = cdf_create(n_bundle_cfgs, socket);
 
 	while (lua_next(prox_lua(), -2)) {
 		PROX_PANIC(lua_to_int(prox_lua(), TABLE, "imix_fraction", &imix) ||
 			   lua_to_bundle_cfg(prox_lua(), TABLE, "bundle", socket, &task->bundle_cfgs[i], hs),
 			   "Failed to load bundle cfg:\n%s\n", get_lua_to_errors());
-		cdf_add(cdf, imix);
 		occur[i] = imix;
 		total_imix += imix;
 		++i;
@@ -1025,7 +1325,15 @@ static void init_task_gen_client(struct task_base *tbase, struct task_args *targ
 	}
 
 	lua_pop(prox_lua(), pop);
-	cdf_setup(cdf);
+
+	if (targ->large_segments) {
+		bundle_cfgs_set_large_segments(task->bundle_cfgs, n_bundle_cfgs);
+		init_large_segments(&task->gso, targ, task->mempool, socket);
+	}
+	if (targ->zero_copy)
+		bundle_cfgs_set_zero_copy(task->bundle_cfgs, n_bundle_cfgs, targ, socket);
+	if (targ->rss_steering)
+		bundle_cfgs_set_steering(task->bundle_cfgs, n_bundle_cfgs, targ, socket);
 
 	PROX_PANIC(targ->max_setup_rate == 0, "Max setup rate not set\n");
 
@@ -57,7 +57,32 @@ struct cpe_gre_key {
 	uint16_t          pad;
 } __attribute__((__packed__));
 
+#define DO_ENC_ETH_OVER_GRE 1
+#define DO_ENC_IP_OVER_GRE 0
+
+#if DO_ENC_ETH_OVER_GRE
+#define PKT_PREPEND_LEN (sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + sizeof(struct gre_hdr))
+#elif DO_ENC_IP_OVER_GRE
+#define PKT_PREPEND_LEN (sizeof(struct ipv4_hdr) + sizeof(struct gre_hdr))
+#else
+#error "Set either DO_ENC_ETH_OVER_GRE or DO_ENC_IP_OVER_GRE"
+#endif
+
+/* Outer headers written in front of each encapsulated packet. In
+   case of DO_ENC_IP_OVER_GRE, the Ethernet header of the payload is
+   overwritten. */
+struct gre_encap_hdr {
+	struct ether_hdr eth;
+	struct ipv4_hdr  ip;
+	struct gre_hdr   gre;
+} __attribute__((__packed__));
+
 struct cpe_gre_data {
+	/* Prebuilt when the entry is learned. The IP total length
+	   and checksum are left 0 */
+	struct gre_encap_hdr hdr;
+	/* Sum of the 16 bit words of hdr.ip, not folded */
+	uint32_t ip_cksum;
 	uint32_t gre_id;
 	uint32_t cpe_ip;
 	uint64_t tsc;
@@ -65,7 +90,13 @@ struct cpe_gre_data {
 	uint64_t tp_tsc;
 	double tp_tbsize;
 #endif
-} __attribute__((__packed__));
+} __rte_cache_aligned;
+
+/* Tunnel seen by the decap side for a client */
+struct cpe_gre_tunnel {
+	uint32_t gre_id;
+	uint32_t cpe_ip;
+};
 
 struct task_gre_decap {
 	struct task_base base;
@@ -75,9 +106,10 @@ struct task_gre_decap {
 	uint8_t runtime_flags;
 	uint8_t mapping[PROX_MAX_PORTS];
 	uint32_t bucket_index;
+	uint32_t n_entries;
 	int     offload_crc;
-	const void* key_ptr[16];
-	struct cpe_gre_key key[16];
+	const void* key_ptr[MAX_PKT_BURST];
+	struct cpe_gre_key key[MAX_PKT_BURST];
 	uint64_t           cpe_timeout;
 #ifdef GRE_TP
 	double cycles_per_byte;
@@ -85,21 +117,32 @@ struct task_gre_decap {
 #endif
 };
 
-static void handle_gre_decap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
-static void handle_gre_encap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
+static int handle_gre_decap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
+static int handle_gre_encap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
 
 static inline uint8_t handle_gre_encap(struct task_gre_decap *task, struct rte_mbuf *mbuf, struct cpe_gre_data *table);
-static inline void handle_gre_encap16(struct task_gre_decap *task, struct rte_mbuf **mbufs, uint16_t n_pkts, uint8_t *out);
-static inline uint8_t handle_gre_decap(struct task_gre_decap *tbase, struct rte_mbuf *mbuf);
+static inline uint8_t handle_gre_decap(struct task_gre_decap *task, struct rte_mbuf *mbuf, struct cpe_gre_key *key, struct cpe_gre_tunnel *tunnel);
 
 void update_arp_entries_gre(void *data);
 
+/* Number of entries in the table shared by the GRE tasks of a core */
+static uint32_t cpe_gre_n_entries(struct task_args *targ)
+{
+	uint8_t table_part = targ->nb_slave_threads;
+
+	if (table_part == 0)
+		table_part = 1;
+	if (!rte_is_power_of_2(table_part)) {
+		table_part = rte_align32pow2(table_part) >> 1;
+	}
+	return MAX_GRE / table_part;
+}
+
 static void init_cpe_gre_hash(struct task_args *targ)
 {
 	char name[64];
 	uint8_t socket_id;
 	uint8_t lcore_id;
-	uint8_t table_part;
 
 	/* Already set up by other task */
 	if (targ->cpe_gre_hash) {
@@ -109,27 +152,23 @@ static void init_cpe_gre_hash(struct task_args *targ)
 	lcore_id = targ->lconf->id;
 	socket_id = rte_lcore_to_socket_id(lcore_id);
 	sprintf(name, "core_%u_CPE_GRE_Table", targ->lconf->id);
-	table_part = targ->nb_slave_threads;
-
-	if (table_part == 0)
-		table_part = 1;
-	if (!rte_is_power_of_2(table_part)) {
-		table_part = rte_align32pow2(table_part) >> 1;
-	}
 
 	struct rte_hash_parameters hash_params = {
 		.name = name,
-		.entries = MAX_GRE / table_part,
+		.entries = cpe_gre_n_entries(targ),
+#if RTE_VERSION < RTE_VERSION_NUM(2,1,0,0)
 		.bucket_entries = GRE_BUCKET_ENTRIES,
+#endif
 		.key_len = sizeof(struct cpe_gre_key),
 		.hash_func_init_val = 0,
 		.socket_id = socket_id
 	};
 
 	struct rte_hash* phash = rte_hash_create(&hash_params);
-	struct cpe_gre_data *cpe_gre_data = prox_zmalloc(MAX_GRE / table_part, socket_id);
+	struct cpe_gre_data *cpe_gre_data = prox_zmalloc(hash_params.entries * sizeof(struct cpe_gre_data), socket_id);
 
 	PROX_PANIC(phash == NULL, "Unable to allocate memory for IPv4 hash table on core %u\n", lcore_id);
+	PROX_PANIC(cpe_gre_data == NULL, "Unable to allocate memory for GRE data on core %u\n", lcore_id);
 
 	for (uint8_t task_id = 0; task_id < targ->lconf->n_tasks_all; ++task_id) {
 		enum task_mode smode = targ->lconf->targs[task_id].mode;
@@ -150,12 +189,13 @@ static void init_task_gre_decap(struct task_base *tbase, struct task_args *targ)
 	task->runtime_flags = targ->runtime_flags;
 	task->lconf = targ->lconf;
 	task->cpe_timeout = msec_to_tsc(targ->cpe_table_timeout_ms);
+	task->n_entries = cpe_gre_n_entries(targ);
 
 	targ->lconf->period_func = update_arp_entries_gre;
 	targ->lconf->period_data = tbase;
 	targ->lconf->period_timeout = msec_to_tsc(500) / NUM_VCPES;
 
-	for (uint8_t i = 0; i < 16; ++i) {
+	for (uint8_t i = 0; i < MAX_PKT_BURST; ++i) {
 		task->key_ptr[i] = &task->key[i];
 	}
 }
@@ -169,8 +209,13 @@ static void init_task_gre_encap(struct task_base *tbase, struct task_args *targ)
 	task->cpe_gre_data = targ->cpe_gre_data;
 	task->runtime_flags = targ->runtime_flags;
 	task->lconf = targ->lconf;
+	task->n_entries = cpe_gre_n_entries(targ);
+
+	for (uint8_t i = 0; i < MAX_PKT_BURST; ++i) {
+		task->key_ptr[i] = &task->key[i];
+	}
 
-	struct port_cfg *port = find_reachable_task_sending_to_port(targ);
+	struct prox_port_cfg *port = find_reachable_port(targ);
 	if (port) {
 		task->offload_crc = port->capabilities.tx_offload_cksum;
 	}
@@ -209,29 +254,100 @@ __attribute__((constructor)) static void reg_task_gre(void)
 	reg_task(&task_init_gre_encap);
 }
 
-void handle_gre_decap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
+static void gre_encap_hdr_build(struct cpe_gre_data *data)
+{
+	struct gre_encap_hdr *hdr = &data->hdr;
+	const uint16_t *words = (const uint16_t *)&hdr->ip;
+	uint32_t sum = 0;
+
+	struct ether_hdr eth = {
+		.d_addr = {.addr_bytes = {0x0A, 0x0A, 0x0A, 0xC8, 0x00, 0x02}},
+		.s_addr = {.addr_bytes = {0x0A, 0x0A, 0x0A, 0xC8, 0x00, 0x01}},
+		.ether_type = ETYPE_IPv4
+	};
+	rte_memcpy(&hdr->eth, &eth, sizeof(struct ether_hdr));
+
+	rte_memcpy(&hdr->ip, &tunnel_ip_proto, sizeof(struct ipv4_hdr));
+	hdr->ip.src_addr = 0x02010a0a;	//emulate port ip
+	hdr->ip.dst_addr = data->cpe_ip;
+
+	rte_memcpy(&hdr->gre, &gre_hdr_proto, sizeof(struct gre_hdr));
+#if DO_ENC_ETH_OVER_GRE
+	hdr->gre.type = ETYPE_EoGRE;
+#elif DO_ENC_IP_OVER_GRE
+	hdr->gre.type = ETYPE_IPv4;
+#endif
+	hdr->gre.gre_id = data->gre_id;
+
+	for (uint32_t i = 0; i < sizeof(struct ipv4_hdr) / sizeof(uint16_t); ++i)
+		sum += words[i];
+	data->ip_cksum = sum;
+}
+
+/* total_length is in network byte order, as is the result */
+static inline uint16_t gre_encap_ip_cksum(uint32_t partial, uint16_t total_length)
+{
+	uint32_t sum = partial + total_length;
+
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return ~sum;
+}
+
+int handle_gre_decap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_gre_decap *task = (struct task_gre_decap *)tbase;
+	struct cpe_gre_tunnel tunnel[MAX_PKT_BURST];
 	uint8_t out[MAX_PKT_BURST];
+	uint64_t tsc = rte_rdtsc() + task->cpe_timeout;
 	uint16_t j;
 
 	prefetch_first(mbufs, n_pkts);
 
+	/* Decapsulate and extract the keys for the whole burst
+	   first. The updates below then only touch the table. */
 	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
 #ifdef PROX_PREFETCH_OFFSET
 		PREFETCH0(mbufs[j + PREFETCH_OFFSET]);
 		PREFETCH0(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
 #endif
-		out[j] = handle_gre_decap(task, mbufs[j]);
+		out[j] = handle_gre_decap(task, mbufs[j], &task->key[j], &tunnel[j]);
 	}
 #ifdef PROX_PREFETCH_OFFSET
 	PREFETCH0(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
 	for (; j < n_pkts; ++j) {
-		out[j] = handle_gre_decap(task, mbufs[j]);
+		out[j] = handle_gre_decap(task, mbufs[j], &task->key[j], &tunnel[j]);
 	}
 #endif
 
-	task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+	for (j = 0; j < n_pkts; ++j) {
+		if (unlikely(out[j] == OUT_DISCARD))
+			continue;
+
+		int32_t hash_index = rte_hash_add_key(task->cpe_gre_hash, &task->key[j]);
+		if (unlikely(hash_index < 0)) {
+			plog_warn("Failed to add key, gre %x\n", tunnel[j].gre_id);
+			continue;
+		}
+		else if (unlikely((uint32_t)hash_index >= task->n_entries)) {
+			plog_warn("Failed to add: Invalid hash_index = 0x%x\n", hash_index);
+			out[j] = OUT_DISCARD;
+			continue;
+		}
+
+		struct cpe_gre_data *entry = &task->cpe_gre_data[hash_index];
+
+		/* Most packets refresh an existing entry, the
+		   template is only rebuilt if the tunnel changed. */
+		if (unlikely(entry->gre_id != tunnel[j].gre_id || entry->cpe_ip != tunnel[j].cpe_ip || entry->ip_cksum == 0)) {
+			entry->gre_id = tunnel[j].gre_id;
+			entry->cpe_ip = tunnel[j].cpe_ip;
+			gre_encap_hdr_build(entry);
+		}
+		entry->tsc = tsc;
+	}
+
+	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
 
 struct gre_packet {
@@ -265,7 +381,7 @@ static inline struct ether_hdr *gre_decap(struct gre_hdr *pgre, struct rte_mbuf
 	return (struct ether_hdr *)rte_pktmbuf_adj(mbuf, hsize);
 }
 
-static inline uint8_t handle_gre_decap(struct task_gre_decap *task, struct rte_mbuf *mbuf)
+static inline uint8_t handle_gre_decap(struct task_gre_decap *task, struct rte_mbuf *mbuf, struct cpe_gre_key *key, struct cpe_gre_tunnel *tunnel)
 {
 	struct ipv4_hdr *pip = (struct ipv4_hdr *)(rte_pktmbuf_mtod(mbuf, struct ether_hdr *) + 1);
 
@@ -275,14 +391,12 @@ static inline uint8_t handle_gre_decap(struct task_gre_decap *task, struct rte_m
 		return OUT_DISCARD;
 	}
 
-	struct cpe_gre_data data;
-	struct cpe_gre_key key;
 	struct gre_hdr *pgre = (struct gre_hdr *)(pip + 1);
-	data.gre_id = pgre->gre_id;
-	data.cpe_ip = pip->src_addr;
+	tunnel->gre_id = pgre->gre_id;
+	tunnel->cpe_ip = pip->src_addr;
 
 	struct ether_hdr *peth = gre_decap(pgre, mbuf);
-	PROX_PANIC(peth != 0, "Failed to gre_decap");
+	PROX_PANIC(peth == NULL, "Failed to gre_decap");
 
 	pip = (struct ipv4_hdr *)(peth + 1);
 
@@ -303,21 +417,9 @@ static inline uint8_t handle_gre_decap(struct task_gre_decap *task, struct rte_m
 		eth.s_addr.addr_bytes[5] = (hip) & 0xFF;
 		rte_memcpy(peth, &eth, sizeof(struct ether_hdr));
 	}
-	ether_addr_copy(&peth->s_addr, &key.clt_mac);
+	ether_addr_copy(&peth->s_addr, &key->clt_mac);
 #endif
 
-	data.tsc = rte_rdtsc() + task->cpe_timeout;
-
-	int32_t hash_index = rte_hash_add_key(task->cpe_gre_hash, &key);
-	if (unlikely(hash_index < 0)) {
-		plog_warn("Failed to add key, gre %x\n", data.gre_id);
-	}
-	else if (unlikely(hash_index >= MAX_GRE)) {
-		plog_warn("Failed to add: Invalid hash_index = 0x%x\n",
-			hash_index);
-		return OUT_DISCARD;
-	}
-	rte_memcpy(&task->cpe_gre_data[hash_index], &data, sizeof(data));
 	if (task->runtime_flags & TASK_TX_CRC) {
 		prox_ip_cksum(mbuf, pip, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
 	}
@@ -325,60 +427,50 @@ static inline uint8_t handle_gre_decap(struct task_gre_decap *task, struct rte_m
 	return 0;
 }
 
-void handle_gre_encap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
+int handle_gre_encap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_gre_decap *task = (struct task_gre_decap *)tbase;
+	int32_t hash_index[MAX_PKT_BURST];
 	uint8_t out[MAX_PKT_BURST];
-	uint16_t done = 0;
-
-	while (n_pkts) {
-		uint16_t chopped = RTE_MIN(n_pkts, 16);
-		prefetch_pkts(mbufs, chopped);
-		handle_gre_encap16(task, mbufs, chopped, out + done);
-		mbufs += chopped;
-		n_pkts -= chopped;
-		done += chopped;
-	}
+	uint16_t i;
 
-	task->base.tx_pkt(&task->base, mbufs - done, done, out);
-}
+	prefetch_pkts(mbufs, n_pkts);
 
-#define DO_ENC_ETH_OVER_GRE 1
-#define DO_ENC_IP_OVER_GRE 0
-
-static inline void handle_gre_encap16(struct task_gre_decap *task, struct rte_mbuf **mbufs, uint16_t n_pkts, uint8_t *out)
-{
-	for (uint8_t i = 0; i < n_pkts; ++i) {
+	for (i = 0; i < n_pkts; ++i) {
 		struct ether_hdr *peth = rte_pktmbuf_mtod(mbufs[i], struct ether_hdr *);
 		ether_addr_copy(&peth->d_addr, &task->key[i].clt_mac);
 	}
 
-	int32_t hash_index[16];
-	rte_hash_lookup_bulk(task->cpe_gre_hash, task->key_ptr, n_pkts, hash_index);
-	for (uint8_t i = 0; i < n_pkts; ++i ) {
+	/* rte_hash limits the number of keys per bulk lookup, the
+	   lookups for the whole burst are still done before any
+	   entry is accessed. */
+	for (i = 0; i < n_pkts; i += RTE_HASH_LOOKUP_BULK_MAX) {
+		rte_hash_lookup_bulk(task->cpe_gre_hash, &task->key_ptr[i],
+				     RTE_MIN(n_pkts - i, RTE_HASH_LOOKUP_BULK_MAX), &hash_index[i]);
+	}
+
+	for (i = 0; i < n_pkts; ++i) {
 		if (unlikely(hash_index[i] < 0)) {
-			plog_warn("Invalid hash_index (<0) = 0x%x\n", hash_index[i]);
 			out[i] = OUT_DISCARD;
 		}
-		else if (unlikely(hash_index[i] >= MAX_GRE)) {
+		else if (unlikely((uint32_t)hash_index[i] >= task->n_entries)) {
 			plog_warn("Invalid hash_index = 0x%x\n", hash_index[i]);
 			out[i] = OUT_DISCARD;
 		}
-		rte_prefetch0(&task->cpe_gre_data[hash_index[i]]);
+		else {
+			out[i] = 0;
+			rte_prefetch0(&task->cpe_gre_data[hash_index[i]]);
+		}
 	}
 
-	for (uint8_t i = 0; i < n_pkts; ++i ) {
+	for (i = 0; i < n_pkts; ++i) {
 		if (likely(out[i] != OUT_DISCARD)) {
 			out[i] = handle_gre_encap(task, mbufs[i], &task->cpe_gre_data[hash_index[i]]);
 		}
 	}
-}
 
-#ifdef DO_ENC_ETH_OVER_GRE
-#define PKT_PREPEND_LEN (sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + sizeof(struct gre_hdr))
-#elif DO_ENC_IP_OVER_GRE
-#define PKT_PREPEND_LEN (sizeof(struct ipv4_hdr) + sizeof(struct gre_hdr))
-#else
+	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+}
 
 static inline uint8_t handle_gre_encap(struct task_gre_decap *task, struct rte_mbuf *mbuf, struct cpe_gre_data *table)
 {
@@ -386,9 +478,6 @@ static inline uint8_t handle_gre_encap(struct task_gre_decap *task, struct rte_m
 	struct ipv4_hdr *pip = (struct ipv4_hdr *)(peth + 1);
 	uint16_t ip_len = rte_be_to_cpu_16(pip->total_length);
 
-	struct cpe_gre_key key;
-	ether_addr_copy(&peth->d_addr, &key.clt_mac);
-
 #ifdef GRE_TP
 	/* policing enabled */
 	if (task->cycles_per_byte) {
@@ -416,34 +505,19 @@ static inline uint8_t handle_gre_encap(struct task_gre_decap *task, struct rte_m
 	/* reuse ethernet header from payload, retain payload (ip) in
 	   case of DO_ENC_IP_OVER_GRE */
 	peth = (struct ether_hdr *)rte_pktmbuf_prepend(mbuf, PKT_PREPEND_LEN);
-	PREFETCH0(peth);
 	ip_len += PKT_PREPEND_LEN;
 
+	rte_memcpy(peth, &table->hdr, sizeof(struct gre_encap_hdr));
 	pip = (struct ipv4_hdr *)(peth + 1);
-	struct gre_hdr *pgre = (struct gre_hdr *)(pip + 1);
-
-	struct ether_hdr eth = {
-		.d_addr = {.addr_bytes = {0x0A, 0x0A, 0x0A, 0xC8, 0x00, 0x02}},
-		.s_addr = {.addr_bytes = {0x0A, 0x0A, 0x0A, 0xC8, 0x00, 0x01}},
-		.ether_type = ETYPE_IPv4
-	};
-	rte_memcpy(peth, &eth, sizeof(struct ether_hdr));
-
-	rte_memcpy(pgre, &gre_hdr_proto, sizeof(struct gre_hdr));
-#if DO_ENC_ETH_OVER_GRE
-	pgre->type = ETYPE_EoGRE;
-#elif DO_ENC_IP_OVER_GRE
-	pgre->type = ETYPE_IPv4;
-#endif
-	pgre->gre_id = table->gre_id;
-
-	rte_memcpy(pip, &tunnel_ip_proto, sizeof(struct ipv4_hdr));
-	pip->src_addr = 0x02010a0a;	//emulate port ip
-	pip->dst_addr = table->cpe_ip;
 	pip->total_length = rte_cpu_to_be_16(ip_len);
 
 	if (task->runtime_flags & TASK_TX_CRC) {
-		prox_ip_cksum(mbuf, pip, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
+#ifndef SOFT_CRC
+		if (task->offload_crc)
+			prox_ip_cksum_hw(mbuf, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr));
+		else
+#endif
+			pip->hdr_checksum = gre_encap_ip_cksum(table->ip_cksum, pip->total_length);
 	}
 
 	return 0;
@@ -454,10 +528,23 @@ void update_arp_entries_gre(void *data)
 	uint64_t cur_tsc = rte_rdtsc();
 	struct task_gre_decap *task = (struct task_gre_decap *)data;
 
-#if RTE_VERSION >= RTE_VERSION_NUM(2,1,0,0)
-	// rte_hash_iterate might take a long time if no entries found => we should not use it here
-	// struct rte_hash is now internal.....
-	// => Not implemented
+#if RTE_VERSION >= RTE_VERSION_NUM(16,7,0,0)
+	/* struct rte_hash is internal, entries are expired through
+	   their position instead, which also indexes cpe_gre_data.
+	   Free positions are marked with a tsc of UINT64_MAX. */
+	uint32_t pos = task->bucket_index * GRE_BUCKET_ENTRIES;
+
+	for (uint32_t i = 0; i < GRE_BUCKET_ENTRIES; ++i, ++pos) {
+		void *key;
+
+		if (task->cpe_gre_data[pos].tsc >= cur_tsc)
+			continue;
+		if (rte_hash_get_key_with_position(task->cpe_gre_hash, pos, &key) == 0)
+			rte_hash_del_key(task->cpe_gre_hash, key);
+		task->cpe_gre_data[pos].tsc = UINT64_MAX;
+	}
+	++task->bucket_index;
+	task->bucket_index &= task->n_entries / GRE_BUCKET_ENTRIES - 1;
 #else
 	uint32_t *sig_bucket = (hash_sig_t *)&(task->cpe_gre_hash->sig_tbl[task->bucket_index * task->cpe_gre_hash->sig_tbl_bucket_size]);
 	uint32_t table_index = task->bucket_index * task->cpe_gre_hash->bucket_entries;
@@ -471,9 +471,27 @@ static void init_task(struct task_base *tbase, struct task_args *targ)
 	}
 }
 
+static uint32_t impair_mbufs_held(struct task_args *targ)
+{
+	uint32_t queue_len;
+
+	/* Same line-rate assumption as in init_task(). With a random
+	   delay the buffer is far larger than what can be filled at
+	   line-rate during the maximum delay, so use the latter. */
+	if (targ->random_delay_us)
+		queue_len = (1250L * targ->random_delay_us) / 84;
+	else if (targ->delay_us)
+		queue_len = rte_align32pow2(1250 * targ->delay_us / 84);
+	else
+		return 0;
+
+	return queue_len < MAX_PKT_BURST? MAX_PKT_BURST : queue_len;
+}
+
 static struct task_init tinit = {
 	.mode_str = "impair",
 	.init = init_task,
+	.mbufs_held = impair_mbufs_held,
 	.handle = handle_bulk_impair,
 	.flag_features = TASK_FEATURE_TXQ_FLAGS_NOOFFLOADS | TASK_FEATURE_ZERO_RX,
 	.size = sizeof(struct task_impair)
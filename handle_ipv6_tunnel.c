@@ -33,7 +33,6 @@
 #include <rte_ip.h>
 #include <rte_udp.h>
 #include <rte_tcp.h>
-#include <rte_table_hash.h>
 #include <rte_ether.h>
 #include <rte_version.h>
 #include <rte_byteorder.h>
@@ -47,7 +46,6 @@
 #include "prox_port_cfg.h"
 #include "prefetch.h"
 #include "lconf.h"
-#include "hash_utils.h"
 #include "etypes.h"
 #include "prox_cksum.h"
 #include "defines.h"
@@ -57,16 +55,13 @@
 #include "parse_utils.h"
 #include "cfgfile.h"
 #include "prox_shared.h"
+#include "ipv6_tun_table.h"
+#include "handle_ipv6_tunnel.h"
 
 #if RTE_VERSION < RTE_VERSION_NUM(1,8,0,0)
 #define IPPROTO_IPIP IPPROTO_IPV4
 #endif
 
-struct ipv6_tun_dest {
-        struct ipv6_addr  dst_addr;
-	struct ether_addr dst_mac;
-};
-
 typedef enum ipv6_tun_dir_t {
         TUNNEL_DIR_ENCAP = 0,
         TUNNEL_DIR_DECAP = 1,
@@ -77,9 +72,8 @@ struct task_ipv6_tun_base {
 	struct ether_addr       src_mac;
 	uint8_t                 core_nb;
 	uint64_t                keys[64];
-	struct rte_mbuf*        fake_packets[64];
 	uint16_t                lookup_port_mask;  // Mask used before looking up the port
-	void*                   lookup_table;      // Fast lookup table for bindings
+	struct ipv6_tun_table*  lookup_table;      // Fast lookup table for bindings
 	uint32_t		runtime_flags;
 	int                     offload_crc;
 };
@@ -110,55 +104,51 @@ static void init_lookup_table(struct task_ipv6_tun_base* ptask, struct task_args
 {
 	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
 
-	/* The lookup table is a per-core data structure to reduce the
-	   memory footprint and improve cache utilization. Since
-	   operations on the hash table are not safe, the data
-	   structure can't be used on a per socket or on a system wide
-	   basis. */
-	ptask->lookup_table = prox_sh_find_core(targ->lconf->id, "ipv6_binding_table");
+	/* Lookups are safe during updates, so the lookup table is
+	   shared by all tasks on a socket. Updates through commands
+	   are therefore seen by all these tasks. */
+	ptask->lookup_table = prox_sh_find_socket(socket_id, "ipv6_binding_table");
 	if (NULL == ptask->lookup_table) {
 		struct ipv6_tun_binding_table *table;
 		PROX_PANIC(!strcmp(targ->tun_bindings, ""), "No tun bindings specified\n");
 		int ret = lua_to_ip6_tun_binding(prox_lua(), GLOBAL, targ->tun_bindings, socket_id, &table);
 		PROX_PANIC(ret, "Failed to read tun_bindings config:\n %s\n", get_lua_to_errors());
 
-		struct rte_table_hash_key8_ext_params table_hash_params = {
-			.n_entries = (table->num_binding_entries * 4),
-			.n_entries_ext = (table->num_binding_entries * 2) >> 1,
-			.f_hash = hash_crc32,
-			.seed = 0,
-			.signature_offset = HASH_METADATA_OFFSET(8),  // Ignored for dosig tables
-			.key_offset = HASH_METADATA_OFFSET(0),
-		};
+		uint32_t n_max_entries = targ->n_max_tun_bindings? targ->n_max_tun_bindings : table->num_binding_entries * 2;
+		PROX_PANIC(n_max_entries < table->num_binding_entries, "max tun bindings (%u) is lower than the number of bindings (%u)\n",
+			   n_max_entries, table->num_binding_entries);
+
                 plogx_info("IPv6 Tunnel allocating lookup table on socket %d\n", socket_id);
-		ptask->lookup_table = rte_table_hash_key8_ext_dosig_ops.
-				f_create(&table_hash_params, socket_id, sizeof(struct ipv6_tun_dest));
+		ptask->lookup_table = ipv6_tun_table_create(n_max_entries, ptask->lookup_port_mask, socket_id);
 		PROX_PANIC(ptask->lookup_table == NULL, "Error creating IPv6 Tunnel lookup table");
 
 		for (unsigned idx = 0; idx < table->num_binding_entries; idx++) {
-			int key_found = 0;
-			void* entry_in_hash = NULL;
 			struct ipv6_tun_dest data;
 			struct ipv6_tun_binding_entry* entry = &table->entry[idx];
                         uint64_t key = MAKE_KEY_FROM_FIELDS(rte_cpu_to_be_32(entry->public_ipv4), entry->public_port, ptask->lookup_port_mask);
 			rte_memcpy(&data.dst_addr, &entry->endpoint_addr, sizeof(struct ipv6_addr));
 			rte_memcpy(&data.dst_mac, &entry->next_hop_mac, sizeof(struct ether_addr));
 
-			int ret = rte_table_hash_key8_ext_dosig_ops.f_add(ptask->lookup_table, &key, &data, &key_found, &entry_in_hash);
+			int ret = ipv6_tun_table_add(ptask->lookup_table, key, &data);
 			PROX_PANIC(ret, "Error adding entry (%d) to binding lookup table", idx);
-			PROX_PANIC(key_found, "key_found!!! for idx=%d\n", idx);
 
 #ifdef DBG_IPV6_TUN_BINDING
 			plog_info("Bind: %x:0x%x (port_mask 0x%x) key=0x%"PRIx64"\n", entry->public_ipv4, entry->public_port, ptask->lookup_port_mask, key);
 			plog_info("  -> "IPv6_BYTES_FMT" ("MAC_BYTES_FMT")\n", IPv6_BYTES(entry->endpoint_addr.bytes), MAC_BYTES(entry->next_hop_mac.addr_bytes));
 			plog_info("  -> "IPv6_BYTES_FMT" ("MAC_BYTES_FMT")\n", IPv6_BYTES(data.dst_addr.bytes), MAC_BYTES(data.dst_mac.addr_bytes));
-			plog_info("  -> entry_in_hash=%p\n", entry_in_hash);
 #endif
 		}
                 plogx_info("IPv6 Tunnel created %d lookup table entries\n", table->num_binding_entries);
 
-		prox_sh_add_core(targ->lconf->id, "ipv6_binding_table", ptask->lookup_table);
+		prox_sh_add_socket(socket_id, "ipv6_binding_table", ptask->lookup_table);
 	}
+	PROX_PANIC(ptask->lookup_table->port_mask != ptask->lookup_port_mask,
+		   "All IPv6 tunnel tasks on socket %d must use the same lookup port mask\n", socket_id);
+}
+
+struct ipv6_tun_table *task_ipv6_tun_get_table(struct task_base *tbase)
+{
+	return ((struct task_ipv6_tun_base *)tbase)->lookup_table;
 }
 
 static void init_task_ipv6_tun_base(struct task_ipv6_tun_base* tun_base, struct task_args* targ)
@@ -169,10 +159,6 @@ static void init_task_ipv6_tun_base(struct task_ipv6_tun_base* tun_base, struct
 
 	init_lookup_table(tun_base, targ);
 
-	for (uint32_t i = 0; i < 64; ++i) {
-		tun_base->fake_packets[i] = (struct rte_mbuf*)((uint8_t*)&tun_base->keys[i] - sizeof (struct rte_mbuf));
-	}
-
 	plogx_info("IPv6 Tunnel MAC="MAC_BYTES_FMT" port_mask=0x%x\n",
 		  MAC_BYTES(tun_base->src_mac.addr_bytes), tun_base->lookup_port_mask);
 
@@ -327,20 +313,19 @@ static int handle_ipv6_decap_bulk(struct task_base* tbase, struct rte_mbuf** mbu
 {
         struct task_ipv6_decap* task = (struct task_ipv6_decap *)tbase;
         uint64_t pkts_mask = RTE_LEN2MASK(n_pkts, uint64_t);
-        struct ipv6_tun_dest* entries[64];
+        struct ipv6_tun_dest entries[64];
 	uint8_t out[MAX_PKT_BURST];
         uint64_t lookup_hit_mask;
-        uint16_t n_kept = 0;
 
         prefetch_pkts(mbufs, n_pkts);
 
         // Lookup to verify packets are valid for their respective tunnels (their sending lwB4)
         extract_key_decap_bulk(&task->base, mbufs, n_pkts);
-        rte_table_hash_key8_ext_dosig_ops.f_lookup(task->base.lookup_table, task->base.fake_packets, pkts_mask, &lookup_hit_mask, (void**)entries);
+        ipv6_tun_table_lookup_bulk(task->base.lookup_table, task->base.keys, n_pkts, &lookup_hit_mask, entries);
 
         if (likely(lookup_hit_mask == pkts_mask)) {
                 for (uint16_t j = 0; j < n_pkts; ++j) {
-                        out[j] = handle_ipv6_decap(task, mbufs[j], entries[j]);
+                        out[j] = handle_ipv6_decap(task, mbufs[j], &entries[j]);
                 }
         }
         else {
@@ -350,7 +335,7 @@ static int handle_ipv6_decap_bulk(struct task_base* tbase, struct rte_mbuf** mbu
 				out[j] = OUT_DISCARD;
                                 continue;
                         }
-                        out[j] = handle_ipv6_decap(task, mbufs[j], entries[j]);
+                        out[j] = handle_ipv6_decap(task, mbufs[j], &entries[j]);
                 }
         }
 
@@ -361,19 +346,18 @@ static int handle_ipv6_encap_bulk(struct task_base* tbase, struct rte_mbuf** mbu
 {
 	struct task_ipv6_encap* task = (struct task_ipv6_encap *)tbase;
         uint64_t pkts_mask = RTE_LEN2MASK(n_pkts, uint64_t);
-        struct ipv6_tun_dest* entries[64];
+        struct ipv6_tun_dest entries[64];
         uint64_t lookup_hit_mask;
 	uint8_t out[MAX_PKT_BURST];
-        uint16_t n_kept = 0;
 
 	prefetch_first(mbufs, n_pkts);
 
         extract_key_encap_bulk(&task->base, mbufs, n_pkts);
-        rte_table_hash_key8_ext_dosig_ops.f_lookup(task->base.lookup_table, task->base.fake_packets, pkts_mask, &lookup_hit_mask, (void**)entries);
+        ipv6_tun_table_lookup_bulk(task->base.lookup_table, task->base.keys, n_pkts, &lookup_hit_mask, entries);
 
         if (likely(lookup_hit_mask == pkts_mask)) {
                 for (uint16_t j = 0; j < n_pkts; ++j) {
-                        out[j] = handle_ipv6_encap(task, mbufs[j], entries[j]);
+                        out[j] = handle_ipv6_encap(task, mbufs[j], &entries[j]);
                 }
         }
         else {
@@ -383,7 +367,7 @@ static int handle_ipv6_encap_bulk(struct task_base* tbase, struct rte_mbuf** mbu
 				out[j] = OUT_DISCARD;
                                 continue;
                         }
-                        out[j] = handle_ipv6_encap(task, mbufs[j], entries[j]);
+                        out[j] = handle_ipv6_encap(task, mbufs[j], &entries[j]);
                 }
         }
 
@@ -440,6 +424,8 @@ static inline uint8_t handle_ipv6_encap(struct task_ipv6_encap* ptask, struct rt
 		return OUT_DISCARD;
 	}
 
+	uint16_t cksum = pip4->hdr_checksum;
+
 	if (pip4->time_to_live) {
 		pip4->time_to_live--;
 	}
@@ -474,9 +460,12 @@ static inline uint8_t handle_ipv6_encap(struct task_ipv6_encap* ptask, struct rt
 	rte_memcpy(pip6->src_addr, &ptask->local_endpoint_addr, sizeof(pip6->src_addr));
 
 	if (tun_base->runtime_flags & TASK_TX_CRC) {
-	// We modified the TTL in the IPv4 header, hence have to recompute the IPv4 checksum
+	// We modified the TTL in the IPv4 header, hence have to update the IPv4 checksum
 #define TUNNEL_L2_LEN (sizeof(struct ether_hdr) + sizeof(struct ipv6_hdr))
-		prox_ip_cksum(rx_mbuf, pip4, TUNNEL_L2_LEN, sizeof(struct ipv4_hdr), ptask->base.offload_crc);
+		if (prox_cksum_in_sw(ptask->base.offload_crc))
+			pip4->hdr_checksum = prox_ip_cksum_ttl_dec(cksum);
+		else
+			prox_ip_cksum(rx_mbuf, pip4, TUNNEL_L2_LEN, sizeof(struct ipv4_hdr), ptask->base.offload_crc);
 	}
 	return 0;
 }
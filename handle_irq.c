@@ -39,6 +39,8 @@
 #include "log.h"
 #include "unistd.h"
 #include "input.h"
+#include "msr.h"
+#include "parse_utils.h"
 
 #define MAX_INDEX	65535 * 16
 
@@ -66,6 +68,35 @@ struct task_irq {
 
 #define MAX_INTERRUPT_LENGTH	500000	/* Maximum length of an interrupt is (1 / MAX_INTERRUPT_LENGTH) seconds */
 
+#define MSR_SMI_COUNT		0x34
+#define MSR_CORE_C6_RESIDENCY	0x3FD
+#define IRQ_HIST_MSR_REFRESH	100	/* SMI and C-state counters are re-read every (1 / IRQ_HIST_MSR_REFRESH) seconds */
+
+struct irq_hist_event {
+	uint64_t tsc;
+	uint64_t lat;
+	uint64_t smi;		/* SMIs since the previous MSR read */
+	uint64_t c6;		/* C6 residency since the previous MSR read */
+};
+
+struct task_irq_hist {
+	struct task_base base;
+	uint64_t start_tsc;
+	uint64_t first_tsc;
+	uint64_t tsc;
+	uint64_t max_irq;
+	uint64_t msr_refresh;
+	uint64_t next_msr_tsc;
+	uint64_t last_smi;
+	uint64_t last_c6;
+	uint8_t  lcore_id;
+	uint8_t  msr_support;
+	uint32_t n_worst;
+	uint32_t min_worst;	/* Index of the smallest of the worst events */
+	struct irq_hist_stats stats;
+	struct irq_hist_event worst[IRQ_HIST_TOP_N];
+};
+
 /*
  *	This module is not handling any packets.
  *	It loops on rdtsc() and checks whether it has been interrupted
@@ -187,9 +218,183 @@ static struct task_init task_init_irq = {
 	.size = sizeof(struct task_irq)
 };
 
+/*
+ *	The "hist" sub mode keeps a log2 histogram of every rdtsc loop
+ *		gap instead of storing each interrupt. Only the
+ *		IRQ_HIST_TOP_N worst interrupts are kept, together with the
+ *		SMI count and C6 residency deltas read from the MSRs. Its
+ *		footprint is a few cache lines instead of 2 * MAX_INDEX
+ *		irq_info entries, so it can be left running.
+*/
+
+const struct irq_hist_stats *task_irq_hist_get_stats(struct task_irq_hist *task)
+{
+	return &task->stats;
+}
+
+void task_irq_hist_show_stats(struct task_irq_hist *task, struct input *input)
+{
+	const uint64_t hz = rte_get_tsc_hz();
+	struct irq_hist_event worst[IRQ_HIST_TOP_N];
+	uint32_t n_worst = task->n_worst;
+	char buf[8192];
+	int len = 0;
+
+	/* Sort a copy, the task keeps updating its own */
+	memcpy(worst, task->worst, sizeof(worst));
+	for (uint32_t i = 0; i < n_worst; ++i) {
+		for (uint32_t j = i + 1; j < n_worst; ++j) {
+			if (worst[j].lat > worst[i].lat) {
+				struct irq_hist_event tmp = worst[i];
+				worst[i] = worst[j];
+				worst[j] = tmp;
+			}
+		}
+	}
+
+	len += snprintf(buf + len, sizeof(buf) - len, "core %u: %"PRIu64" loops, %"PRIu64" interrupts, max %"PRIu64" usec, %"PRIu64" smi\n",
+			task->lcore_id, task->stats.n_loops, task->stats.n_events,
+			task->stats.max_gap * 1000000 / hz, task->stats.n_smi);
+	for (uint32_t i = 0; i < IRQ_HIST_BUCKETS; ++i) {
+		if (task->stats.buckets[i] == 0)
+			continue;
+		len += snprintf(buf + len, sizeof(buf) - len, "bucket [%"PRIu64" - %"PRIu64"[ cycles: %"PRIu64"\n",
+				i ? 1ULL << i : 0, i == 63? UINT64_MAX : 2ULL << i, task->stats.buckets[i]);
+	}
+	for (uint32_t i = 0; i < n_worst; ++i) {
+		len += snprintf(buf + len, sizeof(buf) - len, "worst %u: %"PRIu64" usec at %"PRIu64" msec, smi %"PRIu64", c6 %"PRIu64" usec\n",
+				i, worst[i].lat * 1000000 / hz,
+				(worst[i].tsc - task->start_tsc) * 1000 / hz,
+				worst[i].smi, worst[i].c6 * 1000000 / hz);
+	}
+
+	if (input->reply)
+		input->reply(input, buf, strlen(buf));
+	else
+		plog_info("%s", buf);
+}
+
+static void irq_hist_read_msr(struct task_irq_hist *task, uint64_t *smi, uint64_t *c6)
+{
+	uint64_t val;
+
+	*smi = 0;
+	*c6 = 0;
+	if (!task->msr_support)
+		return;
+
+	if (msr_read(&val, task->lcore_id, MSR_SMI_COUNT) == 0) {
+		*smi = (uint32_t)(val - task->last_smi);
+		task->last_smi = val;
+	}
+	if (msr_read(&val, task->lcore_id, MSR_CORE_C6_RESIDENCY) == 0) {
+		*c6 = val - task->last_c6;
+		task->last_c6 = val;
+	}
+}
+
+static void irq_hist_add_event(struct task_irq_hist *task, uint64_t tsc, uint64_t lat)
+{
+	struct irq_hist_event ev = {.tsc = tsc, .lat = lat};
+
+	irq_hist_read_msr(task, &ev.smi, &ev.c6);
+	task->stats.n_events++;
+	task->stats.n_smi += ev.smi;
+	if (lat > task->stats.max_gap)
+		task->stats.max_gap = lat;
+
+	if (task->n_worst < IRQ_HIST_TOP_N) {
+		task->worst[task->n_worst++] = ev;
+	} else if (lat > task->worst[task->min_worst].lat) {
+		task->worst[task->min_worst] = ev;
+	} else {
+		return;
+	}
+
+	task->min_worst = 0;
+	for (uint32_t i = 1; i < task->n_worst; ++i) {
+		if (task->worst[i].lat < task->worst[task->min_worst].lat)
+			task->min_worst = i;
+	}
+}
+
+static inline int handle_irq_hist_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
+{
+	struct task_irq_hist *task = (struct task_irq_hist *)tbase;
+	uint64_t tsc = rte_rdtsc();
+	uint64_t lat = tsc - task->tsc;
+
+	task->tsc = tsc;
+	if (unlikely(tsc < task->first_tsc))
+		return 0;
+
+	task->stats.n_loops++;
+	task->stats.buckets[63 - __builtin_clzll(lat | 1)]++;
+
+	if (unlikely(lat > task->max_irq)) {
+		irq_hist_add_event(task, tsc, lat);
+	} else if (unlikely(tsc > task->next_msr_tsc)) {
+		uint64_t smi, c6;
+
+		irq_hist_read_msr(task, &smi, &c6);
+		task->stats.n_smi += smi;
+	} else {
+		return 0;
+	}
+
+	/* Reading the MSRs takes a system call. Do not account for
+	   it in the next gap. */
+	task->tsc = rte_rdtsc();
+	task->next_msr_tsc = task->tsc + task->msr_refresh;
+	return 0;
+}
+
+static void irq_hist_stop(struct task_base *tbase)
+{
+	struct task_irq_hist *task = (struct task_irq_hist *)tbase;
+	struct input input = {0};
+
+	plog_info("Stopping core %u\n", task->lcore_id);
+	task_irq_hist_show_stats(task, &input);
+}
+
+static void init_task_irq_hist(struct task_base *tbase, struct task_args *targ)
+{
+	struct task_irq_hist *task = (struct task_irq_hist *)tbase;
+	uint64_t smi, c6;
+
+	task->max_irq = rte_get_tsc_hz() / MAX_INTERRUPT_LENGTH;
+	task->msr_refresh = rte_get_tsc_hz() / IRQ_HIST_MSR_REFRESH;
+	task->start_tsc = rte_rdtsc();
+	task->first_tsc = task->start_tsc + 2 * rte_get_tsc_hz();
+	task->lcore_id = targ->lconf->id;
+
+	if (is_virtualized()) {
+		plog_info("\tNot reading SMI and C-state msr as running in a VM\n");
+	} else if (msr_init() == 0) {
+		task->msr_support = 1;
+		/* Set the reference values */
+		irq_hist_read_msr(task, &smi, &c6);
+	} else {
+		plog_warn("\tFailed to open msr pseudo-file: SMI and C-state not reported\n");
+	}
+	plog_info("\tusing irq hist mode with max irq set to %ld cycles\n", task->max_irq);
+}
+
+static struct task_init task_init_irq_hist = {
+	.mode_str = "irq",
+	.sub_mode_str = "hist",
+	.init = init_task_irq_hist,
+	.handle = handle_irq_hist_bulk,
+	.stop = irq_hist_stop,
+	.flag_features = TASK_FEATURE_NO_RX,
+	.size = sizeof(struct task_irq_hist)
+};
+
 static struct task_init task_init_none;
 
 __attribute__((constructor)) static void reg_task_irq(void)
 {
 	reg_task(&task_init_irq);
+	reg_task(&task_init_irq_hist);
 }
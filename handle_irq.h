@@ -33,9 +33,27 @@
 #ifndef _HANDLE_IRQ_H_
 #define _HANDLE_IRQ_H_
 
+#include <inttypes.h>
+
+#define IRQ_HIST_BUCKETS	64
+#define IRQ_HIST_TOP_N		16
+
 struct task_irq;
+struct task_irq_hist;
 struct input;
 
+/* Summary kept by the irq "hist" sub mode. buckets[i] counts the
+   loop gaps in [2^i, 2^(i + 1)[ cycles. */
+struct irq_hist_stats {
+	uint64_t n_loops;
+	uint64_t n_events;
+	uint64_t max_gap;
+	uint64_t n_smi;
+	uint64_t buckets[IRQ_HIST_BUCKETS];
+};
+
 void task_irq_show_stats(struct task_irq *task_irq, struct input *input);
+void task_irq_hist_show_stats(struct task_irq_hist *task, struct input *input);
+const struct irq_hist_stats *task_irq_hist_get_stats(struct task_irq_hist *task);
 
 #endif /* _HANDLE_IRQ_H_ */
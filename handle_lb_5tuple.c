@@ -58,75 +58,57 @@
 #define ALL_32_BITS 0xffffffff
 #define BIT_8_TO_15 0x0000ff00
 
-#define HASH_MAX_SIZE 4*8*1024*1024
-
 struct task_lb_5tuple {
 	struct task_base base;
 	uint32_t runtime_flags;
 	struct rte_hash *lookup_hash;
-	uint8_t out_if[HASH_MAX_SIZE] __rte_cache_aligned;
+	/* Indexed by hash position, sized from the number of tuples */
+	uint8_t *out_if;
 };
 
 static __m128i mask0;
-static inline uint8_t get_ipv4_dst_port(struct task_lb_5tuple *task, void *ipv4_hdr, uint8_t portid, struct rte_hash * ipv4_l3fwd_lookup_struct)
+static inline void get_ipv4_5tuple(union ipv4_5tuple_host *key, struct ipv4_hdr *ipv4_hdr)
 {
-	int ret = 0;
-	union ipv4_5tuple_host key;
-
-	ipv4_hdr = (uint8_t *)ipv4_hdr + offsetof(struct ipv4_hdr, time_to_live);
-	__m128i data = _mm_loadu_si128((__m128i*)(ipv4_hdr));
-	/* Get 5 tuple: dst port, src port, dst IP address, src IP address and protocol */
-	key.xmm = _mm_and_si128(data, mask0);
+	uint8_t *data = (uint8_t *)ipv4_hdr + offsetof(struct ipv4_hdr, time_to_live);
 
 	/* Get 5 tuple: dst port, src port, dst IP address, src IP address and protocol */
-	/*
- 	rte_mov16(&key.pad0, ipv4_hdr);
-	key.pad0 = 0;
-	key.pad1 = 0;
-	*/
-	/* Find destination port */
-	ret = rte_hash_lookup(ipv4_l3fwd_lookup_struct, (const void *)&key);
-	return (uint8_t)((ret < 0)? portid : task->out_if[ret]);
-}
-
-static inline uint8_t handle_lb_5tuple(struct task_lb_5tuple *task, struct rte_mbuf *mbuf)
-{
-	struct ether_hdr *eth_hdr;
-	struct ipv4_hdr *ipv4_hdr;
-
-	eth_hdr = rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
-
-	switch (eth_hdr->ether_type) {
-	case ETYPE_IPv4:
-		/* Handle IPv4 headers.*/
-		ipv4_hdr = (struct ipv4_hdr *) (eth_hdr + 1);
-		return get_ipv4_dst_port(task, ipv4_hdr, OUT_DISCARD, task->lookup_hash);
-	default:
-		return OUT_DISCARD;
-	}
+	key->xmm = _mm_and_si128(_mm_loadu_si128((__m128i *)data), mask0);
 }
 
 static int handle_lb_5tuple_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_lb_5tuple *task = (struct task_lb_5tuple *)tbase;
+	union ipv4_5tuple_host key[MAX_PKT_BURST];
+	const void *key_ptr[MAX_PKT_BURST];
+	int32_t hash_index[MAX_PKT_BURST];
+	uint16_t pkt_idx[MAX_PKT_BURST];
 	uint8_t out[MAX_PKT_BURST];
-	uint16_t j;
-
-	prefetch_first(mbufs, n_pkts);
+	struct ether_hdr *eth_hdr;
+	uint16_t j, n_keys = 0;
+
+	prefetch_pkts(mbufs, n_pkts);
+
+	/* Extract the keys of the whole burst first, only IPv4 packets
+	   are looked up, all others are dropped. */
+	for (j = 0; j < n_pkts; ++j) {
+		eth_hdr = rte_pktmbuf_mtod(mbufs[j], struct ether_hdr *);
+		if (unlikely(eth_hdr->ether_type != ETYPE_IPv4)) {
+			out[j] = OUT_DISCARD;
+			continue;
+		}
+		get_ipv4_5tuple(&key[n_keys], (struct ipv4_hdr *)(eth_hdr + 1));
+		key_ptr[n_keys] = &key[n_keys];
+		pkt_idx[n_keys++] = j;
+	}
 
-	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
-#ifdef PROX_PREFETCH_OFFSET
-		PREFETCH0(mbufs[j + PREFETCH_OFFSET]);
-		PREFETCH0(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
-#endif
-		out[j] = handle_lb_5tuple(task, mbufs[j]);
+	for (j = 0; j < n_keys; j += RTE_HASH_LOOKUP_BULK_MAX) {
+		rte_hash_lookup_bulk(task->lookup_hash, &key_ptr[j],
+				     RTE_MIN(n_keys - j, RTE_HASH_LOOKUP_BULK_MAX), &hash_index[j]);
 	}
-#ifdef PROX_PREFETCH_OFFSET
-	PREFETCH0(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
-	for (; j < n_pkts; ++j) {
-		out[j] = handle_lb_5tuple(task, mbufs[j]);
+
+	for (j = 0; j < n_keys; ++j) {
+		out[pkt_idx[j]] = hash_index[j] < 0 ? OUT_DISCARD : task->out_if[hash_index[j]];
 	}
-#endif
 
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
@@ -138,8 +120,7 @@ static void init_task_lb_5tuple(struct task_base *tbase, struct task_args *targ)
 
 	mask0 = _mm_set_epi32(ALL_32_BITS, ALL_32_BITS, ALL_32_BITS, BIT_8_TO_15);
 
-	uint8_t *out_table = task->out_if;
-	int ret = lua_to_tuples(prox_lua(), GLOBAL, "tuples", socket_id, &task->lookup_hash, &out_table);
+	int ret = lua_to_tuples(prox_lua(), GLOBAL, "tuples", socket_id, &task->lookup_hash, &task->out_if);
 	PROX_PANIC(ret, "Failed to read tuples from config\n");
 
 	task->runtime_flags = targ->flags;
@@ -53,6 +53,7 @@
 #include "hash_utils.h"
 #include "quit.h"
 #include "flow_iter.h"
+#include "pkt_parser.h"
 
 #if RTE_VERSION < RTE_VERSION_NUM(1,8,0,0)
 #define RTE_CACHE_LINE_SIZE CACHE_LINE_SIZE
@@ -78,8 +79,11 @@ struct task_lb_net_lut {
 	struct rte_mbuf       *fake_packets[64];
 };
 
-static inline uint8_t handle_lb_net(struct task_lb_net *task, struct rte_mbuf *mbuf);
 static inline int extract_gre_key(struct task_lb_net_lut *task, uint32_t *key, struct rte_mbuf *mbuf);
+static inline uint8_t lb_ip4(struct task_lb_net *task, struct ipv4_hdr *ip);
+static inline uint8_t lb_ip6(struct task_lb_net *task, struct ipv6_hdr *ip);
+static inline uint8_t lb_mpls(struct task_lb_net *task, struct rte_mbuf *mbuf, uint16_t l3_offset);
+static inline uint8_t lb_qinq(struct task_lb_net *task, struct qinq_hdr *qinq);
 
 static struct rte_table_hash *setup_gre_to_wt_lookup(struct task_args *targ, uint8_t n_workers, int socket_id)
 {
@@ -235,24 +239,49 @@ static int handle_lb_net_bulk(struct task_base *tbase, struct rte_mbuf **mbufs,
 {
 	struct task_lb_net *task = (struct task_lb_net *)tbase;
 	uint8_t out[MAX_PKT_BURST];
-	uint16_t j;
+	struct pkt_burst burst;
+	uint16_t i, j;
 
-	prefetch_first(mbufs, n_pkts);
+	prefetch_pkts(mbufs, n_pkts);
+	parse_pkt_burst(&burst, mbufs, n_pkts, task->qinq_tag);
 
-	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
-#ifdef PROX_PREFETCH_OFFSET
-		PREFETCH0(mbufs[j + PREFETCH_OFFSET]);
-		PREFETCH0(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
-#endif
-		out[j] = handle_lb_net(task, mbufs[j]);
+	for (i = 0; i < burst.n_pkts[PKT_TYPE_IPV4]; ++i) {
+		j = burst.idx[PKT_TYPE_IPV4][i];
+		out[j] = lb_ip4(task, rte_pktmbuf_mtod_offset(mbufs[j], struct ipv4_hdr *, burst.l3_offset[j]));
+	}
+	for (i = 0; i < burst.n_pkts[PKT_TYPE_IPV6]; ++i) {
+		j = burst.idx[PKT_TYPE_IPV6][i];
+		out[j] = lb_ip6(task, rte_pktmbuf_mtod_offset(mbufs[j], struct ipv6_hdr *, burst.l3_offset[j]));
+	}
+	for (i = 0; i < burst.n_pkts[PKT_TYPE_MPLS]; ++i) {
+		j = burst.idx[PKT_TYPE_MPLS][i];
+		out[j] = lb_mpls(task, mbufs[j], burst.l3_offset[j]);
+	}
+	for (i = 0; i < burst.n_pkts[PKT_TYPE_QINQ]; ++i) {
+		j = burst.idx[PKT_TYPE_QINQ][i];
+		out[j] = lb_qinq(task, rte_pktmbuf_mtod(mbufs[j], struct qinq_hdr *));
+	}
+	for (i = 0; i < burst.n_pkts[PKT_TYPE_LLDP]; ++i) {
+		out[burst.idx[PKT_TYPE_LLDP][i]] = OUT_DISCARD;
+	}
+	for (i = 0; i < burst.n_pkts[PKT_TYPE_RUNT]; ++i) {
+		j = burst.idx[PKT_TYPE_RUNT][i];
+		plogd_warn(mbufs[j], "Unexpected frame len = %d for packet : \n", rte_pktmbuf_pkt_len(mbufs[j]));
+		out[j] = OUT_DISCARD;
 	}
-#ifdef PROX_PREFETCH_OFFSET
-	PREFETCH0(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
 
-	for (; j < n_pkts; ++j) {
-		out[j] = handle_lb_net(task, mbufs[j]);
+	static const enum pkt_type unexpected[] = {PKT_TYPE_VLAN, PKT_TYPE_ARP, PKT_TYPE_OTHER};
+	for (uint8_t k = 0; k < sizeof(unexpected)/sizeof(unexpected[0]); ++k) {
+		const enum pkt_type t = unexpected[k];
+
+		for (i = 0; i < burst.n_pkts[t]; ++i) {
+			j = burst.idx[t][i];
+			plogd_warn(mbufs[j], "Unexpected frame Ether type = %#06x for packet : \n",
+				   rte_pktmbuf_mtod(mbufs[j], struct ether_hdr *)->ether_type);
+			out[j] = OUT_DISCARD;
+		}
 	}
-#endif
+
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
 
@@ -469,16 +498,11 @@ static inline uint8_t lb_ip6(struct task_lb_net *task, struct ipv6_hdr *ip)
 	return worker + task->nb_worker_threads * IPV6;
 }
 
-static inline uint8_t lb_mpls(struct task_lb_net *task, struct ether_hdr *peth, struct rte_mbuf *mbuf)
+static inline uint8_t lb_mpls(struct task_lb_net *task, struct rte_mbuf *mbuf, uint16_t l3_offset)
 {
-	struct mpls_hdr *mpls = (struct mpls_hdr *)(peth + 1);
-	uint32_t mpls_len = 0;
-	while (!(mpls->bytes & 0x00010000)) {
-		mpls++;
-		mpls_len += sizeof(struct mpls_hdr);
-	}
-	mpls_len += sizeof(struct mpls_hdr);
-	struct ipv4_hdr *ip = (struct ipv4_hdr *)(mpls + 1);
+	const uint32_t mpls_len = l3_offset - sizeof(struct ether_hdr);
+	struct ipv4_hdr *ip = rte_pktmbuf_mtod_offset(mbuf, struct ipv4_hdr *, l3_offset);
+	struct ether_hdr *peth;
 
 	switch (ip->version_ihl >> 4) {
 	case 4:
@@ -509,36 +533,6 @@ static inline uint8_t lb_qinq(struct task_lb_net *task, struct qinq_hdr *qinq)
 	return worker_from_mask(task, qinq_tags);
 }
 
-static inline uint8_t handle_lb_net(struct task_lb_net *task, struct rte_mbuf *mbuf)
-{
-	struct ether_hdr *peth = rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
-	const uint16_t len = rte_pktmbuf_pkt_len(mbuf);
-	if (len < 60) {
-		plogd_warn(mbuf, "Unexpected frame len = %d for packet : \n", len);
-		return OUT_DISCARD;
-	}
-
-	switch (peth->ether_type) {
-	case ETYPE_MPLSU:
-		return lb_mpls(task, peth, mbuf);
-	case ETYPE_8021ad:
-		return lb_qinq(task, (struct qinq_hdr *)peth);
-	case ETYPE_IPv4:
-		return lb_ip4(task, (struct ipv4_hdr *)(peth + 1));
-	case ETYPE_IPv6:
-		return lb_ip6(task, (struct ipv6_hdr *)(peth + 1));
-	case ETYPE_LLDP:
-		return OUT_DISCARD;
-	default:
-		if (peth->ether_type == task->qinq_tag)
-			return lb_qinq(task, (struct qinq_hdr *)peth);
-		plogd_warn(mbuf, "Unexpected frame Ether type = %#06x for packet : \n", peth->ether_type);
-		return OUT_DISCARD;
-	}
-
-	return 1;
-}
-
 static struct task_init task_init_lb_net = {
 	.mode_str = "lbnetwork",
 	.init = init_task_lb_net,
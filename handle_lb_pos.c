@@ -30,10 +30,13 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <string.h>
+
 #include <rte_mbuf.h>
 #include <rte_ip.h>
 #include <rte_udp.h>
 #include <rte_hash_crc.h>
+#include <rte_lcore.h>
 
 #include "log.h"
 #include "task_base.h"
@@ -45,11 +48,15 @@
 #include "etypes.h"
 #include "gre.h"
 #include "prefetch.h"
+#include "prox_malloc.h"
+#include "toeplitz.h"
+#include "handle_lb_net.h"
 
 struct task_lb_pos {
 	struct task_base base;
 	uint16_t         byte_offset;
 	uint8_t          n_workers;
+	struct toeplitz_tbl *tbl;
 };
 
 static void init_task_lb_pos(struct task_base *tbase, struct task_args *targ)
@@ -150,6 +157,66 @@ static int handle_lb_ip_port_bulk(struct task_base *tbase, struct rte_mbuf **mbu
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
 
+static void init_task_lb_rss(struct task_base *tbase, struct task_args *targ)
+{
+	struct task_lb_pos *task = (struct task_lb_pos *)tbase;
+	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
+
+	init_task_lb_pos(tbase, targ);
+	task->tbl = prox_zmalloc(sizeof(*task->tbl), socket_id);
+	PROX_PANIC(task->tbl == NULL, "Failed to allocate toeplitz table\n");
+	toeplitz_tbl_init(task->tbl);
+}
+
+/* Select the worker as RSS would select the RX queue, i.e. hash the
+   IPv4 addresses and, for unfragmented TCP and UDP, the ports. */
+static uint8_t handle_lb_rss(struct task_lb_pos *task, struct rte_mbuf *mbuf)
+{
+	struct pkt_ether_ipv4_udp *pkt = rte_pktmbuf_mtod(mbuf, void *);
+	uint8_t buf[TOEPLITZ_TBL_LEN];
+	int len = 8;
+
+	if (pkt->ether.ether_type != ETYPE_IPv4)
+		return OUT_DISCARD;
+
+	memcpy(buf, &pkt->ipv4.src_addr, 8);
+	if ((pkt->ipv4.next_proto_id == IPPROTO_TCP ||
+	     pkt->ipv4.next_proto_id == IPPROTO_UDP) &&
+	    !(pkt->ipv4.fragment_offset & rte_cpu_to_be_16(0x3fff))) {
+		uint8_t *l4 = (uint8_t *)&pkt->ipv4 + (pkt->ipv4.version_ihl & 0xF) * 4;
+
+		memcpy(buf + 8, l4, 4);
+		len = 12;
+	}
+
+	return rss_to_queue(toeplitz_tbl_hash(task->tbl, buf, len), task->n_workers);
+}
+
+static int handle_lb_rss_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
+{
+	struct task_lb_pos *task = (struct task_lb_pos *)tbase;
+	uint8_t out[MAX_PKT_BURST];
+	uint16_t j;
+
+	prefetch_first(mbufs, n_pkts);
+
+	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
+#ifdef PROX_PREFETCH_OFFSET
+		PREFETCH0(mbufs[j + PREFETCH_OFFSET]);
+		PREFETCH0(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
+#endif
+		out[j] = handle_lb_rss(task, mbufs[j]);
+	}
+#ifdef PROX_PREFETCH_OFFSET
+	PREFETCH0(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
+	for (; j < n_pkts; ++j) {
+		out[j] = handle_lb_rss(task, mbufs[j]);
+	}
+#endif
+
+	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+}
+
 static struct task_init task_init_lb_pos = {
 	.mode_str = "lbpos",
 	.init = init_task_lb_pos,
@@ -165,8 +232,17 @@ static struct task_init task_init_lb_pos2 = {
 	.size = sizeof(struct task_lb_pos)
 };
 
+static struct task_init task_init_lb_pos3 = {
+	.mode_str = "lbpos",
+	.sub_mode_str = "rss",
+	.init = init_task_lb_rss,
+	.handle = handle_lb_rss_bulk,
+	.size = sizeof(struct task_lb_pos)
+};
+
 __attribute__((constructor)) static void reg_task_lb_pos(void)
 {
 	reg_task(&task_init_lb_pos);
 	reg_task(&task_init_lb_pos2);
+	reg_task(&task_init_lb_pos3);
 }
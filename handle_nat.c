@@ -30,6 +30,10 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <rte_mbuf.h>
 #include <rte_hash.h>
 #include <rte_hash_crc.h>
@@ -37,6 +41,7 @@
 #include <rte_ip.h>
 #include <rte_version.h>
 #include <rte_byteorder.h>
+#include <rte_cycles.h>
 
 #include "prox_lua_types.h"
 #include "prox_lua.h"
@@ -51,13 +56,24 @@
 #include "lconf.h"
 #include "log.h"
 #include "prox_port_cfg.h"
+#include "parse_utils.h"
+#include "qsbr.h"
+#include "handle_nat.h"
 
-struct task_nat {
-	struct task_base base;
+/* Replaced as a whole when changed at runtime, see task_nat_load() */
+struct nat_table {
 	struct rte_hash  *hash;
 	uint32_t         *entries;
+	uint32_t         n_entries;
+	uint32_t         max_entries;
+};
+
+struct task_nat {
+	struct task_base base;
+	struct nat_table *table;  /* Use qsbr_deref() */
 	int              use_src;
 	int              offload_crc;
+	int              socket_id;
 };
 
 struct pkt_eth_ipv4 {
@@ -65,59 +81,137 @@ struct pkt_eth_ipv4 {
 	struct ipv4_hdr  ipv4_hdr;
 } __attribute__((packed));
 
-static int handle_nat(struct task_nat *task, struct rte_mbuf *mbuf)
+static inline uint8_t handle_nat(struct task_nat *task, const struct nat_table *table, struct rte_mbuf *mbuf, uint32_t *ip_addr, int32_t hash_index)
 {
-	uint32_t *ip_addr;
 	struct pkt_eth_ipv4 *pkt = rte_pktmbuf_mtod(mbuf, struct pkt_eth_ipv4 *);
-	int ret;
-
-	/* Currently, only support eth/ipv4 packets */
-	if (pkt->ether_hdr.ether_type != ETYPE_IPv4)
-		return OUT_DISCARD;
-	if (task->use_src)
-		ip_addr = &(pkt->ipv4_hdr.src_addr);
-	else
-		ip_addr = &(pkt->ipv4_hdr.dst_addr);
-
-	ret = rte_hash_lookup(task->hash, ip_addr);
+	uint32_t old_addr = *ip_addr;
 
 	/* Drop all packets for which no translation has been
 	   configured. */
-	if (ret < 0)
+	if (hash_index < 0)
 		return OUT_DISCARD;
 
-        *ip_addr = task->entries[ret];
-	prox_ip_udp_cksum(mbuf, &pkt->ipv4_hdr, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
+	*ip_addr = table->entries[hash_index];
+	/* Only the address changed, the checksums of the received
+	   packet are updated instead of recomputed. */
+	if (prox_cksum_in_sw(task->offload_crc))
+		prox_ip_udp_cksum_update(&pkt->ipv4_hdr, old_addr, *ip_addr, 0, 0);
+	else
+		prox_ip_udp_cksum(mbuf, &pkt->ipv4_hdr, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
 	return 0;
 }
 
 static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
-        struct task_nat *task = (struct task_nat *)tbase;
-        uint8_t out[MAX_PKT_BURST];
-        uint16_t j;
-        prefetch_first(mbufs, n_pkts);
-        for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
-#ifdef PROX_PREFETCH_OFFSET
-                PREFETCH0(mbufs[j + PREFETCH_OFFSET]);
-                PREFETCH0(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
-#endif
-                out[j] = handle_nat(task, mbufs[j]);
-        }
-#ifdef PROX_PREFETCH_OFFSET
-        PREFETCH0(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
-        for (; j < n_pkts; ++j) {
-                out[j] = handle_nat(task, mbufs[j]);
-        }
-#endif
-        return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+	struct task_nat *task = (struct task_nat *)tbase;
+	const struct nat_table *table = qsbr_deref(task->table);
+	struct pkt_eth_ipv4 *pkt;
+	uint32_t *ip_addr[MAX_PKT_BURST];
+	int32_t hash_index[MAX_PKT_BURST];
+	uint16_t pkt_idx[MAX_PKT_BURST];
+	uint8_t out[MAX_PKT_BURST];
+	uint16_t j, n_keys = 0;
+
+	prefetch_pkts(mbufs, n_pkts);
+
+	/* Currently, only support eth/ipv4 packets. The addresses in
+	   the packets are used as keys, all lookups are done before any
+	   packet is rewritten. */
+	for (j = 0; j < n_pkts; ++j) {
+		pkt = rte_pktmbuf_mtod(mbufs[j], struct pkt_eth_ipv4 *);
+		if (unlikely(pkt->ether_hdr.ether_type != ETYPE_IPv4)) {
+			out[j] = OUT_DISCARD;
+			continue;
+		}
+		if (task->use_src)
+			ip_addr[n_keys] = &pkt->ipv4_hdr.src_addr;
+		else
+			ip_addr[n_keys] = &pkt->ipv4_hdr.dst_addr;
+		pkt_idx[n_keys++] = j;
+	}
+
+	for (j = 0; j < n_keys; j += RTE_HASH_LOOKUP_BULK_MAX) {
+		rte_hash_lookup_bulk(table->hash, (const void **)&ip_addr[j],
+				     RTE_MIN(n_keys - j, RTE_HASH_LOOKUP_BULK_MAX), &hash_index[j]);
+	}
+
+	for (j = 0; j < n_keys; ++j) {
+		out[pkt_idx[j]] = handle_nat(task, table, mbufs[pkt_idx[j]], ip_addr[j], hash_index[j]);
+	}
+
+	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+}
+
+static struct nat_table *nat_table_create(uint32_t max_entries, int socket)
+{
+	static uint32_t table_id;
+	struct nat_table *table;
+	char hash_name[30];
+
+	snprintf(hash_name, sizeof(hash_name), "nat_table_%u", table_id++);
+
+	const struct rte_hash_parameters hash_params = {
+		.name = hash_name,
+		.entries = max_entries,
+		.key_len = sizeof(uint32_t),
+		.hash_func = rte_hash_crc,
+		.hash_func_init_val = 0,
+		.socket_id = socket,
+	};
+
+	table = prox_zmalloc(sizeof(*table), socket);
+	if (table == NULL)
+		return NULL;
+	table->max_entries = max_entries;
+	table->hash = rte_hash_create(&hash_params);
+	/* Indexed by the key positions returned by the hash */
+	table->entries = prox_zmalloc(max_entries * sizeof(table->entries[0]), socket);
+	if (table->hash == NULL || table->entries == NULL) {
+		plog_err("Failed to allocate NAT table with %u entries\n", max_entries);
+		rte_hash_free(table->hash);
+		prox_free(table->entries);
+		prox_free(table);
+		return NULL;
+	}
+	return table;
+}
+
+static void nat_table_free(struct nat_table *table)
+{
+	rte_hash_free(table->hash);
+	prox_free(table->entries);
+	prox_free(table);
+}
+
+/* ip_from and ip_to are in network byte order. An existing
+   translation for ip_from is replaced. */
+static int nat_table_add(struct nat_table *table, uint32_t ip_from, uint32_t ip_to)
+{
+	int ret = rte_hash_add_key(table->hash, (const void *)&ip_from);
+
+	if (ret < 0)
+		return ret;
+	if (table->entries[ret] == 0)
+		table->n_entries++;
+	table->entries[ret] = ip_to;
+	return 0;
+}
+
+static int nat_table_del(struct nat_table *table, uint32_t ip_from)
+{
+	int ret = rte_hash_del_key(table->hash, (const void *)&ip_from);
+
+	if (ret < 0)
+		return ret;
+	table->entries[ret] = 0;
+	table->n_entries--;
+	return 0;
 }
 
 static int lua_to_hash_nat(struct lua_State *L, enum lua_place from, const char *name,
-			   uint8_t socket, struct rte_hash **hash, uint32_t **entries)
+			   uint8_t socket, struct nat_table **table)
 {
-	struct rte_hash *ret_hash;
-	uint32_t *ret_entries;
+	struct nat_table *ret_table;
 	uint32_t n_entries;
 	uint32_t ip_from, ip_to;
 	int ret, pop;
@@ -131,21 +225,8 @@ static int lua_to_hash_nat(struct lua_State *L, enum lua_place from, const char
 
 	PROX_PANIC(n_entries == 0, "No entries for NAT\n");
 
-	static char hash_name[30] = "000_hash_nat_table";
-
-	const struct rte_hash_parameters hash_params = {
-		.name = hash_name,
-		.entries = n_entries * 4,
-		.key_len = sizeof(ip_from),
-		.hash_func = rte_hash_crc,
-		.hash_func_init_val = 0,
-	};
-
-	ret_hash = rte_hash_create(&hash_params);
-	PROX_PANIC(ret_hash == NULL, "Failed to set up hash table for NAT\n");
-	name++;
-	ret_entries = prox_zmalloc(n_entries * sizeof(ip_to), socket);
-	PROX_PANIC(ret_entries == NULL, "Failed to allocate memory for NAT %u entries\n", n_entries);
+	ret_table = nat_table_create(n_entries * 4, socket);
+	PROX_PANIC(ret_table == NULL, "Failed to set up hash table for NAT\n");
 
 	lua_pushnil(L);
 	while (lua_next(L, -2)) {
@@ -156,23 +237,132 @@ static int lua_to_hash_nat(struct lua_State *L, enum lua_place from, const char
 		ip_from = rte_bswap32(ip_from);
 		ip_to = rte_bswap32(ip_to);
 
-		ret = rte_hash_lookup(ret_hash, (const void *)&ip_from);
+		ret = rte_hash_lookup(ret_table->hash, (const void *)&ip_from);
 		PROX_PANIC(ret >= 0, "Key %x already exists in NAT hash table\n", ip_from);
 
-		ret = rte_hash_add_key(ret_hash, (const void *)&ip_from);
+		ret = nat_table_add(ret_table, ip_from, ip_to);
 
 		PROX_PANIC(ret < 0, "Failed to add Key %x to NAT hash table\n", ip_from);
-		ret_entries[ret] = ip_to;
 		lua_pop(L, 1);
 	}
 
 	lua_pop(L, pop);
 
-	*hash = ret_hash;
-	*entries = ret_entries;
+	*table = ret_table;
+	return 0;
+}
+
+struct nat_update {
+	uint32_t ip_from;
+	uint32_t ip_to;  /* 0 to delete the translation */
+};
+
+/* The hash table can't be changed while it is looked up. A copy
+   with the changes applied replaces it, and the old table is freed
+   once no core uses it anymore. */
+static int nat_table_update(struct task_nat *task, const struct nat_update *updates, uint32_t n_updates, uint32_t *n_failed)
+{
+	struct nat_table *old = task->table, *table;
+	uint32_t max_entries = old->max_entries;
+	const void *key;
+	void *data;
+	uint32_t next = 0;
+	int32_t pos;
+
+	while (max_entries < 2 * (old->n_entries + n_updates))
+		max_entries *= 2;
+
+	table = nat_table_create(max_entries, task->socket_id);
+	if (table == NULL)
+		return -1;
+
+	while ((pos = rte_hash_iterate(old->hash, &key, &data, &next)) >= 0) {
+		if (nat_table_add(table, *(const uint32_t *)key, old->entries[pos])) {
+			nat_table_free(table);
+			return -1;
+		}
+	}
+
+	*n_failed = 0;
+	for (uint32_t i = 0; i < n_updates; ++i) {
+		int ret;
+
+		if (updates[i].ip_to)
+			ret = nat_table_add(table, updates[i].ip_from, updates[i].ip_to);
+		else
+			ret = nat_table_del(table, updates[i].ip_from);
+		if (ret < 0)
+			(*n_failed)++;
+	}
+
+	qsbr_publish(task->table, table);
+	qsbr_synchronize();
+	nat_table_free(old);
 	return 0;
 }
 
+int task_nat_load(struct task_base *tbase, const char *file_name)
+{
+	struct task_nat *task = (struct task_nat *)tbase;
+	uint32_t n_updates = 0, max_updates = 0, n_failed = 0, n_invalid = 0, line_nb = 0;
+	struct nat_update *updates = NULL, *u;
+	char line[256], op[8], from_str[64], to_str[64];
+	uint32_t ip_from, ip_to;
+	uint64_t tsc_start, tsc;
+	int ret = 0;
+	FILE *f;
+
+	f = fopen(file_name, "r");
+	if (f == NULL) {
+		plog_err("Failed to open NAT file %s\n", file_name);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		line_nb++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		int n = sscanf(line, "%7s %63s %63s", op, from_str, to_str);
+
+		if (n_updates == max_updates) {
+			max_updates = max_updates? 2 * max_updates : 1024;
+			updates = realloc(updates, max_updates * sizeof(updates[0]));
+			PROX_PANIC(updates == NULL, "Failed to allocate memory for NAT updates\n");
+		}
+		u = &updates[n_updates];
+
+		if (n >= 2 && !strcmp(op, "del") && parse_ip(&ip_from, from_str) == 0) {
+			ip_to = 0;
+		}
+		else if (!(n == 3 && !strcmp(op, "add") && parse_ip(&ip_from, from_str) == 0 &&
+			   parse_ip(&ip_to, to_str) == 0 && ip_to != 0)) {
+			plog_err("Invalid NAT entry on line %u of %s: %s", line_nb, file_name, line);
+			n_invalid++;
+			continue;
+		}
+		u->ip_from = rte_bswap32(ip_from);
+		u->ip_to = rte_bswap32(ip_to);
+		n_updates++;
+	}
+	fclose(f);
+
+	tsc_start = rte_rdtsc();
+	if (n_updates)
+		ret = nat_table_update(task, updates, n_updates, &n_failed);
+	tsc = rte_rdtsc() - tsc_start;
+	free(updates);
+
+	if (ret) {
+		plog_err("Failed to update NAT table, no change applied\n");
+		return -1;
+	}
+	plog_info("Applied %u NAT changes (%u failed, %u invalid) in %"PRIu64" us, %"PRIu64" updates/s, %u entries\n",
+		  n_updates - n_failed, n_failed, n_invalid, tsc * 1000000 / rte_get_tsc_hz(),
+		  tsc? (uint64_t)n_updates * rte_get_tsc_hz() / tsc : 0, task->table->n_entries);
+	return n_failed || n_invalid? -1 : 0;
+}
+
 static void init_task_nat(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_nat *task = (struct task_nat *)tbase;
@@ -181,9 +371,10 @@ static void init_task_nat(struct task_base *tbase, struct task_args *targ)
 
 	/* Use destination IP by default. */
 	task->use_src = targ->use_src;
+	task->socket_id = socket_id;
 
 	PROX_PANIC(!strcmp(targ->nat_table, ""), "No nat table specified\n");
-	ret = lua_to_hash_nat(prox_lua(), GLOBAL, targ->nat_table, socket_id, &task->hash, &task->entries);
+	ret = lua_to_hash_nat(prox_lua(), GLOBAL, targ->nat_table, socket_id, &task->table);
 	PROX_PANIC(ret != 0, "Failed to load NAT table from lua:\n%s\n", get_lua_to_errors());
 	struct prox_port_cfg *port = find_reachable_port(targ);
 	if (port) {
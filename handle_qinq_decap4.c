@@ -59,6 +59,8 @@
 #include "lconf.h"
 #include "prox_cfg.h"
 #include "prox_shared.h"
+#include "qsbr.h"
+#include "handle_cpe_learn.h"
 
 struct task_qinq_decap4 {
 	struct task_base        base;
@@ -66,7 +68,7 @@ struct task_qinq_decap4 {
 	struct rte_table_hash   *qinq_gre_table;
 	struct qinq_gre_data    *qinq_gre_data;
 	struct next_hop         *next_hops;
-	struct rte_lpm          *ipv4_lpm;
+	struct lpm4             *lpm;
 	uint32_t                local_ipv4;
 	uint16_t                qinq_tag;
 	uint8_t                 runtime_flags;
@@ -75,6 +77,7 @@ struct task_qinq_decap4 {
 	uint64_t                src_mac[PROX_MAX_PORTS];
 	struct rte_mbuf*        fake_packets[64];
 	struct expire_cpe       expire_cpe;
+	struct cpe_learn_chan   *learn;
 	uint64_t                cpe_timeout;
 	uint8_t                 mapping[PROX_MAX_PORTS];
 };
@@ -100,7 +103,7 @@ static void init_task_qinq_decap4(struct task_base *tbase, struct task_args *tar
 		PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
 		prox_sh_add_socket(socket_id, targ->route_table, lpm);
 	}
-	task->ipv4_lpm = lpm->rte_lpm;
+	task->lpm = lpm;
 	task->next_hops = lpm->next_hops;
 
 	task->qinq_tag = targ->qinq_tag;
@@ -111,7 +114,16 @@ static void init_task_qinq_decap4(struct task_base *tbase, struct task_args *tar
 
 	task->qinq_gre_table = targ->qinq_gre_table;
 
-	if (targ->cpe_table_timeout_ms) {
+	/* With a learner, entries are published back and aged out
+	   by the learner and are applied from the period function. */
+	task->learn = cpe_learn_chan_find(targ);
+	if (task->learn) {
+		task->learn->cpe_table = task->cpe_table;
+		targ->lconf->period_func = cpe_learn_apply;
+		targ->lconf->period_data = task->learn;
+		targ->lconf->period_timeout = freq_to_tsc(targ->ctrl_freq);
+	}
+	else if (targ->cpe_table_timeout_ms) {
 		targ->lconf->period_func = check_expire_cpe;
 		task->expire_cpe.cpe_table = task->cpe_table;
 		targ->lconf->period_data = &task->expire_cpe;
@@ -229,6 +241,16 @@ static int add_cpe_entry(struct rte_table_hash *hash, struct cpe_key *key, struc
 	return 0;
 }
 
+/* Learns inline, or defers to the learner if there is one */
+static int learn_cpe_entry(struct task_qinq_decap4 *task, struct cpe_key *key, struct cpe_data *data)
+{
+	if (task->learn) {
+		cpe_learn_post(task->learn, key, data);
+		return 0;
+	}
+	return add_cpe_entry(task->cpe_table, key, data);
+}
+
 static void extract_key_data_arp(struct rte_mbuf* mbuf, struct cpe_key* key, struct cpe_data* data, const struct qinq_gre_data* entry, uint64_t cpe_timeout, uint8_t* mapping)
 {
 	const struct cpe_packet_arp *packet = rte_pktmbuf_mtod(mbuf, const struct cpe_packet_arp *);
@@ -340,14 +362,7 @@ static void arp_update(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_
 
 		extract_key_data_arp(mbufs[j], &key, &data, entries[j], task->cpe_timeout, task->mapping);
 
-		void* entry_in_hash;
-		int ret, key_found = 0;
-
-		ret = rte_table_hash_key8_ext_dosig_ops.
-			f_add(task->cpe_table, &key, &data, &key_found, &entry_in_hash);
-
-		if (unlikely(ret)) {
-			plogx_err("Failed to add key %x, gre %x\n", key.ip, key.gre_id);
+		if (unlikely(learn_cpe_entry(task, &key, &data))) {
 			TASK_STATS_ADD_DROP_DISCARD(&task->base.aux->stats, 1);
 		}
 
@@ -470,7 +485,7 @@ static inline uint8_t gre_encap_route(uint32_t src_ipv4, struct rte_mbuf *mbuf,
 #else
 	uint8_t next_hop_index;
 #endif
-	if (unlikely(rte_lpm_lookup(task->ipv4_lpm, rte_bswap32(pip->dst_addr), &next_hop_index) != 0)) {
+	if (unlikely(rte_lpm_lookup(qsbr_deref(task->lpm->rte_lpm), rte_bswap32(pip->dst_addr), &next_hop_index) != 0)) {
 		plog_warn("lpm_lookup failed for ip %x: rc = %d\n", rte_bswap32(pip->dst_addr), -ENOENT);
 		return ROUTE_ERR;
 	}
@@ -573,7 +588,7 @@ static uint8_t handle_qinq_decap4(struct task_qinq_decap4 *task, struct rte_mbuf
 		extract_key_data(mbuf, &key, &data, entry, task->cpe_timeout, task->mapping);
 		//plogx_err("Adding key ip=%x/gre_id=%x data (svlan|cvlan)=%x|%x, rss=%x, gre_id=%x\n", key.ip, key.gre_id, data.qinq_svlan,data.qinq_cvlan, mbuf->hash.rss, entry->gre_id);
 
-		if (add_cpe_entry(task->cpe_table, &key, &data)) {
+		if (learn_cpe_entry(task, &key, &data)) {
 			plog_warn("Failed to add ARP entry\n");
 			return OUT_DISCARD;
 		}
@@ -586,7 +601,7 @@ static uint8_t handle_qinq_decap4(struct task_qinq_decap4 *task, struct rte_mbuf
 			struct cpe_data data;
 			extract_key_data_arp(mbuf, &key, &data, entry, task->cpe_timeout, task->mapping);
 
-			if (add_cpe_entry(task->cpe_table, &key, &data)) {
+			if (learn_cpe_entry(task, &key, &data)) {
 				plog_warn("Failed to add ARP entry\n");
 				return OUT_DISCARD;
 			}
@@ -602,7 +617,7 @@ static uint8_t handle_qinq_decap4(struct task_qinq_decap4 *task, struct rte_mbuf
 				struct cpe_data data;
 				extract_key_data_arp(mbuf, &key, &data, entry, task->cpe_timeout, task->mapping);
 
-				if (add_cpe_entry(task->cpe_table, &key, &data)) {
+				if (learn_cpe_entry(task, &key, &data)) {
 					plog_warn("Failed to add ARP entry\n");
 					return OUT_DISCARD;
 				}
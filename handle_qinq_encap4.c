@@ -530,6 +530,9 @@ int handle_qinq_encap4_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, ui
 
 static inline uint8_t handle_qinq_encap4(struct task_qinq_encap4 *task, struct cpe_pkt *cpe_pkt, struct rte_mbuf *mbuf, struct cpe_data *entry)
 {
+	uint16_t cksum = cpe_pkt->ipv4_hdr.hdr_checksum;
+	uint32_t dst_addr = cpe_pkt->ipv4_hdr.dst_addr;
+
 	PROX_ASSERT(cpe_pkt);
 
 	if (cpe_pkt->ipv4_hdr.time_to_live) {
@@ -553,7 +556,13 @@ static inline uint8_t handle_qinq_encap4(struct task_qinq_encap4 *task, struct c
 	task->stats_per_user[entry->user]++;
 #endif
 	if (task->runtime_flags & TASK_TX_CRC) {
-		prox_ip_cksum(mbuf, &cpe_pkt->ipv4_hdr, sizeof(struct qinq_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
+		/* Only TTL and destination address may have changed */
+		if (prox_cksum_in_sw(task->offload_crc)) {
+			cksum = prox_ip_cksum_ttl_dec(cksum);
+			cpe_pkt->ipv4_hdr.hdr_checksum = prox_cksum_update32(cksum, dst_addr, cpe_pkt->ipv4_hdr.dst_addr);
+		}
+		else
+			prox_ip_cksum(mbuf, &cpe_pkt->ipv4_hdr, sizeof(struct qinq_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
 	}
 	return entry->mac_port.out_idx;
 }
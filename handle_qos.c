@@ -181,9 +181,21 @@ static void init_task_qos(struct task_base *tbase, struct task_args *targ)
 	}
 }
 
+static uint32_t qos_mbufs_held(struct task_args *targ)
+{
+	const struct rte_sched_port_params *params = &targ->qos_conf.port_params;
+	uint32_t n_per_pipe = 0;
+
+	for (uint32_t tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; ++tc)
+		n_per_pipe += params->qsize[tc] * RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS;
+
+	return n_per_pipe * params->n_pipes_per_subport * params->n_subports_per_port;
+}
+
 static struct task_init task_init_qos = {
 	.mode_str = "qos",
 	.init = init_task_qos,
+	.mbufs_held = qos_mbufs_held,
 	.handle = handle_qos_bulk,
 	.flag_features = TASK_FEATURE_CLASSIFY | TASK_FEATURE_NEVER_DISCARDS | TASK_FEATURE_MULTI_RX | TASK_FEATURE_ZERO_RX,
 	.size = sizeof(struct task_qos)
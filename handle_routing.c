@@ -33,6 +33,8 @@
 #include <rte_lpm.h>
 #include <rte_cycles.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <rte_version.h>
 #include <rte_ip.h>
 #include <rte_byteorder.h>
@@ -53,6 +55,9 @@
 #include "mpls.h"
 #include "qinq.h"
 #include "prox_cfg.h"
+#include "qsbr.h"
+#include "parse_utils.h"
+#include "ip_subnet.h"
 #include "ip6_addr.h"
 #include "prox_shared.h"
 #include "prox_cksum.h"
@@ -62,37 +67,89 @@ struct task_routing {
 	struct task_base                base;
 	uint8_t                         runtime_flags;
 	struct lcore_cfg                *lconf;
-	struct rte_lpm                  *ipv4_lpm;
+	struct lpm4                     *lpm;
 	struct next_hop                 *next_hops;
 	int                             offload_crc;
-	uint32_t			number_free_rules;
 	uint16_t                        qinq_tag;
 	uint32_t                        marking[4];
 	uint64_t                        src_mac[PROX_MAX_PORTS];
 };
 
-static void routing_update(struct task_base *tbase, void **data, uint16_t n_msgs)
+uint32_t task_routing_update(struct task_base *tbase, const struct lpm4_update *updates, uint32_t n_updates)
 {
 	struct task_routing *task = (struct task_routing *)tbase;
-	struct route_msg *msg;
-
-	for (uint16_t i = 0; i < n_msgs; ++i) {
-		msg = (struct route_msg *)data[i];
-
-		if (task->number_free_rules == 0) {
-			plog_warn("Failed adding route: %u.%u.%u.%u/%u: lpm table full\n",
-				msg->ip_bytes[0], msg->ip_bytes[1], msg->ip_bytes[2],
-				msg->ip_bytes[3], msg->prefix);
-		} else {
-			if (rte_lpm_add(task->ipv4_lpm, rte_bswap32(msg->ip), msg->prefix, msg->nh)) {
-				plog_warn("Failed adding route: %u.%u.%u.%u/%u\n",
-					msg->ip_bytes[0], msg->ip_bytes[1], msg->ip_bytes[2],
-					msg->ip_bytes[3], msg->prefix);
-			} else {
-				task->number_free_rules--;
-			}
+
+	return lpm4_update(task->lpm, updates, n_updates);
+}
+
+struct lpm4 *task_routing_get_lpm(struct task_base *tbase)
+{
+	struct task_routing *task = (struct task_routing *)tbase;
+
+	return task->lpm;
+}
+
+int task_routing_load(struct task_base *tbase, const char *file_name)
+{
+	struct task_routing *task = (struct task_routing *)tbase;
+	uint32_t n_updates = 0, max_updates = 0, n_failed = 0, n_invalid = 0, line_nb = 0;
+	struct lpm4_update *updates = NULL, *u;
+	char line[256], op[8], cidr_str[64];
+	struct ip4_subnet cidr;
+	uint64_t tsc_start, tsc;
+	uint32_t nh;
+	FILE *f;
+
+	f = fopen(file_name, "r");
+	if (f == NULL) {
+		plog_err("Failed to open route file %s\n", file_name);
+		return -1;
+	}
+
+	/* All changes are applied at once, which takes one grace period */
+	while (fgets(line, sizeof(line), f)) {
+		line_nb++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		int n = sscanf(line, "%7s %63s %u", op, cidr_str, &nh);
+
+		if (n_updates == max_updates) {
+			max_updates = max_updates? 2 * max_updates : 1024;
+			updates = realloc(updates, max_updates * sizeof(updates[0]));
+			PROX_PANIC(updates == NULL, "Failed to allocate memory for route updates\n");
 		}
+		u = &updates[n_updates];
+
+		if (n >= 2 && !strcmp(op, "del") && parse_ip4_cidr(&cidr, cidr_str) == 0) {
+			u->del = 1;
+			u->next_hop_index = 0;
+		}
+		else if (n == 3 && !strcmp(op, "add") && parse_ip4_cidr(&cidr, cidr_str) == 0 && nh < MAX_HOP_INDEX) {
+			u->del = 0;
+			u->next_hop_index = nh;
+		}
+		else {
+			plog_err("Invalid route on line %u of %s: %s", line_nb, file_name, line);
+			n_invalid++;
+			continue;
+		}
+		u->ip = cidr.ip;
+		u->prefix = cidr.prefix;
+		n_updates++;
 	}
+	fclose(f);
+
+	tsc_start = rte_rdtsc();
+	if (n_updates)
+		n_failed = lpm4_update(task->lpm, updates, n_updates);
+	tsc = rte_rdtsc() - tsc_start;
+	free(updates);
+
+	plog_info("Applied %u route changes (%u failed, %u invalid) in %"PRIu64" us, %"PRIu64" updates/s, %u routes\n",
+		  n_updates - n_failed, n_failed, n_invalid, tsc * 1000000 / rte_get_tsc_hz(),
+		  tsc? (uint64_t)n_updates * rte_get_tsc_hz() / tsc : 0, task->lpm->n_used_rules);
+	return n_failed || n_invalid? -1 : 0;
 }
 
 static void init_task_routing(struct task_base *tbase, struct task_args *targ)
@@ -110,8 +167,6 @@ static void init_task_routing(struct task_base *tbase, struct task_args *targ)
 		int ret = lua_to_lpm4(prox_lua(), GLOBAL, targ->route_table, socket_id, &lpm);
 		PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
 		prox_sh_add_socket(socket_id, targ->route_table, lpm);
-
-		task->number_free_rules = lpm->n_free_rules;
 	}
 	else {
 		lpm = prox_sh_find_socket(socket_id, targ->route_table);
@@ -121,9 +176,8 @@ static void init_task_routing(struct task_base *tbase, struct task_args *targ)
 			prox_sh_add_socket(socket_id, targ->route_table, lpm);
 		}
 	}
-	task->ipv4_lpm = lpm->rte_lpm;
+	task->lpm = lpm;
 	task->next_hops = lpm->next_hops;
-	task->number_free_rules = lpm->n_free_rules;
 
 	for (uint32_t i = 0; i < MAX_HOP_INDEX; i++) {
 		int tx_port = task->next_hops[i].mac_port.out_idx;
@@ -163,9 +217,6 @@ static void init_task_routing(struct task_base *tbase, struct task_args *targ)
 	if (port) {
 		task->offload_crc = port->capabilities.tx_offload_cksum;
 	}
-
-	targ->lconf->ctrl_func_m[targ->task] = routing_update;
-	targ->lconf->ctrl_timeout = freq_to_tsc(20);
 }
 
 static inline uint8_t handle_routing(struct task_routing *task, struct rte_mbuf *mbuf);
@@ -257,7 +308,7 @@ static uint8_t route_ipv4(struct task_routing *task, uint8_t *beg, uint32_t ip_o
 #else
 	uint8_t next_hop_index;
 #endif
-	if (unlikely(rte_lpm_lookup(task->ipv4_lpm, rte_bswap32(dst_ip), &next_hop_index) != 0)) {
+	if (unlikely(rte_lpm_lookup(qsbr_deref(task->lpm->rte_lpm), rte_bswap32(dst_ip), &next_hop_index) != 0)) {
 		uint8_t* dst_ipp = (uint8_t*)&dst_ip;
 		plog_warn("lpm_lookup failed for ip %d.%d.%d.%d: rc = %d\n",
 			dst_ipp[0], dst_ipp[1], dst_ipp[2], dst_ipp[3], -ENOENT);
@@ -33,13 +33,20 @@
 #ifndef _HANDLE_ROUTING_H_
 #define _HANDLE_ROUTING_H_
 
-struct route_msg {
-	union {
-		uint32_t ip;
-		uint8_t ip_bytes[4];
-	};
-	uint32_t prefix;
-	uint32_t nh;
-};
+#include <inttypes.h>
+
+struct task_base;
+struct lpm4;
+struct lpm4_update;
+
+/* Apply route changes to the table used by the routing task, and by
+   all tasks sharing it. Forwarding continues during the update.
+   Returns the number of changes that failed. */
+uint32_t task_routing_update(struct task_base *tbase, const struct lpm4_update *updates, uint32_t n_updates);
+/* The route table of the task, possibly shared with other tasks */
+struct lpm4 *task_routing_get_lpm(struct task_base *tbase);
+/* Apply the changes in file_name, one per line: "add <ip/prefix>
+   <next hop id>" or "del <ip/prefix>". */
+int task_routing_load(struct task_base *tbase, const char *file_name);
 
 #endif /* _HANDLE_ROUTING_H_ */
@@ -32,6 +32,9 @@
 
 #include <rte_mbuf.h>
 #include <rte_udp.h>
+#ifdef __SSSE3__
+#include <x86intrin.h>
+#endif
 
 #include "task_init.h"
 #include "task_base.h"
@@ -49,8 +52,68 @@ struct task_swap {
 	struct task_base base;
 	uint8_t src_dst_mac[12];
 	uint32_t runtime_flags;
+	/* First 16 bytes of the fast path output: bytes set in mac_mask
+	   are taken from mac_val, the others from the swapped header. */
+	uint8_t mac_val[16];
+	uint8_t mac_mask[16];
 };
 
+/* Fast path packets are untagged IPv4 without options carrying UDP or
+   TCP. IP addresses and L4 ports are then contiguous, starting at the IP
+   source address, and swapping them leaves all checksums unchanged. */
+#define SWAP_L34_OFFSET (sizeof(struct ether_hdr) + offsetof(struct ipv4_hdr, src_addr))
+#define SWAP_PROTO_OFFSET (sizeof(struct ether_hdr) + offsetof(struct ipv4_hdr, next_proto_id))
+/* ether_type 0x0800 followed by version_ihl 0x45, read as little endian */
+#define SWAP_L2L3_KEY 0x00450008
+#define SWAP_L2L3_KEY_MASK 0x00ffffff
+
+static inline int swap_is_fast(const uint8_t *pkt)
+{
+	uint32_t key = *(const uint32_t *)(pkt + offsetof(struct ether_hdr, ether_type)) & SWAP_L2L3_KEY_MASK;
+	uint8_t proto = pkt[SWAP_PROTO_OFFSET];
+
+	return key == SWAP_L2L3_KEY && (proto == IPPROTO_UDP || proto == IPPROTO_TCP);
+}
+
+/* Returns a mask with bit j set if mbufs[j] can take the fast path */
+static inline uint64_t swap_classify(struct rte_mbuf **mbufs, uint16_t n_pkts)
+{
+	uint64_t fast = 0;
+	uint16_t j = 0;
+
+#ifdef __SSSE3__
+	const __m128i key = _mm_set1_epi32(SWAP_L2L3_KEY);
+	const __m128i key_mask = _mm_set1_epi32(SWAP_L2L3_KEY_MASK);
+	const __m128i udp = _mm_set1_epi32(IPPROTO_UDP);
+	const __m128i tcp = _mm_set1_epi32(IPPROTO_TCP);
+	const uint8_t *p0, *p1, *p2, *p3;
+	__m128i l2l3, proto, ok;
+
+	for (; j + 4 <= n_pkts; j += 4) {
+		p0 = rte_pktmbuf_mtod(mbufs[j], const uint8_t *);
+		p1 = rte_pktmbuf_mtod(mbufs[j + 1], const uint8_t *);
+		p2 = rte_pktmbuf_mtod(mbufs[j + 2], const uint8_t *);
+		p3 = rte_pktmbuf_mtod(mbufs[j + 3], const uint8_t *);
+
+		l2l3 = _mm_set_epi32(*(const uint32_t *)(p3 + offsetof(struct ether_hdr, ether_type)),
+				     *(const uint32_t *)(p2 + offsetof(struct ether_hdr, ether_type)),
+				     *(const uint32_t *)(p1 + offsetof(struct ether_hdr, ether_type)),
+				     *(const uint32_t *)(p0 + offsetof(struct ether_hdr, ether_type)));
+		proto = _mm_set_epi32(p3[SWAP_PROTO_OFFSET], p2[SWAP_PROTO_OFFSET],
+				      p1[SWAP_PROTO_OFFSET], p0[SWAP_PROTO_OFFSET]);
+
+		ok = _mm_cmpeq_epi32(_mm_and_si128(l2l3, key_mask), key);
+		ok = _mm_and_si128(ok, _mm_or_si128(_mm_cmpeq_epi32(proto, udp), _mm_cmpeq_epi32(proto, tcp)));
+		fast |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(ok)) << j;
+	}
+#endif
+	for (; j < n_pkts; ++j) {
+		if (swap_is_fast(rte_pktmbuf_mtod(mbufs[j], const uint8_t *)))
+			fast |= 1ULL << j;
+	}
+	return fast;
+}
+
 static void write_src_and_dst_mac(struct task_swap *task, struct rte_mbuf *mbuf)
 {
 	struct ether_hdr *hdr;
@@ -95,6 +158,57 @@ static inline int handle_arp_request(struct task_swap *task, struct ether_hdr_ar
 	}
 }
 
+static void swap_fast_bulk(struct task_swap *task, struct rte_mbuf **mbufs, uint64_t fast)
+{
+	uint8_t *pkt;
+	uint16_t j;
+
+#ifdef __SSSE3__
+	/* Exchange destination and source MAC, keep ether_type and IP version */
+	const __m128i l2_shuffle = _mm_setr_epi8(6, 7, 8, 9, 10, 11, 0, 1, 2, 3, 4, 5, 12, 13, 14, 15);
+	/* Exchange IP source and destination, then L4 source and destination port */
+	const __m128i l34_shuffle = _mm_setr_epi8(4, 5, 6, 7, 0, 1, 2, 3, 10, 11, 8, 9, 12, 13, 14, 15);
+	const __m128i mac_val = _mm_loadu_si128((const __m128i *)task->mac_val);
+	const __m128i mac_mask = _mm_loadu_si128((const __m128i *)task->mac_mask);
+	__m128i l2, l34;
+
+	while (fast) {
+		j = __builtin_ctzll(fast);
+		fast &= fast - 1;
+		pkt = rte_pktmbuf_mtod(mbufs[j], uint8_t *);
+
+		l2 = _mm_loadu_si128((__m128i *)pkt);
+		l34 = _mm_loadu_si128((__m128i *)(pkt + SWAP_L34_OFFSET));
+		l2 = _mm_shuffle_epi8(l2, l2_shuffle);
+		l2 = _mm_or_si128(_mm_andnot_si128(mac_mask, l2), mac_val);
+		l34 = _mm_shuffle_epi8(l34, l34_shuffle);
+		_mm_storeu_si128((__m128i *)pkt, l2);
+		_mm_storeu_si128((__m128i *)(pkt + SWAP_L34_OFFSET), l34);
+	}
+#else
+	struct ipv4_hdr *ip_hdr;
+	struct udp_hdr *udp_hdr;
+	uint32_t ip;
+	uint16_t port;
+
+	while (fast) {
+		j = __builtin_ctzll(fast);
+		fast &= fast - 1;
+		pkt = rte_pktmbuf_mtod(mbufs[j], uint8_t *);
+
+		ip_hdr = (struct ipv4_hdr *)(pkt + sizeof(struct ether_hdr));
+		udp_hdr = (struct udp_hdr *)(ip_hdr + 1);
+		ip = ip_hdr->dst_addr;
+		ip_hdr->dst_addr = ip_hdr->src_addr;
+		ip_hdr->src_addr = ip;
+		port = udp_hdr->dst_port;
+		udp_hdr->dst_port = udp_hdr->src_port;
+		udp_hdr->src_port = port;
+		write_src_and_dst_mac(task, mbufs[j]);
+	}
+#endif
+}
+
 /*
  * swap mode does not send arp requests, so does not expect arp replies
  * Need to understand later whether we must send arp requests
@@ -119,6 +233,7 @@ static int handle_swap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, ui
 	struct qinq_hdr *qinq;
 	struct vlan_hdr *vlan;
 	struct ether_hdr_arp *hdr_arp;
+	uint64_t fast;
 	uint16_t j;
 
 	for (j = 0; j < n_pkts; ++j) {
@@ -128,7 +243,12 @@ static int handle_swap_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, ui
 		PREFETCH0(rte_pktmbuf_mtod(mbufs[j], void *));
 	}
 
+	fast = swap_classify(mbufs, n_pkts);
+	swap_fast_bulk(task, mbufs, fast);
+
 	for (uint16_t j = 0; j < n_pkts; ++j) {
+		if (fast & (1ULL << j))
+			continue;
 		hdr = rte_pktmbuf_mtod(mbufs[j], struct ether_hdr *);
 		switch (hdr->ether_type) {
 		case ETYPE_MPLSU:
@@ -250,6 +370,15 @@ static void init_task_swap(struct task_base *tbase, struct task_args *targ)
 		}
 	}
 	task->runtime_flags = targ->flags;
+
+	if (task->runtime_flags & TASK_ARG_DST_MAC_SET) {
+		memcpy(&task->mac_val[0], &task->src_dst_mac[0], sizeof(struct ether_addr));
+		memset(&task->mac_mask[0], 0xff, sizeof(struct ether_addr));
+	}
+	if (task->runtime_flags & TASK_ARG_SRC_MAC_SET) {
+		memcpy(&task->mac_val[6], &task->src_dst_mac[6], sizeof(struct ether_addr));
+		memset(&task->mac_mask[6], 0xff, sizeof(struct ether_addr));
+	}
 }
 
 static struct task_init task_init_swap = {
@@ -0,0 +1,191 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_cycles.h>
+#include <rte_byteorder.h>
+
+#include "ipv6_tun_table.h"
+#include "prox_malloc.h"
+#include "parse_utils.h"
+#include "log.h"
+
+struct ipv6_tun_table *ipv6_tun_table_create(uint32_t n_max_entries, uint16_t port_mask, int socket_id)
+{
+	struct ipv6_tun_table *table;
+	uint32_t n_buckets;
+
+	/* Keep the load below 50% so that adding to a full pair of
+	   buckets is unlikely. */
+	n_buckets = rte_align32pow2(2 * n_max_entries / IPV6_TUN_BUCKET_ENTRIES);
+	if (n_buckets == 0)
+		n_buckets = 1;
+
+	table = prox_zmalloc(sizeof(*table), socket_id);
+	if (table == NULL)
+		return NULL;
+
+	table->buckets = prox_zmalloc(n_buckets * sizeof(struct ipv6_tun_bucket), socket_id);
+	if (table->buckets == NULL) {
+		prox_free(table);
+		return NULL;
+	}
+	table->bucket_mask = n_buckets - 1;
+	table->port_mask = port_mask;
+	table->n_max_entries = n_max_entries;
+	return table;
+}
+
+static int ipv6_tun_bucket_find(const struct ipv6_tun_bucket *bucket, uint64_t key)
+{
+	uint32_t match = ipv6_tun_bucket_match(bucket, key) & bucket->used;
+
+	return match? __builtin_ctz(match) : -1;
+}
+
+static void ipv6_tun_bucket_write_begin(struct ipv6_tun_bucket *bucket)
+{
+	bucket->seq++;
+	rte_wmb();
+}
+
+static void ipv6_tun_bucket_write_end(struct ipv6_tun_bucket *bucket)
+{
+	rte_wmb();
+	bucket->seq++;
+}
+
+int ipv6_tun_table_add(struct ipv6_tun_table *table, uint64_t key, const struct ipv6_tun_dest *dest)
+{
+	struct ipv6_tun_bucket *b1 = &table->buckets[ipv6_tun_bucket1(table, key)];
+	struct ipv6_tun_bucket *b2 = &table->buckets[ipv6_tun_bucket2(table, key)];
+	struct ipv6_tun_bucket *bucket;
+	int idx;
+
+	if ((idx = ipv6_tun_bucket_find(b1, key)) >= 0)
+		bucket = b1;
+	else if ((idx = ipv6_tun_bucket_find(b2, key)) >= 0)
+		bucket = b2;
+	else {
+		if (table->n_entries == table->n_max_entries)
+			return -1;
+		/* Use the least loaded bucket */
+		bucket = __builtin_popcount(b1->used) <= __builtin_popcount(b2->used)? b1 : b2;
+		if (bucket->used == (1 << IPV6_TUN_BUCKET_ENTRIES) - 1)
+			return -1;
+		idx = __builtin_ctz(~bucket->used);
+		table->n_entries++;
+	}
+
+	ipv6_tun_bucket_write_begin(bucket);
+	bucket->key[idx] = key;
+	bucket->dest[idx] = *dest;
+	bucket->used |= 1 << idx;
+	ipv6_tun_bucket_write_end(bucket);
+	return 0;
+}
+
+int ipv6_tun_table_del(struct ipv6_tun_table *table, uint64_t key)
+{
+	struct ipv6_tun_bucket *bucket = &table->buckets[ipv6_tun_bucket1(table, key)];
+	int idx = ipv6_tun_bucket_find(bucket, key);
+
+	if (idx < 0) {
+		bucket = &table->buckets[ipv6_tun_bucket2(table, key)];
+		idx = ipv6_tun_bucket_find(bucket, key);
+		if (idx < 0)
+			return -1;
+	}
+
+	ipv6_tun_bucket_write_begin(bucket);
+	bucket->used &= ~(1 << idx);
+	ipv6_tun_bucket_write_end(bucket);
+	table->n_entries--;
+	return 0;
+}
+
+static uint64_t ipv6_tun_table_key(const struct ipv6_tun_table *table, uint32_t ip, uint32_t port)
+{
+	return ((uint64_t)rte_cpu_to_be_32(ip) << 16) | (port & table->port_mask);
+}
+
+int ipv6_tun_table_load_delta(struct ipv6_tun_table *table, const char *file_name)
+{
+	char line[256], op[8], ip_str[64], ip6_str[64], mac_str[64];
+	uint32_t n_add = 0, n_del = 0, n_failed = 0, line_nb = 0;
+	struct ipv6_tun_dest dest;
+	uint32_t ip, port;
+	uint64_t tsc_start, tsc;
+	FILE *f;
+
+	f = fopen(file_name, "r");
+	if (f == NULL) {
+		plog_err("Failed to open binding file %s\n", file_name);
+		return -1;
+	}
+
+	tsc_start = rte_rdtsc();
+	while (fgets(line, sizeof(line), f)) {
+		line_nb++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		int n = sscanf(line, "%7s %63s %u %63s %63s", op, ip_str, &port, ip6_str, mac_str);
+
+		if (n >= 3 && !strcmp(op, "del") && parse_ip(&ip, ip_str) == 0) {
+			if (ipv6_tun_table_del(table, ipv6_tun_table_key(table, ip, port)))
+				n_failed++;
+			else
+				n_del++;
+		}
+		else if (n == 5 && !strcmp(op, "add") && parse_ip(&ip, ip_str) == 0 &&
+			 parse_ip6(&dest.dst_addr, ip6_str) == 0 && parse_mac(&dest.dst_mac, mac_str) == 0) {
+			if (ipv6_tun_table_add(table, ipv6_tun_table_key(table, ip, port), &dest))
+				n_failed++;
+			else
+				n_add++;
+		}
+		else {
+			plog_err("Invalid binding on line %u of %s: %s", line_nb, file_name, line);
+			n_failed++;
+		}
+	}
+	fclose(f);
+
+	tsc = rte_rdtsc() - tsc_start;
+	plog_info("Applied %u additions and %u deletions (%u failed) in %"PRIu64" us, %"PRIu64" updates/s, %u bindings\n",
+		  n_add, n_del, n_failed, tsc * 1000000 / rte_get_tsc_hz(),
+		  tsc? (uint64_t)(n_add + n_del) * rte_get_tsc_hz() / tsc : 0, table->n_entries);
+	return n_failed? -1 : 0;
+}
@@ -0,0 +1,178 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _IPV6_TUN_TABLE_H_
+#define _IPV6_TUN_TABLE_H_
+
+#include <inttypes.h>
+
+#include <rte_atomic.h>
+#include <rte_ether.h>
+#include <rte_hash_crc.h>
+#include <rte_memory.h>
+#include <rte_prefetch.h>
+#include <rte_version.h>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <x86intrin.h>
+#endif
+
+#include "ip6_addr.h"
+
+/* Binding table for the IPv6 tunnel (lwAFTR) tasks. Keys are built
+   from the public IPv4 address and port, see MAKE_KEY_FROM_FIELDS.
+
+   Each key can be stored in one of two buckets. Lookups run without
+   locks and concurrently with updates. A single writer (the control
+   plane) changes a bucket in place after making its sequence counter
+   odd, and makes it even again when done. Readers copy the entry
+   they found and retry if the counter was odd or changed in the
+   meantime. */
+
+#define IPV6_TUN_BUCKET_ENTRIES 4
+
+struct ipv6_tun_dest {
+	struct ipv6_addr  dst_addr;
+	struct ether_addr dst_mac;
+};
+
+struct ipv6_tun_bucket {
+	/* First, so that all keys can be compared with one load */
+	uint64_t             key[IPV6_TUN_BUCKET_ENTRIES];
+	volatile uint32_t    seq;
+	/* Bit i is set if entry i is in use */
+	volatile uint32_t    used;
+	struct ipv6_tun_dest dest[IPV6_TUN_BUCKET_ENTRIES];
+} __rte_cache_aligned;
+
+struct ipv6_tun_table {
+	uint32_t               bucket_mask;
+	uint16_t               port_mask;
+	uint32_t               n_entries;
+	uint32_t               n_max_entries;
+	struct ipv6_tun_bucket *buckets;
+};
+
+/* Loads are not reordered with each other on x86, so ordering the
+   reads of the sequence counter with the reads of the entries does
+   not require a fence. */
+#if RTE_VERSION >= RTE_VERSION_NUM(16,4,0,0)
+#define ipv6_tun_rmb() rte_smp_rmb()
+#else
+#define ipv6_tun_rmb() rte_compiler_barrier()
+#endif
+
+struct ipv6_tun_table *ipv6_tun_table_create(uint32_t n_max_entries, uint16_t port_mask, int socket_id);
+
+/* Only to be called from one thread at a time. Adding a key that is
+   present replaces its entry. Return 0 on success, -1 if both
+   buckets for the key are full (add) or if the key is not found
+   (del). */
+int ipv6_tun_table_add(struct ipv6_tun_table *table, uint64_t key, const struct ipv6_tun_dest *dest);
+int ipv6_tun_table_del(struct ipv6_tun_table *table, uint64_t key);
+
+/* Applies a file with one change per line, either
+   "add <ipv4> <port> <ipv6> <mac>" or "del <ipv4> <port>". */
+int ipv6_tun_table_load_delta(struct ipv6_tun_table *table, const char *file_name);
+
+static inline uint32_t ipv6_tun_bucket1(const struct ipv6_tun_table *table, uint64_t key)
+{
+	return rte_hash_crc_8byte(key, 0) & table->bucket_mask;
+}
+
+static inline uint32_t ipv6_tun_bucket2(const struct ipv6_tun_table *table, uint64_t key)
+{
+	return rte_hash_crc_8byte(key, 0x9e3779b9) & table->bucket_mask;
+}
+
+/* Returns a bitmask of the entries of the bucket holding key,
+   without taking into account which entries are in use. */
+static inline uint32_t ipv6_tun_bucket_match(const struct ipv6_tun_bucket *bucket, uint64_t key)
+{
+#if defined(__AVX2__)
+	__m256i keys = _mm256_load_si256((const __m256i *)bucket->key);
+	__m256i cmp = _mm256_cmpeq_epi64(keys, _mm256_set1_epi64x(key));
+
+	return _mm256_movemask_pd(_mm256_castsi256_pd(cmp));
+#elif defined(__SSE4_1__)
+	__m128i k = _mm_set1_epi64x(key);
+	__m128i cmp_lo = _mm_cmpeq_epi64(_mm_load_si128((const __m128i *)&bucket->key[0]), k);
+	__m128i cmp_hi = _mm_cmpeq_epi64(_mm_load_si128((const __m128i *)&bucket->key[2]), k);
+
+	return _mm_movemask_pd(_mm_castsi128_pd(cmp_lo)) | _mm_movemask_pd(_mm_castsi128_pd(cmp_hi)) << 2;
+#else
+	uint32_t match = 0;
+
+	for (uint32_t i = 0; i < IPV6_TUN_BUCKET_ENTRIES; ++i)
+		match |= (bucket->key[i] == key) << i;
+	return match;
+#endif
+}
+
+static inline int ipv6_tun_bucket_lookup(const struct ipv6_tun_bucket *bucket, uint64_t key, struct ipv6_tun_dest *dest)
+{
+	uint32_t seq, match;
+
+	do {
+		seq = bucket->seq;
+		ipv6_tun_rmb();
+		match = ipv6_tun_bucket_match(bucket, key) & bucket->used;
+		if (match)
+			*dest = bucket->dest[__builtin_ctz(match)];
+		ipv6_tun_rmb();
+	} while ((seq & 1) || seq != bucket->seq);
+
+	return match != 0;
+}
+
+/* Looks up n_keys (at most 64) keys. Bit i in hit_mask is set if
+   keys[i] was found, in which case its entry is copied to dests[i]. */
+static inline void ipv6_tun_table_lookup_bulk(const struct ipv6_tun_table *table, const uint64_t *keys, uint16_t n_keys, uint64_t *hit_mask, struct ipv6_tun_dest *dests)
+{
+	uint32_t b1[64], b2[64];
+	uint64_t hits = 0;
+
+	for (uint16_t i = 0; i < n_keys; ++i) {
+		b1[i] = ipv6_tun_bucket1(table, keys[i]);
+		b2[i] = ipv6_tun_bucket2(table, keys[i]);
+		rte_prefetch0(&table->buckets[b1[i]]);
+		rte_prefetch0(&table->buckets[b1[i]].dest);
+	}
+
+	for (uint16_t i = 0; i < n_keys; ++i) {
+		if (ipv6_tun_bucket_lookup(&table->buckets[b1[i]], keys[i], &dests[i]) ||
+		    ipv6_tun_bucket_lookup(&table->buckets[b2[i]], keys[i], &dests[i]))
+			hits |= 1ULL << i;
+	}
+	*hit_mask = hits;
+}
+
+#endif /* _IPV6_TUN_TABLE_H_ */
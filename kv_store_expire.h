@@ -31,6 +31,7 @@
 */
 
 #include <rte_hash_crc.h>
+#include <rte_prefetch.h>
 #include <stdint.h>
 
 #include "prox_malloc.h"
@@ -114,22 +115,42 @@ static struct kv_store_expire_entry *kv_store_expire_get_first(struct kv_store_e
 	return (struct kv_store_expire_entry *)&kv_store->mem[0];
 }
 
-static struct kv_store_expire_entry *kv_store_expire_get_first_in_bucket(struct kv_store_expire *kv_store, void *key)
+/* Entries can be walked from 0 to kv_store_expire_size() - 1, for
+   example to expire them actively instead of on reuse. */
+static struct kv_store_expire_entry *kv_store_expire_get_entry(struct kv_store_expire *kv_store, size_t idx)
+{
+	return (struct kv_store_expire_entry *)&kv_store->mem[idx * kv_store->entry_size];
+}
+
+static struct kv_store_expire_entry *kv_store_expire_bucket(struct kv_store_expire *kv_store, uint32_t key_hash)
 {
-	uint32_t key_hash = rte_hash_crc(key, kv_store->key_size, 0);
 	uint32_t bucket_idx = key_hash & kv_store->bucket_mask;
 
 	return (struct kv_store_expire_entry *)&kv_store->mem[bucket_idx * kv_store->bucket_size];
 }
 
+static struct kv_store_expire_entry *kv_store_expire_get_first_in_bucket(struct kv_store_expire *kv_store, void *key)
+{
+	return kv_store_expire_bucket(kv_store, rte_hash_crc(key, kv_store->key_size, 0));
+}
+
+static void kv_store_expire_prefetch_bucket(struct kv_store_expire *kv_store, struct kv_store_expire_entry *bucket)
+{
+	for (size_t offset = 0; offset < kv_store->bucket_size; offset += RTE_CACHE_LINE_SIZE)
+		rte_prefetch0((uint8_t *)bucket + offset);
+}
+
 static int entry_key_matches(struct kv_store_expire *kv_store, struct kv_store_expire_entry *entry, void *key)
 {
 	return !memcmp(entry_key(kv_store, entry), key, kv_store->key_size);
 }
 
-static struct kv_store_expire_entry *kv_store_expire_get(struct kv_store_expire *kv_store, void *key, uint64_t now)
+/* Same as kv_store_expire_get() but the bucket is given by the
+   caller. This allows to calculate hashes and to prefetch buckets for
+   a whole burst before the lookups. */
+static struct kv_store_expire_entry *kv_store_expire_get_in_bucket(struct kv_store_expire *kv_store, struct kv_store_expire_entry *bucket, void *key, uint64_t now)
 {
-	struct kv_store_expire_entry *entry = kv_store_expire_get_first_in_bucket(kv_store, key);
+	struct kv_store_expire_entry *entry = bucket;
 
 	for (int i = 0; i < KV_STORE_BUCKET_DEPTH; ++i) {
 		if (entry->timeout && entry->timeout >= now) {
@@ -143,6 +164,11 @@ static struct kv_store_expire_entry *kv_store_expire_get(struct kv_store_expire
 	return NULL;
 }
 
+static struct kv_store_expire_entry *kv_store_expire_get(struct kv_store_expire *kv_store, void *key, uint64_t now)
+{
+	return kv_store_expire_get_in_bucket(kv_store, kv_store_expire_get_first_in_bucket(kv_store, key), key, now);
+}
+
 static struct kv_store_expire_entry *kv_store_expire_put(struct kv_store_expire *kv_store, void *key, uint64_t now)
 {
 	struct kv_store_expire_entry *e = kv_store_expire_get_first_in_bucket(kv_store, key);
@@ -167,9 +193,9 @@ static struct kv_store_expire_entry *kv_store_expire_put(struct kv_store_expire
 /* If the entry is not found, a put operation is tried and if that
    succeeds, that entry is returned. The bucket is full if NULL Is
    returned. */
-static struct kv_store_expire_entry *kv_store_expire_get_or_put(struct kv_store_expire *kv_store, void *key, uint64_t now)
+static struct kv_store_expire_entry *kv_store_expire_get_or_put_in_bucket(struct kv_store_expire *kv_store, struct kv_store_expire_entry *bucket, void *key, uint64_t now)
 {
-	struct kv_store_expire_entry *entry = kv_store_expire_get_first_in_bucket(kv_store, key);
+	struct kv_store_expire_entry *entry = bucket;
 	struct kv_store_expire_entry *v = NULL;
 
 	for (int i = 0; i < KV_STORE_BUCKET_DEPTH; ++i) {
@@ -186,7 +212,7 @@ static struct kv_store_expire_entry *kv_store_expire_get_or_put(struct kv_store_
 	}
 
 	if (v) {
-		if (entry->timeout)
+		if (v->timeout)
 			kv_store->expire(entry_value(kv_store, v));
 		rte_memcpy(entry_key(kv_store, v), key, kv_store->key_size);
 		v->timeout = now + kv_store->timeout;
@@ -196,6 +222,11 @@ static struct kv_store_expire_entry *kv_store_expire_get_or_put(struct kv_store_
 	return NULL;
 }
 
+static struct kv_store_expire_entry *kv_store_expire_get_or_put(struct kv_store_expire *kv_store, void *key, uint64_t now)
+{
+	return kv_store_expire_get_or_put_in_bucket(kv_store, kv_store_expire_get_first_in_bucket(kv_store, key), key, now);
+}
+
 static size_t kv_store_expire_expire_all(struct kv_store_expire *kv_store)
 {
 	struct kv_store_expire_entry *entry = kv_store_expire_get_first(kv_store);
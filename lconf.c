@@ -30,6 +30,8 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <rte_cycles.h>
+
 #include "prox_malloc.h"
 #include "lconf.h"
 #include "rx_pkt.h"
@@ -160,8 +162,12 @@ static void msg_start(struct lcore_cfg *lconf)
 	struct task_base *t = NULL;
 
 	if (lconf->msg.task_id == -1) {
+		uint8_t n_tasks_run = 0;
+
 		for (int i = 0; i < lconf->n_tasks_all; ++i) {
-			t = lconf->tasks_run[i] = lconf->tasks_all[i];
+			if (lconf->task_is_away[i])
+				continue;
+			t = lconf->tasks_run[n_tasks_run++] = lconf->tasks_all[i];
 			lconf->task_is_running[i] = 1;
 			if (lconf->n_tasks_run == 0 && t->aux->start_first) {
 				t->aux->start_first(t);
@@ -170,7 +176,7 @@ static void msg_start(struct lcore_cfg *lconf)
 			if (t->aux->start)
 				t->aux->start(t);
 		}
-		lconf->n_tasks_run = lconf->n_tasks_all;
+		lconf->n_tasks_run = n_tasks_run;
 	}
 	else if (lconf->n_tasks_run == 0) {
 		t = lconf->tasks_run[0] = lconf->tasks_all[lconf->msg.task_id];
@@ -209,6 +215,72 @@ static void msg_start(struct lcore_cfg *lconf)
 	}
 }
 
+/* Keeps tasks_run ordered as tasks_all */
+static void run_list_add(struct lcore_cfg *lconf, uint8_t task_id)
+{
+	int i = lconf->n_tasks_run;
+
+	while (i > 0 && lconf_get_task_id(lconf, lconf->tasks_run[i - 1]) > task_id) {
+		lconf->tasks_run[i] = lconf->tasks_run[i - 1];
+		i--;
+	}
+	lconf->tasks_run[i] = lconf->tasks_all[task_id];
+	lconf->task_is_running[task_id] = 1;
+	lconf->n_tasks_run++;
+}
+
+static void run_list_del(struct lcore_cfg *lconf, uint8_t task_id)
+{
+	uint8_t n_tasks_run = 0;
+
+	for (int i = 0; i < lconf->n_tasks_run; ++i) {
+		if (lconf_get_task_id(lconf, lconf->tasks_run[i]) != task_id)
+			lconf->tasks_run[n_tasks_run++] = lconf->tasks_run[i];
+	}
+	lconf->task_is_running[task_id] = 0;
+	lconf->n_tasks_run = n_tasks_run;
+}
+
+void lconf_task_detach(struct lcore_cfg *lconf, uint8_t task_id)
+{
+	if (lconf->task_is_running[task_id])
+		run_list_del(lconf, task_id);
+
+	if (!lconf_task_is_guest(lconf, task_id)) {
+		lconf->task_is_away[task_id] = 1;
+		lconf->n_tasks_away++;
+		return;
+	}
+
+	/* Migrated tasks are always behind the configured tasks, so
+	   closing the gap does not renumber any configured task. */
+	for (uint8_t i = task_id; i + 1 < lconf->n_tasks_all; ++i) {
+		lconf->tasks_all[i] = lconf->tasks_all[i + 1];
+		lconf->targs[i] = lconf->targs[i + 1];
+		lconf->task_is_running[i] = lconf->task_is_running[i + 1];
+		lconf->flush_queues[i] = lconf->flush_queues[i + 1];
+		lconf->ctrl_func_m[i] = lconf->ctrl_func_m[i + 1];
+		lconf->ctrl_rings_m[i] = lconf->ctrl_rings_m[i + 1];
+		lconf->ctrl_func_p[i] = lconf->ctrl_func_p[i + 1];
+		lconf->ctrl_rings_p[i] = lconf->ctrl_rings_p[i + 1];
+	}
+	lconf->n_tasks_all--;
+}
+
+void lconf_task_attach(struct lcore_cfg *lconf, uint8_t task_id, int run)
+{
+	if (task_id == lconf->n_tasks_all) {
+		lconf->task_is_running[task_id] = 0;
+		lconf->n_tasks_all++;
+	}
+	if (lconf->task_is_away[task_id]) {
+		lconf->task_is_away[task_id] = 0;
+		lconf->n_tasks_away--;
+	}
+	if (run)
+		run_list_add(lconf, task_id);
+}
+
 int lconf_do_flags(struct lcore_cfg *lconf)
 {
 	struct task_base *t;
@@ -223,6 +295,21 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		msg_start(lconf);
 		ret = -1;
 		break;
+	case LCONF_MSG_MIGRATE_OUT:
+		/* Packets still buffered by the task are sent from here
+		   so that nothing is left behind in the TX buffers. */
+		t = lconf->tasks_all[lconf->msg.task_id];
+		if (lconf->flush_queues[lconf->msg.task_id])
+			lconf->flush_queues[lconf->msg.task_id](t);
+		lconf_task_detach(lconf, lconf->msg.task_id);
+		lconf->migrate_tsc = rte_rdtsc();
+		ret = -1;
+		break;
+	case LCONF_MSG_MIGRATE_IN:
+		lconf_task_attach(lconf, lconf->msg.task_id, lconf->msg.val);
+		lconf->migrate_tsc = rte_rdtsc();
+		ret = -1;
+		break;
 	case LCONF_MSG_DUMP_RX:
 	case LCONF_MSG_DUMP_TX:
 	case LCONF_MSG_DUMP:
@@ -290,6 +377,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_RX_DISTR_START:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 			task_base_add_rx_pkt_function(t, rx_pkt_distr);
 			memset(t->aux->rx_bucket, 0, sizeof(t->aux->rx_bucket));
@@ -298,6 +387,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_TX_DISTR_START:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 
 			if (t->tx_pkt == tx_pkt_l3) {
@@ -313,6 +404,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_RX_DISTR_STOP:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 			task_base_del_rx_pkt_function(t, rx_pkt_distr);
 			lconf->flags &= ~LCONF_FLAG_RX_DISTR_ACTIVE;
@@ -320,6 +413,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_TX_DISTR_STOP:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 			if (t->aux->tx_pkt_orig) {
 				if (t->tx_pkt == tx_pkt_l3) {
@@ -335,6 +430,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_RX_DISTR_RESET:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 
 			memset(t->aux->rx_bucket, 0, sizeof(t->aux->rx_bucket));
@@ -342,6 +439,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_TX_DISTR_RESET:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 
 			memset(t->aux->tx_bucket, 0, sizeof(t->aux->tx_bucket));
@@ -349,6 +448,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_RX_BW_START:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 			task_base_add_rx_pkt_function(t, rx_pkt_bw);
 			lconf->flags |= LCONF_FLAG_RX_BW_ACTIVE;
@@ -356,6 +457,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_RX_BW_STOP:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 			task_base_del_rx_pkt_function(t, rx_pkt_bw);
 			lconf->flags &= ~LCONF_FLAG_RX_BW_ACTIVE;
@@ -363,6 +466,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_TX_BW_START:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 
 			if (t->tx_pkt == tx_pkt_l3) {
@@ -377,6 +482,8 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		break;
 	case LCONF_MSG_TX_BW_STOP:
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			if (lconf->task_is_away[task_id])
+				continue;
 			t = lconf->tasks_all[task_id];
 			if (t->aux->tx_pkt_orig) {
 				if (t->tx_pkt == tx_pkt_l3) {
@@ -53,6 +53,8 @@ enum lconf_msg_type {
 	LCONF_MSG_RX_BW_STOP,
 	LCONF_MSG_TX_BW_START,
 	LCONF_MSG_TX_BW_STOP,
+	LCONF_MSG_MIGRATE_OUT,
+	LCONF_MSG_MIGRATE_IN,
 };
 
 struct lconf_msg {
@@ -89,9 +91,17 @@ struct lcore_cfg {
 	struct rte_ring         *ctrl_rings_p[MAX_TASKS_PER_CORE];
 
 	struct lconf_msg        msg __attribute__((aligned(4)));
+	/* TSC at which the last migration message was handled */
+	uint64_t                migrate_tsc;
+	/* Tasks migrated from other cores are appended after the
+	   configured tasks. Their targs are copies of the original ones,
+	   with lconf still pointing to the core they were configured on. */
 	struct task_base	*tasks_all[MAX_TASKS_PER_CORE];
 	int                     task_is_running[MAX_TASKS_PER_CORE];
+	/* Set while a configured task runs on another core. */
+	uint8_t                 task_is_away[MAX_TASKS_PER_CORE];
 	uint8_t			n_tasks_all;
+	uint8_t                 n_tasks_away;
 	pthread_t		thread_id;
 
 	/* Following variables are not accessed in main loop */
@@ -114,6 +124,8 @@ static inline void lconf_flush_all_queues(struct lcore_cfg *lconf)
 	struct task_base *task;
 
 	for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+		if (lconf->task_is_away[task_id])
+			continue;
 		task = lconf->tasks_all[task_id];
 		if (!(task->flags & FLAG_TX_FLUSH) || (task->flags & FLAG_NEVER_FLUSH)) {
 			task->flags |= FLAG_TX_FLUSH;
@@ -144,6 +156,19 @@ int lconf_do_flags(struct lcore_cfg *lconf);
 int lconf_get_task_id(const struct lcore_cfg *lconf, const struct task_base *task);
 int lconf_task_is_running(const struct lcore_cfg *lconf, uint8_t task_id);
 
+static inline int lconf_task_is_guest(const struct lcore_cfg *lconf, uint8_t task_id)
+{
+	return lconf->targs[task_id].lconf != lconf;
+}
+
+/* Remove task_id from the core. A configured task is marked as away,
+   the slot of a migrated task is released. Only to be called from the
+   core itself or while the core is not running. */
+void lconf_task_detach(struct lcore_cfg *lconf, uint8_t task_id);
+/* Add task_id back to the core, task_id is either an away task or
+   n_tasks_all if the slot has been filled in beforehand. */
+void lconf_task_attach(struct lcore_cfg *lconf, uint8_t task_id, int run);
+
 int lconf_run(void *dummy);
 
 void lcore_cfg_alloc_hp(void);
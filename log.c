@@ -34,7 +34,10 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 #include <rte_cycles.h>
+#include <rte_atomic.h>
+#include <rte_memcpy.h>
 #include <rte_lcore.h>
 #include <rte_ether.h>
 #include <rte_ip.h>
@@ -45,6 +48,7 @@
 #include "defaults.h"
 #include "etypes.h"
 #include "prox_cfg.h"
+#include "prox_malloc.h"
 
 static pthread_mutex_t file_mtx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 int log_lvl = PROX_MAX_LOG_LVL;
@@ -157,12 +161,94 @@ static const char* lvl_to_str(int lvl, int always)
 	}
 }
 
-static	int dump_pkt(char *dst, size_t dst_size, const struct rte_mbuf *mbuf)
+/* Datapath cores don't format their log messages. Each of them owns a
+   single producer/single consumer ring in which plog_*() stores the
+   format string together with the binary arguments. The logger thread
+   formats and writes the records. Errors are always written
+   synchronously so that nothing is lost when PROX panics, after
+   waiting (up to LOG_ERR_WAIT_MSEC) for the messages queued before
+   them on the same core. */
+#define LOG_RING_SIZE  256 /* Must be a power of 2 */
+#define LOG_MAX_ARGS   12
+#define LOG_DATA_LEN   256 /* Space for the strings passed through %s */
+#define LOG_RATE_SITES 64  /* Must be a power of 2 */
+#define LOG_RATE_BURST 16  /* Messages per second per call site */
+#define LOG_ERR_WAIT_MSEC 10
+
+enum log_arg_type {
+	LOG_ARG_NONE,
+	LOG_ARG_INT,
+	LOG_ARG_WIDE,
+	LOG_ARG_DBL,
+	LOG_ARG_PTR,
+	LOG_ARG_STR,
+};
+
+struct log_rec {
+	uint64_t    tsc;
+	const char  *fmt;
+	uint32_t    suppressed;
+	uint8_t     lvl;
+	uint8_t     extended;
+	uint8_t     text;  /* Already formatted into data, fmt is NULL */
+	uint8_t     n_args;
+	uint8_t     arg_type[LOG_MAX_ARGS];
+	union {
+		int64_t    i;   /* Offset in data for LOG_ARG_STR */
+		double     d;
+		const void *p;
+	} arg[LOG_MAX_ARGS];
+	uint16_t    pkt_len;
+	uint16_t    pkt_bytes;
+	uint8_t     pkt[DUMP_PKT_LEN];
+	char        data[LOG_DATA_LEN];
+};
+
+struct log_site {
+	const char *fmt;
+	uint64_t   window_tsc;
+	uint32_t   count;
+	uint32_t   suppressed;
+};
+
+struct log_ring {
+	volatile uint32_t head __rte_cache_aligned;
+	volatile uint32_t busy; /* set while a record is being queued */
+	volatile uint64_t drops;
+	struct log_site   sites[LOG_RATE_SITES];
+	volatile uint32_t tail __rte_cache_aligned;
+	uint64_t          drops_reported;
+	struct log_rec    rec[LOG_RING_SIZE] __rte_cache_aligned;
+};
+
+static struct log_ring *log_rings[RTE_MAX_LCORE];
+static volatile int log_async;
+
+static struct {
+	pthread_t    thread;
+	volatile int quit;
+	int          running;
+} log_thread;
+
+static int log_prefix(char *buf, size_t size, int lvl, int extended, unsigned lcore, uint64_t tsc, int has_format)
 {
-	const struct ether_hdr *peth = rte_pktmbuf_mtod(mbuf, const struct ether_hdr *);
+	uint64_t hz, rtime_tsc, rtime_sec, rtime_usec;
+
+	if (extended) {
+		hz = rte_get_tsc_hz();
+		rtime_tsc = tsc - tsc_off;
+		rtime_sec = rtime_tsc / hz;
+		rtime_usec = (rtime_tsc - rtime_sec * hz) / (hz / 1000000);
+		return snprintf(buf, size, "%2"PRIu64".%06"PRIu64" C%u %s%s",
+				rtime_sec, rtime_usec, lcore, lvl_to_str(lvl, 1), has_format? " " : "");
+	}
+	return snprintf(buf, size, "%s%s", lvl_to_str(lvl, 0), has_format? " " : "");
+}
+
+static int dump_pkt_bytes(char *dst, size_t dst_size, const uint8_t *pkt_bytes, uint16_t len, uint16_t n_bytes)
+{
+	const struct ether_hdr *peth = (const struct ether_hdr *)pkt_bytes;
 	const struct ipv4_hdr *dpip = (const struct ipv4_hdr *)(peth + 1);
-	const uint8_t *pkt_bytes = (const uint8_t *)peth;
-	const uint16_t len = rte_pktmbuf_pkt_len(mbuf);
 	size_t str_len = 0;
 
 	if (peth->ether_type == ETYPE_IPv4)
@@ -172,7 +258,7 @@ static	int dump_pkt(char *dst, size_t dst_size, const struct rte_mbuf *mbuf)
 		str_len = snprintf(dst, dst_size, "pkt_len=%u, Eth=%x",
 				len, peth->ether_type);
 
-	for (uint16_t i = 0; i < len && i < DUMP_PKT_LEN && str_len < dst_size; ++i) {
+	for (uint16_t i = 0; i < n_bytes && str_len < dst_size; ++i) {
 		if (i % 16 == 0) {
 			str_len += snprintf(dst + str_len, dst_size - str_len, "\n%04x  ", i);
 		}
@@ -186,10 +272,263 @@ static	int dump_pkt(char *dst, size_t dst_size, const struct rte_mbuf *mbuf)
 	return str_len + 1;
 }
 
+static	int dump_pkt(char *dst, size_t dst_size, const struct rte_mbuf *mbuf)
+{
+	const uint16_t len = rte_pktmbuf_pkt_len(mbuf);
+
+	return dump_pkt_bytes(dst, dst_size, rte_pktmbuf_mtod(mbuf, const uint8_t *), len, RTE_MIN(len, DUMP_PKT_LEN));
+}
+
+/* Parse the conversion specification following a '%'. Returns its
+   length (including the conversion character) and the type of the
+   argument it consumes, or -1 if the argument can't be stored in a
+   log_rec (variable width or precision, long double, %n, ...). */
+static int log_parse_conv(const char *spec, int *type)
+{
+	const char *p = spec;
+	int wide = 0;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		p++;
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	while (*p && strchr("hlqjzt", *p)) {
+		if (*p != 'h')
+			wide = 1;
+		p++;
+	}
+	if (p - spec > 16)
+		return -1;
+
+	switch (*p) {
+	case '%':
+		*type = LOG_ARG_NONE;
+		break;
+	case 'c':
+		if (wide)
+			return -1;
+		/* fallthrough */
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+		*type = wide? LOG_ARG_WIDE : LOG_ARG_INT;
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		*type = LOG_ARG_DBL;
+		break;
+	case 'p':
+		*type = LOG_ARG_PTR;
+		break;
+	case 's':
+		if (wide)
+			return -1;
+		*type = LOG_ARG_STR;
+		break;
+	default:
+		return -1;
+	}
+	return p - spec + 1;
+}
+
+static int log_capture(struct log_rec *rec, const char *fmt, va_list ap)
+{
+	uint32_t data_len = 0, n_args = 0;
+	const char *str;
+	size_t str_len;
+	int len, type;
+
+	for (const char *p = fmt; *p; ++p) {
+		if (*p != '%')
+			continue;
+		len = log_parse_conv(p + 1, &type);
+		if (len < 0)
+			return -1;
+		p += len;
+		if (type == LOG_ARG_NONE)
+			continue;
+		if (n_args == LOG_MAX_ARGS)
+			return -1;
+
+		rec->arg_type[n_args] = type;
+		switch (type) {
+		case LOG_ARG_INT:
+			rec->arg[n_args].i = va_arg(ap, int);
+			break;
+		case LOG_ARG_WIDE:
+			rec->arg[n_args].i = va_arg(ap, int64_t);
+			break;
+		case LOG_ARG_DBL:
+			rec->arg[n_args].d = va_arg(ap, double);
+			break;
+		case LOG_ARG_PTR:
+			rec->arg[n_args].p = va_arg(ap, const void *);
+			break;
+		case LOG_ARG_STR:
+			if (data_len == LOG_DATA_LEN)
+				return -1;
+			str = va_arg(ap, const char *);
+			if (str == NULL)
+				str = "(null)";
+			/* Strings that don't fit are truncated */
+			str_len = RTE_MIN(strlen(str), LOG_DATA_LEN - data_len - 1);
+			memcpy(rec->data + data_len, str, str_len);
+			rec->data[data_len + str_len] = 0;
+			rec->arg[n_args].i = data_len;
+			data_len += str_len + 1;
+			break;
+		}
+		n_args++;
+	}
+	rec->n_args = n_args;
+	return 0;
+}
+
+static size_t log_format_rec(char *buf, size_t size, const struct log_rec *rec)
+{
+	const char *p = rec->fmt, *lit;
+	char spec[20];
+	size_t ret = 0;
+	int arg = 0, len, type, n;
+
+	*buf = 0;
+	while (*p && ret + 1 < size) {
+		lit = p;
+		while (*p && *p != '%')
+			p++;
+		n = RTE_MIN((size_t)(p - lit), size - 1 - ret);
+		memcpy(buf + ret, lit, n);
+		ret += n;
+		buf[ret] = 0;
+		if (*p == 0)
+			break;
+
+		/* Formats that failed to parse were stored as text */
+		len = log_parse_conv(p + 1, &type);
+		spec[0] = '%';
+		memcpy(spec + 1, p + 1, len);
+		spec[len + 1] = 0;
+		p += len + 1;
+
+		switch (type) {
+		case LOG_ARG_NONE:
+			n = snprintf(buf + ret, size - ret, "%%");
+			break;
+		case LOG_ARG_INT:
+			n = snprintf(buf + ret, size - ret, spec, (int)rec->arg[arg++].i);
+			break;
+		case LOG_ARG_WIDE:
+			n = snprintf(buf + ret, size - ret, spec, rec->arg[arg++].i);
+			break;
+		case LOG_ARG_DBL:
+			n = snprintf(buf + ret, size - ret, spec, rec->arg[arg++].d);
+			break;
+		case LOG_ARG_PTR:
+			n = snprintf(buf + ret, size - ret, spec, rec->arg[arg++].p);
+			break;
+		case LOG_ARG_STR:
+			n = snprintf(buf + ret, size - ret, spec, rec->data + rec->arg[arg++].i);
+			break;
+		default:
+			n = 0;
+		}
+		if (n > 0)
+			ret += RTE_MIN((size_t)n, size - 1 - ret);
+	}
+	return ret;
+}
+
+/* Returns non-zero if the message must be suppressed. The number of
+   messages suppressed since the last one that went through is
+   returned in *suppressed. */
+static int log_rate_limit(struct log_ring *ring, const char *fmt, uint64_t tsc, uint32_t *suppressed)
+{
+	struct log_site *site = &ring->sites[((uintptr_t)fmt >> 3) & (LOG_RATE_SITES - 1)];
+
+	if (site->fmt != fmt) {
+		site->fmt = fmt;
+		site->window_tsc = tsc;
+		site->count = 0;
+		site->suppressed = 0;
+	}
+	else if (tsc - site->window_tsc > rte_get_tsc_hz()) {
+		site->window_tsc = tsc;
+		site->count = 0;
+	}
+
+	if (site->count == LOG_RATE_BURST) {
+		site->suppressed++;
+		return 1;
+	}
+	site->count++;
+	*suppressed = site->suppressed;
+	site->suppressed = 0;
+	return 0;
+}
+
+static int vplog_async(struct log_ring *ring, int lvl, const char *format, va_list ap, const struct rte_mbuf *mbuf, int extended)
+{
+	const uint32_t head = ring->head;
+	uint64_t tsc = rte_rdtsc();
+	struct log_rec *rec;
+	uint32_t suppressed;
+	va_list aq;
+
+	if (log_rate_limit(ring, format, tsc, &suppressed))
+		return 0;
+
+	if (head - ring->tail == LOG_RING_SIZE) {
+		ring->drops += 1 + suppressed;
+		return 0;
+	}
+
+	rec = &ring->rec[head & (LOG_RING_SIZE - 1)];
+	rec->tsc = tsc;
+	rec->fmt = format;
+	rec->suppressed = suppressed;
+	rec->lvl = lvl;
+	rec->extended = extended;
+	rec->text = 0;
+	rec->n_args = 0;
+	rec->pkt_bytes = 0;
+
+	if (format) {
+		va_copy(aq, ap);
+		if (log_capture(rec, format, aq)) {
+			vsnprintf(rec->data, sizeof(rec->data), format, ap);
+			rec->fmt = NULL;
+			rec->text = 1;
+		}
+		va_end(aq);
+	}
+
+	if (mbuf) {
+		rec->pkt_len = rte_pktmbuf_pkt_len(mbuf);
+		rec->pkt_bytes = RTE_MIN(rte_pktmbuf_data_len(mbuf), DUMP_PKT_LEN);
+		rte_memcpy(rec->pkt, rte_pktmbuf_mtod(mbuf, const uint8_t *), rec->pkt_bytes);
+	}
+
+	rte_smp_wmb();
+	ring->head = head + 1;
+	return 0;
+}
+
+static void log_wait_queued(struct log_ring *ring)
+{
+	const uint32_t head = ring->head;
+	const uint64_t deadline = rte_rdtsc() + rte_get_tsc_hz() / 1000 * LOG_ERR_WAIT_MSEC;
+
+	while (ring->tail != head && rte_rdtsc() < deadline)
+		rte_pause();
+}
+
 static int vplog(int lvl, const char *format, va_list ap, const struct rte_mbuf *mbuf, int extended)
 {
 	char buf[32768];
-	uint64_t hz, rtime_tsc, rtime_sec, rtime_usec;
+	struct log_ring *ring;
+	unsigned lcore;
 	int ret = 0;
 
 	if (lvl > log_lvl)
@@ -198,18 +537,27 @@ static int vplog(int lvl, const char *format, va_list ap, const struct rte_mbuf
 	if (format == NULL && mbuf == NULL)
 		return ret;
 
-	*buf = 0;
-	if (extended) {
-		hz = rte_get_tsc_hz();
-		rtime_tsc = rte_rdtsc() - tsc_off;
-		rtime_sec = rtime_tsc / hz;
-		rtime_usec = (rtime_tsc - rtime_sec * hz) / (hz / 1000000);
-		ret += snprintf(buf, sizeof(buf) - ret, "%2"PRIu64".%06"PRIu64" C%u %s%s",
-				rtime_sec, rtime_usec, rte_lcore_id(), lvl_to_str(lvl, 1), format? " " : "");
-	}
-	else {
-		ret += snprintf(buf, sizeof(buf) - ret, "%s%s", lvl_to_str(lvl, 0), format? " " : "");
+	lcore = rte_lcore_id();
+	ring = lcore < RTE_MAX_LCORE ? log_rings[lcore] : NULL;
+	if (ring && log_async && lvl != PROX_LOG_ERR) {
+		/* plog_async_stop() waits for records being queued after
+		   it cleared log_async, see there. */
+		ring->busy = 1;
+		rte_smp_mb();
+		if (log_async) {
+			ret = vplog_async(ring, lvl, format, ap, mbuf, extended);
+			rte_smp_wmb();
+			ring->busy = 0;
+			return ret;
+		}
+		ring->busy = 0;
 	}
+	/* Keep the messages of this core in order */
+	if (ring)
+		log_wait_queued(ring);
+
+	*buf = 0;
+	ret += log_prefix(buf, sizeof(buf), lvl, extended, lcore, rte_rdtsc(), format != NULL);
 
 	if (format) {
 		ret--;
@@ -228,6 +576,132 @@ static int vplog(int lvl, const char *format, va_list ap, const struct rte_mbuf
 	return ret;
 }
 
+/* Only used from the logger thread, or from plog_async_stop() once it
+   has exited */
+static char log_thread_buf[32768];
+
+static void log_write_rec(unsigned lcore, const struct log_rec *rec)
+{
+	char *buf = log_thread_buf;
+	const size_t size = sizeof(log_thread_buf);
+	size_t ret;
+
+	if (rec->suppressed) {
+		ret = log_prefix(buf, size, rec->lvl, 1, lcore, rec->tsc, 1);
+		snprintf(buf + ret - 1, size - ret + 1, "%u similar messages suppressed\n", rec->suppressed);
+		plog_buf(buf);
+	}
+
+	ret = log_prefix(buf, size, rec->lvl, rec->extended, lcore, rec->tsc, rec->fmt || rec->text);
+	if (ret)
+		ret--;
+	if (rec->text)
+		ret += snprintf(buf + ret, size - ret, "%s", rec->data);
+	else if (rec->fmt)
+		ret += log_format_rec(buf + ret, size - ret, rec);
+
+	if (rec->pkt_bytes) {
+		if (ret)
+			ret--;
+		dump_pkt_bytes(buf + ret, size - ret, rec->pkt, rec->pkt_len, rec->pkt_bytes);
+	}
+	plog_buf(buf);
+
+	if (rec->lvl == PROX_LOG_WARN) {
+		store_warning(buf);
+	}
+}
+
+static int log_drain(void)
+{
+	struct log_ring *ring;
+	uint64_t drops;
+	uint32_t tail;
+	size_t ret;
+	int n = 0;
+
+	for (unsigned lcore = 0; lcore < RTE_MAX_LCORE; ++lcore) {
+		ring = log_rings[lcore];
+		if (ring == NULL)
+			continue;
+
+		for (tail = ring->tail; tail != ring->head; ++tail, ++n) {
+			rte_smp_rmb();
+			log_write_rec(lcore, &ring->rec[tail & (LOG_RING_SIZE - 1)]);
+			rte_smp_mb();
+			ring->tail = tail + 1;
+		}
+
+		drops = ring->drops;
+		if (drops != ring->drops_reported) {
+			ret = log_prefix(log_thread_buf, sizeof(log_thread_buf), PROX_LOG_WARN, 1, lcore, rte_rdtsc(), 1);
+			snprintf(log_thread_buf + ret - 1, sizeof(log_thread_buf) - ret + 1,
+				 "%"PRIu64" log messages dropped\n", drops - ring->drops_reported);
+			plog_buf(log_thread_buf);
+			store_warning(log_thread_buf);
+			ring->drops_reported = drops;
+		}
+	}
+	return n;
+}
+
+static void *log_thread_main(__attribute__((unused)) void *arg)
+{
+	const struct timespec idle = {.tv_sec = 0, .tv_nsec = 1000000};
+
+	while (!log_thread.quit) {
+		if (log_drain() == 0)
+			nanosleep(&idle, NULL);
+	}
+	log_drain();
+	return NULL;
+}
+
+int plog_async_start(void)
+{
+	uint32_t lcore_id = -1;
+
+	while (prox_core_next(&lcore_id, 0) == 0) {
+		log_rings[lcore_id] = prox_zmalloc(sizeof(struct log_ring), rte_lcore_to_socket_id(lcore_id));
+		if (log_rings[lcore_id] == NULL)
+			return -1;
+	}
+
+	log_thread.quit = 0;
+	if (pthread_create(&log_thread.thread, NULL, log_thread_main, NULL))
+		return -1;
+	log_thread.running = 1;
+	if (prox_ctrl_thread_affinity(log_thread.thread) < 0)
+		plog_warn("Failed to set logging thread affinity\n");
+
+	rte_smp_wmb();
+	log_async = 1;
+	return 0;
+}
+
+void plog_async_stop(void)
+{
+	if (!log_thread.running)
+		return;
+
+	/* Messages logged after this point are written synchronously */
+	log_async = 0;
+	rte_smp_mb();
+	log_thread.quit = 1;
+	pthread_join(log_thread.thread, NULL);
+	log_thread.running = 0;
+
+	/* A core that saw log_async set before it was cleared can still
+	   be queuing a record, which the logger thread may have missed.
+	   Wait for those and write what is left. */
+	for (unsigned lcore = 0; lcore < RTE_MAX_LCORE; ++lcore) {
+		while (log_rings[lcore] && log_rings[lcore]->busy)
+			rte_pause();
+	}
+	rte_smp_rmb();
+	log_drain();
+}
+
 #if PROX_MAX_LOG_LVL >= PROX_LOG_INFO
 int plog_info(const char *fmt, ...)
 {
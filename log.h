@@ -99,6 +99,15 @@ __attribute__((format(printf, 2, 3))) static inline int plogdx_dbg(__attribute__
 void plog_init(const char *log_name, int log_name_pid);
 void file_print(const char *str);
 
+/* Move formatting and writing of messages logged by the datapath cores
+   to a separate thread. Errors are still written synchronously. The
+   messages of a core stay in order: an error first waits (up to 10 ms)
+   until the messages the core queued before it have been written.
+   Messages of different cores can be interleaved out of order. */
+int plog_async_start(void);
+/* Write pending messages and stop the logging thread */
+void plog_async_stop(void);
+
 int plog_set_lvl(int lvl);
 
 #endif /* _LOG_H_ */
@@ -63,6 +63,7 @@
 #include "thread_pipeline.h"
 #include "cqm.h"
 #include "handle_master.h"
+#include "mempool_plan.h"
 
 #if RTE_VERSION < RTE_VERSION_NUM(1,8,0,0)
 #define RTE_CACHE_LINE_SIZE CACHE_LINE_SIZE
@@ -219,6 +220,35 @@ static int chain_flag_state(struct task_args *targ, uint64_t flag, int is_set)
 	return 0;
 }
 
+/* Sockets of the mempools that the mbufs handled by targ can come
+   from. Tasks receiving from a port or generating packets use a pool
+   on their own socket, other tasks get the mbufs of their sources. */
+static uint64_t chain_mbuf_sockets(struct task_args *targ, uint32_t depth)
+{
+	uint64_t sockets = 0;
+
+	if (targ->nb_rxports || targ->n_prev_tasks == 0 || depth == 0)
+		return 1ULL << rte_lcore_to_socket_id(targ->lconf->id);
+
+	for (uint32_t i = 0; i < targ->n_prev_tasks; ++i)
+		sockets |= chain_mbuf_sockets(targ->prev_tasks[i], depth - 1);
+	return sockets;
+}
+
+static void report_cross_socket(const char *msg)
+{
+	switch (prox_cfg.cross_socket_policy) {
+	case CROSS_SOCKET_ALLOW:
+		plog_info("\t\t%s", msg);
+		break;
+	case CROSS_SOCKET_WARN:
+		plog_warn("%s", msg);
+		break;
+	case CROSS_SOCKET_REJECT:
+		PROX_PANIC(1, "%s(cross socket=reject)\n", msg);
+	}
+}
+
 static void configure_if_tx_queues(struct task_args *targ, uint8_t socket)
 {
 	uint8_t if_port;
@@ -231,8 +261,18 @@ static void configure_if_tx_queues(struct task_args *targ, uint8_t socket)
 		PROX_PANIC(!prox_port_cfg[if_port].active, "\tPort %u not used, skipping...\n", if_port);
 
 		int dsocket = prox_port_cfg[if_port].socket;
-		if (dsocket != -1 && dsocket != socket) {
-			plog_warn("TX core on socket %d while device on socket %d\n", socket, dsocket);
+		if (dsocket != -1) {
+			uint64_t mbuf_sockets = chain_mbuf_sockets(targ, MAX_TASKS_PER_CORE * 4);
+			char msg[128];
+
+			if (dsocket != socket) {
+				snprintf(msg, sizeof(msg), "TX core on socket %d while device on socket %d\n", socket, dsocket);
+				report_cross_socket(msg);
+			} else if (mbuf_sockets & ~(1ULL << dsocket)) {
+				snprintf(msg, sizeof(msg), "Core %u task %u transmits mbufs from another socket to port %u on socket %d\n",
+					 targ->lconf->id, targ->id, if_port, dsocket);
+				report_cross_socket(msg);
+			}
 		}
 
 		if (prox_port_cfg[if_port].tx_ring[0] == '\0') {  // Rings-backed port can use single queue
@@ -296,11 +336,19 @@ static void configure_if_rx_queues(struct task_args *targ, uint8_t socket)
 		targ->rx_port_queue[i].queue = prox_port_cfg[if_port].n_rxq;
 		prox_port_cfg[if_port].pool[targ->rx_port_queue[i].queue] = targ->pool;
 		prox_port_cfg[if_port].pool_size[targ->rx_port_queue[i].queue] = targ->nb_mbuf - 1;
+		prox_port_cfg[if_port].pool_plan[targ->rx_port_queue[i].queue] = targ->nb_mbuf_inflight;
 		prox_port_cfg[if_port].n_rxq++;
+		if (targ->rss_steering ||
+		    (!strcmp(targ->task_init->mode_str, "lbpos") && !strcmp(targ->task_init->sub_mode_str, "rss")))
+			prox_port_cfg[if_port].rss_tcp = 1;
 
 		int dsocket = prox_port_cfg[if_port].socket;
 		if (dsocket != -1 && dsocket != socket) {
-			plog_warn("RX core on socket %d while device on socket %d\n", socket, dsocket);
+			char msg[128];
+
+			snprintf(msg, sizeof(msg), "RX core on socket %d while device on socket %d\n", socket, dsocket);
+			report_cross_socket(msg);
+			targ->rx_xsocket[i] = 1;
 		}
 	}
 }
@@ -395,20 +443,24 @@ static struct rte_ring *init_ring_between_tasks(struct lcore_cfg *lconf, struct
 	struct rte_ring *ring = NULL;
 	struct lcore_cfg *lworker;
 	struct task_args *dtarg;
+	uint64_t mbuf_sockets;
+	int xsocket;
 
 	PROX_ASSERT(prox_core_active(ct.core, 0));
 	lworker = &lcore_cfg[ct.core];
 
-	/* socket used is the one that the sending core resides on */
-	socket = rte_lcore_to_socket_id(lconf->id);
+	/* socket used is the one that the receiving core resides on:
+	   the consumer polls the ring continuously, the producer only
+	   touches it when it has packets to send. */
+	socket = rte_lcore_to_socket_id(ct.core);
 
 	plog_info("\t\tCreating ring on socket %u with size %u\n"
 		  "\t\t\tsource core, task and socket = %u, %u, %u\n"
 		  "\t\t\tdestination core, task and socket = %u, %u, %u\n"
 		  "\t\t\tdestination worker id = %u\n",
 		  socket, starg->ring_size,
-		  lconf->id, starg->id, socket,
-		  ct.core, ct.task, rte_lcore_to_socket_id(ct.core),
+		  lconf->id, starg->id, rte_lcore_to_socket_id(lconf->id),
+		  ct.core, ct.task, socket,
 		  ring_idx);
 
 	if (ct.type) {
@@ -491,10 +543,26 @@ static struct rte_ring *init_ring_between_tasks(struct lcore_cfg *lconf, struct
 	starg->tx_rings[starg->tot_n_txrings_inited] = ring;
 	starg->tot_n_txrings_inited++;
 
+	mbuf_sockets = chain_mbuf_sockets(starg, MAX_TASKS_PER_CORE * 4);
+	xsocket = rte_lcore_to_socket_id(lconf->id) != socket || (mbuf_sockets & ~(1ULL << socket));
+	if (xsocket) {
+		char msg[128];
+
+		snprintf(msg, sizeof(msg), "Ring from core %u task %u to core %u task %u carries mbufs to socket %u from another socket\n",
+			 lconf->id, starg->id, ct.core, ct.task, socket);
+		report_cross_socket(msg);
+	}
+
 	if (ring_created) {
 		PROX_ASSERT(dtarg->nb_rxrings < MAX_RINGS_PER_TASK);
+		dtarg->rx_xsocket[dtarg->nb_rxrings] = xsocket;
 		dtarg->rx_rings[dtarg->nb_rxrings] = ring;
 		++dtarg->nb_rxrings;
+	} else if (xsocket) {
+		for (uint8_t i = 0; i < dtarg->nb_rxrings; ++i) {
+			if (dtarg->rx_rings[i] == ring)
+				dtarg->rx_xsocket[i] = 1;
+		}
 	}
 	dtarg->nb_slave_threads = starg->core_task_set[idx].n_elems;
 	dtarg->lb_friend_core = lconf->id;
@@ -582,6 +650,7 @@ static void setup_mempools_unique_per_socket(void)
 
 	struct rte_mempool     *pool[MAX_SOCKETS];
 	uint32_t mbuf_count[MAX_SOCKETS] = {0};
+	uint32_t mbuf_inflight[MAX_SOCKETS] = {0};
 	uint32_t nb_cache_mbuf[MAX_SOCKETS] = {0};
 	uint32_t mbuf_size[MAX_SOCKETS] = {0};
 
@@ -599,6 +668,7 @@ static void setup_mempools_unique_per_socket(void)
 			struct prox_port_cfg* port_cfg = &prox_port_cfg[targ->rx_port_queue[0].port];
 			PROX_ASSERT(targ->nb_mbuf != 0);
 			mbuf_count[socket] += targ->nb_mbuf;
+			mbuf_inflight[socket] += targ->nb_mbuf_inflight;
 			if (nb_cache_mbuf[socket] == 0)
 				nb_cache_mbuf[socket] = targ->nb_cache_mbuf;
 			else {
@@ -647,6 +717,7 @@ static void setup_mempools_unique_per_socket(void)
 			targ->pool = pool[socket];
 			/* Set the number of mbuf to the number of the unique mempool, so that the used and free work */
 			targ->nb_mbuf = mbuf_count[socket];
+			targ->nb_mbuf_inflight = mbuf_inflight[socket];
 			plog_info("\t\tMempool %p size = %u * %u cache %u, socket %d\n", targ->pool,
 				  targ->nb_mbuf, mbuf_size[socket], targ->nb_cache_mbuf, socket);
 		}
@@ -866,6 +937,9 @@ static void init_lcores(void)
 	}
 
 	/* need to allocate mempools as the first thing to use the lowest possible address range */
+	plog_info("=== Planning mempool and ring sizes ===\n");
+	mempool_plan();
+
 	plog_info("=== Initializing mempools ===\n");
 	setup_mempools();
 
@@ -43,8 +43,10 @@ static void init_mbuf_seg(struct rte_mbuf *mbuf)
 {
 #if RTE_VERSION >= RTE_VERSION_NUM(1,8,0,0)
 	mbuf->nb_segs = 1;
+	mbuf->next = NULL;
 #else
 	mbuf->pkt.nb_segs = 1;
+	mbuf->pkt.next = NULL;
 #endif
 	rte_mbuf_refcnt_set(mbuf, 1);
 }
@@ -58,6 +60,19 @@ static uint16_t mbuf_wire_size(const struct rte_mbuf *mbuf)
 {
 	uint16_t pkt_len = rte_pktmbuf_pkt_len(mbuf);
 
+#if RTE_VERSION >= RTE_VERSION_NUM(1,8,0,0)
+	/* Large segments are sent as multiple packets on the wire,
+	   each with its own copy of the headers. */
+	if (unlikely(mbuf->ol_flags & PKT_TX_TCP_SEG)) {
+		uint16_t hdr_len = mbuf->l2_len + mbuf->l3_len + mbuf->l4_len;
+		uint16_t payload_len = pkt_len - hdr_len;
+		uint16_t n_full = payload_len / mbuf->tso_segsz;
+		uint16_t last = payload_len % mbuf->tso_segsz;
+
+		return n_full * pkt_len_to_wire_size(hdr_len + mbuf->tso_segsz) +
+			(last? pkt_len_to_wire_size(hdr_len + last) : 0);
+	}
+#endif
 	return pkt_len_to_wire_size(pkt_len);
 }
 
@@ -0,0 +1,193 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <rte_common.h>
+
+#include "mempool_plan.h"
+#include "prox_port_cfg.h"
+#include "prox_globals.h"
+#include "prox_cfg.h"
+#include "task_init.h"
+#include "defaults.h"
+#include "lconf.h"
+#include "log.h"
+
+struct mempool_plan_walk {
+	uint8_t task_seen[RTE_MAX_LCORE][MAX_TASKS_PER_CORE];
+	uint8_t lcore_seen[RTE_MAX_LCORE];
+	uint32_t n_lcores;
+	uint32_t n_tasks;
+};
+
+static struct task_args *plan_targ_get(const struct core_task *ct)
+{
+	return &lcore_cfg_init[ct->core].targs[ct->task];
+}
+
+/* Number of tasks that send packets through a ring to the given task. */
+static uint32_t plan_n_producers(uint32_t lcore_id, uint32_t task_id)
+{
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *targ;
+	uint32_t n = 0;
+
+	while (core_targ_next_early(&lconf, &targ, 0) == 0) {
+		for (uint8_t idx = 0; idx < MAX_PROTOCOLS; ++idx) {
+			for (uint32_t i = 0; i < targ->core_task_set[idx].n_elems; ++i) {
+				struct core_task *ct = &targ->core_task_set[idx].core_task[i];
+
+				if (!ct->type && ct->core == lcore_id && ct->task == task_id)
+					n++;
+			}
+		}
+	}
+	return n;
+}
+
+static void plan_ring_sizes(void)
+{
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *targ;
+
+	while (core_targ_next_early(&lconf, &targ, 0) == 0) {
+		uint32_t ring_size = targ->ring_size;
+
+		if (targ->ring_size_set_explicitely)
+			continue;
+
+		/* Each destination serves all its input rings in turn: the
+		   ring must hold one burst from every producer while the
+		   destination is busy with the other rings. */
+		for (uint8_t idx = 0; idx < MAX_PROTOCOLS; ++idx) {
+			for (uint32_t i = 0; i < targ->core_task_set[idx].n_elems; ++i) {
+				struct core_task *ct = &targ->core_task_set[idx].core_task[i];
+				uint32_t needed;
+
+				if (ct->type)
+					continue;
+				needed = rte_align32pow2(MAX_RING_BURST * (plan_n_producers(ct->core, ct->task) + 1));
+				if (needed > ring_size)
+					ring_size = needed;
+			}
+		}
+		if (ring_size != targ->ring_size) {
+			plog_info("\t\tRing size of core %u task %u raised from %u to %u\n",
+				  lconf->id, targ->id, targ->ring_size, ring_size);
+			targ->ring_size = ring_size;
+		}
+	}
+}
+
+/* Worst-case number of mbufs held from the moment targ receives them
+   until they are transmitted or freed, including all tasks downstream. */
+static uint32_t plan_task_inflight(struct mempool_plan_walk *walk, uint32_t lcore_id, struct task_args *targ)
+{
+	uint32_t n = MAX_PKT_BURST;
+
+	if (walk->task_seen[lcore_id][targ->id])
+		return 0;
+	walk->task_seen[lcore_id][targ->id] = 1;
+	walk->n_tasks++;
+	if (!walk->lcore_seen[lcore_id]) {
+		walk->lcore_seen[lcore_id] = 1;
+		walk->n_lcores++;
+	}
+
+	if (targ->task_init && targ->task_init->mbufs_held)
+		n += targ->task_init->mbufs_held(targ);
+
+	for (uint8_t i = 0; i < targ->nb_txports; ++i) {
+		if (targ->tx_port_queue[i].port != OUT_DISCARD)
+			n += prox_port_cfg[targ->tx_port_queue[i].port].n_txd;
+	}
+
+	for (uint8_t idx = 0; idx < MAX_PROTOCOLS; ++idx) {
+		for (uint32_t i = 0; i < targ->core_task_set[idx].n_elems; ++i) {
+			struct core_task *ct = &targ->core_task_set[idx].core_task[i];
+
+			n += targ->ring_size - 1;
+			/* Packets sent to the control plane are returned or
+			   freed by the master, do not follow them. */
+			if (ct->type || !prox_core_active(ct->core, 0))
+				continue;
+			n += plan_task_inflight(walk, ct->core, plan_targ_get(ct));
+		}
+	}
+	return n;
+}
+
+static uint32_t plan_rx_task(uint32_t lcore_id, struct task_args *targ)
+{
+	struct mempool_plan_walk walk;
+	uint32_t n = 0;
+
+	memset(&walk, 0, sizeof(walk));
+	for (uint8_t i = 0; i < targ->nb_rxports; ++i) {
+		if (targ->rx_port_queue[i].port != OUT_DISCARD)
+			n += prox_port_cfg[targ->rx_port_queue[i].port].n_rxd;
+	}
+	n += plan_task_inflight(&walk, lcore_id, targ);
+
+	/* A per-lcore cache can grow up to 1.5 times its size before it
+	   is flushed back to the pool. */
+	n += walk.n_lcores * (targ->nb_cache_mbuf * 3 / 2);
+
+	plog_info("\t\tCore %u task %u: worst-case %u mbufs in flight over %u tasks on %u cores\n",
+		  lcore_id, targ->id, n, walk.n_tasks, walk.n_lcores);
+	return n;
+}
+
+void mempool_plan(void)
+{
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *targ;
+
+	plan_ring_sizes();
+
+	while (core_targ_next_early(&lconf, &targ, 0) == 0) {
+		if (targ->task_init == NULL || targ->rx_port_queue[0].port == OUT_DISCARD)
+			continue;
+
+		targ->nb_mbuf_inflight = plan_rx_task(lconf->id, targ);
+
+		if (targ->nb_mbuf == 0) {
+			/* Pools are created with nb_mbuf - 1 elements, a
+			   power of two minus one is optimal for the ring. */
+			targ->nb_mbuf = rte_align32pow2(targ->nb_mbuf_inflight + 1);
+			plog_info("\t\tCore %u task %u: mempool size set to %u\n", lconf->id, targ->id, targ->nb_mbuf);
+		} else if (targ->nb_mbuf - 1 < targ->nb_mbuf_inflight) {
+			plog_warn("Core %u task %u: mempool size %u is below the worst-case %u mbufs in flight, RX might run out of mbufs\n",
+				  lconf->id, targ->id, targ->nb_mbuf, targ->nb_mbuf_inflight);
+		}
+	}
+}
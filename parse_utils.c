@@ -1124,6 +1124,34 @@ int parse_port_name_list(uint32_t *val, uint32_t* tot, uint8_t max_vals, const c
 	return 0;
 }
 
+int parse_int_list(uint32_t *val, uint32_t *tot, uint8_t max_vals, const char *str2)
+{
+	char *elements[64 + 1];
+	char str[MAX_STR_LEN_PROC];
+	int ret;
+
+	if (parse_str(str, str2, sizeof(str)))
+		return -1;
+
+	ret = rte_strsplit(str, strlen(str), elements, 64 + 1, ',');
+
+	if (ret == 64 + 1 || ret > max_vals) {
+		set_errf("Too many elements in list");
+		return -1;
+	}
+
+	strip_spaces(elements, ret);
+	for (uint8_t i = 0; i < ret; ++i) {
+		if (parse_int(&val[i], elements[i])) {
+			return -1;
+		}
+	}
+	if (tot) {
+		*tot = ret;
+	}
+	return 0;
+}
+
 int parse_remap(uint8_t *mapping, const char *str)
 {
 	char *elements[PROX_MAX_PORTS + 1];
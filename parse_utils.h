@@ -100,6 +100,9 @@ int parse_random_str(uint32_t *mask, uint32_t *fixed, uint32_t *len, const char
 
 int parse_port_name_list(uint32_t *val, uint32_t *tot, uint8_t max_vals, const char *str);
 
+/* Comma separated list of integers, e.g. "8,4,2,1". */
+int parse_int_list(uint32_t *val, uint32_t *tot, uint8_t max_vals, const char *str);
+
 /* Parses a comma separated list containing a remapping of ports
    specified by their name. Hence, all port names referenced from the
    list have to be added using add_port_name() before this function
@@ -39,9 +39,13 @@
 #include <rte_udp.h>
 #include <rte_tcp.h>
 #include <rte_byteorder.h>
+#ifdef __SSE2__
+#include <x86intrin.h>
+#endif
 
 #include "log.h"
 #include "etypes.h"
+#include "defaults.h"
 
 struct pkt_tuple {
 	uint32_t src_addr;
@@ -58,7 +62,7 @@ struct l4_meta {
 	uint16_t len;
 };
 
-static void pkt_tuple_debug2(const struct pkt_tuple *pt)
+static inline void pkt_tuple_debug2(const struct pkt_tuple *pt)
 {
 	plogx_info("src_ip : %#010x\n", pt->src_addr);
 	plogx_info("dst_ip : %#010x\n", pt->dst_addr);
@@ -70,7 +74,7 @@ static void pkt_tuple_debug2(const struct pkt_tuple *pt)
 		plogx_info("  - %#04x\n", pt->l2_types[i]);
 }
 
-static void pkt_tuple_debug(const struct pkt_tuple *pt)
+static inline void pkt_tuple_debug(const struct pkt_tuple *pt)
 {
 	plogx_dbg("src_ip : %#010x\n", pt->src_addr);
 	plogx_dbg("dst_ip : %#010x\n", pt->dst_addr);
@@ -83,7 +87,7 @@ static void pkt_tuple_debug(const struct pkt_tuple *pt)
 }
 
 /* Return 0 on success, i.e. packets parsed without any error. */
-static int parse_pkt(struct rte_mbuf *mbuf, struct pkt_tuple *pt, struct l4_meta *l4_meta)
+static inline int parse_pkt(struct rte_mbuf *mbuf, struct pkt_tuple *pt, struct l4_meta *l4_meta)
 {
 	struct ether_hdr *peth = rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
 	size_t l2_types_count = 0;
@@ -191,4 +195,140 @@ static int parse_pkt(struct rte_mbuf *mbuf, struct pkt_tuple *pt, struct l4_meta
 	return 0;
 }
 
+#if MAX_PKT_BURST > 64
+#error parse_pkt_burst() supports bursts of up to 64 packets
+#endif
+
+/* Packet types set by parse_pkt_burst(), based on the outer Ethernet
+   type. Handlers process the packets of each type in a separate loop
+   instead of switching on the Ethernet type for every packet. */
+enum pkt_type {
+	PKT_TYPE_IPV4,
+	PKT_TYPE_IPV6,
+	PKT_TYPE_VLAN,
+	PKT_TYPE_QINQ,
+	PKT_TYPE_MPLS,
+	PKT_TYPE_ARP,
+	PKT_TYPE_LLDP,
+	PKT_TYPE_OTHER,
+	PKT_TYPE_RUNT,  /* Shorter than a minimum sized frame, not parsed */
+	PKT_TYPE_COUNT
+};
+
+struct pkt_burst {
+	uint16_t n_pkts[PKT_TYPE_COUNT];
+	/* Position in the burst of the packets of each type, in order */
+	uint8_t  idx[PKT_TYPE_COUNT][MAX_PKT_BURST];
+	uint16_t l3_offset[MAX_PKT_BURST];
+	uint16_t l4_offset[MAX_PKT_BURST];  /* 0 if not parsed */
+};
+
+/* Bit j of the returned mask is set if etypes[j] == etype. etypes
+   must be readable up to n rounded up to a multiple of 8. */
+static inline uint64_t pkt_etype_mask(const uint16_t *etypes, uint16_t n, uint16_t etype)
+{
+	uint64_t mask = 0;
+#ifdef __SSE2__
+	const __m128i val = _mm_set1_epi16(etype);
+
+	for (uint16_t j = 0; j < n; j += 8) {
+		__m128i eq = _mm_cmpeq_epi16(_mm_load_si128((const __m128i *)(etypes + j)), val);
+
+		eq = _mm_packs_epi16(eq, _mm_setzero_si128());
+		mask |= (uint64_t)(_mm_movemask_epi8(eq) & 0xff) << j;
+	}
+#else
+	for (uint16_t j = 0; j < n; ++j)
+		mask |= (uint64_t)(etypes[j] == etype) << j;
+#endif
+	return mask;
+}
+
+static inline void pkt_burst_set_offsets(struct pkt_burst *burst, enum pkt_type type, uint16_t l3_offset, uint16_t l4_offset)
+{
+	for (uint16_t i = 0; i < burst->n_pkts[type]; ++i) {
+		burst->l3_offset[burst->idx[type][i]] = l3_offset;
+		burst->l4_offset[burst->idx[type][i]] = l4_offset;
+	}
+}
+
+/* Classify a burst of packets by their outer Ethernet type and store
+   the offset of the L3 and L4 headers. Packets with Ethernet type
+   qinq_tag are classified as PKT_TYPE_QINQ together with 802.1ad
+   packets. The packet headers should have been prefetched. */
+static inline void parse_pkt_burst(struct pkt_burst *burst, struct rte_mbuf **mbufs, uint16_t n_pkts, uint16_t qinq_tag)
+{
+	uint16_t etypes[MAX_PKT_BURST] __attribute__((aligned(16)));
+	const uint64_t all = n_pkts? UINT64_MAX >> (64 - n_pkts) : 0;
+	uint64_t mask[PKT_TYPE_COUNT], known, qinq, runt = 0;
+	uint16_t j, n;
+
+	for (j = 0; j < n_pkts; ++j) {
+		etypes[j] = rte_pktmbuf_mtod(mbufs[j], const struct ether_hdr *)->ether_type;
+		runt |= (uint64_t)(rte_pktmbuf_pkt_len(mbufs[j]) < ETHER_MIN_LEN - ETHER_CRC_LEN) << j;
+	}
+	for (; j % 8; ++j)
+		etypes[j] = 0;
+
+	mask[PKT_TYPE_IPV4] = pkt_etype_mask(etypes, n_pkts, ETYPE_IPv4);
+	mask[PKT_TYPE_IPV6] = pkt_etype_mask(etypes, n_pkts, ETYPE_IPv6);
+	mask[PKT_TYPE_VLAN] = pkt_etype_mask(etypes, n_pkts, ETYPE_VLAN);
+	mask[PKT_TYPE_QINQ] = pkt_etype_mask(etypes, n_pkts, ETYPE_8021ad);
+	mask[PKT_TYPE_MPLS] = pkt_etype_mask(etypes, n_pkts, ETYPE_MPLSU);
+	mask[PKT_TYPE_ARP] = pkt_etype_mask(etypes, n_pkts, ETYPE_ARP);
+	mask[PKT_TYPE_LLDP] = pkt_etype_mask(etypes, n_pkts, ETYPE_LLDP);
+
+	if (qinq_tag != ETYPE_8021ad) {
+		qinq = pkt_etype_mask(etypes, n_pkts, qinq_tag) &
+			~(mask[PKT_TYPE_IPV4] | mask[PKT_TYPE_IPV6] | mask[PKT_TYPE_MPLS] | mask[PKT_TYPE_ARP] | mask[PKT_TYPE_LLDP]);
+		mask[PKT_TYPE_QINQ] |= qinq;
+		mask[PKT_TYPE_VLAN] &= ~qinq;
+	}
+
+	known = 0;
+	for (int t = 0; t < PKT_TYPE_OTHER; ++t)
+		known |= mask[t];
+	mask[PKT_TYPE_OTHER] = ~known;
+	for (int t = 0; t < PKT_TYPE_RUNT; ++t)
+		mask[t] &= all & ~runt;
+	mask[PKT_TYPE_RUNT] = runt;
+
+	for (int t = 0; t < PKT_TYPE_COUNT; ++t) {
+		uint64_t m = mask[t];
+
+		for (n = 0; m; m &= m - 1)
+			burst->idx[t][n++] = __builtin_ctzll(m);
+		burst->n_pkts[t] = n;
+	}
+
+	pkt_burst_set_offsets(burst, PKT_TYPE_IPV6, sizeof(struct ether_hdr), sizeof(struct ether_hdr) + sizeof(struct ipv6_hdr));
+	pkt_burst_set_offsets(burst, PKT_TYPE_VLAN, sizeof(struct ether_hdr) + sizeof(struct vlan_hdr), 0);
+	pkt_burst_set_offsets(burst, PKT_TYPE_QINQ, sizeof(struct ether_hdr) + 2 * sizeof(struct vlan_hdr), 0);
+	pkt_burst_set_offsets(burst, PKT_TYPE_ARP, sizeof(struct ether_hdr), 0);
+	pkt_burst_set_offsets(burst, PKT_TYPE_LLDP, sizeof(struct ether_hdr), 0);
+	pkt_burst_set_offsets(burst, PKT_TYPE_OTHER, sizeof(struct ether_hdr), 0);
+	pkt_burst_set_offsets(burst, PKT_TYPE_RUNT, 0, 0);
+
+	for (uint16_t i = 0; i < burst->n_pkts[PKT_TYPE_IPV4]; ++i) {
+		j = burst->idx[PKT_TYPE_IPV4][i];
+		const struct ipv4_hdr *ip = rte_pktmbuf_mtod_offset(mbufs[j], const struct ipv4_hdr *, sizeof(struct ether_hdr));
+
+		burst->l3_offset[j] = sizeof(struct ether_hdr);
+		burst->l4_offset[j] = sizeof(struct ether_hdr) + ((ip->version_ihl & 0x0f) << 2);
+	}
+
+	/* The L3 header follows the label with the bottom of stack bit */
+	for (uint16_t i = 0; i < burst->n_pkts[PKT_TYPE_MPLS]; ++i) {
+		j = burst->idx[PKT_TYPE_MPLS][i];
+		const uint8_t *pkt = rte_pktmbuf_mtod(mbufs[j], const uint8_t *);
+		const uint16_t len = rte_pktmbuf_data_len(mbufs[j]);
+		uint16_t offset = sizeof(struct ether_hdr);
+
+		while (!(*(const uint32_t *)(pkt + offset) & 0x00010000) && offset + 8 < len)
+			offset += 4;
+		burst->l3_offset[j] = offset + 4;
+		burst->l4_offset[j] = 0;
+	}
+}
+
 #endif /* _PKT_PARSER_H_ */
@@ -347,6 +347,19 @@ static int get_global_cfg(__attribute__((unused))unsigned sindex, char *str, voi
 	if (STR_EQ(str, "disable cmt")) {
 		return parse_flag(&pset->flags, DSF_DISABLE_CMT, pkey);
 	}
+	if (STR_EQ(str, "cross socket")) {
+		if (STR_EQ(pkey, "allow"))
+			pset->cross_socket_policy = CROSS_SOCKET_ALLOW;
+		else if (STR_EQ(pkey, "warn"))
+			pset->cross_socket_policy = CROSS_SOCKET_WARN;
+		else if (STR_EQ(pkey, "reject"))
+			pset->cross_socket_policy = CROSS_SOCKET_REJECT;
+		else {
+			set_errf("Unknown cross socket policy '%s', expected allow, warn or reject", pkey);
+			return -1;
+		}
+		return 0;
+	}
 	if (STR_EQ(str, "mp rings")) {
 		return parse_flag(&pset->flags, DSF_MP_RINGS, pkey);
 	}
@@ -571,6 +584,13 @@ static int get_port_cfg(unsigned sindex, char *str, void *data)
 			cfg->port_conf.rx_adv_conf.rss_conf.rss_hf = ETH_RSS_IPV4;
 		}
 	}
+	else if (STR_EQ(str, "rss tcp")) {
+		uint32_t val;
+		if (parse_bool(&val, pkey)) {
+			return -1;
+		}
+		cfg->rss_tcp = val;
+	}
 	else if (STR_EQ(str, "rx_ring")) {
 		parse_str(cfg->rx_ring, pkey, sizeof(cfg->rx_ring));
 	}
@@ -812,6 +832,17 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "cpe table timeout ms")) {
 		return parse_int(&targ->cpe_table_timeout_ms, pkey);
 	}
+	if (STR_EQ(str, "learn cores")) {
+		return parse_task_set(&targ->learn_core_task_set, pkey);
+	}
+	if (STR_EQ(str, "learn rate")) {
+		int rc = parse_int(&targ->learn_rate, pkey);
+		if (rc == 0 && targ->learn_rate == 0) {
+			set_errf("learn rate must be non null.");
+			return -1;
+		}
+		return rc;
+	}
 	if (STR_EQ(str, "ctrl path polling frequency")) {
 		int rc = parse_int(&targ->ctrl_freq, pkey);
 		if (rc == 0) {
@@ -900,6 +931,15 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "streams")) {
 		return parse_str(targ->streams, pkey, sizeof(targ->streams));
 	}
+	if (STR_EQ(str, "large segments")) {
+		return parse_flag(&targ->large_segments, 1, pkey);
+	}
+	if (STR_EQ(str, "zero copy")) {
+		return parse_flag(&targ->zero_copy, 1, pkey);
+	}
+	if (STR_EQ(str, "rss steering")) {
+		return parse_flag(&targ->rss_steering, 1, pkey);
+	}
 	if (STR_EQ(str, "local lpm")) {
 		return parse_flag(&targ->flags, TASK_ARG_LOCAL_LPM, pkey);
 	}
@@ -916,6 +956,9 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "bps")) {
 		return parse_u64(&targ->rate_bps, pkey);
 	}
+	if (STR_EQ(str, "rate group")) {
+		return parse_str(targ->rate_group, pkey, sizeof(targ->rate_group));
+	}
 	if (STR_EQ(str, "random")) {
 		return parse_str(targ->rand_str[targ->n_rand_str++], pkey, sizeof(targ->rand_str[0]));
 	}
@@ -927,6 +970,21 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 
 		return parse_int(&targ->rand_offset[targ->n_rand_str - 1], pkey);
 	}
+	if (STR_EQ(str, "flows")) {
+		return parse_int(&targ->n_gen_flows, pkey);
+	}
+	if (STR_EQ(str, "flow distribution")) {
+		return parse_str(targ->flow_distr, pkey, sizeof(targ->flow_distr));
+	}
+	if (STR_EQ(str, "flow zipf exponent")) {
+		return parse_float(&targ->flow_zipf_s, pkey);
+	}
+	if (STR_EQ(str, "flow weights file")) {
+		return parse_str(targ->flow_weights_file, pkey, sizeof(targ->flow_weights_file));
+	}
+	if (STR_EQ(str, "flow counters")) {
+		return parse_flag(&targ->flow_counters, 1, pkey);
+	}
 	if (STR_EQ(str, "keep src mac")) {
 		return parse_flag(&targ->flags, DSF_KEEP_SRC_MAC, pkey);
 	}
@@ -1009,6 +1067,9 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "signature pos")) {
 		return parse_int(&targ->sig_pos, pkey);
 	}
+	if (STR_EQ(str, "mbuf recycle")) {
+		return parse_flag(&targ->flags, TASK_ARG_MBUF_RECYCLE, pkey);
+	}
 	if (STR_EQ(str, "lat pos")) {
 		targ->lat_enabled = 1;
 		return parse_int(&targ->lat_pos, pkey);
@@ -1131,6 +1192,16 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 		return parse_int(&targ->marking[2], pkey);
 	}
 
+	if (STR_EQ(str, "prio weights")) {
+		return parse_int_list(targ->prio_weight, &targ->n_prio_weights,
+				      sizeof(targ->prio_weight)/sizeof(targ->prio_weight[0]), pkey);
+	}
+
+	if (STR_EQ(str, "prio queue limits")) {
+		return parse_int_list(targ->prio_queue_limit, &targ->n_prio_queue_limits,
+				      sizeof(targ->prio_queue_limit)/sizeof(targ->prio_queue_limit[0]), pkey);
+	}
+
 	if (STR_EQ(str, "tx cores")) {
 		uint8_t dest_task = 0;
 		/* if user did not specify, dest_port is left at default (first type) */
@@ -1220,6 +1291,7 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 		return parse_flag(&targ->runtime_flags, TASK_TX_CRC, pkey);
 	}
 	if (STR_EQ(str, "ring size")) {
+		targ->ring_size_set_explicitely = 1;
 		return parse_int(&targ->ring_size, pkey);
 	}
 	if (STR_EQ(str, "mempool size")) {
@@ -1537,6 +1609,9 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
                 targ->lookup_port_mask = val;
                 return 0;
         }
+	if (STR_EQ(str, "max tun bindings")) {
+		return parse_int(&targ->n_max_tun_bindings, pkey);
+	}
 
 	set_errf("Option '%s' is not known", str);
 	/* fail on unknown keys */
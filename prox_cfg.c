@@ -32,6 +32,8 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "prox_cfg.h"
 
@@ -55,6 +57,28 @@ static int prox_cm_isset(const uint32_t lcore_id)
 	return !!(prox_cfg.core_mask[cm_idx] & cm);
 }
 
+int prox_ctrl_thread_affinity(pthread_t thread)
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t cpuset;
+	int n_set = 0;
+
+	CPU_ZERO(&cpuset);
+	for (long cpu = 0; cpu < n_cpus && cpu < CPU_SETSIZE; ++cpu) {
+		if (!prox_core_active(cpu, 1)) {
+			CPU_SET(cpu, &cpuset);
+			n_set++;
+		}
+	}
+	if (n_set == 0) {
+		for (long cpu = 0; cpu < n_cpus && cpu < CPU_SETSIZE; ++cpu)
+			CPU_SET(cpu, &cpuset);
+	}
+	if (pthread_setaffinity_np(thread, sizeof(cpuset), &cpuset))
+		return -1;
+	return n_set == 0;
+}
+
 int prox_core_active(const uint32_t lcore_id, const int with_master)
 {
 	int ret;
@@ -34,6 +34,7 @@
 #define _PROX_CFG_H
 
 #include <inttypes.h>
+#include <pthread.h>
 
 #include "prox_globals.h"
 
@@ -66,11 +67,18 @@ enum prox_ui {
 	PROX_UI_NONE,
 };
 
+enum cross_socket_policy {
+	CROSS_SOCKET_WARN,	/* default */
+	CROSS_SOCKET_ALLOW,
+	CROSS_SOCKET_REJECT,
+};
+
 struct prox_cfg {
 	enum prox_ui    ui;             /* By default, curses is used as a UI. */
 	char            update_interval_str[16];
 	int             use_stats_logger;
 	uint32_t	flags;		/* TGSF_* flags above */
+	enum cross_socket_policy cross_socket_policy; /* mbufs crossing sockets through rings or ports */
 	uint32_t	master;		/* master core to run user interface on */
 	uint64_t        core_mask[PROX_CM_DIM]; /* Active cores without master core */
 	uint32_t	start_time;	/* if set (not 0), average pps will be calculated starting after start_time seconds */
@@ -88,6 +96,11 @@ extern struct prox_cfg prox_cfg;
 
 int prox_core_active(const uint32_t lcore_id, const int with_master);
 
+/* Restrict a control thread (not running tasks) to the cores not used
+   by PROX. Returns 1 if PROX uses all cores and the thread was allowed
+   on any of them, -1 on failure. */
+int prox_ctrl_thread_affinity(pthread_t thread);
+
 /* Returns non-zero if supplied lcore_id is the last active core. The
    first core can be found by setting *lcore_id == -1. The function is
    indented to be used as an interator. */
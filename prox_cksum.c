@@ -33,6 +33,9 @@
 #include "prox_cksum.h"
 #include "prox_port_cfg.h"
 #include <rte_byteorder.h>
+#ifdef __AVX2__
+#include <x86intrin.h>
+#endif
 #include "log.h"
 
 /* compute IP 16 bit checksum */
@@ -75,6 +78,8 @@ static uint16_t calc_pseudo_checksum(uint8_t ipproto, uint16_t len, uint32_t src
 	csum += (src_ip_addr >> 16) + (src_ip_addr & 0xFFFF);
 	csum += (dst_ip_addr >> 16) + (dst_ip_addr & 0xFFFF);
 	csum += rte_bswap16(ipproto) + rte_bswap16(len);
+	/* the first fold can carry again */
+	csum = (csum >> 16) + (csum & 0xFFFF);
 	csum = (csum >> 16) + (csum & 0xFFFF);
 	return csum;
 }
@@ -121,35 +126,63 @@ void prox_ip_udp_cksum(struct rte_mbuf *mbuf, struct ipv4_hdr *pip, uint16_t l2_
 	}
 }
 
-static uint16_t checksum_byte_seq(uint16_t *buf, uint16_t len)
+/* Unfolded one's complement sum of the 16 bit words in buf. Since
+   2^16 = 1 mod 0xFFFF, wider words can be added and folded at the end. */
+static uint64_t raw_cksum_sum(const uint8_t *buf, uint16_t len)
 {
-	uint32_t csum = 0;
-
-	while (len > 1) {
-		csum += *buf;
-		while (csum >> 16) {
-			csum &= 0xffff;
-			csum +=1;
+	uint64_t sum = 0;
+
+#ifdef __AVX2__
+	/* the final reduction costs more than it saves on short buffers */
+	if (len >= 128) {
+		const __m256i zero = _mm256_setzero_si256();
+		__m256i acc = zero;
+		uint64_t lanes[4];
+
+		/* Zero extend the words to 32 bit lanes. Each lane takes
+		   two words per iteration, which cannot overflow for up
+		   to 64KB of data. */
+		for (; len >= 32; len -= 32, buf += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)buf);
+
+			acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+			acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
 		}
-		buf++;
+		acc = _mm256_add_epi64(_mm256_unpacklo_epi32(acc, zero), _mm256_unpackhi_epi32(acc, zero));
+		_mm256_storeu_si256((__m256i *)lanes, acc);
+		sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#endif
+	for (; len >= 4; len -= 4, buf += 4)
+		sum += *(const uint32_t *)buf;
+	if (len >= 2) {
+		sum += *(const uint16_t *)buf;
+		buf += 2;
 		len -= 2;
 	}
+	/* a trailing odd byte is padded with zero */
+	if (len)
+		sum += *buf;
+	return sum;
+}
 
-	if (len) {
-		csum += *(uint8_t*)buf;
-		while (csum >> 16) {
-			csum &= 0xffff;
-			csum +=1;
-		}
-	}
-	return ~csum;
+static uint16_t checksum_byte_seq(uint16_t *buf, uint16_t len)
+{
+	uint64_t sum = raw_cksum_sum((const uint8_t *)buf, len);
+
+	sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+	sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	return ~sum;
 }
 
 void prox_udp_cksum_sw(struct udp_hdr *udp, uint16_t len, uint32_t src_ip_addr, uint32_t dst_ip_addr)
 {
 	prox_write_udp_pseudo_hdr(udp, len, src_ip_addr, dst_ip_addr);
 	uint16_t csum = checksum_byte_seq((uint16_t *)udp, len);
-	udp->dgram_cksum = csum;
+	/* a computed checksum of zero is transmitted as all ones */
+	udp->dgram_cksum = csum ? csum : 0xFFFF;
 }
 
 void prox_tcp_cksum_sw(struct tcp_hdr *tcp, uint16_t len, uint32_t src_ip_addr, uint32_t dst_ip_addr)
@@ -41,6 +41,7 @@
 #include <rte_udp.h>
 #include <rte_tcp.h>
 #include <rte_mbuf.h>
+#include <rte_byteorder.h>
 
 #if RTE_VERSION >= RTE_VERSION_NUM(1,8,0,0)
 #define CALC_TX_OL(l2_len, l3_len) ((uint64_t)(l2_len) | (uint64_t)(l3_len) << 7)
@@ -77,6 +78,79 @@ static inline void prox_ip_cksum(struct rte_mbuf *mbuf, struct ipv4_hdr *buf, ui
 
 void prox_ip_udp_cksum(struct rte_mbuf *mbuf, struct ipv4_hdr *buf, uint16_t l2_len, uint16_t l3_len, int cksum_offload);
 
+/* Non zero if checksums must be written by software, i.e. if the
+   offload capabilities passed to prox_ip_cksum() would not be used. */
+static inline int prox_cksum_in_sw(__attribute__((unused)) int offload)
+{
+#ifdef SOFT_CRC
+	return 1;
+#else
+	return !offload;
+#endif
+}
+
+/* Incremental checksum updates (RFC 1624, eqn. 3) after a covered field
+   changed from old_val to new_val. Checksums and fields are taken as
+   stored in the packet (network byte order). */
+static inline uint16_t prox_cksum_update16(uint16_t cksum, uint16_t old_val, uint16_t new_val)
+{
+	uint32_t sum = (uint16_t)~cksum;
+
+	sum += (uint16_t)~old_val + new_val;
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	return ~sum;
+}
+
+static inline uint16_t prox_cksum_update32(uint16_t cksum, uint32_t old_val, uint32_t new_val)
+{
+	uint32_t sum = (uint16_t)~cksum;
+
+	sum += (uint16_t)~old_val + (uint16_t)(~old_val >> 16);
+	sum += (new_val & 0xFFFF) + (new_val >> 16);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	return ~sum;
+}
+
+/* IPv4 header checksum after decrementing a non zero TTL. The TTL is
+   the high byte of its 16 bit word, so the word decreases by 0x100. */
+static inline uint16_t prox_ip_cksum_ttl_dec(uint16_t cksum)
+{
+	return prox_cksum_update16(cksum, rte_cpu_to_be_16(0x0100), 0);
+}
+
+/* Update the IPv4 and UDP/TCP checksums of a packet of which the
+   address old_addr has been replaced by new_addr and the port old_port
+   by new_port. Pass equal ports if only the address changed. */
+static inline void prox_ip_udp_cksum_update(struct ipv4_hdr *ip, uint32_t old_addr, uint32_t new_addr, uint16_t old_port, uint16_t new_port)
+{
+	uint8_t *l4 = (uint8_t *)ip + (ip->version_ihl & 0x0F) * 4;
+	uint16_t cksum;
+
+	ip->hdr_checksum = prox_cksum_update32(ip->hdr_checksum, old_addr, new_addr);
+
+	/* Only the first fragment carries the L4 header */
+	if (ip->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK))
+		return;
+
+	if (ip->next_proto_id == IPPROTO_UDP) {
+		struct udp_hdr *udp = (struct udp_hdr *)l4;
+
+		/* A zero UDP checksum means none was computed */
+		if (udp->dgram_cksum == 0)
+			return;
+		cksum = prox_cksum_update32(udp->dgram_cksum, old_addr, new_addr);
+		cksum = prox_cksum_update16(cksum, old_port, new_port);
+		udp->dgram_cksum = cksum ? cksum : 0xFFFF;
+	} else if (ip->next_proto_id == IPPROTO_TCP) {
+		struct tcp_hdr *tcp = (struct tcp_hdr *)l4;
+
+		cksum = prox_cksum_update32(tcp->cksum, old_addr, new_addr);
+		tcp->cksum = prox_cksum_update16(cksum, old_port, new_port);
+	}
+}
+
 /* src_ip_addr/dst_ip_addr are in network byte order */
 void prox_udp_cksum_sw(struct udp_hdr *udp, uint16_t len, uint32_t src_ip_addr, uint32_t dst_ip_addr);
 void prox_tcp_cksum_sw(struct tcp_hdr *tcp, uint16_t len, uint32_t src_ip_addr, uint32_t dst_ip_addr);
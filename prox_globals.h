@@ -37,3 +37,4 @@
 #define MAX_PROTOCOLS           3
 #define MAX_RINGS_PER_TASK      (MAX_WT_PER_LB*MAX_PROTOCOLS)
 #define MAX_WT_PER_LB           64
+#define STATS_N_SAMPLES         3
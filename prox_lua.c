@@ -36,6 +36,7 @@
 #include "prox_lua.h"
 #include "lua_compat.h"
 #include "parse_utils.h"
+#include "table_image.h"
 
 static struct lua_State *lua_instance;
 
@@ -422,6 +423,8 @@ struct lua_State *prox_lua(void)
 		lua_setglobal(lua_instance, "server_content");
 		lua_pushcfunction(lua_instance, l_task_count);
 		lua_setglobal(lua_instance, "task_count");
+		lua_pushcfunction(lua_instance, table_image_lua);
+		lua_setglobal(lua_instance, "table_image");
 	}
 	return lua_instance;
 }
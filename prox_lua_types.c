@@ -35,12 +35,14 @@
 #include <lualib.h>
 
 #include <string.h>
+#include <stdlib.h>
 #include <rte_ether.h>
 #include <rte_lpm.h>
 #include <rte_lpm6.h>
 #include <rte_acl.h>
 #include <rte_version.h>
 #include <rte_hash_crc.h>
+#include <rte_cycles.h>
 
 #include "prox_malloc.h"
 #include "etypes.h"
@@ -55,6 +57,8 @@
 #include "handle_qinq_encap4.h"
 #include "toeplitz.h"
 #include "handle_lb_5tuple.h"
+#include "table_image.h"
+#include "qsbr.h"
 
 #if RTE_VERSION < RTE_VERSION_NUM(1,8,0,0)
 #define RTE_CACHE_LINE_SIZE CACHE_LINE_SIZE
@@ -519,22 +523,125 @@ int lua_to_next_hop6(struct lua_State *L, enum lua_place from, const char *name,
 	return 0;
 }
 
-int lua_to_routes4(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm4 *lpm)
+static struct rte_lpm *lpm4_create(uint8_t socket, uint32_t n_tot_rules)
+{
+	static uint32_t lpm_id;
+	struct rte_lpm *new_lpm;
+	char lpm_name[64];
+
+	snprintf(lpm_name, sizeof(lpm_name), "IPv4_lpm%u_s%u", lpm_id++, socket);
+#if RTE_VERSION >= RTE_VERSION_NUM(16,4,0,1)
+	struct rte_lpm_config conf;
+	conf.max_rules = 2 * n_tot_rules;
+	conf.number_tbl8s = 256;
+	conf.flags = 0;
+	new_lpm = rte_lpm_create(lpm_name, socket, &conf);
+#else
+	new_lpm = rte_lpm_create(lpm_name, socket, 2 * n_tot_rules, 0);
+#endif
+	return new_lpm;
+}
+
+static int lpm4_add(struct lpm4 *lpm, uint32_t ip, uint8_t prefix, uint32_t next_hop_index)
+{
+	int ret = rte_lpm_add(lpm->rte_lpm, ip, prefix, next_hop_index);
+
+	if (ret != 0) {
+		set_err("Failed to add (%d) index %u ip %x/%u to lpm\n",
+			ret, next_hop_index, ip, prefix);
+		return ret;
+	}
+	if (++lpm->n_used_rules % 10000 == 0) {
+		plog_info("Route %d added\n", lpm->n_used_rules);
+	}
+
+	if (lpm->n_routes == lpm->max_routes) {
+		lpm->max_routes = lpm->max_routes? 2 * lpm->max_routes : 64;
+		lpm->routes = realloc(lpm->routes, lpm->max_routes * sizeof(lpm->routes[0]));
+		PROX_PANIC(lpm->routes == NULL, "Failed to allocate memory for routes\n");
+	}
+	lpm->routes[lpm->n_routes].ip = ip;
+	lpm->routes[lpm->n_routes].prefix = prefix;
+	lpm->routes[lpm->n_routes].next_hop_index = next_hop_index;
+	lpm->n_routes++;
+	return 0;
+}
+
+static int lpm4_apply(struct rte_lpm *rte_lpm, const struct lpm4_update *update)
+{
+	if (update->del)
+		return rte_lpm_delete(rte_lpm, update->ip, update->prefix);
+	return rte_lpm_add(rte_lpm, update->ip, update->prefix, update->next_hop_index);
+}
+
+uint32_t lpm4_update(struct lpm4 *lpm, const struct lpm4_update *updates, uint32_t n_updates)
+{
+	struct rte_lpm *old;
+	uint32_t n_failed = 0;
+
+	if (lpm->standby == NULL) {
+		lpm->standby = lpm4_create(lpm->socket, lpm->n_tot_rules);
+		if (lpm->standby == NULL) {
+			plog_err("Failed to allocate lpm for updates\n");
+			return n_updates;
+		}
+		for (uint32_t i = 0; i < lpm->n_routes; ++i) {
+			const struct lpm4_route *r = &lpm->routes[i];
+
+			rte_lpm_add(lpm->standby, r->ip, r->prefix, r->next_hop_index);
+		}
+		free(lpm->routes);
+		lpm->routes = NULL;
+		lpm->n_routes = 0;
+	}
+
+	/* The updates are applied to the standby copy, which is then
+	   published. When no core uses the previous version anymore,
+	   the same updates are applied to it and it becomes the
+	   standby copy. */
+	for (uint32_t i = 0; i < n_updates; ++i) {
+		if (lpm4_apply(lpm->standby, &updates[i])) {
+			n_failed++;
+		}
+		else if (updates[i].del) {
+			lpm->n_used_rules--;
+			lpm->n_free_rules++;
+		}
+		else {
+			lpm->n_used_rules++;
+			lpm->n_free_rules--;
+		}
+	}
+
+	old = lpm->rte_lpm;
+	qsbr_publish(lpm->rte_lpm, lpm->standby);
+	qsbr_synchronize();
+
+	/* Both copies are identical, failed updates fail again */
+	for (uint32_t i = 0; i < n_updates; ++i)
+		lpm4_apply(old, &updates[i]);
+	lpm->standby = old;
+	return n_failed;
+}
+
+/* Image of a struct lpm4: the next hops followed by the routes */
+struct lpm4_image {
+	struct next_hop         next_hops[MAX_HOP_INDEX];
+	uint32_t                n_routes;
+	uint32_t                reserved;
+	struct lpm4_route routes[0];
+};
+
+static int routes4_to_lpm(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm4 *lpm, struct lpm4_image **image)
 {
 	struct ip4_subnet dst;
 	uint32_t next_hop_index;
-	uint32_t n_loaded_rules;
 	uint32_t n_tot_rules;
-	struct rte_lpm *new_lpm;
-	char lpm_name[64];
-	int ret;
 	int pop;
 
 	if ((pop = lua_getfrom(L, from, name)) < 0)
 		return -1;
 
-	snprintf(lpm_name, sizeof(lpm_name), "IPv4_lpm_s%u", socket);
-
 	if (!lua_istable(L, -1)) {
 		set_err("Data is not a table\n");
 		return -1;
@@ -542,18 +649,19 @@ int lua_to_routes4(struct lua_State *L, enum lua_place from, const char *name, u
 
 	lua_len(L, -1);
 	n_tot_rules = lua_tointeger(L, -1);
-	n_loaded_rules = 0;
 	lua_pop(L, 1);
-#if RTE_VERSION >= RTE_VERSION_NUM(16,4,0,1)
-	struct rte_lpm_config conf;
-	conf.max_rules = 2 * n_tot_rules;
-	conf.number_tbl8s = 256;
-	conf.flags = 0;
-	new_lpm = rte_lpm_create(lpm_name, socket, &conf);
-#else
-	new_lpm = rte_lpm_create(lpm_name, socket, 2 * n_tot_rules, 0);
-#endif
-	PROX_PANIC(NULL == new_lpm, "Failed to allocate lpm\n");
+
+	lpm->socket = socket;
+	lpm->n_tot_rules = n_tot_rules;
+	lpm->rte_lpm = lpm4_create(socket, n_tot_rules);
+	PROX_PANIC(lpm->rte_lpm == NULL, "Failed to allocate lpm\n");
+	lpm->n_used_rules = 0;
+
+	if (image) {
+		*image = calloc(1, sizeof(**image) + n_tot_rules * sizeof((*image)->routes[0]));
+		if (*image == NULL)
+			image = NULL;
+	}
 
 	lua_pushnil(L);
 	while (lua_next(L, -2)) {
@@ -561,29 +669,64 @@ int lua_to_routes4(struct lua_State *L, enum lua_place from, const char *name, u
 			set_err("Failed to read entry while setting up lpm\n");
 			return -1;
 		}
-		ret = rte_lpm_add(new_lpm, dst.ip, dst.prefix, next_hop_index);
-
-		if (ret != 0) {
-			set_err("Failed to add (%d) index %u ip %x/%u to lpm\n",
-				 ret, next_hop_index, dst.ip, dst.prefix);
-		}
-		else if (++n_loaded_rules % 10000 == 0) {
-			plog_info("Route %d added\n", n_loaded_rules);
+		if (lpm4_add(lpm, dst.ip, dst.prefix, next_hop_index) == 0 && image) {
+			/* Only the routes that could be added are kept */
+			struct lpm4_image *img = *image;
+
+			if (img->n_routes == n_tot_rules) {
+				free(img);
+				*image = NULL;
+				image = NULL;
+			}
+			else {
+				img->routes[img->n_routes].ip = dst.ip;
+				img->routes[img->n_routes].prefix = dst.prefix;
+				img->routes[img->n_routes].next_hop_index = next_hop_index;
+				img->n_routes++;
+			}
 		}
 
 		lua_pop(L, 1);
 	}
 
-	lpm->rte_lpm = new_lpm;
-	lpm->n_used_rules = n_loaded_rules;
-	lpm->n_free_rules = 2 * n_tot_rules - n_loaded_rules;
+	lpm->n_free_rules = 2 * n_tot_rules - lpm->n_used_rules;
 
 	lua_pop(L, pop);
 	return 0;
 }
 
+int lua_to_routes4(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm4 *lpm)
+{
+	return routes4_to_lpm(L, from, name, socket, lpm, NULL);
+}
+
+static void lpm4_from_image(const struct lpm4_image *image, uint64_t len, uint8_t socket, struct lpm4 *lpm)
+{
+	PROX_PANIC(len < sizeof(*image) || len != sizeof(*image) + image->n_routes * sizeof(image->routes[0]),
+		   "Inconsistent lpm4 image\n");
+
+	lpm->next_hops = prox_zmalloc(sizeof(*lpm->next_hops) * MAX_HOP_INDEX, socket);
+	PROX_PANIC(lpm->next_hops == NULL, "Could not allocate memory for next hop\n");
+	memcpy(lpm->next_hops, image->next_hops, sizeof(image->next_hops));
+
+	lpm->socket = socket;
+	lpm->n_tot_rules = image->n_routes;
+	lpm->rte_lpm = lpm4_create(socket, image->n_routes);
+	PROX_PANIC(lpm->rte_lpm == NULL, "Failed to allocate lpm\n");
+	lpm->n_used_rules = 0;
+	for (uint32_t i = 0; i < image->n_routes; ++i) {
+		const struct lpm4_route *r = &image->routes[i];
+
+		PROX_PANIC(lpm4_add(lpm, r->ip, r->prefix, r->next_hop_index), "%s", get_lua_to_errors());
+	}
+	lpm->n_free_rules = 2 * image->n_routes - lpm->n_used_rules;
+}
+
 int lua_to_lpm4(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm4 **lpm)
 {
+	const uint64_t tsc_beg = rte_rdtsc();
+	struct lpm4_image *image = NULL;
+	struct table_image img;
 	struct lpm4 *ret;
 	int pop;
 
@@ -597,9 +740,23 @@ int lua_to_lpm4(struct lua_State *L, enum lua_place from, const char *name, uint
 		return -1;
 	}
 
-	if (lua_to_routes4(L, TABLE, "routes", socket, ret) ||
-	    lua_to_next_hop(L, TABLE, "next_hops", socket, &ret->next_hops)) {
-		return -1;
+	if (table_image_open(L, TABLE_IMAGE_LPM4, sizeof(struct lpm4_route), sizeof(image->next_hops), &img) == 0) {
+		lpm4_from_image((const struct lpm4_image *)img.payload, img.hdr->payload_len, socket, ret);
+		table_image_close(&img);
+	}
+	else {
+		if (routes4_to_lpm(L, TABLE, "routes", socket, ret, table_image_wanted(L)? &image : NULL) ||
+		    lua_to_next_hop(L, TABLE, "next_hops", socket, &ret->next_hops)) {
+			free(image);
+			return -1;
+		}
+
+		if (image) {
+			memcpy(image->next_hops, ret->next_hops, sizeof(image->next_hops));
+			table_image_save(L, TABLE_IMAGE_LPM4, sizeof(struct lpm4_route), sizeof(image->next_hops), tsc_beg,
+					 image, sizeof(*image) + image->n_routes * sizeof(image->routes[0]));
+			free(image);
+		}
 	}
 
 	if (ret->rte_lpm)
@@ -771,6 +928,12 @@ int lua_to_qinq_gre_map(struct lua_State *L, enum lua_place from, const char *na
 		return -1;
 	}
 
+	/* The user table can be shared with tasks loading it from an image */
+	if (table_image_materialize(L) && from == GLOBAL) {
+		lua_pushvalue(L, -1);
+		lua_setglobal(L, name);
+	}
+
 	struct qinq_gre_map *ret;
 	uint32_t svlan, cvlan;
 	uint16_t be_svlan, be_cvlan;
@@ -826,8 +989,19 @@ int lua_to_qinq_gre_map(struct lua_State *L, enum lua_place from, const char *na
 	return 0;
 }
 
+struct user_table_image_entry {
+	uint32_t idx;
+	uint16_t user;
+	uint16_t reserved;
+};
+
 int lua_to_user_table(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, uint16_t **user_table)
 {
+	struct user_table_image_entry *image_entries = NULL;
+	const uint64_t tsc_beg = rte_rdtsc();
+	struct table_image img;
+	uint32_t n_image_entries = 0;
+	uint32_t n_entries = 0;
 	int pop;
 
 	if ((pop = lua_getfrom(L, from, name)) < 0)
@@ -845,12 +1019,30 @@ int lua_to_user_table(struct lua_State *L, enum lua_place from, const char *name
 	*user_table = prox_zmalloc(0x1000000 * sizeof(uint16_t), socket);
 	PROX_PANIC(*user_table == NULL, "Error creating user table");
 
+	if (table_image_open(L, TABLE_IMAGE_USER_TABLE, sizeof(*image_entries), 0, &img) == 0) {
+		const struct user_table_image_entry *e = (const struct user_table_image_entry *)img.payload;
+
+		for (uint64_t i = 0; i < img.hdr->payload_len / sizeof(*e); ++i)
+			(*user_table)[e[i].idx & 0xffffff] = e[i].user;
+		table_image_close(&img);
+		lua_pop(L, pop);
+		return 0;
+	}
+
+	if (table_image_wanted(L)) {
+		lua_len(L, -1);
+		n_image_entries = lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		image_entries = malloc(n_image_entries * sizeof(*image_entries));
+	}
+
 	lua_pushnil(L);
 	while (lua_next(L, -2)) {
 		if (lua_to_int(L, TABLE, "svlan_id", &svlan) ||
 		    lua_to_int(L, TABLE, "cvlan_id", &cvlan) ||
 		    lua_to_int(L, TABLE, "user_id", &user)) {
 			concat_err("Failed to read user table config\n");
+			free(image_entries);
 			return -1;
 		}
 
@@ -859,9 +1051,20 @@ int lua_to_user_table(struct lua_State *L, enum lua_place from, const char *name
 
 		(*user_table)[PKT_TO_LUTQINQ(be_svlan, be_cvlan)] = user;
 
+		if (image_entries && n_entries < n_image_entries) {
+			image_entries[n_entries].idx = PKT_TO_LUTQINQ(be_svlan, be_cvlan);
+			image_entries[n_entries].user = user;
+			image_entries[n_entries].reserved = 0;
+		}
+		n_entries++;
+
 		lua_pop(L, 1);
 	}
 
+	if (image_entries && n_entries == n_image_entries)
+		table_image_save(L, TABLE_IMAGE_USER_TABLE, sizeof(*image_entries), 0, tsc_beg, image_entries, n_entries * sizeof(*image_entries));
+	free(image_entries);
+
 	lua_pop(L, pop);
 	return 0;
 }
@@ -916,7 +1119,9 @@ int lua_to_ip6_tun_binding(struct lua_State *L, enum lua_place from, const char
 
 int lua_to_cpe_table_data(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct cpe_table_data **data)
 {
+	const uint64_t tsc_beg = rte_rdtsc();
 	struct cpe_table_data *ret;
+	struct table_image img;
 	int pop;
 
 	if ((pop = lua_getfrom(L, from, name)) < 0)
@@ -927,6 +1132,23 @@ int lua_to_cpe_table_data(struct lua_State *L, enum lua_place from, const char *
 		return -1;
 	}
 
+	/* The image contains struct cpe_table_data as is */
+	if (table_image_open(L, TABLE_IMAGE_CPE_TABLE, sizeof(struct cpe_table_entry), 0, &img) == 0) {
+		const struct cpe_table_data *image_data = (const struct cpe_table_data *)img.payload;
+
+		PROX_PANIC(img.hdr->payload_len < sizeof(*ret) ||
+			   img.hdr->payload_len != sizeof(*ret) + image_data->n_entries * sizeof(struct cpe_table_entry),
+			   "Inconsistent cpe table image\n");
+		ret = prox_zmalloc(img.hdr->payload_len, 0);
+		PROX_PANIC(ret == NULL, "Failed to allocate cpe table\n");
+		memcpy(ret, image_data, img.hdr->payload_len);
+		table_image_close(&img);
+
+		*data = ret;
+		lua_pop(L, pop);
+		return 0;
+	}
+
 	/* Each entry in the input table expands to multiple entries
 	   depending on the number of hosts within the subnet. For
 	   this reason, go through the whole table and find out how
@@ -979,6 +1201,8 @@ int lua_to_cpe_table_data(struct lua_State *L, enum lua_place from, const char *
 	ret->n_entries = n_entries;
 	*data = ret;
 
+	table_image_save(L, TABLE_IMAGE_CPE_TABLE, sizeof(struct cpe_table_entry), 0, tsc_beg, ret, sizeof(*ret) + n_entries * sizeof(struct cpe_table_entry));
+
 	lua_pop(L, pop);
 	return 0;
 }
@@ -988,8 +1212,79 @@ struct acl4_rule {
 	struct rte_acl_field fields[9];
 };
 
+/* Rule as read from Lua, before conversion to an ACL rule */
+struct acl4_rule_image {
+	struct val_mask svlan;
+	struct val_mask cvlan;
+	struct val_mask ip_proto;
+	struct ip4_subnet src_cidr;
+	struct ip4_subnet dst_cidr;
+	struct val_range sport;
+	struct val_range dport;
+	uint32_t action;
+};
+
+static void acl4_rule_add(struct rte_acl_ctx *ctx, const struct acl4_rule_image *r, uint32_t priority, int use_qinq, uint16_t qinq_tag)
+{
+	struct acl4_rule rule;
+
+	rule.data.userdata = r->action; /* allow, drop or rate_limit */
+	rule.data.category_mask = 1;
+	rule.data.priority = priority;
+
+	/* Configuration for rules is done in little-endian so no bswap is needed here.. */
+
+	rule.fields[0].value.u8 = r->ip_proto.val;
+	rule.fields[0].mask_range.u8 = r->ip_proto.mask;
+	rule.fields[1].value.u32 = r->src_cidr.ip;
+	rule.fields[1].mask_range.u32 = r->src_cidr.prefix;
+
+	rule.fields[2].value.u32 = r->dst_cidr.ip;
+	rule.fields[2].mask_range.u32 = r->dst_cidr.prefix;
+
+	rule.fields[3].value.u16 = r->sport.beg;
+	rule.fields[3].mask_range.u16 = r->sport.end;
+
+	rule.fields[4].value.u16 = r->dport.beg;
+	rule.fields[4].mask_range.u16 = r->dport.end;
+
+	if (use_qinq) {
+		rule.fields[5].value.u16 = rte_bswap16(qinq_tag);
+		rule.fields[5].mask_range.u16 = 0xffff;
+
+		/* To mask out the TCI and only keep the VID, the mask should be 0x0fff */
+		rule.fields[6].value.u16 = r->svlan.val;
+		rule.fields[6].mask_range.u16 = r->svlan.mask;
+
+		rule.fields[7].value.u16 = rte_bswap16(ETYPE_VLAN);
+		rule.fields[7].mask_range.u16 = 0xffff;
+
+		rule.fields[8].value.u16 = r->cvlan.val;
+		rule.fields[8].mask_range.u16 = r->cvlan.mask;
+	}
+	else {
+		/* Reuse first ethertype from vlan to check if packet is IPv4 packet */
+		rule.fields[5].value.u16 =  rte_bswap16(ETYPE_IPv4);
+		rule.fields[5].mask_range.u16 = 0xffff;
+
+		/* Other fields are ignored */
+		rule.fields[6].value.u16 = 0;
+		rule.fields[6].mask_range.u16 = 0;
+		rule.fields[7].value.u16 = 0;
+		rule.fields[7].mask_range.u16 = 0;
+		rule.fields[8].value.u16 = 0;
+		rule.fields[8].mask_range.u16 = 0;
+	}
+
+	rte_acl_add_rules(ctx, (struct rte_acl_rule*) &rule, 1);
+}
+
 int lua_to_rules(struct lua_State *L, enum lua_place from, const char *name, struct rte_acl_ctx *ctx, uint32_t* n_max_rules, int use_qinq, uint16_t qinq_tag)
 {
+	struct acl4_rule_image *image_rules = NULL;
+	const uint64_t tsc_beg = rte_rdtsc();
+	uint32_t n_image_rules = 0;
+	struct table_image img;
 	int pop;
 
 	if ((pop = lua_getfrom(L, from, name)) < 0)
@@ -1000,85 +1295,74 @@ int lua_to_rules(struct lua_State *L, enum lua_place from, const char *name, str
 		return -1;
 	}
 
-	struct val_mask svlan, cvlan, ip_proto;
-	struct ip4_subnet src_cidr, dst_cidr;
-	struct val_range sport, dport;
-	enum acl_action action;
+	/* VLANs are only read from Lua with QinQ */
+	if (table_image_open(L, TABLE_IMAGE_ACL_RULES, sizeof(struct acl4_rule_image), !!use_qinq, &img) == 0) {
+		const struct acl4_rule_image *r = (const struct acl4_rule_image *)img.payload;
+		uint32_t n_rules = img.hdr->payload_len / sizeof(*r);
+
+		if (n_rules > *n_max_rules) {
+			table_image_close(&img);
+			set_err("Too many rules");
+			return -1;
+		}
+		for (uint32_t i = 0; i < n_rules; ++i)
+			acl4_rule_add(ctx, &r[i], i, use_qinq, qinq_tag);
+		table_image_close(&img);
+
+		*n_max_rules -= n_rules;
+		lua_pop(L, pop);
+		return 0;
+	}
+
+	if (table_image_wanted(L)) {
+		lua_len(L, -1);
+		n_image_rules = lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		image_rules = calloc(n_image_rules, sizeof(*image_rules));
+	}
+
+	struct acl4_rule_image r;
 	uint32_t n_rules = 0;
+
+	memset(&r, 0, sizeof(r));
 	lua_pushnil(L);
 	while (lua_next(L, -2)) {
 		if (n_rules == *n_max_rules) {
 			set_err("Too many rules");
+			free(image_rules);
 			return -1;
 		}
 		if (use_qinq) {
-			if (lua_to_val_mask(L, TABLE, "svlan_id", &svlan) ||
-			    lua_to_val_mask(L, TABLE, "cvlan_id", &cvlan))
+			if (lua_to_val_mask(L, TABLE, "svlan_id", &r.svlan) ||
+			    lua_to_val_mask(L, TABLE, "cvlan_id", &r.cvlan)) {
+				free(image_rules);
 				return -1;
+			}
 		}
 
-		if (lua_to_val_mask(L, TABLE, "ip_proto", &ip_proto) ||
-		    lua_to_cidr(L, TABLE, "src_cidr", &src_cidr) ||
-		    lua_to_cidr(L, TABLE, "dst_cidr", &dst_cidr) ||
-		    lua_to_val_range(L, TABLE, "sport", &sport) ||
-		    lua_to_val_range(L, TABLE, "dport", &dport) ||
-		    lua_to_action(L, TABLE, "action", &action))
-			return -1;
-
-		struct acl4_rule rule;
-
-		rule.data.userdata = action; /* allow, drop or rate_limit */
-		rule.data.category_mask = 1;
-		rule.data.priority = n_rules++;
-
-		/* Configuration for rules is done in little-endian so no bswap is needed here.. */
-
-		rule.fields[0].value.u8 = ip_proto.val;
-		rule.fields[0].mask_range.u8 = ip_proto.mask;
-		rule.fields[1].value.u32 = src_cidr.ip;
-		rule.fields[1].mask_range.u32 = src_cidr.prefix;
-
-		rule.fields[2].value.u32 = dst_cidr.ip;
-		rule.fields[2].mask_range.u32 = dst_cidr.prefix;
-
-		rule.fields[3].value.u16 = sport.beg;
-		rule.fields[3].mask_range.u16 = sport.end;
-
-		rule.fields[4].value.u16 = dport.beg;
-		rule.fields[4].mask_range.u16 = dport.end;
+		enum acl_action action;
 
-		if (use_qinq) {
-			rule.fields[5].value.u16 = rte_bswap16(qinq_tag);
-			rule.fields[5].mask_range.u16 = 0xffff;
-
-			/* To mask out the TCI and only keep the VID, the mask should be 0x0fff */
-			rule.fields[6].value.u16 = svlan.val;
-			rule.fields[6].mask_range.u16 = svlan.mask;
-
-			rule.fields[7].value.u16 = rte_bswap16(ETYPE_VLAN);
-			rule.fields[7].mask_range.u16 = 0xffff;
-
-			rule.fields[8].value.u16 = cvlan.val;
-			rule.fields[8].mask_range.u16 = cvlan.mask;
-		}
-		else {
-			/* Reuse first ethertype from vlan to check if packet is IPv4 packet */
-			rule.fields[5].value.u16 =  rte_bswap16(ETYPE_IPv4);
-			rule.fields[5].mask_range.u16 = 0xffff;
-
-			/* Other fields are ignored */
-			rule.fields[6].value.u16 = 0;
-			rule.fields[6].mask_range.u16 = 0;
-			rule.fields[7].value.u16 = 0;
-			rule.fields[7].mask_range.u16 = 0;
-			rule.fields[8].value.u16 = 0;
-			rule.fields[8].mask_range.u16 = 0;
+		if (lua_to_val_mask(L, TABLE, "ip_proto", &r.ip_proto) ||
+		    lua_to_cidr(L, TABLE, "src_cidr", &r.src_cidr) ||
+		    lua_to_cidr(L, TABLE, "dst_cidr", &r.dst_cidr) ||
+		    lua_to_val_range(L, TABLE, "sport", &r.sport) ||
+		    lua_to_val_range(L, TABLE, "dport", &r.dport) ||
+		    lua_to_action(L, TABLE, "action", &action)) {
+			free(image_rules);
+			return -1;
 		}
+		r.action = action;
 
-		rte_acl_add_rules(ctx, (struct rte_acl_rule*) &rule, 1);
+		if (image_rules && n_rules < n_image_rules)
+			image_rules[n_rules] = r;
+		acl4_rule_add(ctx, &r, n_rules++, use_qinq, qinq_tag);
 		lua_pop(L, 1);
 	}
 
+	if (image_rules && n_rules == n_image_rules)
+		table_image_save(L, TABLE_IMAGE_ACL_RULES, sizeof(*image_rules), !!use_qinq, tsc_beg, image_rules, n_rules * sizeof(*image_rules));
+	free(image_rules);
+
 	*n_max_rules -= n_rules;
 	lua_pop(L, pop);
 	return 0;
@@ -1138,6 +1422,11 @@ int lua_to_tuples(struct lua_State *L, enum lua_place from, const char *name, ui
 		PROX_PANIC(*lookup_hash == NULL, "Unable to create the lb_5tuple hash\n");
 	}
 
+	/* Positions returned by the hash are below its number of entries,
+	   so the output table only needs to cover those. */
+	*out_if = prox_zmalloc(rte_align32pow2(ipv4_l3fwd_hash_params.entries), socket);
+	PROX_PANIC(*out_if == NULL, "Unable to allocate lb_5tuple output table for %u tuples\n", n_tot_tuples);
+
 	lua_pushnil(L);
 	while (lua_next(L, -2)) {
 		uint32_t if_out, ip_src, ip_dst, port_src, port_dst, proto;
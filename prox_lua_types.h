@@ -49,6 +49,7 @@ struct rte_lpm6;
 struct next_hop6;
 struct rte_acl_ctx;
 struct qinq_gre_map;
+struct rte_mbuf_ext_shared_info;
 
 #define MAX_HOP_INDEX  128
 enum l4gen_peer {PEER_SERVER, PEER_CLIENT};
@@ -62,6 +63,9 @@ struct peer_data {
 	uint8_t *hdr;
 	uint32_t hdr_len;
 	uint8_t *content;
+	/* Only set when content is attached to packets instead of copied */
+	struct rte_mbuf_ext_shared_info *content_shinfo;
+	uint64_t content_iova;
 };
 
 struct peer_action {
@@ -70,11 +74,34 @@ struct peer_action {
 	uint32_t          len;
 };
 
+struct lpm4_route {
+	uint32_t ip;
+	uint32_t prefix;
+	uint32_t next_hop_index;
+};
+
 struct lpm4 {
 	uint32_t n_free_rules;
 	uint32_t n_used_rules;
 	struct next_hop *next_hops;
+	/* Looked up by the datapath, use qsbr_deref() */
 	struct rte_lpm *rte_lpm;
+	/* Copy of rte_lpm that receives the updates first, created by
+	   the first call to lpm4_update(). Until then, routes holds the
+	   routes needed to build it. */
+	struct rte_lpm *standby;
+	struct lpm4_route *routes;
+	uint32_t n_routes;
+	uint32_t max_routes;
+	uint32_t n_tot_rules;
+	uint8_t socket;
+};
+
+struct lpm4_update {
+	uint32_t ip;
+	uint8_t  prefix;
+	uint8_t  del;
+	uint32_t next_hop_index;
 };
 
 struct lpm6 {
@@ -144,6 +171,9 @@ int lua_to_dscp(struct lua_State *L, enum lua_place from, const char *name, uint
 int lua_to_user_table(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, uint16_t **user_table);
 int lua_to_lpm4(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm4 **lpm);
 int lua_to_routes4(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm4 *lpm);
+/* Add or delete routes while the table is in use by the datapath.
+   Returns the number of updates that failed. */
+uint32_t lpm4_update(struct lpm4 *lpm, const struct lpm4_update *updates, uint32_t n_updates);
 int lua_to_next_hop(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct next_hop **nh);
 int lua_to_lpm6(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm6 **lpm);
 int lua_to_ip6_tun_binding(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct ipv6_tun_binding_table **data);
@@ -221,6 +221,13 @@ void init_rte_dev(int use_dummy_devices)
 		if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_UDP_CKSUM) {
 			port_cfg->capabilities.tx_offload_cksum |= UDP_CKSUM;
 		}
+		/* TX queues of virtio and vmxnet3 are set up with
+		   ETH_TXQ_FLAGS_NOOFFLOADS (see init_port()), which
+		   also disables TSO. */
+		if ((dev_info.tx_offload_capa & DEV_TX_OFFLOAD_TCP_TSO) &&
+		    strcmp(port_cfg->short_name, "virtio") && strcmp(port_cfg->short_name, "vmxnet3")) {
+			port_cfg->capabilities.tx_offload_tso = 1;
+		}
 	}
 }
 
@@ -312,9 +319,15 @@ static void init_port(struct prox_port_cfg *port_cfg)
 		port_cfg->port_conf.rx_adv_conf.rss_conf.rss_key_len 	= TOEPLITZ_KEY_LEN;
 #if RTE_VERSION >= RTE_VERSION_NUM(2,0,0,0)
 		port_cfg->port_conf.rx_adv_conf.rss_conf.rss_hf 	= ETH_RSS_IPV4|ETH_RSS_NONFRAG_IPV4_UDP;
+		if (port_cfg->rss_tcp)
+			port_cfg->port_conf.rx_adv_conf.rss_conf.rss_hf |= ETH_RSS_NONFRAG_IPV4_TCP;
 #else
 		port_cfg->port_conf.rx_adv_conf.rss_conf.rss_hf 	= ETH_RSS_IPV4|ETH_RSS_NONF_IPV4_UDP;
+		if (port_cfg->rss_tcp)
+			port_cfg->port_conf.rx_adv_conf.rss_conf.rss_hf |= ETH_RSS_NONF_IPV4_TCP;
 #endif
+		if (port_cfg->rss_tcp)
+			plog_info("\t\tHashing TCP ports on port %u\n", port_id);
 	}
 
 	plog_info("\t\tConfiguring port %u... with %u RX queues and %u TX queues\n",
@@ -48,10 +48,12 @@ enum addr_type {PROX_PORT_MAC_HW, PROX_PORT_MAC_SET, PROX_PORT_MAC_RAND};
 struct prox_port_cfg {
 	struct rte_mempool *pool[32];  /* Rx/Tx mempool */
 	size_t pool_size[32];
+	size_t pool_plan[32];          /* worst-case mbufs in flight */
 	uint8_t promiscuous;
 	uint8_t lsc_set_explicitely; /* Explicitly enable/disable lsc */
 	uint8_t lsc_val;
 	uint8_t active;
+	uint8_t rss_tcp;           /* hash TCP ports: "rss tcp" or an rx task steering by RSS */
 	int socket;
 	uint16_t max_rxq;         /* max number of Tx queues */
 	uint16_t max_txq;         /* max number of Tx queues */
@@ -75,6 +77,7 @@ struct prox_port_cfg {
 	struct rte_eth_txconf tx_conf;
 	struct {
 		int tx_offload_cksum;
+		int tx_offload_tso;
 	} capabilities;
 };
 
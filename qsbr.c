@@ -0,0 +1,80 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rte_cycles.h>
+#include <rte_atomic.h>
+
+#include "qsbr.h"
+#include "log.h"
+
+/* Grace period counter, starts at 1 as 0 means offline */
+volatile uint64_t qsbr_gp = 1;
+struct qsbr_core qsbr_cores[RTE_MAX_LCORE];
+
+void qsbr_online(unsigned lcore_id)
+{
+	qsbr_cores[lcore_id].seen = qsbr_gp;
+	/* Tables must be looked up after the core is seen online */
+	rte_smp_mb();
+}
+
+void qsbr_offline(unsigned lcore_id)
+{
+	__atomic_store_n(&qsbr_cores[lcore_id].seen, 0, __ATOMIC_RELEASE);
+}
+
+void qsbr_synchronize(void)
+{
+	const unsigned self = rte_lcore_id();
+	uint64_t gp, seen, tsc_warn;
+	int warned = 0;
+
+	/* Order the publication of the new version before the new grace
+	   period, cores seen online after this point use it. */
+	gp = __atomic_add_fetch(&qsbr_gp, 1, __ATOMIC_SEQ_CST);
+	tsc_warn = rte_rdtsc() + rte_get_tsc_hz();
+
+	for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+		if (lcore_id == self)
+			continue;
+		for (;;) {
+			seen = __atomic_load_n(&qsbr_cores[lcore_id].seen, __ATOMIC_ACQUIRE);
+			if (seen == 0 || seen >= gp)
+				break;
+			if (!warned && rte_rdtsc() > tsc_warn) {
+				plog_warn("Waiting for core %u to pass a quiescent state\n", lcore_id);
+				warned = 1;
+			}
+			rte_pause();
+		}
+	}
+}
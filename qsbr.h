@@ -0,0 +1,78 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _QSBR_H_
+#define _QSBR_H_
+
+#include <inttypes.h>
+
+#include <rte_lcore.h>
+#include <rte_memory.h>
+
+/* Quiescent state based reclamation for tables that are looked up by
+   the datapath and replaced at runtime by the control plane.
+
+   Cores running thread_generic() report a quiescent state at each
+   iteration of their main loop, i.e. whenever they don't hold any
+   pointer into a shared table. A writer publishes a new version of
+   a table with qsbr_publish() and calls qsbr_synchronize(). When it
+   returns, every core has passed through a quiescent state, so that
+   no core can still use the old version and it can be freed or
+   changed. Readers load the current version with qsbr_deref() and
+   must not keep it across loop iterations. */
+
+struct qsbr_core {
+	/* Last grace period counter seen, 0 if the core is offline */
+	volatile uint64_t seen;
+} __rte_cache_aligned;
+
+extern volatile uint64_t qsbr_gp;
+extern struct qsbr_core qsbr_cores[RTE_MAX_LCORE];
+
+#define qsbr_deref(p)       __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define qsbr_publish(p, v)  __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+static inline void qsbr_quiescent(unsigned lcore_id)
+{
+	__atomic_store_n(&qsbr_cores[lcore_id].seen, qsbr_gp, __ATOMIC_RELEASE);
+}
+
+/* Start and stop reporting quiescent states. Offline cores are not
+   waited for and must not use shared tables. */
+void qsbr_online(unsigned lcore_id);
+void qsbr_offline(unsigned lcore_id);
+
+/* Wait until all online cores have reported a quiescent state. Must
+   not be called from a datapath core. */
+void qsbr_synchronize(void);
+
+#endif /* _QSBR_H_ */
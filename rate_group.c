@@ -0,0 +1,115 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <string.h>
+#include <stdio.h>
+
+#include <rte_cycles.h>
+
+#include "prox_malloc.h"
+#include "prox_shared.h"
+#include "rate_group.h"
+#include "log.h"
+
+/* Must be called with rg->lock held. The group budget is rebased on
+   the current time so that bytes accumulated at the old rate are
+   kept and new bytes are added at the new rate. */
+static void rate_group_rebase(struct rate_group *rg, uint64_t tsc, uint64_t bytes_base, uint64_t bps)
+{
+	rg->seq++;
+	rte_wmb();
+	rg->tsc_base = tsc;
+	rg->bytes_base = bytes_base;
+	rg->bps = bps;
+	rg->cfg = token_time_cfg_create(bps, rte_get_tsc_hz(), rg->cfg.bytes_max);
+	rte_wmb();
+	rg->seq++;
+}
+
+struct rate_group *rate_group_join(const char *name, uint64_t bps, uint64_t batch, int socket_id)
+{
+	char sh_name[96];
+	struct rate_group *rg;
+
+	snprintf(sh_name, sizeof(sh_name), "rate_group_%s", name);
+	rg = prox_sh_find_system(sh_name);
+	if (rg == NULL) {
+		rg = prox_zmalloc(sizeof(*rg), socket_id);
+		if (rg == NULL)
+			return NULL;
+		strncpy(rg->name, name, sizeof(rg->name) - 1);
+		rte_spinlock_init(&rg->lock);
+		rg->cfg.period = rte_get_tsc_hz();
+		prox_sh_add_system(sh_name, rg);
+	}
+
+	rte_spinlock_lock(&rg->lock);
+	rg->n_members++;
+	/* Allow each member to hold two batches before the budget
+	   stops accumulating. */
+	rg->cfg.bytes_max = rg->n_members * batch * 2;
+	rate_group_rebase(rg, rte_rdtsc(), rg->consumed, rg->bps + bps);
+	rte_spinlock_unlock(&rg->lock);
+
+	plog_info("\tRate group %s: %u members, %"PRIu64" Bps\n", rg->name, rg->n_members, rg->bps);
+	return rg;
+}
+
+void rate_group_set_rate(struct rate_group *rg, uint64_t bps)
+{
+	rte_spinlock_lock(&rg->lock);
+	if (bps != rg->bps) {
+		uint64_t tsc = rte_rdtsc();
+
+		rate_group_rebase(rg, tsc, rate_group_allowed(rg, tsc), bps);
+	}
+	rte_spinlock_unlock(&rg->lock);
+}
+
+void rate_group_start(struct rate_group *rg)
+{
+	rte_spinlock_lock(&rg->lock);
+	/* The first member to start discards the budget accumulated
+	   while the group was not running. */
+	if (rg->n_running++ == 0)
+		rate_group_rebase(rg, rte_rdtsc(), rg->consumed, rg->bps);
+	rte_spinlock_unlock(&rg->lock);
+}
+
+void rate_group_stop(struct rate_group *rg)
+{
+	rte_spinlock_lock(&rg->lock);
+	if (rg->n_running)
+		rg->n_running--;
+	rte_spinlock_unlock(&rg->lock);
+}
@@ -0,0 +1,125 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef _RATE_GROUP_H_
+#define _RATE_GROUP_H_
+
+#include <inttypes.h>
+
+#include <rte_atomic.h>
+#include <rte_spinlock.h>
+#include <rte_memory.h>
+
+#include "token_time.h"
+
+/* A rate group is a budget of bytes shared by multiple tasks,
+   possibly running on different cores. The budget grows with time
+   at the group rate. Members take bytes from it in batches through
+   a single compare-and-set on consumed, and keep the bytes in their
+   own token_time until they are used. The aggregate rate of the
+   group is therefore exact (up to the bytes cached by the members),
+   independent of the number of members and of how fast each member
+   is.
+
+   The rate configuration is written under a lock by the control
+   plane and read without lock by the members using a sequence
+   counter. */
+struct rate_group {
+	char name[64];
+	rte_spinlock_t lock;
+	volatile uint32_t seq;
+	uint32_t n_members;
+	uint32_t n_running;
+	uint64_t bps;
+	uint64_t tsc_base;
+	uint64_t bytes_base;
+	struct token_time_cfg cfg;
+	/* Written by all members, kept on its own cache line. */
+	volatile uint64_t consumed __rte_cache_aligned;
+} __rte_cache_aligned;
+
+struct rate_group *rate_group_join(const char *name, uint64_t bps, uint64_t batch, int socket_id);
+void rate_group_set_rate(struct rate_group *rg, uint64_t bps);
+void rate_group_start(struct rate_group *rg);
+void rate_group_stop(struct rate_group *rg);
+
+/* Number of bytes the group was allowed to send up to tsc. */
+static uint64_t rate_group_allowed(const struct rate_group *rg, uint64_t tsc)
+{
+	uint64_t allowed, dt, periods;
+	uint32_t seq;
+
+	do {
+		seq = rg->seq;
+		rte_rmb();
+		dt = tsc > rg->tsc_base? tsc - rg->tsc_base : 0;
+		periods = dt / rg->cfg.period;
+		/* The remainder of the period times bpp does not fit
+		   in 64 bits at high rates (period is the TSC
+		   frequency for integer rates). */
+		allowed = rg->bytes_base + periods * rg->cfg.bpp +
+			(uint64_t)((unsigned __int128)(dt - periods * rg->cfg.period) * rg->cfg.bpp / rg->cfg.period);
+		rte_rmb();
+	} while ((seq & 1) || seq != rg->seq);
+
+	return allowed;
+}
+
+/* Take up to max_bytes from the group budget. Returns the number of
+   bytes taken. */
+static uint64_t rate_group_take(struct rate_group *rg, uint64_t tsc, uint64_t max_bytes)
+{
+	const uint64_t allowed = rate_group_allowed(rg, tsc);
+	uint64_t consumed, avail, n;
+
+	for (;;) {
+		consumed = rg->consumed;
+		if (consumed >= allowed)
+			return 0;
+
+		avail = allowed - consumed;
+		if (avail > rg->cfg.bytes_max) {
+			/* The budget has not been used for a
+			   while. Do not let the members catch up
+			   with more than bytes_max at once. */
+			rte_atomic64_cmpset(&rg->consumed, consumed, allowed - rg->cfg.bytes_max);
+			continue;
+		}
+
+		n = avail < max_bytes? avail : max_bytes;
+		if (rte_atomic64_cmpset(&rg->consumed, consumed, consumed + n))
+			return n;
+	}
+}
+
+#endif /* _RATE_GROUP_H_ */
@@ -32,6 +32,7 @@
 
 #include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <rte_launch.h>
 #include <rte_cycles.h>
@@ -62,6 +63,7 @@ static int stop_prox = 0; /* set to 1 to stop prox */
 void set_update_interval(uint32_t msec)
 {
 	update_interval = msec_to_tsc(msec);
+	stats_set_update_interval(update_interval);
 }
 
 void req_refresh(void)
@@ -136,12 +138,25 @@ static void stats_cons_finish(void)
 	}
 }
 
-static void busy_wait_until(uint64_t deadline)
+/* Statistics are sampled by the stats thread, the consumers only run
+   here after each new sample. */
+static void stats_proc_input(struct input *input)
 {
-	while (rte_rdtsc() < deadline)
-		;
+	uint64_t n;
+
+	if (read(input->fd, &n, sizeof(n)) != sizeof(n))
+		return;
+
+	/* A command may already have acquired the new sample */
+	stats_acquire();
+	stats_cons_notify();
+	stats_release();
 }
 
+static struct input stats_input = {
+	.proc_input = stats_proc_input,
+};
+
 static void multiplexed_input_stats(uint64_t deadline)
 {
 	if (deadline)
@@ -182,10 +197,8 @@ static void print_warnings(void)
 void __attribute__((noreturn)) run(uint32_t flags)
 {
 	uint64_t cur_tsc;
-	uint64_t next_update;
 	uint64_t stop_tsc = 0;
 	int ret = 0;
-	const uint64_t update_interval_threshold = usec_to_tsc(1);
 
 	if (flags & DSF_LISTEN_TCP)
 		PROX_PANIC(reg_input_tcp(), "Failed to start listening on TCP port 8474: %s\n", strerror(errno));
@@ -211,6 +224,9 @@ void __attribute__((noreturn)) run(uint32_t flags)
 		break;
 	}
 
+	if (plog_async_start())
+		plog_warn("Failed to start logging thread, datapath cores will log synchronously\n");
+
 	if (flags & DSF_AUTOSTART)
 		start_core_all(-1);
 	else
@@ -225,7 +241,9 @@ void __attribute__((noreturn)) run(uint32_t flags)
 	stats_cons_refresh();
 
 	update_interval = str_to_tsc(prox_cfg.update_interval_str);
-	next_update = cur_tsc + update_interval;
+	stats_input.fd = stats_thread_start(stats_cons_flags, update_interval);
+	PROX_PANIC(stats_input.fd < 0, "Failed to start stats thread\n");
+	PROX_PANIC(reg_input(&stats_input), "Failed to register stats thread notifications\n");
 
 	cmd_rx_tx_info();
 	print_warnings();
@@ -241,11 +259,6 @@ void __attribute__((noreturn)) run(uint32_t flags)
 					ret = handle_ctrl_plane(lcore_cfg[prox_cfg.master].tasks_all[0], NULL, 0);
 			}
 			multiplexed_input_stats(0);
-			if (rte_rdtsc() < next_update)
-				continue;
-			next_update += update_interval;
-			stats_update(stats_cons_flags);
-			stats_cons_notify();
 
 			if (stop_tsc && rte_rdtsc() >= stop_tsc) {
 				stop_prox = 1;
@@ -253,16 +266,7 @@ void __attribute__((noreturn)) run(uint32_t flags)
 		}
 	} else {
 		while (stop_prox == 0) {
-
-			if (update_interval < update_interval_threshold)
-				busy_wait_until(next_update);
-			else
-				multiplexed_input_stats(next_update);
-
-			next_update += update_interval;
-
-			stats_update(stats_cons_flags);
-			stats_cons_notify();
+			multiplexed_input_stats(rte_rdtsc() + update_interval);
 
 			if (stop_tsc && rte_rdtsc() >= stop_tsc) {
 				stop_prox = 1;
@@ -270,11 +274,14 @@ void __attribute__((noreturn)) run(uint32_t flags)
 		}
 	}
 
+	stats_thread_stop();
+	unreg_input(&stats_input);
 	stats_cons_finish();
 
 	if (prox_cfg.flags & DSF_WAIT_ON_QUIT) {
 		stop_core_all(-1);
 	}
+	plog_async_stop();
 
 	if (prox_cfg.logbuf) {
 		file_print(prox_cfg.logbuf);
@@ -525,6 +525,28 @@ uint16_t rx_pkt_tsc(struct task_base *tbase, struct rte_mbuf ***mbufs)
 	return ret;
 }
 
+/* Counts received mbufs per input (ring or port). All rx functions
+   move last_read_ring/last_read_portid past the input they read from,
+   so the input is the one preceding it. Must be the first function
+   stacked on top of the actual rx function. */
+uint16_t rx_pkt_xsocket(struct task_base *tbase, struct rte_mbuf ***mbufs)
+{
+	uint16_t ret = call_prev_rx_pkt(tbase, mbufs);
+	const uint8_t n = tbase->aux->rx_xsocket_n_inputs;
+	uint8_t input = 0;
+
+	if (ret == 0)
+		return 0;
+
+	if (n > 1) {
+		uint8_t last = tbase->aux->rx_xsocket_hw? tbase->rx_params_hw.last_read_portid :
+			tbase->rx_params_sw.last_read_ring;
+		input = last == 0? n - 1 : last - 1;
+	}
+	tbase->aux->rx_xsocket[input] += ret;
+	return ret;
+}
+
 uint16_t rx_pkt_all(struct task_base *tbase, struct rte_mbuf ***mbufs)
 {
 	uint16_t tot = 0;
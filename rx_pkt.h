@@ -68,6 +68,7 @@ uint16_t rx_pkt_distr(struct task_base *tbase, struct rte_mbuf ***mbufs);
 uint16_t rx_pkt_bw(struct task_base *tbase, struct rte_mbuf ***mbufs);
 uint16_t rx_pkt_tsc(struct task_base *tbase, struct rte_mbuf ***mbufs);
 uint16_t rx_pkt_all(struct task_base *tbase, struct rte_mbuf ***mbufs);
+uint16_t rx_pkt_xsocket(struct task_base *tbase, struct rte_mbuf ***mbufs);
 uint16_t ring_deq(struct rte_ring *r, struct rte_mbuf **mbufs);
 
 #endif /* _RX_PKT_H_ */
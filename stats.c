@@ -30,10 +30,17 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
 #include <rte_cycles.h>
+#include <rte_atomic.h>
 
 #include "prox_malloc.h"
 #include "prox_cfg.h"
+#include "log.h"
 #include "stats.h"
 #include "stats_port.h"
 #include "stats_mempool.h"
@@ -48,10 +55,39 @@
 
 /* Stores all readed values from the cores, displaying is done afterwards because
    displaying introduces overhead. If displaying was done right after the values
-   are read, inaccuracy is introduced for later cores */
-int last_stat; /* 0 or 1 to track latest 2 measurements */
+   are read, inaccuracy is introduced for later cores.
 
-void stats_reset(void)
+   Every statistic keeps STATS_N_SAMPLES samples and each thread has its
+   own view of the slots holding the last and previous sample. The
+   sampling thread always writes the slot after the last published one,
+   so a consumer can read the two slots it acquired without locking for
+   one full update interval. */
+__thread int last_stat;
+__thread int prev_stat = STATS_N_SAMPLES - 1;
+
+static volatile int published_stat;
+static volatile uint32_t stats_gen_started;
+static volatile uint32_t stats_gen_done;
+static uint32_t acquired_gen;
+
+/* Spin instead of sleeping for the last part of each interval */
+#define STATS_SPIN_USEC 100
+
+#define STATS_RESET_ALL     0x01
+#define STATS_RESET_LATENCY 0x02
+
+static struct {
+	pthread_t thread;
+	int running;
+	volatile int quit;
+	volatile int reset;
+	int efd;
+	uint16_t flag_cons;
+	volatile uint64_t interval;
+	struct stats_sampling sampling;
+} stats_thread;
+
+static void stats_do_reset(void)
 {
 	stats_task_reset();
 	stats_prio_task_reset();
@@ -60,6 +96,24 @@ void stats_reset(void)
 	stats_global_reset();
 }
 
+/* The sampling thread owns the statistics, it resets them before
+   taking its next sample. */
+void stats_reset(void)
+{
+	if (stats_thread.running)
+		__sync_fetch_and_or(&stats_thread.reset, STATS_RESET_ALL);
+	else
+		stats_do_reset();
+}
+
+void stats_reset_latency(void)
+{
+	if (stats_thread.running)
+		__sync_fetch_and_or(&stats_thread.reset, STATS_RESET_LATENCY);
+	else
+		stats_latency_reset();
+}
+
 void stats_init(unsigned avg_start, unsigned duration)
 {
 	stats_lcore_init();
@@ -75,8 +129,12 @@ void stats_init(unsigned avg_start, unsigned duration)
 
 void stats_update(uint16_t flag_cons)
 {
-	/* Keep track of last 2 measurements. */
-	last_stat = !last_stat;
+	/* Keep track of last 2 measurements, consumers might still be
+	   reading the 2 before. */
+	prev_stat = last_stat;
+	last_stat = (last_stat + 1) % STATS_N_SAMPLES;
+	stats_gen_started++;
+	rte_smp_wmb();
 
 	if (flag_cons & STATS_CONS_F_TASKS)
 		stats_task_update();
@@ -113,4 +171,159 @@ void stats_update(uint16_t flag_cons)
 
 	if (flag_cons & STATS_CONS_F_GLOBAL)
 		stats_global_post_proc();
+
+	rte_smp_wmb();
+	published_stat = last_stat;
+	rte_smp_wmb();
+	stats_gen_done++;
+}
+
+int stats_acquire(void)
+{
+	uint32_t gen;
+	int slot;
+
+	do {
+		gen = stats_gen_done;
+		rte_smp_rmb();
+		slot = published_stat;
+		rte_smp_rmb();
+	} while (gen != stats_gen_done);
+
+	if (gen == acquired_gen)
+		return 0;
+
+	last_stat = slot;
+	prev_stat = (slot + STATS_N_SAMPLES - 1) % STATS_N_SAMPLES;
+	acquired_gen = gen;
+	return 1;
+}
+
+int stats_release(void)
+{
+	rte_smp_rmb();
+	/* The slots acquired are overwritten from the second update
+	   started after the acquired one. */
+	if (stats_gen_started - acquired_gen > 1) {
+		stats_thread.sampling.n_torn++;
+		return -1;
+	}
+	return 0;
+}
+
+const struct stats_sampling *stats_get_sampling(void)
+{
+	return &stats_thread.sampling;
+}
+
+void stats_set_update_interval(uint64_t interval)
+{
+	stats_thread.interval = interval;
+}
+
+static void stats_wait_until(uint64_t deadline)
+{
+	const uint64_t spin = usec_to_tsc(STATS_SPIN_USEC);
+	uint64_t now = rte_rdtsc();
+	struct timespec ts;
+
+	if (now + spin < deadline) {
+		uint64_t nsec = tsc_to_nsec(deadline - spin - now);
+
+		ts.tv_sec = nsec / 1000000000;
+		ts.tv_nsec = nsec % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+	while (rte_rdtsc() < deadline)
+		rte_pause();
+}
+
+static void *stats_thread_main(__attribute__((unused)) void *arg)
+{
+	struct stats_sampling *s = &stats_thread.sampling;
+	uint64_t deadline, now, late, one = 1;
+
+	/* Continue from the samples taken by the thread that started us */
+	last_stat = published_stat;
+	prev_stat = (last_stat + STATS_N_SAMPLES - 1) % STATS_N_SAMPLES;
+
+	deadline = rte_rdtsc() + stats_thread.interval;
+	while (!stats_thread.quit) {
+		stats_wait_until(deadline);
+
+		now = rte_rdtsc();
+		late = now - deadline;
+		s->n_samples++;
+		s->jitter_tot += late;
+		if (late > s->jitter_max)
+			s->jitter_max = late;
+
+		if (stats_thread.reset) {
+			int reset = __sync_fetch_and_and(&stats_thread.reset, 0);
+
+			if (reset & STATS_RESET_ALL)
+				stats_do_reset();
+			else if (reset & STATS_RESET_LATENCY)
+				stats_latency_reset();
+		}
+		stats_update(stats_thread.flag_cons);
+		if (write(stats_thread.efd, &one, sizeof(one)) != sizeof(one))
+			plog_warn("Failed to notify stats consumers\n");
+
+		/* Keep a fixed cadence, skipping the deadlines already
+		   missed instead of sampling in a burst. */
+		deadline += stats_thread.interval;
+		now = rte_rdtsc();
+		while (deadline <= now) {
+			deadline += stats_thread.interval;
+			s->n_missed++;
+		}
+	}
+	return NULL;
+}
+
+int stats_thread_start(uint16_t flag_cons, uint64_t interval)
+{
+	int ret;
+
+	stats_thread.flag_cons = flag_cons;
+	stats_thread.interval = interval;
+	stats_thread.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stats_thread.efd < 0)
+		return -1;
+
+	/* The calling thread reads the samples taken so far */
+	stats_acquire();
+
+	stats_thread.running = 1;
+	if (pthread_create(&stats_thread.thread, NULL, stats_thread_main, NULL)) {
+		stats_thread.running = 0;
+		close(stats_thread.efd);
+		return -1;
+	}
+	ret = prox_ctrl_thread_affinity(stats_thread.thread);
+	if (ret < 0)
+		plog_warn("Failed to set affinity of the stats thread\n");
+	else if (ret > 0)
+		plog_warn("No free core for the stats thread, it will share cores with PROX\n");
+	return stats_thread.efd;
+}
+
+void stats_thread_stop(void)
+{
+	const struct stats_sampling *s = &stats_thread.sampling;
+
+	if (!stats_thread.running)
+		return;
+
+	stats_thread.quit = 1;
+	pthread_join(stats_thread.thread, NULL);
+	stats_thread.running = 0;
+	close(stats_thread.efd);
+
+	if (s->n_samples) {
+		plog_info("Stats sampling: %"PRIu64" samples, jitter avg %"PRIu64" usec max %"PRIu64" usec, %"PRIu64" missed, %"PRIu64" torn reads\n",
+			  s->n_samples, tsc_to_usec(s->jitter_tot / s->n_samples), tsc_to_usec(s->jitter_max),
+			  s->n_missed, s->n_torn);
+	}
 }
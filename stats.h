@@ -40,8 +40,37 @@
 #include "prox_globals.h"
 #include "genl4_bundle.h"
 
+struct stats_sampling {
+	uint64_t n_samples;
+	uint64_t n_missed;   /* intervals skipped because sampling was late */
+	uint64_t n_torn;     /* consumer reads that outlived their samples */
+	uint64_t jitter_tot; /* sum of sampling delays past the deadline, in tsc */
+	uint64_t jitter_max;
+};
+
 void stats_reset(void);
+void stats_reset_latency(void);
 void stats_init(unsigned avg_start, unsigned duration);
 void stats_update(uint16_t flag_cons);
 
+/* Sample all statistics every interval (in tsc) from a separate
+   thread. Returns an fd that becomes readable after each sample. */
+int stats_thread_start(uint16_t flag_cons, uint64_t interval);
+void stats_thread_stop(void);
+void stats_set_update_interval(uint64_t interval);
+
+/* Consumers make the latest sample visible to the calling thread with
+   stats_acquire() (non zero if there was a new one), and can check
+   with stats_release() (non zero on failure) that it was not
+   overwritten while they were reading it. */
+int stats_acquire(void);
+int stats_release(void);
+
+/* Readers outside of the stats consumers, i.e. commands, read the
+   values they need between stats_acquire() and stats_release() and
+   read them again, up to this many times, if the sample was
+   overwritten meanwhile. */
+#define STATS_READ_RETRIES 3
+const struct stats_sampling *stats_get_sampling(void);
+
 #endif /* _STATS_H_ */
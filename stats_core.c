@@ -51,7 +51,7 @@ struct stats_core_manager {
 };
 
 static struct stats_core_manager *scm;
-extern int last_stat;
+extern __thread int last_stat, prev_stat;
 
 static int get_L3_size(void)
 {
@@ -114,7 +114,7 @@ uint32_t stats_lcore_find_stat_id(uint32_t lcore_id)
 
 struct lcore_stats_sample *stats_get_lcore_stats_sample(uint32_t stat_id, int l)
 {
-	return &scm->lcore_stats_set[stat_id].sample[l == last_stat];
+	return &scm->lcore_stats_set[stat_id].sample[l ? last_stat : prev_stat];
 }
 
 struct lcore_stats *stats_get_lcore_stats(uint32_t stat_id)
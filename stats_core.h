@@ -35,6 +35,8 @@
 
 #include <inttypes.h>
 
+#include "prox_globals.h"
+
 struct lcore_stats_sample {
 	uint64_t afreq;
 	uint64_t mfreq;
@@ -55,7 +57,7 @@ struct lcore_stats {
 	uint64_t mbm_tot;
 	uint64_t mbm_loc;
 	uint32_t class;
-	struct lcore_stats_sample sample[2];
+	struct lcore_stats_sample sample[STATS_N_SAMPLES];
 };
 
 uint32_t stats_lcore_find_stat_id(uint32_t lcore_id);
@@ -39,14 +39,14 @@
 #include "stats_task.h"
 
 struct global_stats {
-	struct global_stats_sample sample[2];
+	struct global_stats_sample sample[STATS_N_SAMPLES];
 	struct global_stats_sample beg;
 	uint8_t  started_avg;
 	uint64_t start_tsc;
 	uint64_t end_tsc;
 };
 
-extern int last_stat;
+extern __thread int last_stat, prev_stat;
 static struct global_stats global_stats;
 
 uint64_t stats_get_last_tsc(void)
@@ -71,7 +71,7 @@ uint64_t stats_global_end_tsc(void)
 
 struct global_stats_sample *stats_get_global_stats(int last)
 {
-	return &global_stats.sample[last == last_stat];
+	return &global_stats.sample[last ? last_stat : prev_stat];
 }
 
 struct global_stats_sample *stats_get_global_stats_beg(void)
@@ -82,13 +82,14 @@ struct global_stats_sample *stats_get_global_stats_beg(void)
 void stats_global_reset(void)
 {
 	uint64_t now = rte_rdtsc();
-	uint64_t last_tsc = global_stats.sample[last_stat].tsc;
-	uint64_t prev_tsc = global_stats.sample[!last_stat].tsc;
+	uint64_t tsc[STATS_N_SAMPLES];
 	uint64_t end_tsc = global_stats.end_tsc;
 
+	for (int i = 0; i < STATS_N_SAMPLES; ++i)
+		tsc[i] = global_stats.sample[i].tsc;
 	memset(&global_stats, 0, sizeof(struct global_stats));
-	global_stats.sample[last_stat].tsc = last_tsc;
-	global_stats.sample[!last_stat].tsc = prev_tsc;
+	for (int i = 0; i < STATS_N_SAMPLES; ++i)
+		global_stats.sample[i].tsc = tsc[i];
 	global_stats.start_tsc = now;
 	global_stats.beg.tsc = now;
 	global_stats.end_tsc = end_tsc;
@@ -47,7 +47,7 @@ struct stats_l4gen_manager {
 	struct task_l4_stats task_l4_stats[0];
 };
 
-extern int last_stat;
+extern __thread int last_stat, prev_stat;
 static struct stats_l4gen_manager *sl4m;
 
 int stats_get_n_l4gen(void)
@@ -62,7 +62,7 @@ struct task_l4_stats *stats_get_l4_stats(uint32_t i)
 
 struct l4_stats_sample *stats_get_l4_stats_sample(uint32_t i, int l)
 {
-	return &sl4m->task_l4_stats[i].sample[l == last_stat];
+	return &sl4m->task_l4_stats[i].sample[l ? last_stat : prev_stat];
 }
 
 static struct stats_l4gen_manager *alloc_stats_l4gen_manager(void)
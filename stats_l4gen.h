@@ -36,6 +36,7 @@
 #include <inttypes.h>
 
 #include "genl4_bundle.h"
+#include "prox_globals.h"
 
 struct task_l4gen_stats;
 
@@ -46,7 +47,7 @@ struct l4_stats_sample {
 
 struct task_l4_stats {
 	struct task_l4gen_stats *task;
-	struct l4_stats_sample sample[2];
+	struct l4_stats_sample sample[STATS_N_SAMPLES];
 	uint8_t lcore_id;
 	uint8_t task_id;
 };
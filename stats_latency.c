@@ -35,15 +35,18 @@
 #include "handle_lat.h"
 #include "prox_cfg.h"
 #include "prox_args.h"
+#include "prox_globals.h"
 
+/* lat_test, stats and tot are published per sample like the other
+   statistics, tot_lat_test is only used by the sampling thread. */
 struct stats_latency_manager_entry {
 	struct task_lat        *task;
 	uint8_t                lcore_id;
 	uint8_t                task_id;
-	struct lat_test        lat_test;
 	struct lat_test        tot_lat_test;
-	struct stats_latency   stats;
-	struct stats_latency   tot;
+	struct lat_test        lat_test[STATS_N_SAMPLES];
+	struct stats_latency   stats[STATS_N_SAMPLES];
+	struct stats_latency   tot[STATS_N_SAMPLES];
 };
 
 struct stats_latency_manager {
@@ -51,6 +54,7 @@ struct stats_latency_manager {
 	struct stats_latency_manager_entry entries[0]; /* copy of stats when running update stats. */
 };
 
+extern __thread int last_stat, prev_stat;
 static struct stats_latency_manager *slm;
 
 void stats_latency_reset(void)
@@ -76,12 +80,12 @@ uint32_t stats_latency_get_task_id(uint32_t i)
 
 struct stats_latency *stats_latency_get(uint32_t i)
 {
-	return &slm->entries[i].stats;
+	return &slm->entries[i].stats[last_stat];
 }
 
 struct stats_latency *stats_latency_tot_get(uint32_t i)
 {
-	return &slm->entries[i].tot;
+	return &slm->entries[i].tot[last_stat];
 }
 
 static struct stats_latency_manager_entry *stats_latency_entry_find(uint8_t lcore_id, uint8_t task_id)
@@ -105,7 +109,7 @@ struct stats_latency *stats_latency_tot_find(uint32_t lcore_id, uint32_t task_id
 	if (!entry)
 		return NULL;
 	else
-		return &entry->tot;
+		return &entry->tot[last_stat];
 }
 
 struct stats_latency *stats_latency_find(uint32_t lcore_id, uint32_t task_id)
@@ -115,7 +119,7 @@ struct stats_latency *stats_latency_find(uint32_t lcore_id, uint32_t task_id)
 	if (!entry)
 		return NULL;
 	else
-		return &entry->stats;
+		return &entry->stats[last_stat];
 }
 
 static int task_runs_observable_latency(struct task_args *targ)
@@ -183,7 +187,7 @@ void stats_core_lat_histogram(uint8_t lcore_id, uint8_t task_id, uint64_t **buck
 	lat_stats = stats_latency_entry_find(lcore_id, task_id);
 
 	if (lat_stats)
-		*buckets = lat_stats->lat_test.buckets;
+		*buckets = lat_stats->lat_test[last_stat].buckets;
 	else
 		*buckets = NULL;
 }
@@ -191,17 +195,18 @@ void stats_core_lat_histogram(uint8_t lcore_id, uint8_t task_id, uint64_t **buck
 
 static void stats_latency_fetch_entry(struct stats_latency_manager_entry *entry)
 {
-	struct stats_latency *cur = &entry->stats;
-	struct lat_test *lat_test_local = &entry->lat_test;
+	struct lat_test *lat_test_local = &entry->lat_test[last_stat];
 	struct lat_test *lat_test_remote = task_lat_get_latency_meassurement(entry->task);
 
+	/* Without new measurements, the previous one is shown again */
+	memcpy(lat_test_local, &entry->lat_test[prev_stat], sizeof(*lat_test_local));
 	if (!lat_test_remote)
 		return;
 
 	if (lat_test_remote->tot_all_pkts) {
-		lat_test_copy(&entry->lat_test, lat_test_remote);
+		lat_test_copy(lat_test_local, lat_test_remote);
 		lat_test_reset(lat_test_remote);
-		lat_test_combine(&entry->tot_lat_test, &entry->lat_test);
+		lat_test_combine(&entry->tot_lat_test, lat_test_local);
 	}
 
 	task_lat_use_other_latency_meassurement(entry->task);
@@ -225,11 +230,13 @@ static void stats_latency_from_lat_test(struct stats_latency *dst, struct lat_te
 
 static void stats_latency_update_entry(struct stats_latency_manager_entry *entry)
 {
-	if (!entry->lat_test.tot_all_pkts)
+	entry->stats[last_stat] = entry->stats[prev_stat];
+	entry->tot[last_stat] = entry->tot[prev_stat];
+	if (!entry->lat_test[last_stat].tot_all_pkts)
 		return;
 
-	stats_latency_from_lat_test(&entry->stats, &entry->lat_test);
-	stats_latency_from_lat_test(&entry->tot, &entry->tot_lat_test);
+	stats_latency_from_lat_test(&entry->stats[last_stat], &entry->lat_test[last_stat]);
+	stats_latency_from_lat_test(&entry->tot[last_stat], &entry->tot_lat_test);
 }
 
 void stats_latency_update(void)
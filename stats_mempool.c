@@ -37,12 +37,14 @@
 #include "prox_malloc.h"
 #include "prox_port_cfg.h"
 #include "stats_mempool.h"
+#include "log.h"
 
 struct stats_mempool_manager {
 	uint32_t n_mempools;
 	struct mempool_stats mempool_stats[0];
 };
 
+extern __thread int last_stat, prev_stat;
 static struct stats_mempool_manager *smm;
 
 struct mempool_stats *stats_get_mempool_stats(uint32_t i)
@@ -50,6 +52,11 @@ struct mempool_stats *stats_get_mempool_stats(uint32_t i)
 	return &smm->mempool_stats[i];
 }
 
+struct mempool_stats_sample *stats_get_mempool_stats_sample(uint32_t i, int l)
+{
+	return &smm->mempool_stats[i].sample[l ? last_stat : prev_stat];
+}
+
 int stats_get_n_mempools(void)
 {
 	return smm->n_mempools;
@@ -93,6 +100,7 @@ void stats_mempool_init(void)
 				ms->port = i;
 				ms->queue = j;
 				ms->size = prox_port_cfg[i].pool_size[j];
+				ms->plan = prox_port_cfg[i].pool_plan[j];
 				smm->n_mempools++;
 			}
 		}
@@ -102,11 +110,24 @@ void stats_mempool_init(void)
 void stats_mempool_update(void)
 {
 	for (uint8_t mp_id = 0; mp_id < smm->n_mempools; ++mp_id) {
+		struct mempool_stats *ms = &smm->mempool_stats[mp_id];
+		struct mempool_stats_sample *last = &ms->sample[last_stat];
+
 		/* Note: The function free_count returns the number of used entries. */
 #if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
-		smm->mempool_stats[mp_id].free = rte_mempool_avail_count(smm->mempool_stats[mp_id].pool);
+		last->free = rte_mempool_avail_count(ms->pool);
 #else
-		smm->mempool_stats[mp_id].free = rte_mempool_count(smm->mempool_stats[mp_id].pool);
+		last->free = rte_mempool_count(ms->pool);
 #endif
+		last->max_used = ms->sample[prev_stat].max_used;
+		/* The free count includes mbufs sitting in the per-lcore
+		   caches, so this is a lower bound of what was really in
+		   flight at the time of sampling. */
+		if (ms->size - last->free > last->max_used) {
+			last->max_used = ms->size - last->free;
+			if (ms->plan && last->max_used > ms->plan)
+				plog_warn("Mempool on port %u queue %u: %zu mbufs in use, above the planned worst-case of %zu\n",
+					  ms->port, ms->queue, last->max_used, ms->plan);
+		}
 	}
 }
@@ -36,16 +36,25 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+#include "prox_globals.h"
+
+struct mempool_stats_sample {
+	size_t free;
+	size_t max_used; /* highest sampled number of mbufs in use */
+};
+
 struct mempool_stats {
 	struct rte_mempool *pool;
 	uint16_t port;
 	uint16_t queue;
-	size_t free;
 	size_t size;
+	size_t plan;     /* worst-case mbufs in flight from mempool_plan() */
+	struct mempool_stats_sample sample[STATS_N_SAMPLES];
 };
 
 void stats_mempool_init(void);
 struct mempool_stats *stats_get_mempool_stats(uint32_t i);
+struct mempool_stats_sample *stats_get_mempool_stats_sample(uint32_t i, int last);
 int stats_get_n_mempools(void);
 void stats_mempool_update(void);
 
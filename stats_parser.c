@@ -46,6 +46,9 @@
 #include "stats_latency.h"
 #include "stats_global.h"
 #include "stats_prio_task.h"
+#include "handle_irq.h"
+#include "cmd_parser.h"
+#include "lconf.h"
 
 struct stats_path_str {
 	const char *str;
@@ -124,6 +127,19 @@ static uint64_t sp_task_rx_prio(int argc, const char *argv[])
 	return stats_get_prio_task_stats_sample_by_core_task(c, t, 1)->rx_prio[atoi(argv[2])];
 }
 
+static uint64_t sp_task_enq_prio(int argc, const char *argv[])
+{
+	struct task_stats_sample *last;
+	uint32_t c, t;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return -1;
+	if (stats_get_prio_task_stats_sample_by_core_task(c, t, 1))
+		return stats_get_prio_task_stats_sample_by_core_task(c, t, 1)->enq_prio[atoi(argv[2])];
+	else
+		return -1;
+}
+
 static uint64_t sp_task_drop_discard(int argc, const char *argv[])
 {
 	struct task_stats_sample *last;
@@ -164,6 +180,55 @@ static uint64_t sp_task_tsc(int argc, const char *argv[])
 	return stats_get_task_stats_sample(c, t, 1)->tsc;
 }
 
+static const struct irq_hist_stats *sp_irq_hist_stats(const char *core_str, const char *task_str)
+{
+	uint32_t c, t;
+
+	if (args_to_core_task(core_str, task_str, &c, &t))
+		return NULL;
+	if (c >= RTE_MAX_LCORE || t >= lcore_cfg[c].n_tasks_all || !task_is_mode(c, t, "irq", "hist"))
+		return NULL;
+	return task_irq_hist_get_stats((struct task_irq_hist *)lcore_cfg[c].tasks_all[t]);
+}
+
+static uint64_t sp_task_irq_loops(int argc, const char *argv[])
+{
+	const struct irq_hist_stats *s = sp_irq_hist_stats(argv[0], argv[1]);
+
+	return s ? s->n_loops : (uint64_t)-1;
+}
+
+static uint64_t sp_task_irq_events(int argc, const char *argv[])
+{
+	const struct irq_hist_stats *s = sp_irq_hist_stats(argv[0], argv[1]);
+
+	return s ? s->n_events : (uint64_t)-1;
+}
+
+static uint64_t sp_task_irq_max(int argc, const char *argv[])
+{
+	const struct irq_hist_stats *s = sp_irq_hist_stats(argv[0], argv[1]);
+
+	return s ? s->max_gap : (uint64_t)-1;
+}
+
+static uint64_t sp_task_irq_smi(int argc, const char *argv[])
+{
+	const struct irq_hist_stats *s = sp_irq_hist_stats(argv[0], argv[1]);
+
+	return s ? s->n_smi : (uint64_t)-1;
+}
+
+static uint64_t sp_task_irq_bucket(int argc, const char *argv[])
+{
+	const struct irq_hist_stats *s = sp_irq_hist_stats(argv[0], argv[1]);
+	uint32_t bucket = atoi(argv[2]);
+
+	if (s == NULL || bucket >= IRQ_HIST_BUCKETS)
+		return -1;
+	return s->buckets[bucket];
+}
+
 static uint64_t sp_l4gen_created(int argc, const char *argv[])
 {
 	struct l4_stats_sample *clast = NULL;
@@ -318,27 +383,41 @@ static uint64_t sp_mem_used(int argc, const char *argv[])
 	if (atoi(argv[0]) > stats_get_n_mempools())
 		return -1;
 	ms = stats_get_mempool_stats(atoi(argv[0]));
-	return ms->size - ms->free;
+	return ms->size - stats_get_mempool_stats_sample(atoi(argv[0]), 1)->free;
 }
 
 static uint64_t sp_mem_free(int argc, const char *argv[])
+{
+	if (atoi(argv[0]) > stats_get_n_mempools())
+		return -1;
+	return stats_get_mempool_stats_sample(atoi(argv[0]), 1)->free;
+}
+
+static uint64_t sp_mem_size(int argc, const char *argv[])
 {
 	struct mempool_stats *ms;
 
 	if (atoi(argv[0]) > stats_get_n_mempools())
 		return -1;
 	ms = stats_get_mempool_stats(atoi(argv[0]));
-	return ms->free;
+	return ms->size;
 }
 
-static uint64_t sp_mem_size(int argc, const char *argv[])
+static uint64_t sp_mem_max_used(int argc, const char *argv[])
+{
+	if (atoi(argv[0]) > stats_get_n_mempools())
+		return -1;
+	return stats_get_mempool_stats_sample(atoi(argv[0]), 1)->max_used;
+}
+
+static uint64_t sp_mem_plan(int argc, const char *argv[])
 {
 	struct mempool_stats *ms;
 
 	if (atoi(argv[0]) > stats_get_n_mempools())
 		return -1;
 	ms = stats_get_mempool_stats(atoi(argv[0]));
-	return ms->size;
+	return ms->plan;
 }
 
 static uint64_t sp_port_no_mbufs(int argc, const char *argv[])
@@ -721,6 +800,16 @@ static uint64_t sp_ring_size(int argc, const char *argv[])
 	return rs->size;
 }
 
+static uint64_t sp_ring_xsocket(int argc, const char *argv[])
+{
+	struct ring_stats *rs = NULL;
+
+	if (atoi(argv[0]) >= stats_get_n_rings())
+		return -1;
+	rs = stats_get_ring_stats(atoi(argv[0]));
+	return rs->xsocket_mbufs;
+}
+
 static uint64_t sp_global_host_rx_packets(int argc, const char *argv[])
 {
 	return stats_get_global_stats(1)->host_rx_packets;
@@ -756,6 +845,28 @@ static uint64_t sp_global_tsc(int argc, const char *argv[])
 	return stats_get_global_stats(1)->tsc;
 }
 
+static uint64_t sp_global_sampling_jitter_max(int argc, const char *argv[])
+{
+	return stats_get_sampling()->jitter_max;
+}
+
+static uint64_t sp_global_sampling_jitter_avg(int argc, const char *argv[])
+{
+	const struct stats_sampling *s = stats_get_sampling();
+
+	return s->n_samples ? s->jitter_tot / s->n_samples : 0;
+}
+
+static uint64_t sp_global_sampling_missed(int argc, const char *argv[])
+{
+	return stats_get_sampling()->n_missed;
+}
+
+static uint64_t sp_global_sampling_torn(int argc, const char *argv[])
+{
+	return stats_get_sampling()->n_torn;
+}
+
 static uint64_t sp_hz(int argc, const char *argv[])
 {
 	return rte_get_tsc_hz();
@@ -771,6 +882,10 @@ struct stats_path_str stats_paths[] = {
 	{"global.nics.ierrrors", sp_global_nics_ierrors},
 	{"global.nics.imissed", sp_global_nics_imissed},
 	{"global.tsc", sp_global_tsc},
+	{"global.sampling.jitter.max", sp_global_sampling_jitter_max},
+	{"global.sampling.jitter.avg", sp_global_sampling_jitter_avg},
+	{"global.sampling.missed", sp_global_sampling_missed},
+	{"global.sampling.torn", sp_global_sampling_torn},
 
 	{"task.core(#).task(#).idle_cycles", sp_task_idle_cycles},
 	{"task.core(#).task(#).rx.packets", sp_task_rx_packets},
@@ -783,6 +898,12 @@ struct stats_path_str stats_paths[] = {
 	{"task.core(#).task(#).tsc", sp_task_tsc},
 	{"task.core(#).task(#).drop.tx_fail_prio(#)", sp_task_drop_tx_fail_prio},
 	{"task.core(#).task(#).rx_prio(#)", sp_task_rx_prio},
+	{"task.core(#).task(#).enq_prio(#)", sp_task_enq_prio},
+	{"task.core(#).task(#).irq.loops", sp_task_irq_loops},
+	{"task.core(#).task(#).irq.events", sp_task_irq_events},
+	{"task.core(#).task(#).irq.max", sp_task_irq_max},
+	{"task.core(#).task(#).irq.smi", sp_task_irq_smi},
+	{"task.core(#).task(#).irq.bucket(#)", sp_task_irq_bucket},
 
 	{"port(#).no_mbufs", sp_port_no_mbufs},
 	{"port(#).ierrors", sp_port_ierrors},
@@ -804,6 +925,8 @@ struct stats_path_str stats_paths[] = {
 	{"mem(#).used", sp_mem_used},
 	{"mem(#).free", sp_mem_free},
 	{"mem(#).size", sp_mem_size},
+	{"mem(#).max_used", sp_mem_max_used},
+	{"mem(#).plan", sp_mem_plan},
 
 	{"latency(#).min", sp_latency_min},
 	{"latency(#).max", sp_latency_max},
@@ -822,6 +945,7 @@ struct stats_path_str stats_paths[] = {
 	{"ring(#).used", sp_ring_used},
 	{"ring(#).free", sp_ring_free},
 	{"ring(#).size", sp_ring_size},
+	{"ring(#).xsocket", sp_ring_xsocket},
 
 	{"l4gen(#).created.tcp", sp_l4gen_created_tcp},
 	{"l4gen(#).created.udp", sp_l4gen_created_udp},
@@ -128,7 +128,7 @@ static void ixgbe_read_stats(uint8_t port_id, struct port_stats_sample* stats, s
 
 #endif
 
-extern int last_stat;
+extern __thread int last_stat, prev_stat;
 static struct port_stats   port_stats[PROX_MAX_PORTS];
 static uint8_t nb_interface;
 static uint8_t n_ports;
@@ -242,7 +242,7 @@ static void nic_read_stats(uint8_t port_id)
 
 #if defined(PROX_STATS) && defined(PROX_HW_DIRECT_STATS)
 	if (is_ixgbe) {
-		struct port_stats_sample *prev = &port_stats[port_id].sample[!last_stat];
+		struct port_stats_sample *prev = &port_stats[port_id].sample[prev_stat];
 		ixgbe_read_stats(port_id, stats, prev, last_stat);
 		return;
 	}
@@ -388,7 +388,7 @@ int stats_get_n_ports(void)
 
 struct port_stats_sample *stats_get_port_stats_sample(uint32_t port_id, int l)
 {
-	return &port_stats[port_id].sample[l == last_stat];
+	return &port_stats[port_id].sample[l ? last_stat : prev_stat];
 }
 
 int stats_port(uint8_t port_id, struct get_port_stats *gps)
@@ -397,7 +397,7 @@ int stats_port(uint8_t port_id, struct get_port_stats *gps)
 		return -1;
 
 	struct port_stats_sample *last = &port_stats[port_id].sample[last_stat];
-	struct port_stats_sample *prev = &port_stats[port_id].sample[!last_stat];
+	struct port_stats_sample *prev = &port_stats[port_id].sample[prev_stat];
 
 	gps->no_mbufs_diff = last->no_mbufs - prev->no_mbufs;
 	gps->ierrors_diff = last->ierrors - prev->ierrors;
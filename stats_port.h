@@ -35,6 +35,8 @@
 
 #include <inttypes.h>
 
+#include "prox_globals.h"
+
 enum PKT_SIZE_BIN {
 	PKT_SIZE_64,
 	PKT_SIZE_65,
@@ -60,7 +62,7 @@ struct port_stats_sample {
 };
 
 struct port_stats {
-	struct port_stats_sample sample[2];
+	struct port_stats_sample sample[STATS_N_SAMPLES];
 };
 
 struct get_port_stats {
@@ -46,9 +46,10 @@ struct lcore_prio_task_stats {
 	struct prio_task_stats prio_task_stats[MAX_TASKS_PER_CORE];
 };
 
-extern int last_stat;
+extern __thread int last_stat, prev_stat;
 static struct prio_task_stats   prio_task_stats_set[RTE_MAX_LCORE * MAX_TASKS_PER_CORE];
 static uint8_t nb_prio_tasks_tot;
+static int prio_task_stats_reset;
 
 int stats_get_n_prio_tasks_tot(void)
 {
@@ -57,53 +58,56 @@ int stats_get_n_prio_tasks_tot(void)
 
 struct prio_task_stats_sample *stats_get_prio_task_stats_sample(uint32_t prio_task_id, int l)
 {
-	return &prio_task_stats_set[prio_task_id].sample[l == last_stat];
+	return &prio_task_stats_set[prio_task_id].sample[l ? last_stat : prev_stat];
 }
 
 struct prio_task_stats_sample *stats_get_prio_task_stats_sample_by_core_task(uint32_t lcore_id, uint32_t prio_task_id, int l)
 {
 	for (uint8_t task_id = 0; task_id < nb_prio_tasks_tot; ++task_id) {
 		if ((prio_task_stats_set[task_id].lcore_id == lcore_id) && (prio_task_stats_set[task_id].task_id == task_id))
-			return &prio_task_stats_set[prio_task_id].sample[l == last_stat];
+			return &prio_task_stats_set[prio_task_id].sample[l ? last_stat : prev_stat];
 	}
 	return NULL;
 }
 
+/* As for the task stats, the totals restart in the next sample */
 void stats_prio_task_reset(void)
 {
-	struct prio_task_stats *cur_task_stats;
-
-	for (uint8_t task_id = 0; task_id < nb_prio_tasks_tot; ++task_id) {
-		cur_task_stats = &prio_task_stats_set[task_id];
-		for (int i = 0; i < 8; i++) {
-			cur_task_stats->tot_drop_tx_fail_prio[i] = 0;
-			cur_task_stats->tot_rx_prio[i] = 0;
-		}
-	}
+	prio_task_stats_reset = 1;
 }
 
 uint64_t stats_core_task_tot_drop_tx_fail_prio(uint8_t prio_task_id, uint8_t prio)
 {
-	return prio_task_stats_set[prio_task_id].tot_drop_tx_fail_prio[prio];
+	return prio_task_stats_set[prio_task_id].sample[last_stat].tot_drop_tx_fail_prio[prio];
 }
 
 uint64_t stats_core_task_tot_rx_prio(uint8_t prio_task_id, uint8_t prio)
 {
-	return prio_task_stats_set[prio_task_id].tot_rx_prio[prio];
+	return prio_task_stats_set[prio_task_id].sample[last_stat].tot_rx_prio[prio];
+}
+
+uint64_t stats_core_task_tot_enq_prio(uint8_t prio_task_id, uint8_t prio)
+{
+	return prio_task_stats_set[prio_task_id].sample[last_stat].tot_enq_prio[prio];
 }
 
 void stats_prio_task_post_proc(void)
 {
+	static const struct prio_task_stats_sample zero;
+
 	for (uint8_t task_id = 0; task_id < nb_prio_tasks_tot; ++task_id) {
 		struct prio_task_stats *cur_task_stats = &prio_task_stats_set[task_id];
-		const struct prio_task_stats_sample *last = &cur_task_stats->sample[last_stat];
-		const struct prio_task_stats_sample *prev = &cur_task_stats->sample[!last_stat];
+		struct prio_task_stats_sample *last = &cur_task_stats->sample[last_stat];
+		const struct prio_task_stats_sample *prev = &cur_task_stats->sample[prev_stat];
+		const struct prio_task_stats_sample *tot = prio_task_stats_reset ? &zero : prev;
 
 		for (int i=0; i<8; i++) {
-			cur_task_stats->tot_rx_prio[i] += last->rx_prio[i] - prev->rx_prio[i];
-			cur_task_stats->tot_drop_tx_fail_prio[i] += last->drop_tx_fail_prio[i] - prev->drop_tx_fail_prio[i];
+			last->tot_rx_prio[i] = tot->tot_rx_prio[i] + last->rx_prio[i] - prev->rx_prio[i];
+			last->tot_drop_tx_fail_prio[i] = tot->tot_drop_tx_fail_prio[i] + last->drop_tx_fail_prio[i] - prev->drop_tx_fail_prio[i];
+			last->tot_enq_prio[i] = tot->tot_enq_prio[i] + last->enq_prio[i] - prev->enq_prio[i];
 		}
 	}
+	prio_task_stats_reset = 0;
 }
 
 void stats_prio_task_update(void)
@@ -119,6 +123,7 @@ void stats_prio_task_update(void)
 		for (int i=0; i<8; i++) {
 			last->drop_tx_fail_prio[i] = stats->drop_tx_fail_prio[i];
 			last->rx_prio[i] = stats->rx_prio[i];
+			last->enq_prio[i] = stats->enq_prio[i];
 		}
 		after = rte_rdtsc();
 		last->tsc = (before >> 1) + (after >> 1);
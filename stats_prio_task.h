@@ -36,24 +36,32 @@
 #include <inttypes.h>
 
 #include "clock.h"
+#include "prox_globals.h"
 
 struct prio_task_stats_sample {
 	uint64_t tsc;
 	uint64_t drop_tx_fail_prio[8];
 	uint64_t rx_prio[8];
+	uint64_t enq_prio[8];
+	/* totals since the last reset */
+	uint64_t tot_drop_tx_fail_prio[8];
+	uint64_t tot_rx_prio[8];
+	uint64_t tot_enq_prio[8];
 };
 
+/* rx_prio counts the packets dequeued (transmitted) per priority,
+   enq_prio the packets accepted in the priority buffers and
+   drop_tx_fail_prio the packets dropped because a buffer was full. */
 struct prio_task_rt_stats {
 	uint64_t drop_tx_fail_prio[8];
 	uint64_t rx_prio[8];
+	uint64_t enq_prio[8];
 };
 
 struct prio_task_stats {
-	uint64_t tot_drop_tx_fail_prio[8];
-	uint64_t tot_rx_prio[8];
 	uint8_t lcore_id;
 	uint8_t task_id;
-	struct prio_task_stats_sample sample[2];
+	struct prio_task_stats_sample sample[STATS_N_SAMPLES];
 	struct prio_task_rt_stats *stats;
 };
 
@@ -67,5 +75,6 @@ struct prio_task_stats_sample *stats_get_prio_task_stats_sample(uint32_t task_id
 struct prio_task_stats_sample *stats_get_prio_task_stats_sample_by_core_task(uint32_t lcore_id, uint32_t task_id, int last);
 uint64_t stats_core_task_tot_drop_tx_fail_prio(uint8_t task_id, uint8_t prio);
 uint64_t stats_core_task_tot_rx_prio(uint8_t task_id, uint8_t prio);
+uint64_t stats_core_task_tot_enq_prio(uint8_t task_id, uint8_t prio);
 
 #endif /* _STATS_PRIO_TASK_H_ */
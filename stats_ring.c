@@ -39,6 +39,7 @@
 #include "prox_port_cfg.h"
 #include "prox_cfg.h"
 #include "lconf.h"
+#include "task_base.h"
 #include "log.h"
 #include "quit.h"
 
@@ -49,6 +50,19 @@ struct stats_ring_manager {
 
 static struct stats_ring_manager *rsm;
 
+static uint16_t n_xsocket_ports;
+static struct port_xsocket_stats *xsocket_port_stats;
+
+int stats_get_n_xsocket_ports(void)
+{
+	return n_xsocket_ports;
+}
+
+struct port_xsocket_stats *stats_get_xsocket_port_stats(uint32_t i)
+{
+	return &xsocket_port_stats[i];
+}
+
 int stats_get_n_rings(void)
 {
 	return rsm->n_rings;
@@ -63,7 +77,11 @@ void stats_ring_update(void)
 {
 	for (uint16_t r_id = 0; r_id < rsm->n_rings; ++r_id) {
 		rsm->ring_stats[r_id].free = rte_ring_free_count(rsm->ring_stats[r_id].ring);
+		if (rsm->ring_stats[r_id].xsocket_counter)
+			rsm->ring_stats[r_id].xsocket_mbufs = *rsm->ring_stats[r_id].xsocket_counter;
 	}
+	for (uint16_t i = 0; i < n_xsocket_ports; ++i)
+		xsocket_port_stats[i].xsocket_mbufs = *xsocket_port_stats[i].xsocket_counter;
 }
 
 static struct ring_stats *init_rings_add(struct stats_ring_manager *rsm, struct rte_ring *ring)
@@ -121,12 +139,45 @@ static struct stats_ring_manager *alloc_stats_ring_manager(void)
 	return prox_zmalloc(mem_size, socket_id);
 }
 
+static void init_xsocket_ports(void)
+{
+	const uint32_t socket_id = rte_lcore_to_socket_id(rte_lcore_id());
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *targ;
+	uint32_t n = 0;
+
+	while (core_targ_next(&lconf, &targ, 0) == 0) {
+		for (uint8_t i = 0; i < targ->nb_rxports; ++i)
+			n += targ->rx_xsocket[i] != 0;
+	}
+	if (n == 0)
+		return;
+
+	xsocket_port_stats = prox_zmalloc(n * sizeof(*xsocket_port_stats), socket_id);
+	PROX_PANIC(xsocket_port_stats == NULL, "Failed to allocate cross socket port stats\n");
+
+	lconf = NULL;
+	while (core_targ_next(&lconf, &targ, 0) == 0) {
+		for (uint8_t i = 0; i < targ->nb_rxports; ++i) {
+			if (!targ->rx_xsocket[i] || !targ->tbase->aux->rx_xsocket)
+				continue;
+			struct port_xsocket_stats *ps = &xsocket_port_stats[n_xsocket_ports++];
+
+			ps->port = targ->rx_port_queue[i].port;
+			ps->queue = targ->rx_port_queue[i].queue;
+			ps->lcore_id = lconf->id;
+			ps->xsocket_counter = &targ->tbase->aux->rx_xsocket[i];
+		}
+	}
+}
+
 void stats_ring_init(void)
 {
 	uint32_t lcore_id = -1;
 	struct lcore_cfg *lconf;
 	struct task_args *targ;
 
+	init_xsocket_ports();
 	rsm = alloc_stats_ring_manager();
 	while(prox_core_next(&lcore_id, 1) == 0) {
 		lconf = &lcore_cfg[lcore_id];
@@ -135,8 +186,12 @@ void stats_ring_init(void)
 			targ = &lconf->targs[task_id];
 
 			for(uint32_t rxring_id = 0; rxring_id < targ->nb_rxrings; ++rxring_id) {
-				if (!targ->tx_opt_ring_task)
-					init_rings_add(rsm, targ->rx_rings[rxring_id]);
+				if (!targ->tx_opt_ring_task) {
+					struct ring_stats *rs = init_rings_add(rsm, targ->rx_rings[rxring_id]);
+
+					if (targ->rx_xsocket[rxring_id] && targ->tbase->aux->rx_xsocket)
+						rs->xsocket_counter = &targ->tbase->aux->rx_xsocket[rxring_id];
+				}
 			}
 
 			for (uint32_t txring_id = 0; txring_id < targ->nb_txrings; ++txring_id) {
@@ -41,6 +41,19 @@ struct ring_stats {
 	struct prox_port_cfg *port[PROX_MAX_PORTS];
 	uint32_t	 free;
 	uint32_t	 size;
+	/* Set if the ring carries mbufs between sockets, the counter
+	   is kept by the consumer. */
+	uint64_t	*xsocket_counter;
+	uint64_t	 xsocket_mbufs;
+};
+
+/* Port queue polled from another socket than the device is on. */
+struct port_xsocket_stats {
+	uint8_t		 port;
+	uint8_t		 queue;
+	uint32_t	 lcore_id;
+	uint64_t	*xsocket_counter;
+	uint64_t	 xsocket_mbufs;
 };
 
 void stats_ring_update(void);
@@ -48,3 +61,6 @@ void stats_ring_init(void);
 
 int stats_get_n_rings(void);
 struct ring_stats *stats_get_ring_stats(uint32_t i);
+
+int stats_get_n_xsocket_ports(void);
+struct port_xsocket_stats *stats_get_xsocket_port_stats(uint32_t i);
@@ -44,10 +44,12 @@ struct lcore_task_stats {
 #define TASK_STATS_RX 0x01
 #define TASK_STATS_TX 0x02
 
-extern int last_stat;
+extern __thread int last_stat, prev_stat;
 static struct lcore_task_stats  lcore_task_stats_all[RTE_MAX_LCORE];
 static struct task_stats   *task_stats_set[RTE_MAX_LCORE * MAX_TASKS_PER_CORE];
 static uint8_t nb_tasks_tot;
+static int task_stats_reset;
+
 int stats_get_n_tasks_tot(void)
 {
 	return nb_tasks_tot;
@@ -60,38 +62,31 @@ struct task_stats *stats_get_task_stats(uint32_t lcore_id, uint32_t task_id)
 
 struct task_stats_sample *stats_get_task_stats_sample(uint32_t lcore_id, uint32_t task_id, int l)
 {
-	return &lcore_task_stats_all[lcore_id].task_stats[task_id].sample[l == last_stat];
+	return &lcore_task_stats_all[lcore_id].task_stats[task_id].sample[l ? last_stat : prev_stat];
 }
 
+/* The totals restart from zero in the next sample, the published
+   samples are left untouched for their readers. */
 void stats_task_reset(void)
 {
-	struct task_stats *cur_task_stats;
-
-	for (uint8_t task_id = 0; task_id < nb_tasks_tot; ++task_id) {
-		cur_task_stats = task_stats_set[task_id];
-		cur_task_stats->tot_rx_pkt_count = 0;
-		cur_task_stats->tot_tx_pkt_count = 0;
-		cur_task_stats->tot_drop_tx_fail = 0;
-		cur_task_stats->tot_drop_discard = 0;
-		cur_task_stats->tot_drop_handled = 0;
-	}
+	task_stats_reset = 1;
 }
 
 uint64_t stats_core_task_tot_rx(uint8_t lcore_id, uint8_t task_id)
 {
-	return lcore_task_stats_all[lcore_id].task_stats[task_id].tot_rx_pkt_count;
+	return lcore_task_stats_all[lcore_id].task_stats[task_id].sample[last_stat].tot_rx_pkt_count;
 }
 
 uint64_t stats_core_task_tot_tx(uint8_t lcore_id, uint8_t task_id)
 {
-	return lcore_task_stats_all[lcore_id].task_stats[task_id].tot_tx_pkt_count;
+	return lcore_task_stats_all[lcore_id].task_stats[task_id].sample[last_stat].tot_tx_pkt_count;
 }
 
 uint64_t stats_core_task_tot_drop(uint8_t lcore_id, uint8_t task_id)
 {
-	return lcore_task_stats_all[lcore_id].task_stats[task_id].tot_drop_tx_fail +
-		lcore_task_stats_all[lcore_id].task_stats[task_id].tot_drop_discard +
-		lcore_task_stats_all[lcore_id].task_stats[task_id].tot_drop_handled;
+	const struct task_stats_sample *last = &lcore_task_stats_all[lcore_id].task_stats[task_id].sample[last_stat];
+
+	return last->tot_drop_tx_fail + last->tot_drop_discard + last->tot_drop_handled;
 }
 
 uint64_t stats_core_task_last_tsc(uint8_t lcore_id, uint8_t task_id)
@@ -107,18 +102,22 @@ static void init_core_port(struct task_stats *ts, struct task_rt_stats *stats, u
 
 void stats_task_post_proc(void)
 {
+	static const struct task_stats_sample zero;
+
 	for (uint8_t task_id = 0; task_id < nb_tasks_tot; ++task_id) {
 		struct task_stats *cur_task_stats = task_stats_set[task_id];
-		const struct task_stats_sample *last = &cur_task_stats->sample[last_stat];
-		const struct task_stats_sample *prev = &cur_task_stats->sample[!last_stat];
+		struct task_stats_sample *last = &cur_task_stats->sample[last_stat];
+		const struct task_stats_sample *prev = &cur_task_stats->sample[prev_stat];
+		const struct task_stats_sample *tot = task_stats_reset ? &zero : prev;
 
 		/* no total stats for empty loops */
-		cur_task_stats->tot_rx_pkt_count += last->rx_pkt_count - prev->rx_pkt_count;
-		cur_task_stats->tot_tx_pkt_count += last->tx_pkt_count - prev->tx_pkt_count;
-		cur_task_stats->tot_drop_tx_fail += last->drop_tx_fail - prev->drop_tx_fail;
-		cur_task_stats->tot_drop_discard += last->drop_discard - prev->drop_discard;
-		cur_task_stats->tot_drop_handled += last->drop_handled - prev->drop_handled;
+		last->tot_rx_pkt_count = tot->tot_rx_pkt_count + (uint32_t)(last->rx_pkt_count - prev->rx_pkt_count);
+		last->tot_tx_pkt_count = tot->tot_tx_pkt_count + (uint32_t)(last->tx_pkt_count - prev->tx_pkt_count);
+		last->tot_drop_tx_fail = tot->tot_drop_tx_fail + (uint32_t)(last->drop_tx_fail - prev->drop_tx_fail);
+		last->tot_drop_discard = tot->tot_drop_discard + (uint32_t)(last->drop_discard - prev->drop_discard);
+		last->tot_drop_handled = tot->tot_drop_handled + (uint32_t)(last->drop_handled - prev->drop_handled);
 	}
+	task_stats_reset = 0;
 }
 
 void stats_task_update(void)
@@ -159,10 +158,10 @@ void stats_task_get_host_rx_tx_packets(uint64_t *rx, uint64_t *tx, uint64_t *tsc
 		t = task_stats_set[task_id];
 
 		if (t->flags & TASK_STATS_RX)
-			*rx += t->tot_rx_pkt_count;
+			*rx += t->sample[last_stat].tot_rx_pkt_count;
 
 		if (t->flags & TASK_STATS_TX)
-			*tx += t->tot_tx_pkt_count;
+			*tx += t->sample[last_stat].tot_tx_pkt_count;
 	}
 	if (nb_tasks_tot)
 		*tsc = task_stats_set[nb_tasks_tot - 1]->sample[last_stat].tsc;
@@ -36,6 +36,7 @@
 #include <inttypes.h>
 
 #include "clock.h"
+#include "prox_globals.h"
 
 /* The struct task_stats is read/write from the task itself and
    read-only from the core that collects the stats. Since only the
@@ -125,16 +126,17 @@ struct task_stats_sample {
 	uint64_t rx_bytes;
 	uint64_t tx_bytes;
 	uint64_t drop_bytes;
-};
-
-struct task_stats {
+	/* totals since the last reset, kept in the sample so that they
+	   are read consistently with it */
 	uint64_t tot_tx_pkt_count;
 	uint64_t tot_drop_tx_fail;
 	uint64_t tot_drop_discard;
 	uint64_t tot_drop_handled;
 	uint64_t tot_rx_pkt_count;
+};
 
-	struct task_stats_sample sample[2];
+struct task_stats {
+	struct task_stats_sample sample[STATS_N_SAMPLES];
 
 	struct task_rt_stats *stats;
 	/* flags set if total RX/TX values need to be reported set at
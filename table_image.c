@@ -0,0 +1,323 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_cycles.h>
+#include <rte_hash_crc.h>
+
+#include "prox_lua.h"
+#include "log.h"
+#include "quit.h"
+#include "table_image.h"
+
+/* Fields of the metatable set by table_image() */
+struct image_meta {
+	char     image[256];
+	char     src[256];
+	int      fresh;       /* image is up to date */
+	int      placeholder; /* Lua file has not been run, table is empty */
+	uint64_t lua_usec;
+};
+
+static const char *table_image_names[] = {
+	[TABLE_IMAGE_USER_TABLE] = "user table",
+	[TABLE_IMAGE_CPE_TABLE]  = "cpe table",
+	[TABLE_IMAGE_ACL_RULES]  = "acl rules",
+	[TABLE_IMAGE_LPM4]       = "lpm4",
+};
+
+static uint64_t tsc_to_usec(uint64_t tsc)
+{
+	return tsc * 1000000 / rte_get_tsc_hz();
+}
+
+static int src_stat(const char *src, uint64_t *size, int64_t *mtime)
+{
+	struct stat st;
+
+	if (stat(src, &st))
+		return -1;
+	*size = st.st_size;
+	*mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	return 0;
+}
+
+static int image_is_fresh(const char *image, const char *src)
+{
+	struct table_image_hdr hdr;
+	uint64_t size;
+	int64_t mtime;
+	FILE *f = fopen(image, "rb");
+	size_t n;
+
+	if (f == NULL)
+		return 0;
+	n = fread(&hdr, sizeof(hdr), 1, f);
+	fclose(f);
+
+	if (n != 1 || hdr.magic != TABLE_IMAGE_MAGIC || hdr.version != TABLE_IMAGE_VERSION)
+		return 0;
+	if (src_stat(src, &size, &mtime))
+		return 0;
+	return hdr.src_size == size && hdr.src_mtime == mtime;
+}
+
+static void push_image_meta(struct lua_State *L, const char *src, const char *image, int fresh, uint64_t lua_usec)
+{
+	lua_createtable(L, 0, 5);
+	lua_pushstring(L, image);
+	lua_setfield(L, -2, "__image");
+	lua_pushstring(L, src);
+	lua_setfield(L, -2, "__source");
+	lua_pushboolean(L, fresh);
+	lua_setfield(L, -2, "__fresh");
+	lua_pushboolean(L, fresh);
+	lua_setfield(L, -2, "__placeholder");
+	lua_pushinteger(L, lua_usec);
+	lua_setfield(L, -2, "__lua_usec");
+}
+
+static int get_image_meta(struct lua_State *L, struct image_meta *meta)
+{
+	if (!lua_istable(L, -1) || !lua_getmetatable(L, -1))
+		return -1;
+
+	lua_getfield(L, -1, "__image");
+	if (!lua_isstring(L, -1)) {
+		lua_pop(L, 2);
+		return -1;
+	}
+	snprintf(meta->image, sizeof(meta->image), "%s", lua_tostring(L, -1));
+	lua_pop(L, 1);
+
+	lua_getfield(L, -1, "__source");
+	snprintf(meta->src, sizeof(meta->src), "%s", lua_tostring(L, -1));
+	lua_pop(L, 1);
+	lua_getfield(L, -1, "__fresh");
+	meta->fresh = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	lua_getfield(L, -1, "__placeholder");
+	meta->placeholder = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	lua_getfield(L, -1, "__lua_usec");
+	meta->lua_usec = lua_tointeger(L, -1);
+	lua_pop(L, 2);
+	return 0;
+}
+
+/* Run the Lua file and set up its table as if the image was stale */
+static int run_lua_file(struct lua_State *L, const char *src, const char *image)
+{
+	uint64_t tsc = rte_rdtsc();
+	int top = lua_gettop(L);
+
+	if (luaL_dofile(L, src))
+		return -1;
+	if (lua_gettop(L) == top || !lua_istable(L, top + 1)) {
+		lua_settop(L, top);
+		lua_pushfstring(L, "'%s' did not return a table", src);
+		return -1;
+	}
+	lua_settop(L, top + 1);
+
+	push_image_meta(L, src, image, 0, tsc_to_usec(rte_rdtsc() - tsc));
+	lua_setmetatable(L, -2);
+	return 0;
+}
+
+int table_image_lua(struct lua_State *L)
+{
+	char image[256];
+	const char *src;
+
+	if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+		return luaL_error(L, "Expecting the name of a Lua file as argument\n");
+
+	src = lua_tostring(L, 1);
+	snprintf(image, sizeof(image), "%s.img", src);
+
+	if (image_is_fresh(image, src)) {
+		lua_newtable(L);
+		push_image_meta(L, src, image, 1, 0);
+		lua_setmetatable(L, -2);
+		return 1;
+	}
+
+	if (run_lua_file(L, src, image))
+		return lua_error(L);
+	return 1;
+}
+
+static int image_check(struct table_image *img, enum table_image_type type, uint32_t entry_size, uint32_t param)
+{
+	const struct table_image_hdr *hdr = img->mem;
+
+	if (img->len < sizeof(*hdr) ||
+	    hdr->magic != TABLE_IMAGE_MAGIC ||
+	    hdr->version != TABLE_IMAGE_VERSION ||
+	    hdr->type != type ||
+	    hdr->entry_size != entry_size ||
+	    hdr->param != param ||
+	    hdr->payload_len != img->len - sizeof(*hdr))
+		return -1;
+
+	img->hdr = hdr;
+	img->payload = (const uint8_t *)(hdr + 1);
+
+	if (rte_hash_crc(img->payload, hdr->payload_len, 0) != hdr->checksum)
+		return -1;
+	return 0;
+}
+
+int table_image_open(struct lua_State *L, enum table_image_type type, uint32_t entry_size, uint32_t param, struct table_image *img)
+{
+	struct image_meta meta;
+	struct stat st;
+	int fd;
+
+	memset(img, 0, sizeof(*img));
+	if (get_image_meta(L, &meta) || !meta.fresh)
+		return 1;
+
+	img->tsc_beg = rte_rdtsc();
+	img->type = type;
+
+	fd = open(meta.image, O_RDONLY);
+	if (fd >= 0) {
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			img->mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+			img->len = st.st_size;
+			if (img->mem == MAP_FAILED)
+				img->mem = NULL;
+		}
+		close(fd);
+	}
+
+	if (img->mem && image_check(img, type, entry_size, param) == 0)
+		return 0;
+
+	if (img->mem)
+		munmap(img->mem, img->len);
+	memset(img, 0, sizeof(*img));
+
+	plog_warn("\tImage '%s' can't be used for %s, using '%s'\n", meta.image, table_image_names[type], meta.src);
+	if (meta.placeholder) {
+		PROX_PANIC(run_lua_file(L, meta.src, meta.image), "Failed to load '%s': %s\n", meta.src, lua_tostring(L, -1));
+		lua_replace(L, -2);
+	}
+	return 1;
+}
+
+int table_image_materialize(struct lua_State *L)
+{
+	struct image_meta meta;
+
+	if (get_image_meta(L, &meta) || !meta.placeholder)
+		return 0;
+
+	PROX_PANIC(run_lua_file(L, meta.src, meta.image), "Failed to load '%s': %s\n", meta.src, lua_tostring(L, -1));
+	lua_replace(L, -2);
+	return 1;
+}
+
+void table_image_close(struct table_image *img)
+{
+	const uint64_t usec = tsc_to_usec(rte_rdtsc() - img->tsc_beg);
+	const uint64_t lua_usec = img->hdr->lua_usec;
+
+	plog_info("\tLoaded %s from image in %"PRIu64" ms instead of %"PRIu64" ms from Lua, saved %"PRId64" ms\n",
+		  table_image_names[img->type], usec / 1000, lua_usec / 1000, ((int64_t)lua_usec - (int64_t)usec) / 1000);
+	munmap(img->mem, img->len);
+	memset(img, 0, sizeof(*img));
+}
+
+int table_image_wanted(struct lua_State *L)
+{
+	struct image_meta meta;
+
+	return get_image_meta(L, &meta) == 0 && !meta.fresh;
+}
+
+int table_image_save(struct lua_State *L, enum table_image_type type, uint32_t entry_size, uint32_t param, uint64_t tsc_beg, const void *payload, size_t len)
+{
+	struct table_image_hdr hdr;
+	struct image_meta meta;
+	char tmp[sizeof(meta.image) + 4];
+	FILE *f;
+
+	if (get_image_meta(L, &meta) || meta.fresh)
+		return 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = TABLE_IMAGE_MAGIC;
+	hdr.version = TABLE_IMAGE_VERSION;
+	hdr.type = type;
+	hdr.entry_size = entry_size;
+	hdr.param = param;
+	hdr.lua_usec = meta.lua_usec + tsc_to_usec(rte_rdtsc() - tsc_beg);
+	hdr.payload_len = len;
+	hdr.checksum = rte_hash_crc(payload, len, 0);
+	if (src_stat(meta.src, &hdr.src_size, &hdr.src_mtime))
+		return -1;
+
+	/* Written to a temporary file first so that an image is
+	   either complete or missing. */
+	snprintf(tmp, sizeof(tmp), "%s.tmp", meta.image);
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		plog_warn("\tFailed to create image '%s': %s\n", tmp, strerror(errno));
+		return -1;
+	}
+	int err = fwrite(&hdr, sizeof(hdr), 1, f) != 1 || (len && fwrite(payload, len, 1, f) != 1);
+
+	err |= fclose(f) != 0;
+	if (err || rename(tmp, meta.image) != 0) {
+		plog_warn("\tFailed to write image '%s': %s\n", meta.image, strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+
+	lua_getmetatable(L, -1);
+	lua_pushboolean(L, 1);
+	lua_setfield(L, -2, "__fresh");
+	lua_pop(L, 1);
+
+	plog_info("\tCreated image '%s' for %s (%"PRIu64" ms from Lua)\n", meta.image, table_image_names[type], hdr.lua_usec / 1000);
+	return 0;
+}
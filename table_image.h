@@ -0,0 +1,113 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _TABLE_IMAGE_H_
+#define _TABLE_IMAGE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Binary images of tables that are otherwise converted from Lua at
+   each start. A table is marked for caching by loading its Lua file
+   through table_image() instead of dofile() in the [lua] section:
+
+	user_table = table_image("user_table-131K-bng.lua")
+
+   The first time, the Lua file is run and the converted table is
+   written to "<file>.img". Next time, if the image is newer than the
+   Lua file (same size and modification time as when the image was
+   created), the Lua file is not run and the table is loaded from the
+   image. If the Lua file depends on anything else than itself (other
+   files, variables), the image needs to be removed when those
+   change. */
+
+#define TABLE_IMAGE_MAGIC   0x31474d49584f5250ULL /* "PROXIMG1" */
+#define TABLE_IMAGE_VERSION 1
+
+enum table_image_type {
+	TABLE_IMAGE_USER_TABLE = 1,
+	TABLE_IMAGE_CPE_TABLE,
+	TABLE_IMAGE_ACL_RULES,
+	TABLE_IMAGE_LPM4,
+};
+
+struct table_image_hdr {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t type;
+	uint32_t entry_size;  /* sizeof the entries, detects layout changes */
+	uint32_t param;       /* type specific, has to match when loading */
+	uint64_t src_size;    /* Lua file the image was created from */
+	int64_t  src_mtime;
+	uint64_t lua_usec;    /* time taken to run and convert the Lua table */
+	uint64_t payload_len;
+	uint32_t checksum;    /* CRC32C of the payload */
+	uint32_t reserved;
+};
+
+struct table_image {
+	void                         *mem;
+	size_t                       len;
+	const struct table_image_hdr *hdr;
+	const uint8_t                *payload;
+	uint64_t                     tsc_beg;
+	enum table_image_type        type;
+};
+
+struct lua_State;
+
+/* Implementation of table_image() in Lua */
+int table_image_lua(struct lua_State *L);
+
+/* The Lua table at the top of the stack is checked for an image. If
+   it has an up to date image, the image is mapped and 0 is
+   returned. Otherwise, 1 is returned and the table needs to be
+   converted from Lua. If the image turns out to be unusable, the Lua
+   file is run and the resulting table replaces the one at the top of
+   the stack. */
+int table_image_open(struct lua_State *L, enum table_image_type type, uint32_t entry_size, uint32_t param, struct table_image *img);
+/* Tables loaded through table_image() are empty if their image is
+   up to date. Conversions that don't use images need to call this
+   first to run the Lua file instead. Returns 1 if the table at the
+   top of the stack has been replaced. */
+int table_image_materialize(struct lua_State *L);
+/* Unmap the image and report the time saved compared to Lua. */
+void table_image_close(struct table_image *img);
+/* Returns 1 if table_image_save() will write an image for the Lua
+   table at the top of the stack. */
+int table_image_wanted(struct lua_State *L);
+/* Write the image for the Lua table at the top of the stack if it
+   was loaded through table_image(). tsc_beg is the time when the
+   conversion started. */
+int table_image_save(struct lua_State *L, enum table_image_type type, uint32_t entry_size, uint32_t param, uint64_t tsc_beg, const void *payload, size_t len);
+
+#endif /* _TABLE_IMAGE_H_ */
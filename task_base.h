@@ -177,6 +177,12 @@ struct task_base_aux {
 
 	struct  rte_mbuf **all_mbufs;
 
+	/* Used if one of the rx rings or rx ports brings mbufs from
+	   another socket: number of mbufs received per input. */
+	uint64_t *rx_xsocket;
+	uint8_t  rx_xsocket_n_inputs;
+	uint8_t  rx_xsocket_hw;
+
 	int      rx_prev_count;
 	int      rx_prev_idx;
 	uint16_t (*rx_pkt_prev[MAX_STACKED_RX_FUCTIONS])(struct task_base *tbase, struct rte_mbuf ***mbufs);
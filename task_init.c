@@ -373,6 +373,17 @@ struct task_base *init_task_struct(struct task_args *targ)
 		}
 	}
 
+	uint8_t n_inputs = targ->nb_rxports? targ->nb_rxports : targ->nb_rxrings;
+	for (uint8_t i = 0; i < n_inputs; ++i) {
+		if (targ->rx_xsocket[i]) {
+			tbase->aux->rx_xsocket = prox_zmalloc(n_inputs * sizeof(*tbase->aux->rx_xsocket), task_socket);
+			PROX_PANIC(tbase->aux->rx_xsocket == NULL, "Failed to allocate cross socket counters\n");
+			tbase->aux->rx_xsocket_n_inputs = n_inputs;
+			tbase->aux->rx_xsocket_hw = targ->nb_rxports != 0;
+			task_base_add_rx_pkt_function(tbase, rx_pkt_xsocket);
+			break;
+		}
+	}
 	if (targ->task_init->flag_features & TASK_FEATURE_RX_ALL) {
 		task_base_add_rx_pkt_function(tbase, rx_pkt_all);
 		tbase->aux->all_mbufs = prox_zmalloc(MAX_RX_PKT_ALL * sizeof(* tbase->aux->all_mbufs), task_socket);
@@ -62,6 +62,7 @@ struct lcore_cfg;
 #define	TASK_ARG_DO_NOT_SET_SRC_MAC 0x200
 #define	TASK_ARG_DO_NOT_SET_DST_MAC 0x400
 #define	TASK_ARG_HW_SRC_MAC 	0x800
+#define	TASK_ARG_MBUF_RECYCLE	0x1000
 
 enum protocols {IPV4, ARP, IPV6};
 
@@ -90,6 +91,8 @@ struct task_init {
 	void (*stop_last)(struct task_base *tbase);
 	int (*thread_x)(struct lcore_cfg* lconf);
 	struct flow_iter flow_iter;
+	/* worst-case number of mbufs buffered inside the task, used to size mempools */
+	uint32_t (*mbufs_held)(struct task_args *targ);
 	size_t size;
 	uint16_t     flag_req_data; /* flags from prox_shared.h */
 	uint64_t     flag_features;
@@ -118,6 +121,7 @@ struct task_args {
 	char		       pool_name[MAX_NAME_SIZE];
 	struct lcore_cfg       *lconf;
 	uint32_t               nb_mbuf;
+	uint32_t               nb_mbuf_inflight; /* worst-case mbufs in flight, see mempool_plan() */
 	uint32_t               mbuf_size;
 	uint8_t    	       mbuf_size_set_explicitely;
 	uint32_t               nb_cache_mbuf;
@@ -130,6 +134,7 @@ struct task_args {
 	struct task_args       *prev_tasks[MAX_RINGS_PER_TASK];
 	uint32_t               n_prev_tasks;
 	uint32_t               ring_size; /* default is RX_RING_SIZE */
+	uint8_t                ring_size_set_explicitely;
 	struct qos_cfg         qos_conf;
 	uint32_t               flags;
 	uint32_t               runtime_flags;
@@ -143,6 +148,7 @@ struct task_args {
 	uint32_t               local_ipv4;
 	struct ipv6_addr       local_ipv6;    /* For IPv6 Tunnel, it's the local tunnel endpoint address */
 	struct rte_ring        *rx_rings[MAX_RINGS_PER_TASK];
+	uint8_t                rx_xsocket[MAX_RINGS_PER_TASK]; /* rx ring or rx port brings mbufs from another socket */
 	struct rte_ring        *tx_rings[MAX_RINGS_PER_TASK];
 	struct rte_ring        *ctrl_plane_ring;
 	uint32_t               tot_n_txrings_inited;
@@ -177,10 +183,16 @@ struct task_args {
 	uint32_t               overhead;
 	enum police_action     police_act[3][3];
 	uint32_t               marking[4];
+	uint32_t               prio_weight[8];        /* aggreg: DRR weight per priority */
+	uint32_t               n_prio_weights;
+	uint32_t               prio_queue_limit[8];   /* aggreg: max buffered packets per priority */
+	uint32_t               n_prio_queue_limits;
 	uint32_t               n_max_rules;
 	uint32_t               random_delay_us;
 	uint32_t               delay_us;
 	uint32_t               cpe_table_timeout_ms;
+	struct core_task_set   learn_core_task_set; /* qinqdecapv4 tasks handled by a cpelearn task */
+	uint32_t               learn_rate;          /* learn events per second accepted per core */
 	uint32_t               etype;
 #ifdef GRE_TP
 	uint32_t tb_rate;                /**< Pipe token bucket rate (measured in bytes per second) */
@@ -188,14 +200,21 @@ struct task_args {
 #endif
 	uint8_t                tunnel_hop_limit;  /* IPv6 Tunnel - Hop limit */
         uint16_t               lookup_port_mask;  /* Ipv6 Tunnel - Mask applied to UDP/TCP port before lookup */
+	uint32_t               n_max_tun_bindings; /* Ipv6 Tunnel - Capacity of the binding table, 0 for twice the configured bindings */
 	uint32_t               ctrl_freq;
 	uint8_t                lb_friend_core;
 	uint8_t                lb_friend_task;
 	/* gen related*/
 	uint64_t               rate_bps;
+	char                   rate_group[64];
 	uint32_t               n_rand_str;
 	char                   rand_str[64][64];
 	uint32_t               rand_offset[64];
+	uint32_t               n_gen_flows;
+	char                   flow_distr[16];
+	float                  flow_zipf_s;
+	char                   flow_weights_file[256];
+	uint32_t               flow_counters;
 	char                   pcap_file[256];
 	uint32_t               accur_pos;
 	uint32_t               sig_pos;
@@ -218,6 +237,9 @@ struct task_args {
 	char                   user_table[256];
 	uint32_t               n_concur_conn;
 	char                   streams[256];
+	uint32_t               large_segments;
+	uint32_t               zero_copy;
+	uint32_t               rss_steering;
 	uint32_t               min_bulk_size;
 	uint32_t               max_bulk_size;
 	uint32_t               max_setup_rate;
@@ -41,6 +41,7 @@
 #include "hash_entry_types.h"
 #include "defines.h"
 #include "hash_utils.h"
+#include "qsbr.h"
 
 struct tsc_task {
 	uint64_t tsc;
@@ -50,6 +51,11 @@ struct tsc_task {
 static uint64_t tsc_drain(struct lcore_cfg *lconf)
 {
 	lconf_flush_all_queues(lconf);
+	/* A migrated task is not serviced by any core until it has been
+	   taken over, don't wait for tsc_term to do so. */
+	if (lconf_is_req(lconf) && lconf->msg.type == LCONF_MSG_MIGRATE_IN &&
+	    lconf_do_flags(lconf))
+		return -2;
 	return DRAIN_TIMEOUT;
 }
 
@@ -75,6 +81,8 @@ static uint64_t tsc_ctrl(struct lcore_cfg *lconf)
 	uint16_t n_msgs;
 
 	for (uint8_t task_id = 0; task_id < n_tasks_all; ++task_id) {
+		if (lconf->task_is_away[task_id])
+			continue;
 		if (lconf->ctrl_rings_m[task_id] && lconf->ctrl_func_m[task_id]) {
 #if RTE_VERSION < RTE_VERSION_NUM(17,5,0,1)
 			n_msgs = rte_ring_sc_dequeue_burst(lconf->ctrl_rings_m[task_id], msgs, MAX_RING_BURST);
@@ -99,6 +107,15 @@ static uint64_t tsc_ctrl(struct lcore_cfg *lconf)
 	return lconf->ctrl_timeout;
 }
 
+static int lconf_has_ctrl(const struct lcore_cfg *lconf)
+{
+	for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+		if (lconf->ctrl_func_m[task_id] || lconf->ctrl_func_p[task_id])
+			return 1;
+	}
+	return 0;
+}
+
 int thread_generic(struct lcore_cfg *lconf)
 {
 	struct task_base *tasks[MAX_TASKS_PER_CORE];
@@ -106,6 +123,7 @@ int thread_generic(struct lcore_cfg *lconf)
 	struct rte_mbuf **mbufs;
 	uint64_t cur_tsc = rte_rdtsc();
 	uint8_t zero_rx[MAX_TASKS_PER_CORE] = {0};
+	uint8_t opt_ring_rx[MAX_TASKS_PER_CORE] = {0};
 	struct tsc_task tsc_tasks[] = {
 		{.tsc = cur_tsc, .tsc_task = tsc_term},
 		{.tsc = cur_tsc + DRAIN_TIMEOUT, .tsc_task = tsc_drain},
@@ -114,23 +132,16 @@ int thread_generic(struct lcore_cfg *lconf)
 		{.tsc = -1},
 	};
 	uint8_t n_tasks_run = lconf->n_tasks_run;
+	int has_ctrl = lconf_has_ctrl(lconf);
 
 	if (lconf->period_func) {
 		tsc_tasks[2].tsc = cur_tsc + lconf->period_timeout;
 		tsc_tasks[2].tsc_task = tsc_period;
 	}
 
-	for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
-		if (lconf->ctrl_func_m[task_id]) {
-			tsc_tasks[3].tsc = cur_tsc + lconf->ctrl_timeout;
-			tsc_tasks[3].tsc_task = tsc_ctrl;
-			break;
-		}
-		if (lconf->ctrl_func_p[task_id]) {
-			tsc_tasks[3].tsc = cur_tsc + lconf->ctrl_timeout;
-			tsc_tasks[3].tsc_task = tsc_ctrl;
-			break;
-		}
+	if (has_ctrl) {
+		tsc_tasks[3].tsc = cur_tsc + lconf->ctrl_timeout;
+		tsc_tasks[3].tsc_task = tsc_ctrl;
 	}
 
 	/* sort tsc tasks */
@@ -145,7 +156,10 @@ int thread_generic(struct lcore_cfg *lconf)
 	}
 	struct tsc_task next_tsc = tsc_tasks[0];
 
+	qsbr_online(lconf->id);
 	for (;;) {
+		/* No table looked up in the previous iteration is used anymore */
+		qsbr_quiescent(lconf->id);
 		cur_tsc = rte_rdtsc();
 		/* Sort scheduled tsc_tasks starting from earliest
 		   first. A linear search is performed moving
@@ -161,14 +175,19 @@ int thread_generic(struct lcore_cfg *lconf)
 
 			if (resched_diff == (uint64_t)-2) {
 				n_tasks_run = lconf->n_tasks_run;
-				if (!n_tasks_run)
+				if (!n_tasks_run) {
+					qsbr_offline(lconf->id);
 					return 0;
+				}
 				for (int i = 0; i < lconf->n_tasks_run; ++i) {
 					tasks[i] = lconf->tasks_run[i];
 
 					uint8_t task_id = lconf_get_task_id(lconf, tasks[i]);
-					if (lconf->targs[task_id].task_init->flag_features & TASK_FEATURE_ZERO_RX)
-						zero_rx[i] = 1;
+					struct task_args *targ = &lconf->targs[task_id];
+
+					/* Indexed as tasks[], not as tasks_all */
+					zero_rx[i] = !!(targ->task_init->flag_features & TASK_FEATURE_ZERO_RX);
+					opt_ring_rx[i] = targ->tx_opt_ring_task != NULL;
 				}
 			}
 
@@ -187,16 +206,32 @@ int thread_generic(struct lcore_cfg *lconf)
 				else
 					tsc_tasks[i - 1] = tsc_tasks[i];
 			}
+
+			/* A task migrated to this core can come with
+			   control rings. The last tsc_task is unused as
+			   long as tsc_ctrl is not scheduled. */
+			if (resched_diff == (uint64_t)-2 && !has_ctrl && lconf_has_ctrl(lconf)) {
+				size_t i = sizeof(tsc_tasks)/sizeof(tsc_tasks[0]) - 1;
+
+				has_ctrl = 1;
+				tsc_tasks[i].tsc = cur_tsc + lconf->ctrl_timeout;
+				tsc_tasks[i].tsc_task = tsc_ctrl;
+				for (; i > 0 && tsc_tasks[i].tsc < tsc_tasks[i - 1].tsc; --i) {
+					struct tsc_task tmp = tsc_tasks[i];
+					tsc_tasks[i] = tsc_tasks[i - 1];
+					tsc_tasks[i - 1] = tmp;
+				}
+				next_tsc = tsc_tasks[0];
+			}
 		}
 
 		uint16_t nb_rx;
 		for (uint8_t task_id = 0; task_id < n_tasks_run; ++task_id) {
 			struct task_base *t = tasks[task_id];
-			struct task_args *targ = &lconf->targs[task_id];
 			// Do not skip a task receiving packets from an optimized ring
 			// as the transmitting task expects such a receiving task to always run and consume
 			// the transmitted packets.
-			if (unlikely(next[task_id] && (targ->tx_opt_ring_task == NULL))) {
+			if (unlikely(next[task_id] && !opt_ring_rx[task_id])) {
 				// plogx_info("task %d is too busy\n", task_id);
 				next[task_id] = 0;
 			} else {
@@ -32,6 +32,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include "toeplitz.h"
 
 /* From XL710 Datasheet, 7.1.10 */
@@ -74,3 +75,17 @@ uint32_t toeplitz_hash(uint8_t *buf_p, int buflen)
 	}
 	return result;
 }
+
+void toeplitz_tbl_init(struct toeplitz_tbl *tbl)
+{
+	uint8_t buf[TOEPLITZ_TBL_LEN];
+
+	memset(buf, 0, sizeof(buf));
+	for (int i = 0; i < TOEPLITZ_TBL_LEN; ++i) {
+		for (int v = 0; v < 256; ++v) {
+			buf[i] = v;
+			tbl->byte[i][v] = toeplitz_hash(buf, i + 1);
+		}
+		buf[i] = 0;
+	}
+}
@@ -33,7 +33,31 @@
 #ifndef _TOEPLITZ_H_
 #define _TOEPLITZ_H_
 
+#include <stdint.h>
+
 #define TOEPLITZ_KEY_LEN	52
+/* Input length of the IPv4 4-tuple hash: src/dst address, src/dst port */
+#define TOEPLITZ_TBL_LEN	12
+
 extern uint8_t toeplitz_init_key[TOEPLITZ_KEY_LEN];
 uint32_t toeplitz_hash(uint8_t *buf_p, int buflen);
+
+/* The hash is linear in its input: the hash of a buffer is the XOR
+   of the hashes of each of its bytes at their position. Per position
+   tables replace the bit loop by one lookup per input byte. */
+struct toeplitz_tbl {
+	uint32_t byte[TOEPLITZ_TBL_LEN][256];
+};
+
+void toeplitz_tbl_init(struct toeplitz_tbl *tbl);
+
+static inline uint32_t toeplitz_tbl_hash(const struct toeplitz_tbl *tbl, const uint8_t *buf_p, int buflen)
+{
+	uint32_t result = 0;
+
+	for (int i = 0; i < buflen; ++i)
+		result ^= tbl->byte[i][buf_p[i]];
+	return result;
+}
+
 #endif
@@ -0,0 +1,122 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <rte_cycles.h>
+
+#include "prox_malloc.h"
+#include "prox_shared.h"
+#include "log.h"
+
+void *prox_zmalloc(size_t size, __attribute__((unused)) int socket)
+{
+	return calloc(1, size);
+}
+
+void prox_free(void *ptr)
+{
+	free(ptr);
+}
+
+static uint64_t nsec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t rte_get_tsc_hz(void)
+{
+	static uint64_t hz;
+
+	if (hz == 0) {
+		uint64_t ns = nsec_now(), tsc = rte_rdtsc();
+
+		usleep(100000);
+		hz = (rte_rdtsc() - tsc) * 1000000000ULL / (nsec_now() - ns);
+	}
+	return hz;
+}
+
+static struct {
+	char name[128];
+	void *data;
+} sh[64];
+static int n_sh;
+
+int prox_sh_add_system(const char *name, void *data)
+{
+	if (n_sh == sizeof(sh)/sizeof(sh[0]))
+		return -1;
+	strncpy(sh[n_sh].name, name, sizeof(sh[n_sh].name) - 1);
+	sh[n_sh++].data = data;
+	return 0;
+}
+
+void *prox_sh_find_system(const char *name)
+{
+	for (int i = 0; i < n_sh; ++i) {
+		if (!strcmp(sh[i].name, name))
+			return sh[i].data;
+	}
+	return NULL;
+}
+
+/* Only errors and warnings are shown */
+static int log_stderr(const char *fmt, va_list ap)
+{
+	return vfprintf(stderr, fmt, ap);
+}
+
+#define LOG_STUB(name, show)					\
+	int name(const char *fmt, ...)				\
+	{							\
+		va_list ap;					\
+		int ret = 0;					\
+								\
+		va_start(ap, fmt);				\
+		if (show)					\
+			ret = log_stderr(fmt, ap);		\
+		va_end(ap);					\
+		return ret;					\
+	}
+
+LOG_STUB(plog_err, 1)
+LOG_STUB(plog_warn, 1)
+LOG_STUB(plog_info, 0)
@@ -0,0 +1,349 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "prox_malloc.h"
+#include "cdf.h"
+
+/* Exact probability of each outcome of the alias table in cdf. */
+static void alias_probs(const struct cdf *cdf, double *p)
+{
+	const uint32_t n = cdf->n_vals;
+
+	memset(p, 0, n * sizeof(p[0]));
+	for (uint32_t j = 0; j < n; ++j) {
+		double keep = cdf->elems[j].prob / 4294967296.0;
+
+		p[j] += keep / n;
+		p[cdf->elems[j].alias] += (1 - keep) / n;
+	}
+}
+
+static struct cdf *cdf_from_weights(const uint32_t *w, uint32_t n)
+{
+	struct cdf *cdf = cdf_create(n, 0);
+
+	for (uint32_t i = 0; i < n; ++i)
+		cdf_add(cdf, w[i]);
+	if (cdf_setup(cdf)) {
+		prox_free(cdf);
+		return NULL;
+	}
+	return cdf;
+}
+
+/* Check the alias table built from w against the expected
+   distribution w[i]/sum(w). */
+static int check_weights(const char *name, const uint32_t *w, uint32_t n)
+{
+	struct cdf *cdf = cdf_from_weights(w, n);
+	double *p = malloc(n * sizeof(p[0]));
+	double total = 0, max_err = 0;
+	int ret = 0;
+
+	if (cdf == NULL) {
+		printf("FAIL %s: cdf_setup failed\n", name);
+		return -1;
+	}
+	for (uint32_t i = 0; i < n; ++i)
+		total += w[i];
+	alias_probs(cdf, p);
+	for (uint32_t i = 0; i < n; ++i) {
+		double err = fabs(p[i] - w[i] / total);
+
+		if (err > max_err)
+			max_err = err;
+	}
+	/* Each slot is exact up to 2^-32 */
+	if (max_err > 2.0 / 4294967296.0)
+		ret = -1;
+
+	/* Sampled frequencies within 5 sigma of the expected ones */
+	if (n <= 64) {
+		const uint32_t n_samples = 1 << 24;
+		uint32_t *count = calloc(n, sizeof(count[0]));
+		uint32_t out[64];
+
+		for (uint32_t s = 0; s < n_samples; s += 64) {
+			cdf_sample_n(cdf, out, 64);
+			for (uint32_t k = 0; k < 64; ++k)
+				count[out[k]]++;
+		}
+		for (uint32_t i = 0; i < n; ++i) {
+			double q = w[i] / total;
+			double sigma = sqrt(n_samples * q * (1 - q));
+
+			if (fabs(count[i] - n_samples * q) > 5 * sigma + 1)
+				ret = -1;
+		}
+		free(count);
+	}
+
+	printf("%s %s: n = %u, max probability error %.3g\n", ret? "FAIL" : "ok  ", name, n, max_err);
+	free(p);
+	prox_free(cdf);
+	return ret;
+}
+
+/* Per value probabilities of cdf_create_zipf(), as used for the gen
+   flow popularity, against 1/(i + 1)^s normalized. */
+static int check_zipf(uint32_t n, double s)
+{
+	struct cdf *cdf = cdf_create_zipf(n, s, 0);
+	double *p = malloc(n * sizeof(p[0]));
+	double h = 0, max_err = 0;
+	int ret = 0;
+
+	if (cdf == NULL) {
+		printf("FAIL zipf s = %.2f, n = %u: setup failed\n", s, n);
+		return -1;
+	}
+	for (uint32_t i = 0; i < n; ++i)
+		h += 1 / pow(i + 1, s);
+	alias_probs(cdf, p);
+	for (uint32_t i = 0; i < n; ++i) {
+		double expected = 1 / pow(i + 1, s) / h;
+		double err = fabs(p[i] - expected) / expected;
+
+		/* Integer weights below 10000 have a rounding error
+		   above 1e-4 */
+		if (UINT32_MAX / pow(i + 1, s) < 10000)
+			break;
+		if (err > max_err)
+			max_err = err;
+	}
+	if (max_err > 1e-3)
+		ret = -1;
+	printf("%s zipf s = %.2f: n = %u, flow 0 probability %.4f (expected %.4f), max relative error %.3g\n",
+	       ret? "FAIL" : "ok  ", s, n, p[0], 1 / h, max_err);
+	free(p);
+	prox_free(cdf);
+	return ret;
+}
+
+static int run_tests(void)
+{
+	const uint32_t n = 1000;
+	uint32_t *w = malloc(n * sizeof(w[0]));
+	struct cdf *cdf;
+	int ret = 0;
+
+	/* Sum of the weights well above 2^32 */
+	for (uint32_t i = 0; i < 16; ++i)
+		w[i] = UINT32_MAX / (i + 1);
+	ret |= check_weights("zipf, max weights", w, 16);
+
+	for (uint32_t i = 0; i < n; ++i)
+		w[i] = UINT32_MAX / pow(i + 1, 0.9);
+	ret |= check_weights("zipf 0.9, max weights", w, n);
+
+	for (uint32_t i = 0; i < n; ++i)
+		w[i] = rand() % 1000;
+	ret |= check_weights("random", w, n);
+
+	ret |= check_zipf(16, 1.0);
+	ret |= check_zipf(1000, 0.8);
+	ret |= check_zipf(1 << 20, 1.0);
+	ret |= check_zipf(1 << 20, 1.2);
+
+	w[0] = 0; w[1] = 1; w[2] = 0; w[3] = 3;
+	ret |= check_weights("zero weights", w, 4);
+
+	w[0] = 7;
+	ret |= check_weights("single", w, 1);
+
+	memset(w, 0, n * sizeof(w[0]));
+	cdf = cdf_from_weights(w, 4);
+	printf("%s zero total rejected\n", cdf? "FAIL" : "ok  ");
+	ret |= cdf? -1 : 0;
+
+	free(w);
+	return ret;
+}
+
+/* The binary tree walk that was used before the alias method,
+   kept as a reference for the benchmark. */
+struct tree_cdf {
+	uint32_t rand_max;
+	uint32_t seed;
+	uint32_t first_child;
+	uint32_t elems[0];
+};
+
+static uint32_t round_pow2(uint32_t val)
+{
+	uint32_t ret = 1;
+
+	while (ret < val)
+		ret <<= 1;
+	return ret;
+}
+
+static uint32_t tree_r_max(struct tree_cdf *cdf, uint32_t cur)
+{
+	uint32_t right_child = cur;
+
+	do {
+		cur = right_child;
+		right_child = cur * 2 + 1;
+	} while (right_child < cdf->elems[0]);
+
+	return cdf->elems[cur];
+}
+
+static struct tree_cdf *tree_cdf_create(const uint32_t *w, uint32_t n)
+{
+	uint32_t first_leaf = round_pow2(n), last_leaf = first_leaf + n;
+	uint32_t end = first_leaf * 2;
+	struct tree_cdf *cdf = calloc(1, sizeof(*cdf) + end * sizeof(cdf->elems[0]));
+	uint32_t total = 0, multiplier, first_parent, last_parent;
+
+	for (uint32_t i = 0; i < n; ++i)
+		total += w[i];
+	multiplier = RAND_MAX / total;
+	if (multiplier * total == RAND_MAX)
+		multiplier--;
+	cdf->rand_max = multiplier * total;
+	cdf->seed = rte_rdtsc();
+	total = 0;
+	for (uint32_t i = first_leaf; i < last_leaf; ++i) {
+		total += w[i - first_leaf] * multiplier - 1;
+		cdf->elems[i] = total;
+		total += 1;
+	}
+	for (uint32_t i = last_leaf; i < end; ++i)
+		cdf->elems[i] = RAND_MAX;
+	cdf->first_child = first_leaf;
+	cdf->elems[0] = end;
+
+	last_leaf = end - 1;
+	do {
+		first_parent = first_leaf / 2;
+		last_parent = last_leaf / 2;
+		for (uint32_t i = first_parent; i <= last_parent; ++i)
+			cdf->elems[i] = tree_r_max(cdf, i * 2);
+		first_leaf = first_parent;
+		last_leaf = last_parent;
+	} while (first_parent != last_parent);
+	return cdf;
+}
+
+static uint32_t tree_cdf_sample(struct tree_cdf *cdf)
+{
+	uint32_t left_child, right_child;
+	uint32_t rand;
+
+	do {
+		rand = rand_r(&cdf->seed);
+	} while (rand > cdf->rand_max);
+
+	uint32_t cur = 1;
+
+	while (1) {
+		left_child = cur * 2;
+		right_child = cur * 2 + 1;
+		if (right_child < cdf->elems[0])
+			cur = rand > cdf->elems[cur]? right_child : left_child;
+		else if (left_child < cdf->elems[0])
+			cur = left_child;
+		else
+			return cur - cdf->first_child;
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run_bench(void)
+{
+	const uint32_t sizes[] = {16, 1024, 1 << 20};
+	const uint32_t n_samples = 1 << 26;
+	volatile uint32_t sink;
+
+	printf("%12s %14s %14s %14s\n", "categories", "tree Msps", "alias Msps", "alias_n Msps");
+	for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+		uint32_t n = sizes[s];
+		uint32_t *w = malloc(n * sizeof(w[0]));
+		uint32_t out[64], acc = 0;
+		double t, t_tree, t_alias, t_alias_n;
+
+		for (uint32_t i = 0; i < n; ++i)
+			w[i] = 1 + rand() % 1000;
+
+		struct tree_cdf *tree = tree_cdf_create(w, n);
+		struct cdf *cdf = cdf_from_weights(w, n);
+
+		t = now();
+		for (uint32_t i = 0; i < n_samples; ++i)
+			acc += tree_cdf_sample(tree);
+		t_tree = now() - t;
+
+		t = now();
+		for (uint32_t i = 0; i < n_samples; ++i)
+			acc += cdf_sample(cdf);
+		t_alias = now() - t;
+
+		t = now();
+		for (uint32_t i = 0; i < n_samples; i += 64) {
+			cdf_sample_n(cdf, out, 64);
+			acc += out[0] + out[63];
+		}
+		t_alias_n = now() - t;
+		sink = acc;
+		(void)sink;
+
+		printf("%12u %14.1f %14.1f %14.1f\n", n, n_samples / t_tree / 1e6,
+		       n_samples / t_alias / 1e6, n_samples / t_alias_n / 1e6);
+		free(tree);
+		prox_free(cdf);
+		free(w);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "-b")) {
+		run_bench();
+		return 0;
+	}
+	return run_tests()? 1 : 0;
+}
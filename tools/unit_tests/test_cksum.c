@@ -0,0 +1,349 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_cycles.h>
+
+/* prox_cksum.c is included to reach its static helpers. The offload
+   flags are the only part of prox_port_cfg.h it uses. */
+#define _PROX_PORT_CFG_H
+#define IPV4_CKSUM 1
+#define UDP_CKSUM  2
+#include "prox_cksum.c"
+
+#define MAX_L4_LEN 1480
+#define N_ITER     200000
+
+/* The checksum loop as it was before raw_cksum_sum, used as the
+   reference: 16 bit words with the carry folded after each add. */
+static uint16_t ref_checksum_byte_seq(const uint16_t *buf, uint32_t len)
+{
+	uint32_t csum = 0;
+
+	while (len > 1) {
+		csum += *buf;
+		while (csum >> 16) {
+			csum &= 0xffff;
+			csum +=1;
+		}
+		buf++;
+		len -= 2;
+	}
+
+	if (len) {
+		csum += *(const uint8_t*)buf;
+		while (csum >> 16) {
+			csum &= 0xffff;
+			csum +=1;
+		}
+	}
+	return ~csum;
+}
+
+/* Reference UDP/TCP checksum over the pseudo header followed by the
+   L4 header and payload, with the checksum field taken as zero. */
+static uint16_t ref_l4_cksum(const struct ipv4_hdr *ip)
+{
+	static uint8_t buf[12 + 65536];
+	uint16_t l4_len = rte_be_to_cpu_16(ip->total_length) - sizeof(*ip);
+	uint16_t be_len = rte_cpu_to_be_16(l4_len);
+	uint16_t csum;
+
+	memcpy(buf, &ip->src_addr, 4);
+	memcpy(buf + 4, &ip->dst_addr, 4);
+	buf[8] = 0;
+	buf[9] = ip->next_proto_id;
+	memcpy(buf + 10, &be_len, 2);
+	memcpy(buf + 12, ip + 1, l4_len);
+	if (ip->next_proto_id == IPPROTO_UDP) {
+		memset(buf + 12 + offsetof(struct udp_hdr, dgram_cksum), 0, 2);
+		csum = ref_checksum_byte_seq((uint16_t *)buf, 12 + l4_len);
+		return csum ? csum : 0xFFFF;
+	}
+	memset(buf + 12 + offsetof(struct tcp_hdr, cksum), 0, 2);
+	return ref_checksum_byte_seq((uint16_t *)buf, 12 + l4_len);
+}
+
+static uint16_t ref_ip_cksum(const struct ipv4_hdr *ip)
+{
+	struct ipv4_hdr tmp = *ip;
+
+	tmp.hdr_checksum = 0;
+	return ref_checksum_byte_seq((uint16_t *)&tmp, sizeof(tmp));
+}
+
+static uint16_t *l4_cksum_field(struct ipv4_hdr *ip)
+{
+	if (ip->next_proto_id == IPPROTO_UDP)
+		return &((struct udp_hdr *)(ip + 1))->dgram_cksum;
+	return &((struct tcp_hdr *)(ip + 1))->cksum;
+}
+
+static uint16_t *l4_src_port(struct ipv4_hdr *ip)
+{
+	return (uint16_t *)(ip + 1);
+}
+
+static uint32_t rand32(void)
+{
+	return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+static void fill_random(uint8_t *buf, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; ++i)
+		buf[i] = rand();
+}
+
+/* Random IPv4 UDP or TCP packet at a random alignment in buf, without
+   valid checksums. */
+static struct ipv4_hdr *random_pkt(uint8_t *buf, int proto)
+{
+	struct ipv4_hdr *ip = (struct ipv4_hdr *)(buf + rand() % 64);
+	uint16_t min_len = proto == IPPROTO_UDP ? sizeof(struct udp_hdr) : sizeof(struct tcp_hdr);
+	uint16_t l4_len = min_len + rand() % (MAX_L4_LEN - min_len + 1);
+
+	fill_random((uint8_t *)ip, sizeof(*ip) + l4_len);
+	ip->version_ihl = 0x45;
+	ip->fragment_offset = 0;
+	ip->next_proto_id = proto;
+	ip->time_to_live = 1 + rand() % 255;
+	ip->total_length = rte_cpu_to_be_16(sizeof(*ip) + l4_len);
+	return ip;
+}
+
+static int check_sum(void)
+{
+	static uint8_t buf[65536 + 64];
+	uint32_t n_err = 0, n = 0;
+
+	/* all short lengths at all alignments, then random lengths */
+	for (uint32_t len = 0; len < 128; ++len) {
+		for (uint32_t off = 0; off < 32; ++off, ++n) {
+			fill_random(buf + off, len);
+			n_err += checksum_byte_seq((uint16_t *)(buf + off), len) !=
+				ref_checksum_byte_seq((uint16_t *)(buf + off), len);
+		}
+	}
+	for (uint32_t i = 0; i < N_ITER / 10; ++i, ++n) {
+		uint32_t off = rand() % 64, len = rand() % 9000;
+
+		fill_random(buf + off, len);
+		n_err += checksum_byte_seq((uint16_t *)(buf + off), len) !=
+			ref_checksum_byte_seq((uint16_t *)(buf + off), len);
+	}
+	/* largest carries: all ones up to the maximum length */
+	memset(buf, 0xFF, sizeof(buf));
+	for (uint32_t len = 65500; len <= 65535; ++len, ++n)
+		n_err += checksum_byte_seq((uint16_t *)(buf + 1), len) !=
+			ref_checksum_byte_seq((uint16_t *)(buf + 1), len);
+
+	printf("%s checksum_byte_seq against 16 bit loop: %u buffers, %u errors\n", n_err? "FAIL" : "ok  ", n, n_err);
+	return n_err? -1 : 0;
+}
+
+static int check_full(int proto)
+{
+	static uint8_t buf[2048];
+	struct rte_mbuf mbuf;
+	uint32_t n_err = 0, n_zero = 0;
+
+	for (uint32_t i = 0; i < N_ITER; ++i) {
+		struct ipv4_hdr *ip = random_pkt(buf, proto);
+		uint16_t *cksum = l4_cksum_field(ip);
+		uint16_t ref;
+
+		/* Make the UDP sum all ones every 16 packets by adjusting
+		   the source port, so that zero must be sent as 0xFFFF. */
+		if (proto == IPPROTO_UDP && i % 16 == 0) {
+			uint16_t c = ref_l4_cksum(ip);
+			uint16_t *port = l4_src_port(ip);
+
+			*port = ~prox_cksum_update16(~*port, 0, c);
+			n_zero++;
+		}
+		ref = ref_l4_cksum(ip);
+		memset(&mbuf, 0, sizeof(mbuf));
+		prox_ip_udp_cksum(&mbuf, ip, 14, sizeof(*ip), 0);
+		n_err += ip->hdr_checksum != ref_ip_cksum(ip) || *cksum != ref;
+	}
+	printf("%s %s full checksum: %u packets (%u with zero sum), %u errors\n", n_err? "FAIL" : "ok  ",
+	       proto == IPPROTO_UDP ? "udp" : "tcp", N_ITER, n_zero, n_err);
+	return n_err? -1 : 0;
+}
+
+/* Rewrite addresses, ports and TTL of packets with valid checksums
+   and compare the incrementally updated checksums against a full
+   recalculation. */
+static int check_update(int proto)
+{
+	static uint8_t buf[2048];
+	uint32_t n_err = 0;
+
+	for (uint32_t i = 0; i < N_ITER; ++i) {
+		struct ipv4_hdr *ip = random_pkt(buf, proto);
+		uint16_t *cksum = l4_cksum_field(ip);
+		uint16_t *port = l4_src_port(ip);
+		uint32_t *addr = rand() & 1 ? &ip->src_addr : &ip->dst_addr;
+		uint32_t old_addr = *addr, new_addr = rand32();
+		uint16_t old_port = *port, new_port = rand() & 1 ? old_port : rand();
+		int frag = rand() % 8 == 0, no_udp_cksum = proto == IPPROTO_UDP && rand() % 8 == 0;
+		uint16_t ref_l4;
+
+		if (frag)
+			ip->fragment_offset = rte_cpu_to_be_16(1 + rand() % IPV4_HDR_OFFSET_MASK);
+		ip->hdr_checksum = ref_ip_cksum(ip);
+		*cksum = no_udp_cksum ? 0 : ref_l4_cksum(ip);
+		ref_l4 = *cksum;
+
+		*addr = new_addr;
+		*port = new_port;
+		prox_ip_udp_cksum_update(ip, old_addr, new_addr, old_port, new_port);
+		/* Fragments and packets without UDP checksum keep theirs */
+		if (!frag && !no_udp_cksum)
+			ref_l4 = ref_l4_cksum(ip);
+		n_err += ip->hdr_checksum != ref_ip_cksum(ip) || *cksum != ref_l4;
+
+		ip->time_to_live--;
+		ip->hdr_checksum = prox_ip_cksum_ttl_dec(ip->hdr_checksum);
+		n_err += ip->hdr_checksum != ref_ip_cksum(ip);
+	}
+	printf("%s %s incremental update: %u rewrites, %u errors\n", n_err? "FAIL" : "ok  ",
+	       proto == IPPROTO_UDP ? "udp" : "tcp", N_ITER, n_err);
+	return n_err? -1 : 0;
+}
+
+static int run_tests(void)
+{
+	int ret = 0;
+
+	srand(1);
+#ifdef __AVX2__
+	printf("raw_cksum_sum: avx2\n");
+#else
+	printf("raw_cksum_sum: 32 bit\n");
+#endif
+	ret |= check_sum();
+	ret |= check_full(IPPROTO_UDP);
+	ret |= check_full(IPPROTO_TCP);
+	ret |= check_update(IPPROTO_UDP);
+	ret |= check_update(IPPROTO_TCP);
+	return ret;
+}
+
+static void run_bench(void)
+{
+	const uint16_t sizes[] = {64, 256, 512, 1500, 9000};
+	const uint32_t n_pkts = 1 << 20;
+	static uint8_t buf[9000 + 64];
+	volatile uint16_t sink;
+	uint16_t acc = 0;
+	uint64_t t;
+
+#ifdef __AVX2__
+	printf("raw_cksum_sum: avx2\n");
+#else
+	printf("raw_cksum_sum: 32 bit\n");
+#endif
+	printf("%8s %16s %16s\n", "bytes", "16 bit cycles", "new cycles");
+	fill_random(buf, sizeof(buf));
+	for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+		uint16_t len = sizes[s];
+		double c_ref, c_new;
+
+		t = rte_rdtsc();
+		for (uint32_t i = 0; i < n_pkts; ++i) {
+			buf[i & 63] = i;
+			acc += ref_checksum_byte_seq((uint16_t *)buf, len);
+		}
+		c_ref = (double)(rte_rdtsc() - t) / n_pkts;
+
+		t = rte_rdtsc();
+		for (uint32_t i = 0; i < n_pkts; ++i) {
+			buf[i & 63] = i;
+			acc += checksum_byte_seq((uint16_t *)buf, len);
+		}
+		c_new = (double)(rte_rdtsc() - t) / n_pkts;
+		printf("%8u %16.1f %16.1f\n", len, c_ref, c_new);
+	}
+
+	/* NAT rewrite of the source address and port of a UDP packet:
+	   full recalculation against the incremental update */
+	printf("%8s %16s %16s\n", "nat", "full cycles", "update cycles");
+	for (size_t s = 0; s < 4; ++s) {
+		struct ipv4_hdr *ip = (struct ipv4_hdr *)buf;
+		struct rte_mbuf mbuf;
+		double c_full, c_update;
+
+		ip->version_ihl = 0x45;
+		ip->fragment_offset = 0;
+		ip->next_proto_id = IPPROTO_UDP;
+		ip->total_length = rte_cpu_to_be_16(sizes[s]);
+		prox_ip_udp_cksum(&mbuf, ip, 14, sizeof(*ip), 0);
+
+		t = rte_rdtsc();
+		for (uint32_t i = 0; i < n_pkts; ++i) {
+			ip->src_addr = i;
+			*l4_src_port(ip) = i;
+			prox_ip_udp_cksum(&mbuf, ip, 14, sizeof(*ip), 0);
+			acc += *l4_cksum_field(ip);
+		}
+		c_full = (double)(rte_rdtsc() - t) / n_pkts;
+
+		t = rte_rdtsc();
+		for (uint32_t i = 0; i < n_pkts; ++i) {
+			uint32_t old_addr = ip->src_addr;
+			uint16_t old_port = *l4_src_port(ip);
+
+			ip->src_addr = i;
+			*l4_src_port(ip) = i;
+			prox_ip_udp_cksum_update(ip, old_addr, i, old_port, i);
+			acc += *l4_cksum_field(ip);
+		}
+		c_update = (double)(rte_rdtsc() - t) / n_pkts;
+		printf("%8u %16.1f %16.1f\n", sizes[s], c_full, c_update);
+	}
+	sink = acc;
+	(void)sink;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "-b")) {
+		run_bench();
+		return 0;
+	}
+	return run_tests()? 1 : 0;
+}
@@ -0,0 +1,191 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <rte_ether.h>
+
+#include "rate_group.h"
+
+/* Each thread behaves like a gen task in a rate group: it takes a
+   batch from the group when its cached bytes run low, and sends as
+   many maximum sized packets as the cached bytes allow. */
+#define PKT_WIRE_SIZE (ETHER_MAX_LEN + 20)
+#define BATCH (64 * PKT_WIRE_SIZE)
+
+struct member {
+	pthread_t thread;
+	struct rate_group *rg;
+	volatile uint64_t sent;
+	volatile int *quit;
+} __rte_cache_aligned;
+
+static void *member_main(void *arg)
+{
+	struct member *m = arg;
+	uint64_t cached = 0;
+
+	while (!*m->quit) {
+		if (cached < BATCH)
+			cached += rate_group_take(m->rg, rte_rdtsc(), BATCH);
+		if (cached >= PKT_WIRE_SIZE) {
+			uint64_t n = cached / PKT_WIRE_SIZE * PKT_WIRE_SIZE;
+
+			cached -= n;
+			m->sent += n;
+		} else {
+			rte_pause();
+		}
+	}
+	return NULL;
+}
+
+static uint64_t total_sent(struct member *m, uint32_t n)
+{
+	uint64_t ret = 0;
+
+	for (uint32_t i = 0; i < n; ++i)
+		ret += m[i].sent;
+	return ret;
+}
+
+/* Aggregate rate of n members sharing bps, measured over duration
+   seconds after the members are running. Returns the relative
+   error. */
+static double measure(const char *name, uint64_t bps, uint32_t n, double duration)
+{
+	struct member *m = aligned_alloc(64, n * sizeof(m[0]));
+	volatile int quit = 0;
+	uint64_t tsc0, tsc1, sent0, sent1;
+	const uint64_t hz = rte_get_tsc_hz();
+	struct rate_group *rg = NULL;
+	double rate;
+
+	memset(m, 0, n * sizeof(m[0]));
+	for (uint32_t i = 0; i < n; ++i) {
+		/* Each member brings its share of the rate */
+		rg = rate_group_join(name, bps / n + (i < bps % n), BATCH, 0);
+		m[i].rg = rg;
+		m[i].quit = &quit;
+	}
+	/* Disable the catch-up limit. On a shared test host, all
+	   members can be descheduled at the same time, which PROX
+	   avoids by dedicating cores to tasks. */
+	rg->cfg.bytes_max = UINT64_MAX;
+	for (uint32_t i = 0; i < n; ++i) {
+		rate_group_start(rg);
+		pthread_create(&m[i].thread, NULL, member_main, &m[i]);
+	}
+
+	usleep(200000);
+	tsc0 = rte_rdtsc();
+	sent0 = total_sent(m, n);
+	usleep(duration * 1000000);
+	tsc1 = rte_rdtsc();
+	sent1 = total_sent(m, n);
+
+	quit = 1;
+	for (uint32_t i = 0; i < n; ++i) {
+		pthread_join(m[i].thread, NULL);
+		rate_group_stop(rg);
+	}
+	free(m);
+
+	rate = (sent1 - sent0) / ((double)(tsc1 - tsc0) / hz);
+	return rate / bps - 1;
+}
+
+/* rate_group_allowed() against a floating point reference, at rates
+   where bpp * period does not fit in 64 bits. */
+static int check_allowed(void)
+{
+	const uint64_t rates[] = {1250000, 1250000000, 7500000000, 12500000000, 50000000000};
+	const uint64_t hz = rte_get_tsc_hz();
+	int ret = 0;
+
+	for (size_t i = 0; i < sizeof(rates)/sizeof(rates[0]); ++i) {
+		struct rate_group rg;
+		double max_err = 0;
+
+		memset(&rg, 0, sizeof(rg));
+		rg.cfg = token_time_cfg_create(rates[i], hz, -1);
+		for (uint64_t dt = 1; dt < 4 * hz; dt = dt * 3 + 7) {
+			double expected = (double)rates[i] * dt / hz;
+			double err = rate_group_allowed(&rg, dt) - expected;
+
+			if (err < 0)
+				err = -err;
+			if (err > max_err)
+				max_err = err;
+		}
+		if (max_err > 2)
+			ret = -1;
+		printf("%s allowed bytes at %"PRIu64" Bps: max error %.1f bytes\n",
+		       max_err > 2? "FAIL" : "ok  ", rates[i], max_err);
+	}
+	return ret;
+}
+
+static int run_tests(double duration)
+{
+	const uint64_t rates[] = {1250000000, 12500000000};
+	const uint32_t members[] = {4, 8, 16};
+	int ret = check_allowed();
+
+	for (size_t r = 0; r < sizeof(rates)/sizeof(rates[0]); ++r) {
+		for (size_t i = 0; i < sizeof(members)/sizeof(members[0]); ++i) {
+			char name[32];
+			double err;
+
+			snprintf(name, sizeof(name), "test_%zu_%zu", r, i);
+			err = measure(name, rates[r], members[i], duration);
+			printf("%s %2u members at %"PRIu64" Bps: aggregate rate error %+.4f%%\n",
+			       err < -0.001 || err > 0.001? "FAIL" : "ok  ",
+			       members[i], rates[r], err * 100);
+			if (err < -0.001 || err > 0.001)
+				ret = -1;
+		}
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	/* The benchmark measures over a longer period */
+	if (argc > 1 && !strcmp(argv[1], "-b"))
+		return run_tests(10)? 1 : 0;
+	return run_tests(2)? 1 : 0;
+}